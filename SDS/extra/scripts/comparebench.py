@@ -0,0 +1,60 @@
+'''Compares two runs of sdsbench (see extra/sds-benchmarks), e.g.
+
+    python comparebench.py old.json new.json
+
+prints the ratio new/old of the median time of each benchmark run by both, and
+flags those that got slower by more than the threshold (default 10%). Exits with
+status 1 if any did, so it can be used to catch regressions.'''
+
+import json
+import sys
+
+def load(filename):
+    "the results of a run, keyed by (name, fixture)"
+    f = open(filename)
+    run = json.load(f)
+    f.close()
+    results = {}
+    for r in run['results']:
+        results[(r['name'], r['fixture'])] = r
+    return results
+
+def compare(old, new, threshold):
+    "prints the ratios, and returns the number of regressions"
+    regressions = 0
+    print('%-46s %-12s %12s %12s %8s' % ('benchmark', 'fixture', 'old (ms)', 'new (ms)', 'ratio'))
+    for key in sorted(new.keys()):
+        if key not in old:
+            continue
+        o = old[key]['median_s']
+        n = new[key]['median_s']
+        # the macro benchmarks may stop early, if the simulation goes unstable
+        if 's_per_step' in old[key] and 's_per_step' in new[key]:
+            o = old[key]['s_per_step']
+            n = new[key]['s_per_step']
+        ratio = n / o if o > 0 else float('inf')
+        flag = ''
+        if ratio > 1 + threshold:
+            flag = '  SLOWER'
+            regressions += 1
+        elif ratio < 1 - threshold:
+            flag = '  faster'
+        print('%-46s %-12s %12.4f %12.4f %8.3f%s' % (key[0], key[1], o * 1e3, n * 1e3, ratio, flag))
+
+    for key in sorted(set(old.keys()) - set(new.keys())):
+        print('%-46s %-12s only in the old run' % key)
+    for key in sorted(set(new.keys()) - set(old.keys())):
+        print('%-46s %-12s only in the new run' % key)
+    return regressions
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print('usage: comparebench.py old.json new.json [threshold]')
+        sys.exit(2)
+    threshold = 0.1
+    if len(sys.argv) > 3:
+        threshold = float(sys.argv[3])
+    regressions = compare(load(sys.argv[1]), load(sys.argv[2]), threshold)
+    if regressions:
+        print('%d benchmarks got slower by more than %d%%' % (regressions, threshold * 100))
+        sys.exit(1)
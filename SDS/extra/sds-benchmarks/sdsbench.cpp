@@ -0,0 +1,550 @@
+/*
+ * Benchmarks of the SDS core, for comparing one build (or machine) with another.
+ *
+ * The micro benchmarks time the force and integration passes of Physics, collision
+ * detection, mesh lookups, sanity checks and serialisation, morphogen diffusion and
+ * cell division, on procedural lattices (see MeshTester::cube) of about 1k, 10k, 100k
+ * and 1M tetras. The macro benchmarks grow a small lattice with LimbBudModel and
+ * PlantModel for a fixed number of steps.
+ *
+ * Everything is generated deterministically, so two runs time exactly the same work.
+ * Each benchmark is run once to warm up, then timed --repeats times, and the results
+ * are written as JSON (see extra/scripts/comparebench.py to compare two runs).
+ *
+ * Run with "scons benchmark", or e.g. "sdsbench --sizes 1k,10k --filter physics".
+ */
+
+#include "organismtools.h"
+#include "organism.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "physics.h"
+#include "collision.h"
+#include "processmodel.h"
+#include "transform.h"
+#include "sdssimulation.h"
+#include "oworld.h"
+#include "profile.h"
+#include "cell.h"
+#include "vertex.h"
+#include "edge.h"
+#include "tetra.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+#include <boost/program_options.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace po = boost::program_options;
+
+// wall clock timer
+class WallTimer
+{
+	public:
+	WallTimer(){restart();}
+	void restart(){mStart = boost::posix_time::microsec_clock::universal_time();}
+	double elapsed() const {return (boost::posix_time::microsec_clock::universal_time() - mStart).total_microseconds()*1e-6;}
+
+	protected:
+	boost::posix_time::ptime mStart;
+};
+
+// exposes the force of a single edge and tetra
+class BenchPhysics: public Physics
+{
+	public:
+	using Physics::FD;
+	using Physics::FV;
+};
+
+const int NUM_MORPHOGENS = 3;
+// cells divided in each timed run of the division benchmark
+const int DIVISIONS = 20;
+// the size of the lattice grown in the macro benchmarks
+const int MACRO_LATTICE = 3;
+// substeps allowed per step of a macro benchmark, before it is given up
+const int MACRO_MAX_SUBSTEPS = 100;
+
+// keeps the compiler from optimising away the results of lookups
+volatile unsigned long sink = 0;
+
+/// a lattice of cells, and the state of the benchmarks run on it
+struct Fixture
+{
+	std::string name;
+	int n; // the lattice has n*n*n cubes, of 5 tetras each
+	Organism* organism;
+	Mesh* mesh;
+
+	Collision* collision; // of the lattice with a copy of itself
+	Mesh* other;
+	std::string serialised; // the mesh, as written by bWriteFull
+	Organism* divided; // a copy of the organism, and the cells of it to divide
+	std::vector<Cell*> toDivide;
+
+	Fixture(const std::string& name_, int n_);
+	~Fixture();
+};
+
+Fixture::Fixture(const std::string& name_, int n_)
+:name(name_),n(n_),collision(NULL),other(NULL),divided(NULL)
+{
+	mesh = MeshTester::cube(n,n,n,1);
+	organism = OrganismTools::fromMesh(mesh);
+
+	ProcessModel* pm = new ProcessModel(NUM_MORPHOGENS);
+	for(int i=0;i<NUM_MORPHOGENS;i++)
+	{
+		pm->setMorphogenDiffusion(i,0.5+i);
+		pm->setMorphogenDecay(i,0.01*i);
+	}
+	organism->setProcessModel(pm);
+
+	unsigned int i = 0;
+	BOOST_FOREACH(Cell* c, organism->cells())
+	{
+		for(int m=0;m<NUM_MORPHOGENS;m++)
+			c->getCellContents()->setMorphogen(m,((i*7919 + m*104729)%1000)*0.0002);
+		i++;
+	}
+}
+
+Fixture::~Fixture()
+{
+	delete collision;
+	delete other;
+	delete divided;
+	delete organism;
+}
+
+/// the number of cubes on a side of a lattice of about t tetras
+int latticeSize(double t)
+{
+	return std::max(1,(int)floor(pow(t/5,1/3.0) + 0.5));
+}
+
+/// the timings of a benchmark
+struct Result
+{
+	std::string name;
+	std::string fixture;
+	unsigned int tetras; // in the fixture
+	unsigned int elements; // worked on in each run
+	std::vector<double> times; // seconds, of each run
+	std::string extra; // more JSON members, after a comma (or empty)
+
+	double min() const {return *std::min_element(times.begin(),times.end());}
+	double mean() const
+	{
+		double s = 0;
+		BOOST_FOREACH(double t, times) s += t;
+		return s/times.size();
+	}
+	double median() const
+	{
+		std::vector<double> t = times;
+		std::sort(t.begin(),t.end());
+		return (t.size()%2) ? t[t.size()/2] : (t[t.size()/2-1] + t[t.size()/2])/2;
+	}
+};
+
+class Benchmarks
+{
+	public:
+	Benchmarks(int repeats, const std::string& filter):mRepeats(repeats),mFilter(filter){}
+
+	bool selected(const std::string& name) const {return name.find(mFilter)!=std::string::npos;}
+
+	/// time f(fx) (which works on elements elements), after setup(fx) (untimed) if given
+	void run(const std::string& name, Fixture& fx, void (*f)(Fixture&), unsigned int elements, void (*setup)(Fixture&) = NULL)
+	{
+		if (not selected(name)) return;
+
+		Result r;
+		r.name = name;
+		r.fixture = fx.name;
+		r.tetras = fx.mesh->tetras().size();
+		r.elements = elements;
+
+		if (setup) setup(fx);
+		f(fx);
+		for(int i=0;i<mRepeats;i++)
+		{
+			if (setup) setup(fx);
+			WallTimer timer;
+			f(fx);
+			r.times.push_back(timer.elapsed());
+		}
+		add(r);
+	}
+
+	void add(const Result& r)
+	{
+		mResults.push_back(r);
+		std::cout << std::left << std::setw(46) << r.name << std::setw(12) << r.fixture << std::right
+			<< std::setw(9) << r.tetras << " tetras  median " << std::setw(11) << r.median()*1e3 << "ms";
+		if (r.elements > 0)
+			std::cout << "  " << std::setw(9) << r.median()/r.elements*1e9 << "ns per element";
+		std::cout << std::endl;
+	}
+
+	void writeJSON(std::ostream& os, const std::string& sizes) const
+	{
+		os << std::setprecision(9);
+		os << "{\n";
+		os << "  \"suite\": \"sdsbench\",\n";
+		os << "  \"date\": \"" << boost::posix_time::to_iso_extended_string(boost::posix_time::second_clock::universal_time()) << "\",\n";
+		os << "  \"compiler\": \"" << __VERSION__ << "\",\n";
+		os << "  \"threads\": " << Physics::NUM_THREADS << ",\n";
+		os << "  \"repeats\": " << mRepeats << ",\n";
+		os << "  \"sizes\": \"" << sizes << "\",\n";
+		os << "  \"results\": [";
+		for(unsigned int i=0;i<mResults.size();i++)
+		{
+			const Result& r = mResults[i];
+			os << (i ? ",\n" : "\n");
+			os << "    {\"name\": \"" << r.name << "\", \"fixture\": \"" << r.fixture << "\", \"tetras\": " << r.tetras
+				<< ", \"elements\": " << r.elements
+				<< ", \"min_s\": " << r.min() << ", \"median_s\": " << r.median() << ", \"mean_s\": " << r.mean();
+			if (r.elements > 0)
+				os << ", \"ns_per_element\": " << r.median()/r.elements*1e9;
+			os << ", \"times_s\": [";
+			for(unsigned int j=0;j<r.times.size();j++)
+				os << (j ? ", " : "") << r.times[j];
+			os << "]";
+			if (not r.extra.empty()) os << ", " << r.extra;
+			os << "}";
+		}
+		os << "\n  ]\n}\n";
+	}
+
+	int repeats() const {return mRepeats;}
+
+	private:
+	int mRepeats;
+	std::string mFilter;
+	std::vector<Result> mResults;
+};
+
+// the micro benchmarks
+
+void benchGetEdge(Fixture& fx)
+{
+	BOOST_FOREACH(Edge* e, fx.mesh->edges())
+		sink += (fx.mesh->getEdge(e->v(0),e->v(1))==e);
+}
+
+void benchIsSane(Fixture& fx)
+{
+	bool sane = fx.mesh->isSane();
+	assert(sane);
+	sink += sane;
+}
+
+void benchFD(Fixture& fx)
+{
+	BOOST_FOREACH(Edge* e, fx.mesh->edges())
+		BenchPhysics::FD(e);
+}
+
+void benchFV(Fixture& fx)
+{
+	BOOST_FOREACH(Tetra* t, fx.mesh->tetras())
+		BenchPhysics::FV(t);
+}
+
+void benchCalculateForces(Fixture& fx)
+{
+	Physics::calculateForces(fx.mesh);
+}
+
+void benchTakeVerletStep(Fixture& fx)
+{
+	// (a small step, so the lattice stays much the same for the following benchmarks)
+	Physics::takeVerletStep(fx.mesh,1e-5);
+}
+
+void benchCollision(Fixture& fx)
+{
+	fx.collision->estimateCollisionDepthAndDirection();
+	sink += fx.collision->penetrationInfo().size();
+}
+
+void benchDiffusion(Fixture& fx)
+{
+	fx.organism->processModel()->simulateMorphogenDiffusion(fx.organism,0.001);
+}
+
+void benchWrite(Fixture& fx)
+{
+	std::ostringstream oss(std::ios::binary);
+	fx.mesh->bWriteFull(oss);
+	fx.serialised = oss.str();
+}
+
+void benchRead(Fixture& fx)
+{
+	std::istringstream iss(fx.serialised,std::ios::binary);
+	Mesh m;
+	m.bReadFull(iss);
+	sink += m.tetras().size();
+}
+
+// divides a fresh copy of the lattice each time, as dividing a cell over and over
+// without relaxing the mesh soon leaves nothing sensible to divide
+void setupDivide(Fixture& fx)
+{
+	delete fx.divided;
+	fx.divided = fx.organism->copy(NULL);
+
+	// internal cells, spread through the lattice
+	std::vector<Cell*> cells;
+	BOOST_FOREACH(Cell* c, fx.divided->cells())
+		if (not c->isBoundary()) cells.push_back(c);
+	fx.toDivide.clear();
+	if (cells.size() < (unsigned int)DIVISIONS) return;
+	for(int i=0;i<DIVISIONS;i++)
+		fx.toDivide.push_back(cells[(i*cells.size())/DIVISIONS]);
+}
+
+void benchDivide(Fixture& fx)
+{
+	for(unsigned int i=0;i<fx.toDivide.size();i++)
+	{
+		Vector3d dir((i%3) - 0.69, ((i/3)%3) - 0.83, 0.5);
+		Transform::Divide(fx.toDivide[i],dir.normalise(),fx.divided);
+		if (Transform::state==Transform::TRANSFORM_ERROR)
+			Transform::reset();
+	}
+}
+
+void runMicro(Benchmarks& b, Fixture& fx)
+{
+	Mesh* m = fx.mesh;
+	const unsigned int V = m->vertices().size(), E = m->edges().size(), T = m->tetras().size();
+
+	b.run("mesh/getEdge",fx,benchGetEdge,E);
+	b.run("mesh/isSane",fx,benchIsSane,V+E+T+m->faces().size());
+	b.run("physics/FD",fx,benchFD,E);
+	b.run("physics/FV",fx,benchFV,T);
+	b.run("physics/calculateForces",fx,benchCalculateForces,E+T);
+	b.run("physics/takeVerletStep",fx,benchTakeVerletStep,V);
+
+	if (b.selected("collision/estimateCollisionDepthAndDirection"))
+	{
+		// a copy of the lattice, overlapping a quarter of it
+		fx.other = MeshTester::cube(fx.n,fx.n,fx.n,1);
+		fx.other->move(Vector3d(0.75*fx.n + 0.31,0.27,0.19));
+		fx.collision = new Collision();
+		fx.collision->addMesh(m);
+		fx.collision->addMesh(fx.other);
+		fx.collision->setWorldBounds(AABB(-1000,-1000,-1000,1000,1000,1000));
+		b.run("collision/estimateCollisionDepthAndDirection",fx,benchCollision,2*T);
+	}
+
+	b.run("processmodel/simulateMorphogenDiffusion",fx,benchDiffusion,V*NUM_MORPHOGENS);
+	b.run("mesh/bWriteFull",fx,benchWrite,V+E+T);
+	if (fx.serialised.empty()) benchWrite(fx);
+	b.run("mesh/bReadFull",fx,benchRead,V+E+T);
+
+	b.run("transform/Divide",fx,benchDivide,DIVISIONS,setupDivide);
+}
+
+// the macro benchmarks
+
+/// grow a lattice with a process model for steps steps (or until it goes unstable)
+void runMacro(Benchmarks& b, const std::string& model, int steps)
+{
+	std::string name = "macro/" + model;
+	if (not b.selected(name)) return;
+
+	std::ostringstream fixture;
+	fixture << "lattice" << MACRO_LATTICE*MACRO_LATTICE*MACRO_LATTICE*5;
+
+	Result r;
+	r.name = name;
+	r.fixture = fixture.str();
+	r.elements = 0;
+
+	for(int rep=0;rep<=b.repeats();rep++)
+	{
+		// (as in SDSSimulator/data/orblimb.cfg)
+		Physics::kD = 17;
+		Physics::kV = 17;
+		Physics::kDamp = 0.05;
+		Physics::GRAVITY = 0;
+
+		Organism* o = OrganismTools::fromMesh(MeshTester::cube(MACRO_LATTICE,MACRO_LATTICE,MACRO_LATTICE,1));
+		ProcessModel* pm = ProcessModel::create(model);
+		o->setProcessModel(pm);
+		r.tetras = o->mesh()->tetras().size();
+
+		// set each parameter, as loading a config would (some models only apply them then)
+		BOOST_FOREACH(std::string p, pm->parameters())
+			pm->set(p,pm->get(p));
+		if (model=="LimbBudModel")
+		{
+			// grow as in orblimb.cfg, but only divide a cell once it is half as big again
+			// as the first cell (the cells of the lattice aren't all the same size)
+			pm->set("rE",1.5);
+			pm->set("rM",1.5);
+			pm->set("drdtE",0.2);
+			pm->set("drdtM",0.2);
+		}
+
+		// the cells on top are the source of the morphogen which drives the growth
+		double top = -1e10;
+		BOOST_FOREACH(Cell* c, o->cells()) top = std::max(top,c->x().y());
+		BOOST_FOREACH(Cell* c, o->cells())
+		{
+			if (c->x().y() < top - 1e-6) continue;
+			CellContents* cc = c->getCellContents();
+			if (model=="LimbBudModel")
+			{
+				cc->setType(3);
+				cc->setMorphogen(0,1);
+			}
+			else
+			{
+				cc->setMorphogen(0,c->vol());
+				cc->setMorphogen(2,c->vol());
+			}
+		}
+		pm->setup();
+
+		OWorld* w = new OWorld();
+		w->addOrganism(o);
+		w->setBounds(AABB(-100,-100,-100,100,100,100));
+
+		SDSSimulation s;
+		s.setStepSize(0.01);
+		s.setWorld(w);
+		// (only the last run is profiled, to break down the time of the phases)
+		bool profile = rep==b.repeats();
+		s.profile().setEnabled(profile);
+
+		double phases[Profile::NUM_PHASES] = {0};
+		int substeps = 0;
+		WallTimer timer;
+		while (s.steps() < steps and s.state()!=SDSSimulation::UNSTABLE and substeps < steps*MACRO_MAX_SUBSTEPS)
+		{
+			s.substep();
+			substeps++;
+			if (profile and s.profile().size() > 0)
+				for(int p=0;p<Profile::NUM_PHASES;p++)
+					phases[p] += s.profile().time(s.profile().size()-1,Profile::Phase(p));
+		}
+		double elapsed = timer.elapsed();
+		if (rep>0) r.times.push_back(elapsed);
+
+		if (profile)
+		{
+			std::ostringstream extra;
+			extra << std::setprecision(9);
+			extra << "\"steps\": " << s.steps() << ", \"s_per_step\": " << elapsed/std::max(1,s.steps()) << ", \"substeps\": " << substeps
+				<< ", \"cells\": " << o->cells().size() << ", \"final_tetras\": " << o->mesh()->tetras().size()
+				<< ", \"state\": \"" << ((s.state()==SDSSimulation::UNSTABLE) ? "unstable" : "stable") << "\"";
+			#ifndef SDS_NO_PROFILE
+			extra << ", \"phases_s\": {";
+			for(int p=0;p<Profile::NUM_PHASES;p++)
+				extra << (p ? ", " : "") << "\"" << Profile::phaseName(Profile::Phase(p)) << "\": " << phases[p];
+			extra << "}";
+			#endif
+			r.extra = extra.str();
+		}
+
+		s.cleanup();
+	}
+
+	b.add(r);
+}
+
+int main(int argc, char** argv)
+{
+	std::string output, sizes, filter;
+	int repeats, steps, threads;
+
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("output,o", po::value<std::string>(&output)->default_value("benchmarks.json"), "file the results are written to (JSON)")
+		("sizes", po::value<std::string>(&sizes)->default_value("1k,10k,100k"), "the sizes of the lattices, in tetras (e.g. 1k,10k,100k,1M)")
+		("filter", po::value<std::string>(&filter)->default_value(""), "only run the benchmarks whose names contain this")
+		("repeats", po::value<int>(&repeats)->default_value(5), "timed runs of each benchmark")
+		("steps", po::value<int>(&steps)->default_value(200), "steps of the macro benchmarks")
+		("threads", po::value<int>(&threads)->default_value(1), "number of threads used to compute forces and collisions (0 = all cores)")
+	;
+
+	try
+	{
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << "\n";
+			return 1;
+		}
+	}
+	catch(...)
+	{
+		std::cout << "** Error parsing command line. **\n" << desc;
+		return 1;
+	}
+
+	if (repeats < 1)
+	{
+		std::cout << "** At least one repeat is needed. **\n";
+		return 1;
+	}
+
+	Physics::NUM_THREADS = threads;
+	Collision::NUM_THREADS = threads;
+	Physics::kD = 10;
+	Physics::kV = 10;
+	Physics::kDamp = 0.05;
+	Physics::GRAVITY = 1;
+
+	Benchmarks b(repeats,filter);
+
+	std::istringstream sizeList(sizes);
+	std::string size;
+	while (std::getline(sizeList,size,','))
+	{
+		double t = atof(size.c_str());
+		char unit = size.empty() ? ' ' : size[size.size()-1];
+		if (unit=='k' or unit=='K') t *= 1e3;
+		if (unit=='m' or unit=='M') t *= 1e6;
+		if (t < 5)
+		{
+			std::cout << "** Unknown size: " << size << " **\n";
+			return 1;
+		}
+
+		Fixture fx("lattice" + size,latticeSize(t));
+		runMicro(b,fx);
+	}
+
+	runMacro(b,"LimbBudModel",steps);
+	runMacro(b,"PlantModel",steps);
+
+	std::ofstream out(output.c_str());
+	if (!out)
+	{
+		std::cerr << "Cannot open \"" << output << "\" for output!\n";
+		return 1;
+	}
+	b.writeJSON(out,sizes);
+	std::cout << "Wrote " << output << std::endl;
+	return 0;
+}
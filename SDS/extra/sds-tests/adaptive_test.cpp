@@ -0,0 +1,177 @@
+/*
+ * Checks SDSSimulation's adaptive stepping (see StepController).
+ *
+ * Lets a shaken lattice of cells settle, with fixed steps and with adaptive ones starting at
+ * the same size, and checks that the adaptive steps grow as it quietens down (so that it takes
+ * far fewer of them) and that it ends up in nearly the same place. Then drops a lattice of stiff
+ * cells on the floor starting with a step too large for it, which makes fixed stepping unstable,
+ * and checks that the adaptive steps are rolled back and shrunk instead, and that each rolled
+ * back step leaves the vertices exactly where they were.
+ */
+
+#include "organismtools.h"
+#include "organism.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "physics.h"
+#include "processmodel.h"
+#include "sdssimulation.h"
+#include "simulationcontext.h"
+#include "oworld.h"
+#include "vertex.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int LATTICE = 4;
+const int SEED = 3;
+
+// the settling lattice
+const double SOFT_K = 10;
+const double SPEED = 0.5;
+const double SETTLE_DT = 0.001;
+const double SETTLE_T = 10;
+// the adaptive run must take at least this many times fewer steps
+const double MIN_SPEEDUP = 5;
+// and end up this close (relative to the size of the lattice, Physics::VISCOSITY damps
+// each step, so that fewer steps damp a little less)
+const double MAX_DISTANCE = 0.05;
+
+// the dropped lattice (see implicit_test, where 0.0064 is the largest stable step)
+const double STIFF_K = 2000;
+const double GRAVITY = 10;
+const double FLOOR = -2;
+const double DROP_DT = 0.0256;
+const double DROP_T = 2;
+
+struct Run
+{
+	bool stable;
+	int steps;
+	int substeps;
+	int rejected;
+	// a rejected step that moved the vertices
+	bool moved;
+	double largestStep;
+	std::vector<Vector3d> x;
+	double size;
+};
+
+Run simulate(bool adaptive, double dt, double t, double k, double gravity, double speed)
+{
+	SimulationContext context;
+	SimulationContext::Scope scope(context);
+
+	Physics::kD = k;
+	Physics::kV = k;
+	Physics::kDamp = 0.05;
+	Physics::GRAVITY = gravity;
+
+	// (in the context, as the tetras take its kV)
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(LATTICE,LATTICE,LATTICE,1));
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	srand(SEED);
+	BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+	{
+		Vector3d kick(rand()/(double)RAND_MAX - .5,rand()/(double)RAND_MAX - .5,rand()/(double)RAND_MAX - .5);
+		v->mOldX = v->mX - kick*(2*speed*dt);
+	}
+
+	OWorld* w = new OWorld();
+	w->addOrganism(o);
+	w->setBounds(AABB(-100,FLOOR,-100,100,100,100));
+
+	SDSSimulation s(&context);
+	s.setStepSize(dt);
+	s.setAdaptiveStepping(adaptive);
+	s.setWorld(w);
+	assert(s.currentStepSize()==dt);
+
+	Run r;
+	r.rejected = 0;
+	r.moved = false;
+	r.largestStep = 0;
+	const int maxSubsteps = 20*(int)(t/dt + 1);
+	int substeps = 0;
+	std::vector<Vector3d> before;
+	while (s.t() < t - dt/2 and s.state()!=SDSSimulation::UNSTABLE and substeps < maxSubsteps)
+	{
+		before.clear();
+		BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+			before.push_back(v->x());
+		double time = s.t();
+
+		s.substep();
+		substeps++;
+		r.largestStep = std::max(r.largestStep,s.currentStepSize());
+
+		if (not s.lastStepProperties.properties("step rejected").empty())
+		{
+			r.rejected++;
+			int i = 0;
+			BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+				r.moved = r.moved or v->x()!=before[i++];
+			r.moved = r.moved or s.t()!=time;
+		}
+	}
+
+	AABB box = o->mesh()->aabb();
+	r.size = std::max(box[3]-box[0],std::max(box[4]-box[1],box[5]-box[2]));
+	// (stable means it didn't blow up, nor grind to a halt, nor fly apart)
+	r.stable = s.state()!=SDSSimulation::UNSTABLE and substeps < maxSubsteps and r.size < 2*LATTICE and o->mesh()->isSane();
+	r.steps = s.steps();
+	r.substeps = substeps;
+	BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+		r.x.push_back(v->x());
+
+	s.cleanup();
+	return r;
+}
+
+void report(const char* what, const Run& r)
+{
+	std::cout << what << ": " << r.steps << " steps, " << r.rejected << " rejected, largest " << r.largestStep
+		<< (r.stable ? "" : ", unstable") << "\n";
+}
+
+int main()
+{
+	// a settling lattice
+	{
+		Run fixed = simulate(false,SETTLE_DT,SETTLE_T,SOFT_K,0,SPEED);
+		Run adaptive = simulate(true,SETTLE_DT,SETTLE_T,SOFT_K,0,SPEED);
+		report("settling, fixed",fixed);
+		report("settling, adaptive",adaptive);
+		assert(fixed.stable and adaptive.stable);
+		assert(fixed.rejected==0 and fixed.largestStep==SETTLE_DT);
+		assert(adaptive.steps*MIN_SPEEDUP <= fixed.steps);
+		assert(not adaptive.moved);
+
+		double d = 0;
+		for(unsigned int i=0;i<fixed.x.size();i++)
+			d = std::max(d,(fixed.x[i] - adaptive.x[i]).length());
+		std::cout << "the lattices end up " << d/fixed.size << " apart (of their size)\n";
+		assert(d < MAX_DISTANCE*fixed.size);
+	}
+
+	// a stiff lattice dropped with too large a step
+	{
+		Run fixed = simulate(false,DROP_DT,DROP_T,STIFF_K,GRAVITY,0);
+		Run adaptive = simulate(true,DROP_DT,DROP_T,STIFF_K,GRAVITY,0);
+		report("dropped, fixed",fixed);
+		report("dropped, adaptive",adaptive);
+		assert(not fixed.stable);
+		assert(adaptive.stable);
+		assert(adaptive.rejected > 0);
+		assert(not adaptive.moved);
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
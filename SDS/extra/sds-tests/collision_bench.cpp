@@ -0,0 +1,293 @@
+/*
+ * Times the broad phase of Collision (building the vertex hash table, and
+ * querying it with the bounding boxes of the tetras) separately from the whole
+ * estimateCollisionDepthAndDirection(), on growing sets of interpenetrating cubes.
+ *
+ * Checks that the broad phase finds exactly the vertex/tetra intersections that
+ * a brute force search finds, that the hash tables are reused between steps, and
+ * that the multithreaded point-tetra test gives exactly the serial result.
+ *
+ * Then times collisions against a large static mesh (which is looked up in trees),
+ * and checks the result against adding the same mesh as a moving mesh with all its
+ * vertices frozen (which goes through the spatial hash, as static meshes used to).
+ */
+
+#include "collision.h"
+#include "meshtester.h"
+#include "vertex.h"
+#include "tetra.h"
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <utility>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+// how many steps to time
+const int REPS = 5;
+
+typedef std::set<std::pair<const Vertex*,const Tetra*> > Intersections;
+
+bool inside(const Vertex* v, Tetra* t)
+{
+	if (t->isVertex(v) or not t->aabb().contains(v->x())) return false;
+	Vector3d b = t->bary(v->x());
+	return b.x() >= 0 and b.y() >= 0 and b.z() >= 0 and (b.x()+b.y()+b.z()) <= 1;
+}
+
+// exposes the broad phase of Collision
+class BroadPhase: public Collision
+{
+	public:
+	void build(){hashVertices();}
+
+	/// query the vertex table with every tetra, returns the number of candidates
+	unsigned int query(Intersections* found = NULL)
+	{
+		unsigned int candidates = 0;
+		BOOST_FOREACH(Mesh* m, mAllMeshes)
+			BOOST_FOREACH(Tetra* t, m->tetras())
+			{
+				const AABB& aabb = t->updateAABB();
+				int min[3], max[3];
+				toGridCoords(aabb.cpts(),min);
+				toGridCoords(aabb.cpts()+3,max);
+
+				for(int ix=min[0];ix<=max[0];++ix)
+				for(int iy=min[1];iy<=max[1];++iy)
+				for(int iz=min[2];iz<=max[2];++iz)
+				{
+					unsigned int h = hash(ix,iy,iz,mVertexTable.size);
+					for(unsigned int i=mVertexTable.start[h];i<mVertexTable.start[h+1];++i)
+					{
+						const Vertex* v = mVertexTable.items[i];
+						candidates++;
+						if (found and inside(v,t))
+							found->insert(std::make_pair(v,t));
+					}
+				}
+			}
+		return candidates;
+	}
+
+	unsigned int tableSize() const {return mVertexTable.size;}
+	const Vertex* const* tableData() const {return &mVertexTable.items[0];}
+	double cellSize() const {return mCellSize;}
+};
+
+// k*k overlapping copies of the cube array test mesh (jittered off the grid)
+std::vector<Mesh*> makeMeshes(int k, Vector3d offset = Vector3d::ZERO, int seed = 42)
+{
+	srand(seed);
+	std::vector<Mesh*> meshes;
+	for(int i=0;i<k;i++)
+		for(int j=0;j<k;j++)
+		{
+			Mesh* m = MeshTester::CreateCubeColTest3();
+			BOOST_FOREACH(Vertex* v, m->vertices())
+				v->addX(offset + Vector3d(i*5.3 + (rand()%1000)*1e-5, j*0.7 + (rand()%1000)*1e-5, j*5.1 + (rand()%1000)*1e-5));
+			meshes.push_back(m);
+		}
+	return meshes;
+}
+
+void jiggle(const std::vector<Mesh*>& meshes)
+{
+	BOOST_FOREACH(Mesh* m, meshes)
+		BOOST_FOREACH(Vertex* v, m->vertices())
+			v->addX(Vector3d(rand()%100-50,rand()%100-50,rand()%100-50)*1e-3);
+}
+
+void check(BroadPhase& bp, const std::vector<Mesh*>& meshes)
+{
+	Intersections found, expected;
+	bp.build();
+	bp.query(&found);
+
+	BOOST_FOREACH(Mesh* mt, meshes)
+		BOOST_FOREACH(Tetra* t, mt->tetras())
+			BOOST_FOREACH(Mesh* mv, meshes)
+				BOOST_FOREACH(const Vertex* v, mv->vertices())
+					if (inside(v,t)) expected.insert(std::make_pair(v,t));
+
+	assert(not expected.empty());
+	assert(found==expected);
+	std::cout << "broad phase found all " << found.size() << " vertex/tetra intersections\n";
+}
+
+bool same(const std::vector<Collision::PInfo>& a, const std::vector<Collision::PInfo>& b)
+{
+	if (a.size()!=b.size()) return false;
+	for(unsigned int i=0;i<a.size();i++)
+		if (a[i].v!=b[i].v or a[i].f!=b[i].f or a[i].depth!=b[i].depth or a[i].direction!=b[i].direction)
+			return false;
+	return true;
+}
+
+// time estimateCollisionDepthAndDirection with more threads, and check the result doesn't change
+void benchThreads(BroadPhase& bp)
+{
+	Collision::NUM_THREADS = 1;
+	bp.estimateCollisionDepthAndDirection();
+	std::vector<Collision::PInfo> serial = bp.penetrationInfo();
+
+	const int threadCounts[] = {2, 4, 8};
+	for(int i=0;i<3;i++)
+	{
+		Collision::NUM_THREADS = threadCounts[i];
+		double start = Profile::now();
+		for(int r=0;r<REPS;r++)
+			bp.estimateCollisionDepthAndDirection();
+		double t = Profile::now() - start;
+		assert(same(serial,bp.penetrationInfo()));
+
+		std::cout << std::setw(11) << "" << " threads=" << threadCounts[i]
+			<< "  estimateCollisionDepthAndDirection=" << std::setw(9) << t/REPS << "s\n";
+	}
+	Collision::NUM_THREADS = 1;
+}
+
+void bench(int k)
+{
+	std::vector<Mesh*> meshes = makeMeshes(k);
+	BroadPhase bp;
+	unsigned int numVertices = 0;
+	BOOST_FOREACH(Mesh* m, meshes)
+	{
+		bp.addMesh(m);
+		numVertices += m->vertices().size();
+	}
+	bp.setWorldBounds(AABB(-1000,-1000,-1000,1000,1000,1000));
+
+	if (k==2) check(bp,meshes);
+
+	bp.build();
+	const Vertex* const* data = bp.tableData();
+
+	double tBuild = 0, tQuery = 0, tAll = 0;
+	unsigned int candidates = 0, penetrations = 0;
+	double start;
+	for(int r=0;r<REPS;r++)
+	{
+		jiggle(meshes);
+
+		start = Profile::now();
+		bp.build();
+		tBuild += Profile::now() - start;
+
+		start = Profile::now();
+		candidates = bp.query();
+		tQuery += Profile::now() - start;
+
+		start = Profile::now();
+		bp.estimateCollisionDepthAndDirection();
+		tAll += Profile::now() - start;
+		penetrations = bp.penetrationInfo().size();
+	}
+
+	// the same number of vertices, so the table wasn't reallocated
+	assert(data==bp.tableData());
+
+	std::cout << std::setw(4) << k*k << " meshes"
+		<< " |V|=" << std::setw(6) << numVertices
+		<< " buckets=" << std::setw(6) << bp.tableSize()
+		<< " cell=" << std::setprecision(3) << bp.cellSize()
+		<< " candidates=" << std::setw(8) << candidates
+		<< " penetrations=" << std::setw(5) << penetrations
+		<< std::setprecision(6)
+		<< "  build=" << std::setw(9) << tBuild/REPS << "s"
+		<< "  query=" << std::setw(9) << tQuery/REPS << "s"
+		<< "  estimateCollisionDepthAndDirection=" << std::setw(9) << tAll/REPS << "s\n";
+	benchThreads(bp);
+
+	BOOST_FOREACH(Mesh* m, meshes)
+		delete m;
+}
+
+// penetrations by the position of the vertex (which is the same in both runs)
+typedef std::map<std::pair<double,std::pair<double,double> >,Collision::PInfo> Penetrations;
+
+// moving meshes against k*k static meshes, returns the time per step
+double staticStep(int k, bool frozen, Penetrations& result)
+{
+	std::vector<Mesh*> meshes = makeMeshes(2);
+	std::vector<Mesh*> staticMeshes = makeMeshes(k,Vector3d(2.65,0.35,2.55),7);
+
+	Collision c;
+	BOOST_FOREACH(Mesh* m, meshes)
+		c.addMesh(m);
+	BOOST_FOREACH(Mesh* m, staticMeshes)
+	{
+		if (frozen)
+		{
+			BOOST_FOREACH(Vertex* v, m->vertices())
+				v->setFrozen(true);
+			c.addMesh(m);
+		}
+		else
+			c.addStaticMesh(m);
+	}
+	c.setWorldBounds(AABB(-1000,-1000,-1000,1000,1000,1000));
+
+	// the first step builds the static trees
+	c.estimateCollisionDepthAndDirection();
+	double start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		c.estimateCollisionDepthAndDirection();
+	double t = (Profile::now() - start)/REPS;
+
+	result.clear();
+	BOOST_FOREACH(const Collision::PInfo& p, c.penetrationInfo())
+		result[std::make_pair(p.v->x().x(),std::make_pair(p.v->x().y(),p.v->x().z()))] = p;
+
+	BOOST_FOREACH(Mesh* m, meshes)
+		delete m;
+	BOOST_FOREACH(Mesh* m, staticMeshes)
+		delete m;
+	return t;
+}
+
+void benchStatic(int k)
+{
+	Penetrations treeResult, hashResult;
+	double tTree = staticStep(k,false,treeResult);
+	double tHash = staticStep(k,true,hashResult);
+
+	assert(treeResult.size()==hashResult.size() and not treeResult.empty());
+	std::vector<Collision::PInfo> a, b;
+	typedef Penetrations::value_type Entry;
+	BOOST_FOREACH(const Entry& e, treeResult) a.push_back(e.second);
+	BOOST_FOREACH(const Entry& e, hashResult) b.push_back(e.second);
+	double maxDiff = 0;
+	for(unsigned int i=0;i<a.size();i++)
+		maxDiff = std::max(maxDiff,std::fabs(a[i].depth-b[i].depth) + (a[i].direction-b[i].direction).length());
+	assert(maxDiff < 1e-9);
+
+	std::cout << std::setw(4) << k*k << " static meshes, "
+		<< a.size() << " penetrations, "
+		<< "static (trees)=" << std::setw(9) << tTree << "s  "
+		<< "frozen (hashed)=" << std::setw(9) << tHash << "s  "
+		<< "per step\n";
+}
+
+int main()
+{
+	std::cout << "Collision broad phase benchmark (mean of " << REPS << " steps)\n";
+	for(int k=2;k<=8;k*=2)
+		bench(k);
+
+	for(int k=4;k<=16;k*=2)
+		benchStatic(k);
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
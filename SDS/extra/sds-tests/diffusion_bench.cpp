@@ -0,0 +1,232 @@
+/*
+ * Compares ProcessModel::simulateMorphogenDiffusion (which goes through a
+ * MorphogenDiffusion) against the old loop over each morphogen and cell.
+ *
+ * Checks that both give exactly the same morphogens over several steps while the
+ * cells move, with cells being skipped, and after cells are added (which changes
+ * the topology), then reports the time per step of both on larger organisms.
+ */
+
+#include "organism.h"
+#include "processmodel.h"
+#include "meshtester.h"
+#include "cell.h"
+#include "vertex.h"
+#include "edge.h"
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int NUM_MORPHOGENS = 3;
+// how many steps to time
+const int REPS = 10;
+
+// the old diffusion loop, for comparison
+void referenceDiffusion(ProcessModel* pm, Organism* o, double dt, std::set<Cell*> skip, int morph = -1)
+{
+	for(int i=0;i<pm->numMorphogens();i++)
+	{
+		double D = pm->getMorphogenDiffusion(i);
+		double C = pm->getMorphogenDecay(i);
+
+		BOOST_FOREACH(Cell* c, o->cells())
+		{
+			if ((morph<0 or i==morph) and skip.count(c)>0) continue;
+
+			CellContents* cc = c->getCellContents();
+			double cm = cc->getMorphogen(i);
+			double cvol = c->vol();
+
+			double laplacian = 0;
+			BOOST_FOREACH(Cell* cn, o->getNeighbours(c))
+			{
+				double cnm = cn->getCellContents()->getMorphogen(i);
+				double distance = dist(c->v()->x(),cn->v()->x());
+				laplacian += (1/distance)*(std::min(cnm,cvol) - std::min(cm,cn->vol()));
+			}
+
+			double dcmdt = D*laplacian - C;
+			double newval = std::max(0., std::min(cm + dcmdt * dt, cvol));
+			cc->setMorphogen(i,newval);
+		}
+	}
+}
+
+ProcessModel* makeProcessModel()
+{
+	ProcessModel* pm = new ProcessModel(NUM_MORPHOGENS);
+	for(int i=0;i<NUM_MORPHOGENS;i++)
+	{
+		pm->setMorphogenDiffusion(i,0.5+i);
+		pm->setMorphogenDecay(i,0.01*i);
+	}
+	return pm;
+}
+
+// an n*n*n cube of cells, with random morphogens and types
+Organism* makeOrganism(int n, int seed = 42)
+{
+	srand(seed);
+	Mesh* m = MeshTester::cube(n,n,n,1);
+	BOOST_FOREACH(Edge* e, m->edges())
+	{
+		e->v(0)->addNeighbour(e->v(1));
+		e->v(1)->addNeighbour(e->v(0));
+	}
+
+	Organism* o = new Organism(m);
+	o->setProcessModel(makeProcessModel());
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		Cell* c = new Cell(v,0.4 + (rand()%100)*0.002);
+		o->addCell(c);
+		for(int i=0;i<NUM_MORPHOGENS;i++)
+			c->getCellContents()->setMorphogen(i,(rand()%1000)*0.0002);
+		c->getCellContents()->setType(rand()%4);
+	}
+	return o;
+}
+
+void move(Organism* o, int step)
+{
+	int i = 0;
+	BOOST_FOREACH(Cell* c, o->cells())
+	{
+		c->v()->addX(Vector3d(1e-3*((i+step)%7),-2e-3*(i%3),0));
+		i++;
+	}
+}
+
+// add a cell next to (and connected to) a few existing cells
+void addCell(Organism* o, int step)
+{
+	std::vector<Cell*> cells(o->cells().begin(),o->cells().end());
+	Cell* a = cells[(step*7)%cells.size()];
+	Cell* b = cells[(step*13+1)%cells.size()];
+
+	Vertex* v = new Vertex(a->v()->x() + Vector3d(0.3,0.2,0.1));
+	o->mesh()->addVertex(v);
+	Cell* c = new Cell(v,0.45);
+	o->addCell(c);
+	c->getCellContents()->setMorphogen(0,0.05);
+	o->connectCells(c,a);
+	o->connectCells(c,b);
+}
+
+bool same(Organism* a, Organism* b)
+{
+	assert(a->cells().size()==b->cells().size());
+	std::list<Cell*>::const_iterator ib = b->cells().begin();
+	BOOST_FOREACH(Cell* ca, a->cells())
+	{
+		Cell* cb = *ib++;
+		for(int i=0;i<NUM_MORPHOGENS;i++)
+		{
+			double x = ca->getCellContents()->getMorphogen(i);
+			double y = cb->getCellContents()->getMorphogen(i);
+			if (std::memcmp(&x,&y,sizeof(double))!=0) return false;
+		}
+	}
+	return true;
+}
+
+std::set<Cell*> toSet(Organism* o, const ProcessModel::CellMask& mask)
+{
+	std::set<Cell*> cells;
+	unsigned int i = 0;
+	BOOST_FOREACH(Cell* c, o->cells())
+	{
+		if (i<mask.size() and mask[i]) cells.insert(c);
+		i++;
+	}
+	return cells;
+}
+
+void check()
+{
+	Organism* a = makeOrganism(4);
+	Organism* b = makeOrganism(4);
+	assert(same(a,b));
+
+	const double dt = 0.01;
+	for(int step=0;step<40;step++)
+	{
+		move(a,step);
+		move(b,step);
+		if (step%10==5)
+		{
+			addCell(a,step);
+			addCell(b,step);
+		}
+
+		if (step%3==0)
+		{
+			a->processModel()->simulateMorphogenDiffusion(a,dt);
+			referenceDiffusion(b->processModel(),b,dt,std::set<Cell*>());
+		}
+		else if (step%3==1)
+		{
+			ProcessModel::CellMask skip = ProcessModel::cellsOfType(a,3);
+			assert(std::count(skip.begin(),skip.end(),1)>0);
+			a->processModel()->simulateMorphogenDiffusion(a,dt,skip);
+			referenceDiffusion(b->processModel(),b,dt,toSet(b,skip));
+		}
+		else
+		{
+			ProcessModel::CellMask skip = ProcessModel::cellsOfType(a,1);
+			a->processModel()->simulateMorphogenDiffusion(a,dt,skip,1);
+			referenceDiffusion(b->processModel(),b,dt,toSet(b,skip),1);
+		}
+		assert(same(a,b));
+	}
+	std::cout << "morphogens match the old loop for " << a->cells().size() << " cells\n";
+
+	delete a;
+	delete b;
+}
+
+void bench(int n)
+{
+	Organism* o = makeOrganism(n);
+	ProcessModel::CellMask skip = ProcessModel::cellsOfType(o,3);
+	std::set<Cell*> skipSet = toSet(o,skip);
+
+	double start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		referenceDiffusion(o->processModel(),o,0.01,skipSet);
+	double tOld = (Profile::now() - start)/REPS;
+
+	// the first step builds the laplacian
+	o->processModel()->simulateMorphogenDiffusion(o,0.01,skip);
+	start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		o->processModel()->simulateMorphogenDiffusion(o,0.01,skip);
+	double tNew = (Profile::now() - start)/REPS;
+
+	std::cout << std::setw(6) << o->cells().size() << " cells, " << NUM_MORPHOGENS << " morphogens: "
+		<< "old=" << std::setw(9) << tOld << "s  "
+		<< "csr=" << std::setw(9) << tNew << "s  "
+		<< "speedup=" << std::setprecision(3) << tOld/tNew << std::setprecision(6) << "\n";
+	delete o;
+}
+
+int main()
+{
+	check();
+
+	std::cout << "Morphogen diffusion benchmark (mean of " << REPS << " steps)\n";
+	for(int n=8;n<=32;n*=2)
+		bench(n);
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Runs a handful of simulations with different physical parameters in an Ensemble
+ * (each in its own SimulationContext, sharing one static floor mesh), and checks
+ * that each ends up exactly where the same simulation ends up when it is run on its
+ * own in the global context, as the simulator runs it.
+ *
+ * Then reports the time taken to run them one after the other, and in the ensemble.
+ */
+
+#include "ensemble.h"
+#include "sdssimulation.h"
+#include "simulationcontext.h"
+#include "physics.h"
+#include "transform.h"
+#include "processmodel.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "oworld.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "vertex.h"
+#include "tetra.h"
+#include "cell.h"
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int SIMULATIONS = 8;
+const int STEPS = 300;
+const double DT = 0.01;
+
+// the physical parameters of simulation i
+void setParameters(int i)
+{
+	Physics::kD = 5 + 2*i;
+	Physics::kV = 10 - i;
+	Physics::kDamp = 0.05;
+	Physics::GRAVITY = 1 + 0.5*i;
+}
+
+// a tetra of cells, with a morphogen source at the top
+Organism* makeOrganism()
+{
+	Organism* o = OrganismTools::loadOneTet();
+	o->setProcessModel(ProcessModel::create("LimbBudModel"));
+
+	Cell* top = o->cells().front();
+	BOOST_FOREACH(Cell* c, o->cells())
+		if (c->x().y() > top->x().y()) top = c;
+	top->getCellContents()->setType(3);
+	top->getCellContents()->setMorphogen(0,1);
+	return o;
+}
+
+// a wide tetra under the organism, point down
+// (it is mirrored, which turns its faces outwards, as Collision expects)
+Mesh* makeFloor()
+{
+	Mesh* m = MeshTester::CreateUnitEdgeTetra();
+	BOOST_FOREACH(Vertex* v, m->vertices())
+		v->resetX(Vector3d(20*v->x().x(), -1 - v->x().y(), 20*v->x().z()));
+	return m;
+}
+
+OWorld* makeWorld(Mesh* floor = NULL)
+{
+	OWorld* w = new OWorld();
+	w->addOrganism(makeOrganism());
+	if (floor) w->addStaticMesh(floor);
+	w->setBounds(AABB(Vector3d(-10,-10,-10),Vector3d(10,10,10)));
+	return w;
+}
+
+std::vector<double> positions(SDSSimulation* s)
+{
+	std::vector<double> x;
+	BOOST_FOREACH(Vertex* v, s->world()->organism()->mesh()->vertices())
+		for(int i=0;i<3;i++)
+			x.push_back(v->x()[i]);
+	return x;
+}
+
+// run simulation i on its own (in the current context), returns its final positions
+std::vector<double> runAlone(int i)
+{
+	setParameters(i);
+	SDSSimulation s;
+	s.setStepSize(DT);
+	s.setCollisionInterval(1);
+	s.setWorld(makeWorld(makeFloor()));
+
+	for(int step=0;step<STEPS;step++)
+	{
+		while (not s.substep())
+			;
+		assert(s.state()!=SDSSimulation::UNSTABLE);
+	}
+
+	// it has fallen onto the floor (and not through it)
+	std::vector<double> x = positions(&s);
+	double minY = x[1];
+	for(unsigned int j=1;j<x.size();j+=3)
+		minY = std::min(minY,x[j]);
+	std::cout << "simulation " << i << " came to rest at y = " << minY << std::endl;
+	assert(minY < -0.9 and minY > -1.1);
+	return x;
+}
+
+int main()
+{
+	std::cout << std::setprecision(3);
+
+	// run each simulation on its own in the global context
+	std::vector<std::vector<double> > expected;
+	double start = Profile::now();
+	for(int i=0;i<SIMULATIONS;i++)
+		expected.push_back(runAlone(i));
+	double serial = Profile::now() - start;
+
+	// the parameters of the global context are left as the last simulation set them
+	setParameters(SIMULATIONS-1);
+	const double kD = Physics::kD, gravity = Physics::GRAVITY;
+
+	// now run them all together
+	Ensemble ensemble;
+	ensemble.addStaticMesh(makeFloor());
+	for(int i=0;i<SIMULATIONS;i++)
+	{
+		SDSSimulation* s = ensemble.add();
+		SimulationContext::Scope scope(ensemble.context(i));
+		setParameters(i);
+		s->setStepSize(DT);
+		s->setCollisionInterval(1);
+		s->setWorld(makeWorld());
+	}
+
+	assert(Physics::kD==kD and Physics::GRAVITY==gravity);
+	for(int i=0;i<SIMULATIONS;i++)
+		assert(ensemble.context(i).kD==5 + 2*i);
+
+	start = Profile::now();
+	for(int step=0;step<STEPS;step++)
+	{
+		int running = ensemble.step();
+		assert(running==SIMULATIONS);
+	}
+	double parallel = Profile::now() - start;
+
+	// the simulations didn't change the global context, or each other's
+	assert(Physics::kD==kD and Physics::GRAVITY==gravity);
+	for(int i=0;i<SIMULATIONS;i++)
+	{
+		assert(ensemble.context(i).kD==5 + 2*i);
+		assert(ensemble.simulation(i)->steps()>=STEPS);
+		assert(positions(ensemble.simulation(i))==expected[i]);
+	}
+	std::cout << "all " << SIMULATIONS << " simulations in the ensemble match the simulations run alone\n";
+
+	std::cout << SIMULATIONS << " simulations of " << STEPS << " steps: "
+		<< serial << "s one after the other, "
+		<< parallel << "s in an ensemble of " << ensemble.numThreads() << " threads ("
+		<< serial/parallel << "x)\n";
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+ * Writes a simulation of a lattice moving along x, and plays it back with a FrameCache.
+ * Checks that each frame decoded is the one written (in any order), that the frames kept
+ * fit in the budget while playing forwards and backwards with prefetching, that prefetching
+ * follows the direction of playback, and that the current frame is kept even if it doesn't fit.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+#include <cmath>
+
+#include <boost/foreach.hpp>
+
+#include "framecache.h"
+#include "simulationio.h"
+#include "segmentio.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "meshtester.h"
+#include "vertex.h"
+#include "oworld.h"
+
+const std::string NAME = "framecache";
+const int LATTICE = 3;
+const int NUM_FRAMES = 20;
+const int PREFETCH = 2;
+
+void writeSimulation(Organism* o)
+{
+	SimulationIO_Base::SimulationHeader header;
+	header.dt = 0.01;
+	header.worldBounds = AABB(-100,-100,-100,100,100,100);
+	header.frameDataFileName = NAME + ".bin";
+	header.comments = std::string("Frame Cache Test");
+	header.processModel = o->processModel();
+
+	std::list<SegmentWriter*> segmentWriters;
+	segmentWriters.push_back(new MeshSegmentIO(o->mesh()));
+	segmentWriters.push_back(new OrganismSegmentIO(o));
+	segmentWriters.push_back(new ProcessModelSegmentIO(o));
+	SimulationWriter::writeSimulationHeader(NAME+".cfg", header, segmentWriters);
+	std::remove(SimulationWriter::frameIndexFileName(header.frameDataFileName).c_str());
+
+	// frame i is moved i along x
+	std::ofstream out(header.frameDataFileName.c_str(), std::ios::binary);
+	assert(out);
+	SimulationWriter::writeFrameDataHeader(out);
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		SimulationWriter::writeFrame(out, i, i*0.1, i*10, segmentWriters);
+		BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+			v->resetX(v->x() + Vector3d(1,0,0));
+	}
+}
+
+// the frame an organism was written in
+int frameOf(Organism* o)
+{
+	double minX = 1e10;
+	BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+		minX = std::min(minX,v->x().x());
+	return (int)floor(minX + .5);
+}
+
+// play from frame `from` to `to` one frame at a time, prefetching after each, and check the budget
+void play(FrameCache& cache, int from, int to, unsigned int numberOfVertices)
+{
+	int step = (to > from) ? 1 : -1;
+	for(int f=from;f!=to+step;f+=step)
+	{
+		Organism* o = cache.frame(f);
+		assert(o!=NULL and frameOf(o)==f);
+		assert(o->mesh()->vertices().size()==numberOfVertices);
+		assert(cache.current()==f);
+		assert(cache.bytes() <= cache.budget());
+
+		while (cache.prefetch(PREFETCH))
+			assert(cache.bytes() <= cache.budget());
+		// (the direction is known once the second frame is asked for)
+		if (f!=from and f!=to)
+			assert(cache.isCached(f+step) and cache.direction()==step);
+		// (the current frame is still valid)
+		assert(frameOf(o)==f);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(LATTICE,LATTICE,LATTICE,1));
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	const unsigned int numberOfVertices = o->mesh()->vertices().size();
+	writeSimulation(o);
+
+	FrameCache cache(NAME+".cfg");
+	assert(cache.numberOfFrames()==NUM_FRAMES);
+	for(int i=0;i<NUM_FRAMES;i++)
+		assert(std::fabs(cache.frameTimes()[i] - i*0.1) < 1e-12);
+	assert(cache.numberOfCachedFrames()==0);
+
+	// the frames, in any order
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		int f = (i*7)%NUM_FRAMES;
+		Organism* fo = cache.frame(f);
+		assert(fo!=NULL and frameOf(fo)==f);
+	}
+	assert(cache.numberOfCachedFrames()==NUM_FRAMES);
+	assert(cache.frame(NUM_FRAMES)==NULL and cache.frame(-1)==NULL);
+
+	// a budget of a few frames
+	const unsigned long frameBytes = FrameCache::bytes(cache.frame(0));
+	std::cout << "a frame of " << numberOfVertices << " vertices takes about " << frameBytes << " bytes\n";
+	cache.setBudget(3*frameBytes + frameBytes/2);
+	assert(cache.numberOfCachedFrames()==3);
+	assert(cache.isCached(0));
+
+	play(cache,0,NUM_FRAMES-1,numberOfVertices);
+	play(cache,NUM_FRAMES-2,0,numberOfVertices);
+	play(cache,5,12,numberOfVertices);
+
+	// the current frame is kept even if it doesn't fit, and nothing is prefetched
+	cache.setBudget(1);
+	assert(cache.numberOfCachedFrames()==1 and cache.isCached(12));
+	Organism* fo = cache.frame(3);
+	assert(fo!=NULL and frameOf(fo)==3);
+	assert(cache.numberOfCachedFrames()==1);
+	assert(not cache.prefetch());
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
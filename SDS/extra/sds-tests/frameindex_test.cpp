@@ -0,0 +1,188 @@
+/*
+ * Writes a simulation with a static segment and several frames, and checks that
+ * SimulationLoader::setFrame and countFrames (which use the frame index) agree
+ * with walking the frames with nextFrame, with and without an index file,
+ * with a stale index file, and while the frame data is still growing.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+#include <boost/foreach.hpp>
+
+#include "simulationio.h"
+#include "segmentio.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "meshtools.h"
+#include "oworld.h"
+
+const std::string NAME = "frameindex";
+const int NUM_FRAMES = 5;
+
+std::list<SegmentWriter*> segmentWriters;
+SimulationIO_Base::SimulationHeader header;
+
+void writeSimulation(OWorld* ow)
+{
+	Organism* o = ow->organism();
+
+	header.kD = 10;
+	header.kV = 10;
+	header.kDamp = 0.05;
+	header.gravity = 1;
+	header.dt = 0.01;
+	header.worldBounds = ow->bounds();
+	header.frameDataFileName = NAME + ".bin";
+	header.comments = std::string("Frame Index Test");
+	header.processModel = o->processModel();
+
+	segmentWriters.push_back(new MeshSegmentIO(o->mesh()));
+	segmentWriters.push_back(new OrganismSegmentIO(o));
+	segmentWriters.push_back(new ProcessModelSegmentIO(o));
+
+	std::list<SegmentWriter*> staticSegmentWriters;
+	BOOST_FOREACH(Mesh* m, ow->getStaticMeshes())
+		staticSegmentWriters.push_back(new MeshSegmentIO(m));
+	SimulationWriter::writeSimulationHeader(NAME+".cfg", header, segmentWriters, staticSegmentWriters);
+
+	// no index file, the loader has to build it
+	std::remove(SimulationWriter::frameIndexFileName(header.frameDataFileName).c_str());
+
+	std::ofstream out(header.frameDataFileName.c_str(), std::ios::binary);
+	assert(out);
+	SimulationWriter::writeFrameDataHeader(out);
+	SimulationWriter::writeStaticSegments(out, staticSegmentWriters);
+	for(int i=0;i<NUM_FRAMES;i++)
+		SimulationWriter::writeFrame(out, i, i*0.1, i*10, segmentWriters);
+}
+
+// the frame headers, found by walking the frames from the start
+std::vector<SimulationIO_Base::FrameHeader> walk()
+{
+	std::vector<SimulationIO_Base::FrameHeader> frames;
+	SimulationLoader loader(NAME+".cfg");
+	assert(loader.loadData());
+
+	// sets the first frame
+	Mesh staticMesh;
+	MeshSegmentIO staticMeshLoader(&staticMesh);
+	std::list<SegmentLoader*> staticSegmentLoaders;
+	staticSegmentLoaders.push_back(&staticMeshLoader);
+	if (not loader.loadStaticSegments(staticSegmentLoaders)) return frames;
+
+	frames.push_back(loader.currentFrame());
+	while (loader.nextFrame())
+		frames.push_back(loader.currentFrame());
+	return frames;
+}
+
+bool same(const SimulationIO_Base::FrameHeader& a, const SimulationIO_Base::FrameHeader& b)
+{
+	return a.sizeInBytes==b.sizeInBytes and a.number==b.number and a.time==b.time and a.step==b.step;
+}
+
+// check setFrame against a walk, in a random-ish order, and that the frame contents can be read
+void check(SimulationLoader& loader, int expected)
+{
+	std::vector<SimulationIO_Base::FrameHeader> frames = walk();
+	assert((int)frames.size()==expected);
+	assert(loader.countFrames()==expected);
+
+	for(int i=0;i<expected;i++)
+	{
+		int f = (i*3)%expected;
+		assert(loader.setFrame(f));
+		assert(same(loader.currentFrame(),frames[f]));
+		assert((int)loader.currentFrame().number==f);
+		assert(loader.currentFrame().step==(unsigned int)f*10);
+
+		Mesh* m = new Mesh();
+		MeshSegmentIO ml(m);
+		loader.initialiseSegmentLoader(&ml);
+		loader.loadSegment(&ml);
+		assert(not m->vertices().empty());
+		delete m;
+	}
+
+	assert(not loader.setFrame(expected));
+	assert(not loader.setFrame(-1));
+}
+
+int main(int argc, char** argv)
+{
+	Organism* o = OrganismTools::loadOneTet();
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	OWorld* ow = new OWorld();
+	ow->addOrganism(o);
+	ow->addStaticMesh(OrganismTools::loadOneTet()->mesh());
+	ow->calculateBounds();
+
+	writeSimulation(ow);
+	std::string indexFileName = SimulationWriter::frameIndexFileName(header.frameDataFileName);
+
+	// no index file
+	{
+		SimulationLoader loader(NAME+".cfg");
+		check(loader,NUM_FRAMES);
+	}
+	assert(std::ifstream(indexFileName.c_str()));
+
+	// the index file written by the loader
+	{
+		SimulationLoader loader(NAME+".cfg");
+		check(loader,NUM_FRAMES);
+		std::cout << "index of " << loader.frameIndex().size() << " frames ok\n";
+	}
+
+	// a partially written frame isn't counted, until it is finished
+	{
+		SimulationLoader loader(NAME+".cfg");
+		assert(loader.countFrames()==NUM_FRAMES);
+
+		std::ostringstream oss(std::ios::binary);
+		SimulationWriter::writeFrame(oss, NUM_FRAMES, NUM_FRAMES*0.1, NUM_FRAMES*10, segmentWriters);
+		std::string frame = oss.str();
+
+		std::ofstream out(header.frameDataFileName.c_str(), std::ios::binary | std::ios::app);
+		out << frame.substr(0,frame.size()/2);
+		out.flush();
+		assert(loader.countFrames()==NUM_FRAMES);
+
+		out << frame.substr(frame.size()/2);
+		out.flush();
+		check(loader,NUM_FRAMES+1);
+	}
+
+	// a stale index file (e.g. from an earlier run), with one entry too many and a truncated entry
+	{
+		std::ofstream idx(indexFileName.c_str(), std::ios::binary | std::ios::app);
+		SimulationWriter::FrameHeader fh;
+		fh.time = 42;
+		fh.step = 42;
+		SimulationWriter::writeFrameIndexEntry(idx, 12345, fh);
+		idx.write("xx",2);
+	}
+	{
+		SimulationLoader loader(NAME+".cfg");
+		check(loader,NUM_FRAMES+1);
+	}
+
+	// a bad index file is ignored
+	{
+		std::ofstream idx(indexFileName.c_str(), std::ios::binary);
+		idx << "not an index";
+	}
+	{
+		SimulationLoader loader(NAME+".cfg");
+		check(loader,NUM_FRAMES+1);
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
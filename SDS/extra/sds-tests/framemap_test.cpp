@@ -0,0 +1,324 @@
+/*
+ * Writes a simulation with the "19042010" and "topodelta" mesh segments, with topology changes
+ * part way through, and reads it with a FrameMap. Checks that the frame headers, segment spans,
+ * counts, bounds, positions and topology read from the mapping are those of the frames loaded
+ * by a SimulationLoader, with the whole file mapped and with a small window, and that
+ * Mesh::bReadFull rejects data with ids that are out of range.
+ * Then compares the time to scan the positions of a larger simulation with both.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/foreach.hpp>
+
+#include "framemap.h"
+#include "simulationio.h"
+#include "segmentio.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "meshtester.h"
+#include "oworld.h"
+#include "edge.h"
+#include "face.h"
+#include "tetra.h"
+#include "profile.h"
+
+const int NUM_FRAMES = 20;
+
+// write the simulation name.cfg, calling change(o,i) before frame i
+void writeSimulation(std::string name, Organism* o, std::string version, void (*change)(Organism*,int))
+{
+	MeshSegmentIO* mio = new MeshSegmentIO(o->mesh(),version);
+	mio->keyframeInterval = 6;
+	std::list<SegmentWriter*> segmentWriters;
+	segmentWriters.push_back(mio);
+	segmentWriters.push_back(new OrganismSegmentIO(o));
+
+	SimulationIO_Base::SimulationHeader header;
+	header.frameDataFileName = name + ".bin";
+	header.comments = std::string("Frame Map Test");
+	SimulationWriter::writeSimulationHeader(name+".cfg", header, segmentWriters);
+	std::remove(SimulationWriter::frameIndexFileName(header.frameDataFileName).c_str());
+
+	std::ofstream out(header.frameDataFileName.c_str(), std::ios::binary);
+	assert(out);
+	SimulationWriter::writeFrameDataHeader(out);
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		change(o,i);
+		SimulationWriter::writeFrame(out, i, i*0.1, 2*i, segmentWriters);
+	}
+}
+
+// move the vertices, and change the topology twice
+void change(Organism* o, int frame)
+{
+	Mesh* m = o->mesh();
+	int i = 0;
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		v->addX(Vector3d(0.01*frame,-0.02,0.001*(i%7)));
+		i++;
+	}
+
+	if (frame==7)
+	{
+		Vertex* v = new Vertex(Vector3d(0,20,0));
+		m->addVertex(v);
+		m->addEdge(new Edge(v,m->vertices().front(),1));
+	}
+	else if (frame==12)
+	{
+		Edge* e = m->edges().back();
+		m->removeEdge(e);
+		delete e;
+	}
+}
+
+// move the vertices
+void move(Organism* o, int frame)
+{
+	BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+		v->addX(Vector3d(0.01,0,0));
+}
+
+Mesh* loadMesh(SimulationLoader& loader, int f)
+{
+	assert(loader.setFrame(f));
+	Mesh* m = new Mesh();
+	MeshSegmentIO ml(m);
+	assert(loader.initialiseSegmentLoader(&ml));
+	loader.loadSegment(&ml);
+	return m;
+}
+
+// check the topology read from the mapping against m
+void checkTopology(const MeshTopology& t, Mesh* m)
+{
+	std::map<Vertex*,unsigned int> id;
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		unsigned int i = id.size();
+		id[v] = i;
+	}
+
+	assert(t.surface.size()==m->vertices().size());
+	unsigned int i = 0;
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		assert(t.surface[i]==(v->surface() ? 1 : 0));
+		assert(t.neighbourStart[i+1] - t.neighbourStart[i]==v->neighbours().size());
+		unsigned int n = t.neighbourStart[i];
+		BOOST_FOREACH(Vertex* w, v->neighbours())
+			assert(t.neighbours[n++]==id[w]);
+		i++;
+	}
+
+	assert(t.edges.size()==2*m->edges().size());
+	i = 0;
+	BOOST_FOREACH(Edge* e, m->edges())
+	{
+		assert(t.edges[i++]==id[e->v(0)]);
+		assert(t.edges[i++]==id[e->v(1)]);
+	}
+
+	assert(t.faces.size()==3*m->outerFaces().size());
+	i = 0;
+	BOOST_FOREACH(Face* f, m->outerFaces())
+		for(int j=0;j<3;j++)
+			assert(t.faces[i++]==id[&f->v(j)]);
+
+	std::map<Tetra*,int> tid;
+	BOOST_FOREACH(Tetra* tt, m->tetras())
+	{
+		int k = tid.size();
+		tid[tt] = k;
+	}
+	assert(t.tetras.size()==4*m->tetras().size());
+	i = 0;
+	BOOST_FOREACH(Tetra* tt, m->tetras())
+	{
+		for(int j=0;j<4;j++)
+		{
+			assert(t.tetras[i+j]==id[tt->pv(j)]);
+			assert(t.tetraNeighbours[i+j]==(tt->neighbour(j) ? tid[tt->neighbour(j)] : -1));
+		}
+		i += 4;
+	}
+}
+
+void testFrames(std::string name, unsigned long window)
+{
+	SimulationLoader loader(name + ".cfg");
+	assert(loader.countFrames()==NUM_FRAMES);
+	assert(loader.loadData());
+
+	FrameMap map(name + ".cfg");
+	map.setWindow(window);
+	assert(map.numberOfFrames()==NUM_FRAMES);
+	assert(map.segmentIndex(MeshSegmentIO::type)==0 and map.segmentIndex(OrganismSegmentIO::type)==1);
+	assert(map.segmentIndex("processinfo")==-1);
+
+	bool delta = (map.meshVersion()=="topodelta");
+	MeshTopology topology;
+	for(int i=0;i<2*NUM_FRAMES;i++)
+	{
+		// in order, then jumping around
+		int f = (i<NUM_FRAMES) ? i : ((i*7)%NUM_FRAMES);
+
+		SimulationIO_Base::FrameHeader fh = map.frameHeader(f);
+		assert(loader.setFrame(f));
+		assert(fh.number==loader.currentFrame().number and fh.time==loader.currentFrame().time);
+		assert(fh.step==loader.currentFrame().step and fh.sizeInBytes==loader.currentFrame().sizeInBytes);
+
+		// the segments fill the frame
+		FrameMap::Span frame = map.frame(f);
+		FrameMap::Span mesh = map.segment(f,MeshSegmentIO::type);
+		FrameMap::Span organism = map.segment(f,1);
+		assert(not (frame.empty() or mesh.empty() or organism.empty()));
+		assert(mesh.size + organism.size + 2*sizeof(unsigned long)==frame.size);
+		assert(map.segment(f,2).empty());
+
+		MeshView view;
+		assert(map.mesh(f,view));
+		Mesh* m = loadMesh(loader,f);
+		assert(view.numberOfVertices()==m->vertices().size());
+		assert(view.numberOfEdges()==m->edges().size());
+		assert(view.numberOfTetras()==m->tetras().size());
+		AABB a = view.aabb(), b = m->aabb();
+		for(int j=0;j<6;j++)
+			assert(a[j]==b[j]);
+
+		std::vector<Vector3d> xs;
+		view.positions(xs);
+		unsigned int j = 0;
+		BOOST_FOREACH(Vertex* v, m->vertices())
+		{
+			assert(view.x(j)==v->x());
+			assert(xs[j]==v->x());
+			j++;
+		}
+
+		// (the topology is in the keyframe)
+		assert(view.keyframe()==(view.keyframeDistance()==0));
+		if (not delta)
+			assert(view.keyframe());
+		MeshView key;
+		assert(map.mesh(f - view.keyframeDistance(),key) and key.keyframe());
+		assert(key.numberOfOuterFaces()==m->outerFaces().size());
+		assert(key.topology(topology));
+		assert(view.keyframe()==view.topology(topology));
+		checkTopology(topology,m);
+
+		delete m;
+	}
+	assert(map.frame(NUM_FRAMES).empty() and map.frame(-1).empty());
+}
+
+// overwrite ids in the full form of a mesh with ones that are out of range, the reads must fail
+void testBadIds()
+{
+	Mesh* m = MeshTester::cube(2,2,2,1);
+	std::ostringstream out;
+	m->bWriteFull(out);
+	const std::string data = out.str();
+
+	// (the edges, faces and tetras come last, see MeshView::topology)
+	const unsigned long UINT = sizeof(unsigned int);
+	const unsigned long EDGE_SIZE = 2*UINT + 2*sizeof(double);
+	const unsigned long FACE_SIZE = 3*UINT + sizeof(double);
+	const unsigned long TETRA_SIZE = 4*UINT + 4*sizeof(int) + 2*sizeof(double) + 2*sizeof(bool);
+	const unsigned long tetras = data.size() - m->tetras().size()*TETRA_SIZE;
+	const unsigned long faces = tetras - m->outerFaces().size()*FACE_SIZE;
+	const unsigned long edges = faces - m->edges().size()*EDGE_SIZE;
+
+	const int nv = m->vertices().size(), nt = m->tetras().size();
+	const int BAD = 5;
+	// an edge vertex, a face vertex, a tetra vertex, and tetra neighbours
+	const unsigned long offsets[BAD] = {edges + UINT, faces + 2*UINT, tetras + 3*UINT, tetras + 4*UINT, tetras + TETRA_SIZE + 5*UINT};
+	const int ids[BAD] = {nv, -1, nv + 100, nt, -2};
+	for(int i=0;i<BAD;i++)
+	{
+		std::string bad = data;
+		std::memcpy(&bad[offsets[i]],&ids[i],sizeof(int));
+		std::istringstream in(bad);
+		Mesh r;
+		assert(not r.bReadFull(in));
+		assert(in.fail());
+		assert(r.vertices().empty() and r.edges().empty() and r.tetras().empty() and r.vertexMapRead().empty());
+	}
+
+	std::istringstream in(data);
+	Mesh r;
+	assert(r.bReadFull(in));
+	assert(r.vertices().size()==m->vertices().size() and r.tetras().size()==m->tetras().size());
+	delete m;
+}
+
+// the time to sum the positions of every frame with a SimulationLoader and with a FrameMap
+void bench(int n)
+{
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(n,n,n,1));
+	writeSimulation("framemap_bench", o, "19042010", move);
+	delete o;
+
+	double start = Profile::now();
+	Vector3d sumLoaded = Vector3d::ZERO;
+	SimulationLoader loader("framemap_bench.cfg");
+	loader.loadData();
+	for(int f=0;f<NUM_FRAMES;f++)
+	{
+		Mesh* m = loadMesh(loader,f);
+		BOOST_FOREACH(Vertex* v, m->vertices())
+			sumLoaded += v->x();
+		delete m;
+	}
+	double tLoaded = Profile::now() - start;
+
+	start = Profile::now();
+	Vector3d sumMapped = Vector3d::ZERO;
+	FrameMap map("framemap_bench.cfg");
+	MeshView view;
+	for(int f=0;f<NUM_FRAMES;f++)
+	{
+		assert(map.mesh(f,view));
+		for(unsigned int i=0;i<view.numberOfVertices();i++)
+			sumMapped += view.x(i);
+	}
+	double tMapped = Profile::now() - start;
+
+	assert(sumLoaded==sumMapped);
+	std::cout << "cube(" << n << "," << n << "," << n << "), " << NUM_FRAMES << " frames: "
+		<< "positions loaded in " << tLoaded << "s, mapped in " << tMapped << "s\n";
+}
+
+int main(int argc, char** argv)
+{
+	const std::string versions[] = {"19042010", "topodelta"};
+	for(int i=0;i<2;i++)
+	{
+		std::string name = "framemap_" + versions[i];
+		Organism* o = OrganismTools::fromMesh(MeshTester::cube(2,2,2,1));
+		writeSimulation(name, o, versions[i], change);
+		delete o;
+
+		std::cout << "reading \"" << versions[i] << "\"\n";
+		testFrames(name, 0);
+		// (smaller than a frame)
+		testFrames(name, 64);
+	}
+
+	testBadIds();
+	bench(16);
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Writes the same simulation with SimulationWriter::writeFrame and with FrameWriters (writing
+ * from the calling thread, and from snapshots on a background thread with queues of different
+ * sizes), with "topodelta" and "19042010" mesh segments, and checks that the frame data is
+ * exactly the same, and that the frame index written is the one
+ * a SimulationLoader builds from the frame data.
+ * Then compares the time a simulation spends writing frames with each.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+#include <boost/foreach.hpp>
+
+#include "framewriter.h"
+#include "simulationio.h"
+#include "segmentio.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "meshtester.h"
+#include "oworld.h"
+#include "edge.h"
+#include "profile.h"
+
+const int NUM_FRAMES = 30;
+
+// move things around a bit, and change the topology once
+void change(Organism* o, int frame)
+{
+	int i = 0;
+	BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+	{
+		v->addX(Vector3d(0.01,-0.02,0.001*((i+frame)%5)));
+		v->addF(Vector3d(0,-1,0));
+		i++;
+	}
+	if (frame==11)
+	{
+		Vertex* v = new Vertex(Vector3d(0,20,0));
+		o->mesh()->addVertex(v);
+		o->mesh()->addEdge(new Edge(v,o->mesh()->vertices().front(),1));
+	}
+}
+
+std::list<SegmentWriter*> segmentWriters(Organism* o, std::string version = "topodelta")
+{
+	std::list<SegmentWriter*> sws;
+	MeshSegmentIO* mio = new MeshSegmentIO(o->mesh(),version);
+	mio->keyframeInterval = 8;
+	sws.push_back(mio);
+	sws.push_back(new OrganismSegmentIO(o));
+	sws.push_back(new ProcessModelSegmentIO(o));
+	return sws;
+}
+
+Organism* organism(int n)
+{
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(n,n,n,1));
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	return o;
+}
+
+std::string contents(std::string file)
+{
+	std::ifstream in(file.c_str(), std::ios::binary);
+	std::ostringstream oss;
+	oss << in.rdbuf();
+	return oss.str();
+}
+
+void writeHeader(std::string name, Organism* o, std::list<SegmentWriter*> sws)
+{
+	SimulationIO_Base::SimulationHeader header;
+	header.dt = 0.01;
+	header.worldBounds = AABB(-100,-100,-100,100,100,100);
+	header.processModel = o->processModel();
+	header.frameDataFileName = name + ".bin";
+	header.comments = std::string("Frame Writer Test");
+	SimulationWriter::writeSimulationHeader(name+".cfg", header, sws);
+}
+
+// write with SimulationWriter::writeFrame (without an index)
+void writeReference(std::string name, std::string version)
+{
+	Organism* o = organism(2);
+	std::list<SegmentWriter*> sws = segmentWriters(o,version);
+	writeHeader(name,o,sws);
+	std::remove(SimulationWriter::frameIndexFileName(name + ".bin").c_str());
+
+	std::ofstream out((name + ".bin").c_str(), std::ios::binary);
+	SimulationWriter::writeFrameDataHeader(out);
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		change(o,i);
+		SimulationWriter::writeFrame(out, i, i*0.1, 3*i, sws);
+	}
+}
+
+void write(std::string name, std::string version, unsigned int queueSize)
+{
+	Organism* o = organism(2);
+	std::list<SegmentWriter*> sws = segmentWriters(o,version);
+	writeHeader(name,o,sws);
+
+	FrameWriter writer(name + ".bin", sws, std::list<SegmentWriter*>(), queueSize);
+	assert(writer.good() and writer.queueSize()==queueSize);
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		change(o,i);
+		writer.write(i, i*0.1, 3*i);
+		assert(writer.numberOfFramesWritten() <= i+1);
+		// (at most queueSize frames are waiting)
+		assert(writer.numberOfFramesWritten() >= i+1 - (int)queueSize);
+	}
+	writer.flush();
+	assert(writer.numberOfFramesWritten()==NUM_FRAMES);
+	assert(writer.good());
+}
+
+// the time a simulation waits for its frames to be written, with SimulationWriter::writeFrame
+// (queueSize < 0) or a FrameWriter
+double bench(int n, int queueSize)
+{
+	Organism* o = organism(n);
+	std::list<SegmentWriter*> sws = segmentWriters(o);
+	writeHeader("framewriter_bench",o,sws);
+
+	std::ofstream out;
+	FrameWriter* writer = NULL;
+	if (queueSize < 0)
+	{
+		out.open("framewriter_bench.bin", std::ios::binary);
+		SimulationWriter::writeFrameDataHeader(out);
+	}
+	else
+		writer = new FrameWriter("framewriter_bench.bin", sws, std::list<SegmentWriter*>(), queueSize);
+
+	double t = 0;
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		change(o,i);
+
+		double start = Profile::now();
+		if (writer)
+			writer->write(i, i*0.1, i);
+		else
+		{
+			SimulationWriter::writeFrame(out, i, i*0.1, i, sws);
+			out.flush();
+		}
+		t += Profile::now() - start;
+	}
+	delete writer;
+	return t;
+}
+
+int main(int argc, char** argv)
+{
+	// (the frames written with a queue are written from snapshots of the mesh)
+	std::string versions[] = {"topodelta", "19042010"};
+	BOOST_FOREACH(std::string version, versions)
+	{
+		writeReference("framewriter_reference", version);
+		std::string reference = contents("framewriter_reference.bin");
+
+		SimulationLoader loader("framewriter_reference.cfg");
+		assert(loader.countFrames()==NUM_FRAMES);
+		// (the loader writes the index it builds)
+		std::string index = contents(SimulationWriter::frameIndexFileName("framewriter_reference.bin"));
+		assert(not index.empty());
+
+		unsigned int queueSizes[] = {0, 1, 2, 5};
+		BOOST_FOREACH(unsigned int q, queueSizes)
+		{
+			std::ostringstream name;
+			name << "framewriter_" << q;
+			write(name.str(), version, q);
+			assert(contents(name.str() + ".bin")==reference);
+			assert(contents(SimulationWriter::frameIndexFileName(name.str() + ".bin"))==index);
+
+			SimulationLoader l(name.str() + ".cfg");
+			assert(l.countFrames()==NUM_FRAMES);
+		}
+		std::cout << "the \"" << version << "\" frames written are the same\n";
+	}
+
+	const int n = 16;
+	std::cout << "cube(" << n << "," << n << "," << n << "), " << NUM_FRAMES << " frames, time spent writing: "
+		<< "SimulationWriter::writeFrame " << bench(n,-1) << "s, "
+		<< "FrameWriter without a queue " << bench(n,0) << "s, "
+		<< "with a queue of " << FrameWriter::DEFAULT_QUEUE_SIZE << " " << bench(n,FrameWriter::DEFAULT_QUEUE_SIZE) << "s\n";
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
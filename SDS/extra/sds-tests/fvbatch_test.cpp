@@ -0,0 +1,161 @@
+/*
+ * Checks that Physics::FVBatch computes exactly the forces and energies of Physics::FV,
+ * for full and partial batches, for tetras whose damping is clamped either way, and
+ * that it flags the tetras whose forces aren't numbers. Then reports the time taken
+ * by both.
+ */
+
+#include "physics.h"
+#include "vector3.h"
+#include "profile.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+class TestPhysics: public Physics
+{
+	public:
+	using Physics::FV;
+	using Physics::FVBatch;
+	using Physics::FVInfo;
+	using Physics::FVBatchInfo;
+};
+
+const int NUM_VERTICES = 1000;
+const int NUM_TETRAS = 4003; // (not a multiple of the batch size)
+const int REPS = 200;
+
+double random(double lo, double hi)
+{
+	return lo + (hi - lo)*(rand()/(double)RAND_MAX);
+}
+
+// whether the force a computed by FVBatch is exactly the force b that FV added to zero
+// (so that -0 and 0 are the same)
+bool same(double a, double b)
+{
+	a += 0.;
+	return std::memcmp(&a,&b,sizeof(double))==0;
+}
+
+int main()
+{
+	srand(7);
+
+	std::vector<Vector3d> x(NUM_VERTICES,Vector3d::ZERO), v(NUM_VERTICES,Vector3d::ZERO);
+	for(int i=0;i<NUM_VERTICES;i++)
+	{
+		x[i] = Vector3d(random(-1,1),random(-1,1),random(-1,1));
+		// (large velocities, so the damping is clamped in both directions)
+		v[i] = Vector3d(random(-20,20),random(-20,20),random(-20,20));
+	}
+
+	std::vector<unsigned int> slots(4*NUM_TETRAS);
+	std::vector<double> rest(NUM_TETRAS), k(NUM_TETRAS);
+	for(int t=0;t<NUM_TETRAS;t++)
+	{
+		for(int j=0;j<4;j++)
+			slots[4*t+j] = rand()%NUM_VERTICES;
+		rest[t] = random(0.01,0.2)*((t%2) ? 1 : -1);
+		k[t] = random(1,20);
+	}
+	const double damp = 0.05;
+
+	// the tetras one at a time
+	std::vector<Vector3d> expected(4*NUM_TETRAS,Vector3d::ZERO);
+	std::vector<double> expectedEnergy(NUM_TETRAS);
+	for(int t=0;t<NUM_TETRAS;t++)
+	{
+		const unsigned int* s = &slots[4*t];
+		const Vector3d* tx[] = {&x[s[0]], &x[s[1]], &x[s[2]], &x[s[3]]};
+		const Vector3d* tv[] = {&v[s[0]], &v[s[1]], &v[s[2]], &v[s[3]]};
+		Vector3d* tf[] = {&expected[4*t], &expected[4*t+1], &expected[4*t+2], &expected[4*t+3]};
+		TestPhysics::FVInfo fv;
+		bool ok = TestPhysics::FV(tx,tv,rest[t],k[t],damp,tf,&fv);
+		assert(ok);
+		expectedEnergy[t] = fv.energy;
+	}
+
+	// and in batches of each size
+	for(int size=1;size<=Physics::FV_BATCH;size++)
+	{
+		for(int t=0;t<NUM_TETRAS;t+=size)
+		{
+			const int n = std::min(size,NUM_TETRAS - t);
+			const unsigned int* s[Physics::FV_BATCH];
+			for(int i=0;i<n;i++)
+				s[i] = &slots[4*(t+i)];
+
+			TestPhysics::FVBatchInfo info;
+			TestPhysics::FVBatch(&x[0],&v[0],s,&rest[t],&k[t],n,damp,info);
+			assert(info.nan==0);
+			for(int i=0;i<n;i++)
+			{
+				for(int j=0;j<4;j++)
+				{
+					const Vector3d& e = expected[4*(t+i)+j];
+					assert(same(info.f[j][0][i],e.x()) and same(info.f[j][1][i],e.y()) and same(info.f[j][2][i],e.z()));
+				}
+				assert(same(info.energy[i],expectedEnergy[t+i]));
+			}
+		}
+	}
+
+	// a tetra with a vertex that isn't a number is flagged, and only that one
+	{
+		std::vector<Vector3d> bad = x;
+		bad[slots[4*2+1]] = Vector3d(NAN,0,0);
+		const unsigned int* s[Physics::FV_BATCH];
+		for(int i=0;i<Physics::FV_BATCH;i++)
+			s[i] = &slots[4*i];
+		bool uses = false;
+		for(int i=0;i<Physics::FV_BATCH;i++)
+			if (i!=2)
+				for(int j=0;j<4;j++)
+					uses = uses or slots[4*i+j]==slots[4*2+1];
+		if (not uses)
+		{
+			TestPhysics::FVBatchInfo info;
+			TestPhysics::FVBatch(&bad[0],&v[0],s,&rest[0],&k[0],Physics::FV_BATCH,damp,info);
+			assert(info.nan==(1<<2));
+		}
+	}
+
+	// time them
+	std::vector<Vector3d> f(NUM_VERTICES,Vector3d::ZERO);
+	double start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		for(int t=0;t<NUM_TETRAS;t++)
+		{
+			const unsigned int* s = &slots[4*t];
+			const Vector3d* tx[] = {&x[s[0]], &x[s[1]], &x[s[2]], &x[s[3]]};
+			const Vector3d* tv[] = {&v[s[0]], &v[s[1]], &v[s[2]], &v[s[3]]};
+			Vector3d* tf[] = {&f[s[0]], &f[s[1]], &f[s[2]], &f[s[3]]};
+			TestPhysics::FV(tx,tv,rest[t],k[t],damp,tf);
+		}
+	double single = Profile::now() - start;
+
+	start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		for(int t=0;t<NUM_TETRAS;t+=Physics::FV_BATCH)
+		{
+			const int n = std::min((int)Physics::FV_BATCH,NUM_TETRAS - t);
+			const unsigned int* s[Physics::FV_BATCH];
+			for(int i=0;i<n;i++)
+				s[i] = &slots[4*(t+i)];
+			TestPhysics::FVBatchInfo info;
+			TestPhysics::FVBatch(&x[0],&v[0],s,&rest[t],&k[t],n,damp,info);
+			for(int i=0;i<n;i++)
+				for(int j=0;j<4;j++)
+					f[s[i][j]] += Vector3d(info.f[j][0][i],info.f[j][1][i],info.f[j][2][i]);
+		}
+	double batched = Profile::now() - start;
+
+	std::cout << REPS << "x" << NUM_TETRAS << " tetras: FV=" << single << "s FVBatch=" << batched << "s\n";
+	std::cout << "Test Passed.\n";
+	return 0;
+}
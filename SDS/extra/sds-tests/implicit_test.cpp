@@ -0,0 +1,201 @@
+/*
+ * Compares Physics::takeImplicitStep() with Physics::takeVerletStep() on a stiff lattice.
+ *
+ * Finds the largest step with which each integrator simulates a lattice of stiff cells
+ * falling and squashing against the floor without becoming unstable, and checks that the
+ * implicit one takes steps at least MIN_RATIO times larger. Checks that with small
+ * steps both integrators follow nearly the same trajectory, that the inversions of a
+ * shaken lattice are found and handled with the implicit one too, and that the integrator
+ * is kept in the simulation header.
+ */
+
+#include "organismtools.h"
+#include "organism.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "physics.h"
+#include "processmodel.h"
+#include "sdssimulation.h"
+#include "simulationcontext.h"
+#include "simulationio.h"
+#include "oworld.h"
+#include "vertex.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int LATTICE = 4;
+// kD and kV
+const double K = 2000;
+const double GRAVITY = 10;
+const double FLOOR = -2;
+// the simulated time, and the time the lattice falls before it reaches the floor
+const double T = 2;
+const double FALL_T = 0.5;
+// the steps tried are DT0*2^i
+const double DT0 = 4e-4;
+const int MAX_DOUBLINGS = 10;
+// the largest steps of the two must differ by at least this much
+const double MIN_RATIO = 10;
+
+// the shaken lattice (softer, so that its tetras turn inside out)
+const double SOFT_K = 17;
+const double SHAKE_DT = 0.01;
+const double SHAKE_T = 0.4;
+const double SPEED = 8;
+const int SEED = 3;
+
+// (in the current context, as the tetras take its kV)
+Organism* lattice()
+{
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(LATTICE,LATTICE,LATTICE,1));
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	return o;
+}
+
+// simulate a lattice with spring coefficients k for time t with step dt, returns false if it
+// became unstable (if shake, the vertices start with random velocities of up to SPEED)
+// (positions, if not NULL, gets the final vertex positions)
+bool simulate(Physics::Integrator integrator, double dt, double t, double k, double gravity, bool shake = false,
+		std::vector<Vector3d>* positions = NULL, int* inversions = NULL)
+{
+	SimulationContext context;
+	SimulationContext::Scope scope(context);
+
+	Physics::INTEGRATOR = integrator;
+	Physics::kD = k;
+	Physics::kV = k;
+	Physics::kDamp = 0.05;
+	Physics::GRAVITY = gravity;
+
+	Organism* o = lattice();
+	if (shake)
+	{
+		srand(SEED);
+		BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+		{
+			Vector3d kick(rand()/(double)RAND_MAX - .5,rand()/(double)RAND_MAX - .5,rand()/(double)RAND_MAX - .5);
+			v->mOldX = v->mX - kick*(2*SPEED*dt);
+		}
+	}
+
+	OWorld* w = new OWorld();
+	w->addOrganism(o);
+	w->setBounds(AABB(-100,FLOOR,-100,100,100,100));
+
+	SDSSimulation s(&context);
+	s.setStepSize(dt);
+	s.setWorld(w);
+
+	const int maxSubsteps = 20*(int)(t/dt + 1);
+	int substeps = 0;
+	if (inversions) *inversions = 0;
+	while (s.t() < t - dt/2 and s.state()!=SDSSimulation::UNSTABLE and substeps < maxSubsteps)
+	{
+		s.substep();
+		substeps++;
+		if (inversions and not s.lastStepProperties.properties("inversion detected").empty())
+			(*inversions)++;
+	}
+
+	// (stable means it didn't blow up, nor grind to a halt, nor fly apart)
+	bool stable = s.state()!=SDSSimulation::UNSTABLE and substeps < maxSubsteps;
+	AABB box = o->mesh()->aabb();
+	stable = stable and box[3]-box[0] < 2*LATTICE and box[4]-box[1] < 2*LATTICE and box[5]-box[2] < 2*LATTICE;
+	stable = stable and o->mesh()->isSane();
+
+	if (positions)
+	{
+		positions->clear();
+		BOOST_FOREACH(Vertex* v, o->mesh()->vertices())
+			positions->push_back(v->x());
+	}
+
+	s.cleanup();
+	return stable;
+}
+
+// the largest step DT0*2^i that is stable for T
+double largestStableStep(Physics::Integrator integrator)
+{
+	double largest = 0;
+	for(int i=0;i<=MAX_DOUBLINGS;i++)
+	{
+		double dt = DT0*(1<<i);
+		bool stable = simulate(integrator,dt,T,K,GRAVITY);
+		std::cout << "  " << Physics::integratorName(integrator) << " dt=" << dt << (stable ? " stable" : " unstable") << "\n";
+		if (not stable) break;
+		largest = dt;
+	}
+	return largest;
+}
+
+int main()
+{
+	// the largest stable steps
+	double verlet = largestStableStep(Physics::VERLET);
+	double implicit = largestStableStep(Physics::IMPLICIT_EULER);
+	std::cout << "largest stable step: verlet " << verlet << ", implicit " << implicit << " (" << implicit/verlet << "x)\n";
+	assert(verlet > 0);
+	assert(implicit >= MIN_RATIO*verlet);
+
+	// with a small step they agree (while the lattice is falling, backward Euler lags by about g*dt*t/2)
+	{
+		std::vector<Vector3d> a, b;
+		double dt = verlet/4;
+		assert(simulate(Physics::VERLET,dt,FALL_T,K,GRAVITY,false,&a));
+		assert(simulate(Physics::IMPLICIT_EULER,dt,FALL_T,K,GRAVITY,false,&b));
+		double d = 0;
+		for(unsigned int i=0;i<a.size();i++)
+			d = std::max(d,(a[i] - b[i]).length());
+		std::cout << "with dt=" << dt << " the trajectories are " << d << " apart after t=" << FALL_T << "\n";
+		assert(d < GRAVITY*dt*FALL_T);
+	}
+
+	// the inversions of a shaken lattice are found
+	for(int i=0;i<2;i++)
+	{
+		Physics::Integrator integrator = i ? Physics::IMPLICIT_EULER : Physics::VERLET;
+		int inversions = 0;
+		bool stable = simulate(integrator,SHAKE_DT,SHAKE_T,SOFT_K,0,true,NULL,&inversions);
+		std::cout << "shaken lattice, " << Physics::integratorName(integrator) << ": " << inversions << " inversions" << (stable ? "" : ", unstable") << "\n";
+		assert(stable);
+		assert(inversions > 0);
+	}
+
+	// the integrator is kept in the header
+	{
+		SimulationContext context;
+		SimulationContext::Scope scope(context);
+		Physics::INTEGRATOR = Physics::IMPLICIT_EULER;
+
+		OWorld* w = new OWorld();
+		w->addOrganism(lattice());
+		w->calculateBounds();
+		SDSSimulation s(&context);
+		s.setWorld(w);
+
+		SimulationIO_Base::SimulationHeader hdr;
+		assert(hdr.integrator=="verlet");
+		s.writeHeader(hdr);
+		assert(hdr.integrator=="implicit");
+
+		SimulationContext other;
+		SDSSimulation t(&other);
+		t.initialiseFromHeader(hdr);
+		{
+			SimulationContext::Scope otherScope(other);
+			assert(Physics::INTEGRATOR==Physics::IMPLICIT_EULER);
+		}
+		s.cleanup();
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
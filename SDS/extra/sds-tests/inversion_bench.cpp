@@ -0,0 +1,282 @@
+/*
+ * Compares the InversionScheduler search for the first tetra to invert in a step
+ * (as used by SDSSimulation::detectFirstInversion) against the old search, which
+ * solved every inverted tetra, rewound the whole mesh and rescanned every tetra
+ * each round.
+ *
+ * Moves random vertices of a cube of tetras far enough to invert many tetras at
+ * once, and checks that both searches choose the same tetra and the same time,
+ * and leave the mesh in exactly the same place. Then reports the time taken by both.
+ */
+
+#include "inversionscheduler.h"
+#include "sdsutil.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "mesharrays.h"
+#include "vertex.h"
+#include "tetra.h"
+#include "edge.h"
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cstdlib>
+#include <cmath>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const double DT = 0.01;
+const int MAX_ROUNDS = 100;
+// how many searches to time
+const int REPS = 5;
+
+struct Result
+{
+	Tetra* t;
+	double back;
+	int rounds;
+	Result():t(NULL),back(0),rounds(0){}
+};
+
+// as SDSSimulation::timeBackToInversion, <0 if invalid
+double timeBack(double root, double dt)
+{
+	double tFirst = root*dt;
+	if (not (tFirst>0 and tFirst<=dt)) return -1;
+	return dt-tFirst;
+}
+
+// the old search
+Result referenceSearch(Mesh* m)
+{
+	Result r;
+	std::vector<Tetra*> inverted;
+	BOOST_FOREACH(Tetra* t, m->tetras())
+		if (not t->isFrozen() and t->volume() < 0)
+			inverted.push_back(t);
+
+	while (not inverted.empty())
+	{
+		double deltaT = DT - r.back;
+		double tr = -1;
+		BOOST_FOREACH(Tetra* t, inverted)
+		{
+			double deltaH = timeBack(SDSUtil::doVertexPlaneIntersect(t,0,1,2,3),deltaT);
+			if (deltaH >= 0 and deltaH < deltaT and deltaH > tr)
+			{
+				tr = deltaH;
+				r.t = t;
+			}
+		}
+		// (a tetra which can't be rewound makes the simulation unstable,
+		// and tetras which invert more than once in a step can make the search go round in circles)
+		if (tr<0 or r.rounds==MAX_ROUNDS)
+		{
+			r.t = NULL;
+			return r;
+		}
+
+		SDSUtil::rewindAllVertices(m,tr,deltaT);
+		r.back += tr;
+		r.rounds++;
+
+		inverted.clear();
+		BOOST_FOREACH(Tetra* t, m->tetras())
+			if (t!=r.t and not t->isFrozen() and t->volume() < 0)
+				inverted.push_back(t);
+	}
+	return r;
+}
+
+// the search in SDSSimulation::detectFirstInversion
+Result schedulerSearch(Mesh* m, InversionScheduler& is)
+{
+	Result r;
+	is.start(m,DT);
+	std::vector<Tetra*> inverted;
+	is.findInverted(inverted);
+
+	while (not inverted.empty())
+	{
+		double deltaT = is.window();
+		BOOST_FOREACH(Tetra* t, inverted)
+		{
+			double deltaH = timeBack(is.intersect(t),deltaT);
+			if (deltaH >= 0 and deltaH < deltaT)
+				is.schedule(t,deltaH);
+		}
+		if (not is.scheduled() or r.rounds==MAX_ROUNDS)
+		{
+			r.t = NULL;
+			return r;
+		}
+
+		r.t = is.next();
+		r.rounds++;
+		inverted.clear();
+		is.findInverted(inverted,r.t);
+	}
+	is.rewind();
+	r.back = is.back();
+	return r;
+}
+
+// an n*n*n cube, with some vertices moved in the last step far enough to invert their tetras
+Mesh* makeMesh(int n, int moved, int seed)
+{
+	srand(seed);
+	Mesh* m = MeshTester::cube(n,n,n,1);
+	std::vector<Vertex*> vertices(m->vertices().begin(),m->vertices().end());
+	BOOST_FOREACH(Vertex* v, vertices)
+		v->mOldX = v->mX;
+	for(int i=0;i<moved;i++)
+	{
+		Vertex* v = vertices[rand()%vertices.size()];
+		v->mX += Vector3d(rand()%1000-500,rand()%1000-500,rand()%1000-500)*5e-3;
+	}
+	return m;
+}
+
+// an n*n*n cube, with the ends of some edges swapped in the last step
+// (which invert tetras part way through the step, and can make the search go round in circles)
+Mesh* makeSwappedMesh(int n, int swapped, int seed)
+{
+	srand(seed);
+	Mesh* m = MeshTester::cube(n,n,n,1);
+	BOOST_FOREACH(Vertex* v, m->vertices())
+		v->mOldX = v->mX;
+	std::vector<Edge*> edges(m->edges().begin(),m->edges().end());
+	for(int i=0;i<swapped;i++)
+	{
+		Edge* e = edges[rand()%edges.size()];
+		Vector3d d = (e->v(1)->mOldX - e->v(0)->mOldX)*1.1 + Vector3d(rand()%100-50,rand()%100-50,rand()%100-50)*1e-3;
+		e->v(0)->mX += d;
+		e->v(1)->mX -= d;
+	}
+	return m;
+}
+
+unsigned int index(Mesh* m, Tetra* t)
+{
+	unsigned int i = 0;
+	BOOST_FOREACH(Tetra* u, m->tetras())
+	{
+		if (u==t) return i;
+		i++;
+	}
+	return i;
+}
+
+unsigned int countInverted(Mesh* m)
+{
+	unsigned int k = 0;
+	BOOST_FOREACH(Tetra* t, m->tetras())
+		if (t->volume() < 0) k++;
+	return k;
+}
+
+double maxDistance(Mesh* a, Mesh* b)
+{
+	double d = 0;
+	std::list<Vertex*>::const_iterator ib = b->vertices().begin();
+	BOOST_FOREACH(Vertex* v, a->vertices())
+		d = std::max(d,dist(v->x(),(*ib++)->x()));
+	return d;
+}
+
+void check()
+{
+	InversionScheduler is;
+	int searches = 0, multiRound = 0, unstable = 0;
+	for(int seed=0;seed<200;seed++)
+	{
+		Mesh* a = makeMesh(4,1+seed%8,seed);
+		Mesh* b = makeMesh(4,1+seed%8,seed);
+		if (countInverted(a)==0)
+		{
+			delete a;
+			delete b;
+			continue;
+		}
+
+		Result ra = referenceSearch(a);
+		Result rb = schedulerSearch(b,is);
+		if (ra.t==NULL)
+		{
+			unstable++;
+			delete a;
+			delete b;
+			continue;
+		}
+		searches++;
+		assert(index(a,ra.t)==index(b,rb.t));
+		assert(ra.rounds==rb.rounds);
+		assert(ra.back==rb.back);
+		assert(maxDistance(a,b)==0);
+		if (ra.rounds>1) multiRound++;
+		delete a;
+		delete b;
+	}
+	assert(searches>100 and multiRound>0);
+	std::cout << "the first inversion matches the old search in " << searches << " searches ("
+		<< multiRound << " took more than one round, " << unstable << " steps couldn't be rewound)\n";
+}
+
+void bench(Mesh* a, Mesh* b)
+{
+	unsigned int inverted = countInverted(a);
+	// (the physics builds the mesh arrays before the search in a simulation)
+	b->arrays();
+
+	// the searches rewind the mesh, so time them on copies of the positions
+	std::vector<Vector3d> xs;
+	BOOST_FOREACH(Vertex* v, a->vertices())
+		xs.push_back(v->x());
+
+	double tOld = 0, tNew = 0;
+	Result ra, rb;
+	InversionScheduler is;
+	for(int r=0;r<REPS;r++)
+	{
+		unsigned int i = 0;
+		BOOST_FOREACH(Vertex* v, a->vertices()) v->mX = xs[i++];
+		i = 0;
+		BOOST_FOREACH(Vertex* v, b->vertices()) v->mX = xs[i++];
+
+		double start = Profile::now();
+		ra = referenceSearch(a);
+		tOld += Profile::now() - start;
+
+		start = Profile::now();
+		rb = schedulerSearch(b,is);
+		tNew += Profile::now() - start;
+	}
+	assert(index(a,ra.t)==index(b,rb.t));
+
+	std::cout << std::setw(7) << a->tetras().size() << " tetras, "
+		<< std::setw(4) << inverted << " inverted, "
+		<< std::setw(3) << ra.rounds << " rounds: "
+		<< "old=" << std::setw(9) << tOld/REPS << "s  "
+		<< "scheduler=" << std::setw(9) << tNew/REPS << "s\n";
+	delete a;
+	delete b;
+}
+
+int main()
+{
+	check();
+
+	std::cout << "First inversion search benchmark (mean of " << REPS << " searches)\n";
+	bench(makeMesh(10,5,42),makeMesh(10,5,42));
+	bench(makeMesh(20,40,42),makeMesh(20,40,42));
+	bench(makeMesh(30,120,42),makeMesh(30,120,42));
+	bench(makeMesh(40,1000,42),makeMesh(40,1000,42));
+	// a search which goes round in circles until MAX_ROUNDS
+	bench(makeSwappedMesh(20,5,20),makeSwappedMesh(20,5,20));
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Compares the indexed element lookups in Mesh (getEdge, getFace, getTetra)
+ * and the incident tetras of each vertex (getNeighbours, incidentTetras)
+ * against the old linear search through the mesh lists.
+ *
+ * Checks that both give the same answers (the incident tetras in the same order,
+ * also after tetras have been removed and added), and reports the time taken.
+ */
+
+#include "mesh.h"
+#include "meshtools.h"
+#include "meshtester.h"
+#include "vertex.h"
+#include "edge.h"
+#include "face.h"
+#include "tetra.h"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+#include <boost/timer.hpp>
+
+// the old lookups, for comparison
+Edge* linearGetEdge(Mesh* m, Vertex* v1, Vertex* v2)
+{
+	BOOST_FOREACH(Edge* e, m->edges())
+	{
+		if (e->v(0)==v1 and (v2==NULL or e->v(1)==v2)) return e;
+		else if (e->v(1)==v1 and (v2==NULL or e->v(0)==v2)) return e;
+	}
+	return NULL;
+}
+
+Face* linearGetFace(Mesh* m, Vertex* v1, Vertex* v2, Vertex* v3)
+{
+	BOOST_FOREACH(Face* f, m->faces())
+	{
+		if (f->contains(v1) and f->contains(v2) and f->contains(v3))
+			return f;
+	}
+	return NULL;
+}
+
+Tetra* linearGetTetra(Mesh* m, Vertex* v1, Vertex* v2, Vertex* v3, Vertex* v4)
+{
+	BOOST_FOREACH(Tetra* t, m->tetras())
+	{
+		if (t->contains(v1) and (v2==NULL or (t->contains(v2) and
+				(v3==NULL or (t->contains(v3) and (v4==NULL or t->contains(v4)))))))
+			return t;
+	}
+	return NULL;
+}
+
+std::list<Tetra*> linearGetNeighbours(Mesh* m, Vertex* v)
+{
+	std::list<Tetra*> n;
+	BOOST_FOREACH(Tetra* t, m->tetras())
+	{
+		if (t->contains(v)) n.push_back(t);
+	}
+	return n;
+}
+
+// the incident tetras of each vertex are the ones (and in the order) the linear search finds
+void checkNeighbours(Mesh* m)
+{
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		std::list<Tetra*> n = linearGetNeighbours(m,v);
+		assert(m->getNeighbours(v)==n);
+		const std::vector<Tetra*>& incident = m->incidentTetras(v);
+		assert(incident.size()==n.size() and std::equal(incident.begin(),incident.end(),n.begin()));
+	}
+}
+
+struct Query
+{
+	Vertex* v[4];
+};
+
+// how many times to repeat each set of queries
+const int REPS = 20;
+
+void bench(const std::string& name, Mesh* m)
+{
+	std::vector<Query> edgeQ, faceQ, tetraQ, partialQ;
+	BOOST_FOREACH(Edge* e, m->edges())
+	{
+		Query q = {{e->v(1), e->v(0), NULL, NULL}};
+		edgeQ.push_back(q);
+		partialQ.push_back(q);
+	}
+	BOOST_FOREACH(Face* f, m->faces())
+	{
+		Query q = {{&f->v(2), &f->v(0), &f->v(1), NULL}};
+		faceQ.push_back(q);
+	}
+	BOOST_FOREACH(Tetra* t, m->tetras())
+	{
+		Query q = {{&t->v(3), &t->v(1), &t->v(0), &t->v(2)}};
+		tetraQ.push_back(q);
+	}
+
+	// check the answers agree
+	BOOST_FOREACH(Query& q, edgeQ)
+		assert(m->getEdge(q.v[0],q.v[1])==linearGetEdge(m,q.v[0],q.v[1]));
+	BOOST_FOREACH(Query& q, faceQ)
+		assert(m->getFace(q.v[0],q.v[1],q.v[2])==linearGetFace(m,q.v[0],q.v[1],q.v[2]));
+	BOOST_FOREACH(Query& q, tetraQ)
+		assert(m->getTetra(q.v[0],q.v[1],q.v[2],q.v[3])==linearGetTetra(m,q.v[0],q.v[1],q.v[2],q.v[3]));
+	BOOST_FOREACH(Query& q, partialQ)
+		assert(m->getTetra(q.v[0],q.v[1])==linearGetTetra(m,q.v[0],q.v[1],NULL,NULL));
+	checkNeighbours(m);
+
+	double tLinear = 0, tIndexed = 0;
+	int found = 0;
+	boost::timer timer;
+
+	timer.restart();
+	for(int r=0;r<REPS;r++)
+	{
+		BOOST_FOREACH(Query& q, edgeQ) found += linearGetEdge(m,q.v[0],q.v[1])!=NULL;
+		BOOST_FOREACH(Query& q, faceQ) found += linearGetFace(m,q.v[0],q.v[1],q.v[2])!=NULL;
+		BOOST_FOREACH(Query& q, tetraQ) found += linearGetTetra(m,q.v[0],q.v[1],q.v[2],q.v[3])!=NULL;
+		BOOST_FOREACH(Query& q, partialQ) found += linearGetTetra(m,q.v[0],q.v[1],NULL,NULL)!=NULL;
+	}
+	tLinear = timer.elapsed();
+
+	timer.restart();
+	for(int r=0;r<REPS;r++)
+	{
+		BOOST_FOREACH(Query& q, edgeQ) found += m->getEdge(q.v[0],q.v[1])!=NULL;
+		BOOST_FOREACH(Query& q, faceQ) found += m->getFace(q.v[0],q.v[1],q.v[2])!=NULL;
+		BOOST_FOREACH(Query& q, tetraQ) found += m->getTetra(q.v[0],q.v[1],q.v[2],q.v[3])!=NULL;
+		BOOST_FOREACH(Query& q, partialQ) found += m->getTetra(q.v[0],q.v[1])!=NULL;
+	}
+	tIndexed = timer.elapsed();
+
+	int numQueries = REPS*(edgeQ.size()+faceQ.size()+tetraQ.size()+partialQ.size());
+	assert(found==2*numQueries);
+
+	// the incident tetras of every vertex
+	double tLinearNeighbours = 0, tIndexedNeighbours = 0;
+	std::size_t incident = 0;
+	timer.restart();
+	for(int r=0;r<REPS;r++)
+		BOOST_FOREACH(Vertex* v, m->vertices())
+			incident += linearGetNeighbours(m,v).size();
+	tLinearNeighbours = timer.elapsed();
+
+	timer.restart();
+	for(int r=0;r<REPS;r++)
+		BOOST_FOREACH(Vertex* v, m->vertices())
+			incident += m->incidentTetras(v).size();
+	tIndexedNeighbours = timer.elapsed();
+	assert(incident==2*REPS*4*m->tetras().size());
+
+	std::cout << std::setw(22) << std::left << name << std::right
+		<< " |V|=" << std::setw(6) << m->vertices().size()
+		<< " |E|=" << std::setw(6) << m->edges().size()
+		<< " |T|=" << std::setw(6) << m->tetras().size()
+		<< "  queries=" << std::setw(8) << numQueries
+		<< "  linear=" << std::setw(8) << tLinear << "s"
+		<< "  indexed=" << std::setw(8) << tIndexed << "s"
+		<< "  neighbours: linear=" << std::setw(8) << tLinearNeighbours << "s"
+		<< "  indexed=" << std::setw(8) << tIndexedNeighbours << "s\n";
+}
+
+int main()
+{
+	std::cout << "Mesh lookup benchmark (" << REPS << " reps)\n";
+
+	const char* meshes[] = {"../data/lattice111.1", "../data/cube2.1", "../tests/lattice222.1"};
+	for(int i=0;i<3;i++)
+	{
+		Mesh* m = MeshTools::Load(meshes[i]);
+		if (m==NULL)
+		{
+			std::cerr << "Couldn't load " << meshes[i] << "\n";
+			continue;
+		}
+		bench(meshes[i],m);
+		delete m;
+	}
+
+	// larger lattices
+	for(int n=4;n<=8;n+=4)
+	{
+		Mesh* m = MeshTester::cube(n,n,n,1);
+		std::ostringstream oss;
+		oss << "cube(" << n << "," << n << "," << n << ")";
+		bench(oss.str(),m);
+		delete m;
+	}
+
+	// the incident tetras follow tetras being removed and added again (at the end of the list)
+	{
+		Mesh* m = MeshTester::cube(4,4,4,1);
+		checkNeighbours(m);
+		std::vector<Tetra*> removed;
+		int i = 0;
+		BOOST_FOREACH(Tetra* t, std::vector<Tetra*>(m->tetras().begin(),m->tetras().end()))
+			if (i++%3==0)
+			{
+				m->removeTetra(t);
+				removed.push_back(t);
+			}
+		checkNeighbours(m);
+		for(unsigned int j=0;j<removed.size();j+=2)
+			m->addTetra(removed[j]);
+		checkNeighbours(m);
+		for(unsigned int j=1;j<removed.size();j+=2)
+			m->addTetra(removed[j]);
+		checkNeighbours(m);
+		delete m;
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
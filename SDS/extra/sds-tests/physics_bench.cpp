@@ -0,0 +1,246 @@
+/*
+ * Compares the force and integration pass in Physics against the old per-element
+ * pass over the mesh lists (which Physics still uses for one thread, see
+ * Physics::calculateForcesSerial), and the multithreaded force passes (which run
+ * over the contiguous MeshArrays of a mesh) against the serial one.
+ *
+ * Checks that the serial and deterministic passes give exactly the same forces,
+ * that the coloured pass is close, that the colouring is valid, that vertex
+ * slots survive add/remove churn, and reports the time taken.
+ */
+
+#include "mesh.h"
+#include "mesharrays.h"
+#include "meshtester.h"
+#include "physics.h"
+#include "vertex.h"
+#include "edge.h"
+#include "tetra.h"
+#include "profile.h"
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+
+#include <boost/foreach.hpp>
+
+// the old force pass, for comparison
+class ReferencePhysics: public Physics
+{
+	public:
+	static void calculateForces(Mesh* m)
+	{
+		BOOST_FOREACH(Vertex* v, m->vertices())
+		{
+			if (v->isFrozen()) continue;
+			v->zeroF();
+			v->addF(Vector3d::Y * -Physics::GRAVITY * (v->m() * Physics::DENSITY));
+		}
+		BOOST_FOREACH(Edge* e, m->edges())
+		{
+			if (e->v(0)->isFrozen() and e->v(1)->isFrozen()) continue;
+			FD(e);
+		}
+		BOOST_FOREACH(Tetra* t, m->tetras())
+		{
+			if (t->pv(0)->isFrozen() and t->pv(1)->isFrozen() and t->pv(2)->isFrozen() and t->pv(3)->isFrozen()) continue;
+			FV(t);
+		}
+	}
+};
+
+// how many force passes to time
+const int REPS = 20;
+
+std::vector<Vector3d> forces(Mesh* m)
+{
+	std::vector<Vector3d> f;
+	BOOST_FOREACH(Vertex* v, m->vertices())
+		f.push_back(v->f());
+	return f;
+}
+
+// bitwise comparison (== doesn't distinguish 0 and -0)
+bool identical(const std::vector<Vector3d>& a, const std::vector<Vector3d>& b)
+{
+	if (a.size()!=b.size()) return false;
+	for(unsigned int i=0;i<a.size();i++)
+		for(int j=0;j<3;j++)
+		{
+			double x = a[i](j), y = b[i](j);
+			if (std::memcmp(&x,&y,sizeof(double))!=0) return false;
+		}
+	return true;
+}
+
+bool close(const std::vector<Vector3d>& a, const std::vector<Vector3d>& b)
+{
+	if (a.size()!=b.size()) return false;
+	for(unsigned int i=0;i<a.size();i++)
+		if ((a[i]-b[i]).length() > 1e-9*(1+a[i].length())) return false;
+	return true;
+}
+
+// no two elements of a colour share a vertex
+template <int N, typename Tuple>
+void checkColouring(const std::vector<Tuple>& elements, const std::vector<unsigned int>& order, const std::vector<unsigned int>& start, unsigned int numSlots)
+{
+	std::vector<unsigned int> seen(numSlots,0);
+	assert(order.size()==elements.size());
+	for(unsigned int c=0;c+1<start.size();c++)
+		for(unsigned int k=start[c];k<start[c+1];k++)
+			for(int j=0;j<N;j++)
+			{
+				unsigned int s = elements[order[k]].v[j];
+				assert(seen[s]!=c+1);
+				seen[s] = c+1;
+			}
+}
+
+// time REPS force passes with the current settings
+double timeForces(Mesh* m)
+{
+	double start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		Physics::calculateForces(m);
+	return Profile::now() - start;
+}
+
+void benchThreads(Mesh* m, const std::vector<Vector3d>& fSerial)
+{
+	const int threadCounts[] = {2, 4, 8, 16};
+	for(int i=0;i<4;i++)
+	{
+		Physics::NUM_THREADS = threadCounts[i];
+
+		Physics::DETERMINISTIC = true;
+		Physics::calculateForces(m);
+		assert(identical(fSerial,forces(m)));
+		double tDet = timeForces(m);
+
+		Physics::DETERMINISTIC = false;
+		Physics::calculateForces(m);
+		assert(close(fSerial,forces(m)));
+		double tCol = timeForces(m);
+
+		std::cout << std::setw(22) << "" << " threads=" << std::setw(2) << threadCounts[i]
+			<< "  deterministic=" << std::setw(8) << tDet << "s"
+			<< "  coloured=" << std::setw(8) << tCol << "s\n";
+	}
+	Physics::NUM_THREADS = 1;
+
+	MeshArrays& arrays = m->arrays();
+	checkColouring<2>(arrays.edges,arrays.edgeOrder,arrays.edgeColourStart,arrays.vertices.size());
+	checkColouring<4>(arrays.tetras,arrays.tetraOrder,arrays.tetraColourStart,arrays.vertices.size());
+	std::cout << std::setw(22) << "" << " colours: " << arrays.numEdgeColours() << " edge, " << arrays.numTetraColours() << " tetra\n";
+}
+
+// jiggle the vertices so that the springs are under some load
+void perturb(Mesh* m)
+{
+	srand(42);
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		Vector3d d(rand()%100-50,rand()%100-50,rand()%100-50);
+		v->addX(d*0.001);
+	}
+}
+
+void bench(const std::string& name, Mesh* m)
+{
+	perturb(m);
+	Physics::setLastStepSize(-1);
+	Physics::SetAllEdgeSpringStrengths(m);
+
+	// check the forces agree exactly
+	ReferencePhysics::calculateForces(m);
+	std::vector<Vector3d> fRef = forces(m);
+	Physics::calculateForces(m);
+	std::vector<Vector3d> fNew = forces(m);
+	assert(fRef.size()==fNew.size());
+	assert(identical(fRef,fNew));
+
+	double start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		ReferencePhysics::calculateForces(m);
+	double tRef = Profile::now() - start;
+
+	start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		Physics::calculateForces(m);
+	double tNew = Profile::now() - start;
+
+	start = Profile::now();
+	for(int r=0;r<REPS;r++)
+		Physics::takeVerletStep(m,0.001,true);
+	double tStep = Profile::now() - start;
+
+	std::cout << std::setw(22) << std::left << name << std::right
+		<< " |V|=" << std::setw(6) << m->vertices().size()
+		<< " |E|=" << std::setw(7) << m->edges().size()
+		<< " |T|=" << std::setw(7) << m->tetras().size()
+		<< "  old forces=" << std::setw(8) << tRef << "s"
+		<< "  new forces=" << std::setw(8) << tNew << "s"
+		<< "  integrate=" << std::setw(8) << tStep << "s\n";
+
+	Physics::calculateForces(m);
+	benchThreads(m,forces(m));
+}
+
+// add and remove vertices, and check the slots are reused and the forces still agree
+void churn(Mesh* m)
+{
+	Physics::calculateForces(m);
+
+	std::vector<Vertex*> extra;
+	for(int i=0;i<10;i++)
+	{
+		Vertex* v = new Vertex(Vector3d(i,-10,0));
+		m->addVertex(v);
+		extra.push_back(v);
+	}
+	Physics::calculateForces(m);
+
+	unsigned int freed = extra[3]->slot();
+	m->removeVertex(extra[3]);
+	delete extra[3];
+	Vertex* v = new Vertex(Vector3d(0,-20,0));
+	m->addVertex(v);
+	Physics::calculateForces(m);
+	assert(v->slot()==freed);
+
+	// an edge between two new vertices
+	Edge* e = new Edge(extra[0],extra[1],0.5);
+	m->addEdge(e);
+	ReferencePhysics::calculateForces(m);
+	std::vector<Vector3d> fRef = forces(m);
+	Physics::calculateForces(m);
+	std::vector<Vector3d> fNew = forces(m);
+	assert(identical(fRef,fNew));
+	benchThreads(m,fNew);
+	assert(extra[0]->f()!=extra[2]->f());
+}
+
+int main()
+{
+	std::cout << "Physics benchmark (" << REPS << " reps)\n";
+
+	for(int n=4;n<=24;n*=2)
+	{
+		Mesh* m = MeshTester::cube(n,n,n,1);
+		std::ostringstream oss;
+		oss << "cube(" << n << "," << n << "," << n << ")";
+		bench(oss.str(),m);
+		if (n==4) churn(m);
+		delete m;
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
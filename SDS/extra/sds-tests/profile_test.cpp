@@ -0,0 +1,106 @@
+/*
+ * Profiles a small simulation, and checks that the profile keeps the last substeps
+ * in its ring buffer, that the phases add up, and that nothing is recorded while it
+ * is disabled. Then reports where the time of the substeps went.
+ */
+
+#include "sdssimulation.h"
+#include "profile.h"
+#include "processmodel.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "oworld.h"
+#include "cell.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int SUBSTEPS = 50;
+const unsigned int CAPACITY = 16;
+
+int main()
+{
+	Organism* o = OrganismTools::loadOneTet();
+	o->setProcessModel(ProcessModel::create("LimbBudModel"));
+	OWorld* w = new OWorld();
+	w->addOrganism(o);
+	w->setBounds(AABB(Vector3d(-10,-10,-10),Vector3d(10,10,10)));
+
+	SDSSimulation s;
+	s.setStepSize(0.01);
+	s.setCollisionInterval(1);
+	s.setWorld(w);
+
+	Profile& profile = s.profile();
+	assert(not profile.enabled());
+
+	// nothing is recorded while it is disabled
+	for(int i=0;i<SUBSTEPS;i++)
+		s.substep();
+	assert(profile.size()==0);
+
+#ifdef SDS_NO_PROFILE
+	std::cout << "Profiling is compiled out.\n";
+#else
+	profile.setCapacity(CAPACITY);
+	profile.setEnabled(true);
+
+	int firstStep = s.steps();
+	for(int i=0;i<SUBSTEPS;i++)
+	{
+		bool fullStep = s.substep();
+		assert(fullStep and s.state()!=SDSSimulation::UNSTABLE);
+	}
+
+	// only the last substeps are kept, the oldest first
+	assert(profile.size()==CAPACITY);
+	for(unsigned int i=0;i<profile.size();i++)
+	{
+		assert(profile.step(i)==firstStep + SUBSTEPS - (int)CAPACITY + (int)i);
+		assert(profile.count(i,Profile::VERTICES)==4);
+		assert(profile.count(i,Profile::TETRAS)==1);
+
+		// the phases are inside the substep, and diffusion inside the process model
+		double phases = 0;
+		for(int p=Profile::SANITY_CHECK;p<Profile::DIFFUSION;p++)
+			phases += profile.time(i,Profile::Phase(p));
+		assert(profile.time(i,Profile::SUBSTEP) > 0);
+		assert(phases <= profile.time(i,Profile::SUBSTEP));
+		assert(profile.time(i,Profile::DIFFUSION) <= profile.time(i,Profile::PROCESS_MODEL));
+	}
+
+	// and the last substep is in the properties
+	bool found = false;
+	BOOST_FOREACH(PropertyList::property_type p, s.lastStepProperties.all())
+		if (p.first=="profile substep (us)") found = true;
+	assert(found);
+
+	// a line per substep, after the header
+	std::ostringstream csv;
+	profile.writeCSVHeader(csv);
+	profile.writeCSV(csv);
+	std::istringstream lines(csv.str());
+	std::string line;
+	int numLines = 0;
+	while (std::getline(lines,line)) numLines++;
+	assert(numLines==(int)CAPACITY+1);
+
+	for(int p=0;p<Profile::NUM_PHASES;p++)
+	{
+		double total = 0;
+		for(unsigned int i=0;i<profile.size();i++)
+			total += profile.time(i,Profile::Phase(p));
+		std::cout << Profile::phaseName(Profile::Phase(p)) << ": " << total*1e6/profile.size() << "us per substep\n";
+	}
+
+	profile.clear();
+	assert(profile.size()==0);
+#endif
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
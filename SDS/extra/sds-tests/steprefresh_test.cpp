@@ -0,0 +1,142 @@
+/*
+ * Checks that the spring coefficients and rest values SDSSimulation refreshes
+ * incrementally (only around the vertices that have changed) are exactly the ones
+ * a full refresh computes.
+ *
+ * Grows a lattice of cells, dividing some of them part way through, and after every
+ * full step compares the rest lengths and volumes of all the edges and tetras with the
+ * ones computed from the cell radii, and the spring coefficients left by
+ * Physics::UpdateEdgeSpringStrengths() with the ones of Physics::SetAllEdgeSpringStrengths().
+ * Then changes kD and checks that they all follow.
+ */
+
+#include "organismtools.h"
+#include "organism.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "physics.h"
+#include "processmodel.h"
+#include "sdssimulation.h"
+#include "simulationcontext.h"
+#include "transform.h"
+#include "oworld.h"
+#include "cell.h"
+#include "edge.h"
+#include "tetra.h"
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int LATTICE = 3;
+const int STEPS = 200;
+const int DIVIDE_EVERY = 25;
+// every GROWING-th cell grows
+const int GROWING = 3;
+const double GROWTH_RATE = 0.2;
+const int MAX_SUBSTEPS = 10*STEPS;
+
+// the rest values of the mesh differ from the ones computed from the cell radii
+int checkRest(Organism* o)
+{
+	int wrong = 0;
+	BOOST_FOREACH(Edge* e, o->mesh()->edges())
+	{
+		double r = o->getAssociatedCell(e->v(0))->r() + o->getAssociatedCell(e->v(1))->r();
+		if (e->rest()!=r*e->restMultiplier())
+			wrong++;
+	}
+	BOOST_FOREACH(Tetra* t, o->mesh()->tetras())
+	{
+		double r = Transform::tetrahedraRestVolume(&t->v(0),&t->v(1),&t->v(2),&t->v(3),o);
+		if (t->rest()!=r*t->restMultiplier())
+			wrong++;
+	}
+	return wrong;
+}
+
+// the spring coefficients of the incremental update differ from the ones of a full one
+int checkSprings(Mesh* m)
+{
+	Physics::UpdateEdgeSpringStrengths(m);
+	std::vector<double> k;
+	BOOST_FOREACH(Edge* e, m->edges())
+		k.push_back(e->springCoefficient());
+
+	Physics::SetAllEdgeSpringStrengths(m);
+	int wrong = 0, i = 0;
+	BOOST_FOREACH(Edge* e, m->edges())
+		if (e->springCoefficient()!=k[i++])
+			wrong++;
+	return wrong;
+}
+
+int main()
+{
+	SimulationContext context;
+	SimulationContext::Scope scope(context);
+
+	Physics::kD = 10;
+	Physics::kSM = 2;
+	Physics::kV = 10;
+	Physics::kDamp = 0.05;
+	Physics::GRAVITY = 1;
+
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(LATTICE,LATTICE,LATTICE,1));
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+	// (some of the cells grow, without any change to the mesh around them)
+	int i = 0;
+	BOOST_FOREACH(Cell* c, o->cells())
+		if (i++%GROWING==0)
+			c->setDrdt(GROWTH_RATE*c->r());
+	OWorld* w = new OWorld();
+	w->addOrganism(o);
+	w->calculateBounds();
+
+	SDSSimulation s(&context);
+	s.setStepSize(0.01);
+	s.setWorld(w);
+
+	int checks = 0, divisions = 0, substeps = 0;
+	while (s.steps() < STEPS and s.state()!=SDSSimulation::UNSTABLE and substeps < MAX_SUBSTEPS)
+	{
+		bool full = s.substep();
+		substeps++;
+		if (not full or s.state()==SDSSimulation::UNSTABLE)
+			continue;
+
+		assert(checkRest(o)==0);
+		assert(checkSprings(o->mesh())==0);
+		checks++;
+
+		// divide an inner cell (the rest values around it must then be refreshed)
+		if (s.steps()%DIVIDE_EVERY==0)
+		{
+			std::vector<Cell*> cells(o->cells().begin(),o->cells().end());
+			for(unsigned int i=0;i<cells.size();i++)
+			{
+				Cell* c = cells[(s.steps()*7 + i)%cells.size()];
+				if (c->isBoundary()) continue;
+				Vector3d dir(1,(s.steps()/DIVIDE_EVERY)%3 - 1.,.5);
+				Transform::Divide(c,dir.normalise(),o);
+				divisions++;
+				break;
+			}
+		}
+	}
+	std::cout << s.steps() << " steps, " << divisions << " divisions, " << o->cells().size() << " cells, " << checks << " checks\n";
+	assert(s.state()!=SDSSimulation::UNSTABLE);
+	assert(divisions > 0);
+
+	// all the springs follow a change of kD
+	Physics::kD = 12;
+	assert(checkSprings(o->mesh())==0);
+	BOOST_FOREACH(Edge* e, o->mesh()->edges())
+		assert(e->springCoefficient()==12 or e->springCoefficient()==24);
+
+	s.cleanup();
+	std::cout << "Test Passed.\n";
+	return 0;
+}
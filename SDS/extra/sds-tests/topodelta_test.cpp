@@ -0,0 +1,225 @@
+/*
+ * Writes the same simulation with the "19042010" and "topodelta" mesh segments,
+ * with topology changes part way through, and checks that every frame loads
+ * (in any order) to exactly the same mesh and organism from both files.
+ * Then compares the size and the write and read times of the two versions on larger meshes.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cstdio>
+
+#include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+
+#include "simulationio.h"
+#include "segmentio.h"
+#include "organism.h"
+#include "organismtools.h"
+#include "meshtester.h"
+#include "oworld.h"
+#include "cell.h"
+#include "edge.h"
+#include "profile.h"
+
+const int NUM_FRAMES = 20;
+
+struct Output
+{
+	std::string name;
+	std::list<SegmentWriter*> segmentWriters;
+	std::ofstream out;
+
+	Output(std::string n, Organism* o, std::string version, unsigned int keyframeInterval = 50)
+	:name(n)
+	{
+		MeshSegmentIO* mio = new MeshSegmentIO(o->mesh(),version);
+		mio->keyframeInterval = keyframeInterval;
+		segmentWriters.push_back(mio);
+		if (not o->cells().empty())
+			segmentWriters.push_back(new OrganismSegmentIO(o));
+
+		SimulationIO_Base::SimulationHeader header;
+		header.frameDataFileName = name + ".bin";
+		header.comments = std::string("Topology Delta Test");
+		header.worldBounds = AABB(-100,-100,-100,100,100,100);
+		SimulationWriter::writeSimulationHeader(name+".cfg", header, segmentWriters);
+		std::remove(SimulationWriter::frameIndexFileName(header.frameDataFileName).c_str());
+
+		out.open(header.frameDataFileName.c_str(), std::ios::binary);
+		assert(out);
+		SimulationWriter::writeFrameDataHeader(out);
+	}
+
+	void write(int frame)
+	{
+		SimulationWriter::writeFrame(out, frame, frame*0.1, frame, segmentWriters);
+	}
+};
+
+// move things around a bit, as a simulation step would
+void perturb(Mesh* m, int frame)
+{
+	int i = 0;
+	BOOST_FOREACH(Vertex* v, m->vertices())
+	{
+		v->addF(Vector3d(0,-1,0));
+		v->addM(0.001);
+		v->addX(Vector3d(0.01,-0.02,0.005) + Vector3d(1e-4*((i+frame)%3),0,1e-4*(i%5)));
+		i++;
+	}
+	BOOST_FOREACH(Edge* e, m->edges())
+		e->setRest(e->rest()*1.01);
+	BOOST_FOREACH(Tetra* t, m->tetras())
+		t->setRest(t->rest()*1.02);
+	m->vertices().front()->setFrozen(frame%2==0);
+}
+
+// the loaded frame, serialised in full
+std::string loadFrame(SimulationLoader& loader, int f)
+{
+	assert(loader.setFrame(f));
+
+	Mesh* m = new Mesh();
+	MeshSegmentIO ml(m);
+	assert(loader.initialiseSegmentLoader(&ml));
+	loader.loadSegment(&ml);
+
+	std::ostringstream oss(std::ios::binary);
+	m->bWriteFull(oss);
+	m->bWriteSpringMultipliers(oss);
+	m->bWriteFrozenVerts(oss);
+
+	Organism* o = new Organism(m);
+	OrganismSegmentIO oio(o);
+	loader.initialiseSegmentLoader(&oio);
+	loader.loadSegment(&oio);
+	o->bWrite(oss);
+	delete o;
+
+	return oss.str();
+}
+
+void testFrames()
+{
+	Organism* o = OrganismTools::loadOneTet();
+	o->setProcessModel(ProcessModel::create("NoProcessModel"));
+
+	Output full("topodelta_full", o, "19042010");
+	Output delta("topodelta_delta", o, "topodelta", 6);
+
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		perturb(o->mesh(),i);
+
+		// change the topology
+		if (i==7)
+		{
+			Vertex* v = new Vertex(Vector3d(0,2,0));
+			o->mesh()->addVertex(v);
+			o->mesh()->addEdge(new Edge(v,o->mesh()->vertices().front(),1));
+		}
+		else if (i==12)
+		{
+			Edge* e = o->mesh()->edges().back();
+			o->mesh()->removeEdge(e);
+			delete e;
+		}
+		// and a spring coefficient, which is only stored in keyframes
+		else if (i==15)
+			o->mesh()->edges().front()->setSpringCoefficient(3);
+
+		full.write(i);
+		delta.write(i);
+	}
+	full.out.close();
+	delta.out.close();
+	std::cout << "mesh has " << o->mesh()->vertices().size() << " vertices after the topology changes\n";
+
+	SimulationLoader fullLoader(full.name + ".cfg");
+	SimulationLoader deltaLoader(delta.name + ".cfg");
+	assert(fullLoader.countFrames()==NUM_FRAMES);
+	assert(deltaLoader.countFrames()==NUM_FRAMES);
+
+	// in order, then jumping around
+	for(int i=0;i<2*NUM_FRAMES;i++)
+	{
+		int f = (i<NUM_FRAMES) ? i : ((i*7)%NUM_FRAMES);
+		assert(loadFrame(fullLoader,f)==loadFrame(deltaLoader,f));
+	}
+
+	std::cout << "frame data: " << boost::filesystem::file_size(full.name + ".bin") << " bytes for \"19042010\", "
+		<< boost::filesystem::file_size(delta.name + ".bin") << " bytes for \"topodelta\"\n";
+
+	delete o;
+}
+
+double write(Output& output, Organism* o)
+{
+	double start = Profile::now();
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		perturb(o->mesh(),i);
+		output.write(i);
+	}
+	output.out.close();
+	return Profile::now() - start;
+}
+
+// load every frame in order, each into a new mesh (as FrameCache does)
+double read(Output& output)
+{
+	SimulationLoader loader(output.name + ".cfg");
+	assert(loader.countFrames()==NUM_FRAMES);
+
+	double start = Profile::now();
+	for(int i=0;i<NUM_FRAMES;i++)
+	{
+		assert(loader.setFrame(i));
+		Mesh* m = new Mesh();
+		MeshSegmentIO ml(m);
+		assert(loader.initialiseSegmentLoader(&ml));
+		loader.loadSegment(&ml);
+		delete m;
+	}
+	return Profile::now() - start;
+}
+
+void bench(int n)
+{
+	Organism* o = new Organism(MeshTester::cube(n,n,n,1));
+
+	Output full("topodelta_full", o, "19042010");
+	double tFull = write(full,o);
+	Output delta("topodelta_delta", o, "topodelta");
+	double tDelta = write(delta,o);
+
+	double rFull = read(full);
+	double rDelta = read(delta);
+
+	boost::uintmax_t sFull = boost::filesystem::file_size(full.name + ".bin");
+	boost::uintmax_t sDelta = boost::filesystem::file_size(delta.name + ".bin");
+
+	std::cout << "cube(" << n << "," << n << "," << n << "), " << NUM_FRAMES << " frames: "
+		<< "19042010 " << sFull << " bytes " << tFull << "s, "
+		<< "topodelta " << sDelta << " bytes " << tDelta << "s, "
+		<< "size ratio " << std::setprecision(3) << double(sFull)/sDelta << "\n"
+		<< "  reading every frame: 19042010 " << rFull << "s, topodelta " << rDelta << "s\n";
+
+	delete o;
+}
+
+int main(int argc, char** argv)
+{
+	testFrames();
+	bench(8);
+	bench(16);
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
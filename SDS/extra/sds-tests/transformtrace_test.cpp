@@ -0,0 +1,118 @@
+/*
+ * Checks the trace of the transformations (see TransformTrace).
+ *
+ * Divides cells of a lattice, and checks that the properties converted from the trace name the
+ * transformation, that the transformations of a step are counted whether or not the trace is
+ * enabled, and that nothing is recorded while it is disabled. Then checks that the ring buffer
+ * only keeps the last events, and their values.
+ */
+
+#include "organismtools.h"
+#include "organism.h"
+#include "meshtester.h"
+#include "mesh.h"
+#include "cell.h"
+#include "transform.h"
+#include "transformtrace.h"
+#include "simulationcontext.h"
+
+#include <iostream>
+#include <string>
+#include <list>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+const int LATTICE = 3;
+const unsigned int CAPACITY = 8;
+
+// an inner cell of o
+Cell* innerCell(Organism* o)
+{
+	BOOST_FOREACH(Cell* c, o->cells())
+		if (not c->isBoundary()) return c;
+	return NULL;
+}
+
+// the name of the transformation in pl
+std::string transformation(PropertyList& pl)
+{
+	std::list<PropertyList::value_type> names = pl.properties("Transformation");
+	assert(names.size()==1);
+	return boost::any_cast<std::string>(names.front());
+}
+
+int main()
+{
+	SimulationContext context;
+	SimulationContext::Scope scope(context);
+	TransformTrace& trace = Transform::trace();
+	assert(&trace==&context.transformTrace);
+	assert(trace.enabled());
+
+	Organism* o = OrganismTools::fromMesh(MeshTester::cube(LATTICE,LATTICE,LATTICE,1));
+
+	// with the trace enabled
+	{
+		Transform::clearAllProperties();
+		assert(Transform::allProperties().empty());
+
+		Cell* c = innerCell(o);
+		assert(c!=NULL);
+		Transform::Divide(c,Vector3d(1,0,0),o);
+		assert(not Transform::hasError());
+		assert(trace.transformations()==1);
+
+		std::list<PropertyList> all = Transform::allProperties();
+		assert(all.size()==1);
+		std::string name = transformation(all.front());
+		std::cout << "divided with " << name << "\n";
+		assert(name.find("Divide")==0);
+
+		// (the last transformation is the one finished)
+		PropertyList last = Transform::properties();
+		assert(transformation(last)==name);
+		assert(last.all().size()==all.front().all().size());
+	}
+
+	// with the trace disabled
+	{
+		trace.setEnabled(false);
+		Transform::clearAllProperties();
+		Transform::Divide(innerCell(o),Vector3d(0,1,0),o);
+		assert(not Transform::hasError());
+		assert(trace.transformations()==1);
+		assert(Transform::allProperties().empty());
+		trace.setEnabled(true);
+	}
+	assert(o->mesh()->isSane());
+
+	// the ring buffer keeps the last CAPACITY events (begin, 2 properties, end for each transformation)
+	{
+		TransformTrace t(CAPACITY);
+		const char* names[] = {"a","b","c","d","e"};
+		for(int i=0;i<5;i++)
+		{
+			t.begin();
+			t.add("Transformation").text(names[i]);
+			t.add("index ").at(i);
+			t.end();
+		}
+		assert(t.transformations()==5);
+		std::list<PropertyList> all = t.allProperties();
+		assert(all.size()==2);
+		assert(transformation(all.front())=="d");
+		assert(transformation(all.back())=="e");
+		assert(all.back().properties("index 4").size()==1);
+
+		PropertyList last = t.properties();
+		assert(transformation(last)=="e");
+
+		t.clearStep();
+		assert(t.transformations()==0);
+		assert(t.allProperties().empty());
+	}
+
+	std::cout << "Test Passed.\n";
+	return 0;
+}
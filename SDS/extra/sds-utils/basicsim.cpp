@@ -8,18 +8,31 @@
 #include <fstream>
 #include <string>
 #include <ctime>
+#include <algorithm>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
 
 #include "simulationio.h"
 #include "segmentio.h"
+#include "framewriter.h"
 #include "organismtools.h"
 #include "sdssimulation.h"
 #include "physics.h"
+#include "collision.h"
 
 namespace po = boost::program_options;
 
+// write the substeps profiled since the last call to out, and forget them
+void flushProfile(Profile& profile, std::ofstream& out, bool json)
+{
+	if (!out.is_open()) return;
+	if (json) profile.writeJSON(out);
+	else profile.writeCSV(out);
+	out.flush();
+	profile.clear();
+}
+
 int main(int argc, char** argv)
 {
 	std::string input, output;
@@ -27,6 +40,11 @@ int main(int argc, char** argv)
 	int numFrames;
 	int stepsPerFrame;
 	bool dirty = false;
+	bool adaptive = false;
+	int threads;
+	int writeQueue;
+	std::string profileFile;
+	std::string integrator;
 
 	AABB bounds;
 
@@ -49,6 +67,12 @@ int main(int argc, char** argv)
 		("numFrames", po::value<int>(&numFrames)->default_value(100), "number of frames to simulate (default = 100)")
 		("stepsPerFrame", po::value<int>(&stepsPerFrame)->default_value(1), "number of simulator steps to take per frame (default==1)")
 		("dirty", "Try to fix errors in a hacky way -- may result in a longer simulation but with stranger results")
+		("threads", po::value<int>(&threads)->default_value(1), "number of threads used to compute forces and collisions (0 = all cores, default==1)")
+		("deterministic", "when using more than one thread, give exactly the same results as a single thread (a bit slower)")
+		("integrator", po::value<std::string>(&integrator), "\"verlet\" or \"implicit\" (backward Euler, for larger steps with stiff springs), instead of the one in the simulation header")
+		("adaptive", "choose the size of each step from an estimate of its error (starting at the one in the simulation header), and take unstable steps again with smaller ones instead of quitting")
+		("profile", po::value<std::string>(&profileFile), "write the time of each phase of each substep to this file (CSV, or one JSON object per line if it ends in .json)")
+		("writeQueue", po::value<int>(&writeQueue)->default_value(0), "number of frames that can wait to be written to disk by a background thread (0 = write each frame before continuing, default==0)")
 	;
 
 	try
@@ -66,6 +90,11 @@ int main(int argc, char** argv)
 		{
 			dirty = true;
 		}
+		adaptive = vm.count("adaptive")>0;
+
+		Physics::NUM_THREADS = threads;
+		Collision::NUM_THREADS = threads;
+		Physics::DETERMINISTIC = vm.count("deterministic")>0;
 
 		if (vm.count("input")==0)
 		{
@@ -88,6 +117,8 @@ int main(int argc, char** argv)
 	{
 		SimulationLoader loader(input);
 		SimulationIO_Base::SimulationHeader hdr = loader.simulationHeader();
+		if (not integrator.empty())
+			hdr.integrator = integrator;
 
 		if (!(loader.hasSegment("mesh") and
 			loader.hasSegment("organism") and
@@ -139,11 +170,8 @@ int main(int argc, char** argv)
 				frame = loader.countFrames()-1;
 			}
 
-			// skip forward to the required frame
-			for(int i=0;i<frame;i++)
-			{
-				if (!loader.nextFrame()) throw(std::runtime_error("Simulation file doesn't have that many frames."));
-			}
+			// jump to the required frame
+			if (!loader.setFrame(frame)) throw(std::runtime_error("Simulation file doesn't have that many frames."));
 
 			SimulationIO_Base::FrameHeader frame = loader.currentFrame();
 
@@ -159,6 +187,9 @@ int main(int argc, char** argv)
 				simulation->setContinueOnError(true);
 
 			simulation->initialiseFromHeader(hdr);
+			simulation->setAdaptiveStepping(adaptive);
+			// (nothing reads what the transformations have done)
+			simulation->transformTrace().setEnabled(false);
 
 			std::cout << "Comments\n"
 					  << "--------\n"
@@ -213,7 +244,7 @@ int main(int argc, char** argv)
 			header.comments = fullCommandLine;
 
 			// build the segment writers
-			MeshSegmentIO* outmio = new MeshSegmentIO(simulation->world()->organism()->mesh());
+			MeshSegmentIO* outmio = new MeshSegmentIO(simulation->world()->organism()->mesh(),"topodelta");
 			OrganismSegmentIO* outoio = new OrganismSegmentIO(simulation->world()->organism());
 			ProcessModelSegmentIO* outpio = new ProcessModelSegmentIO(simulation->world()->organism());
 
@@ -234,19 +265,27 @@ int main(int argc, char** argv)
 			// dump the header
 			SimulationWriter::writeSimulationHeader(output+".cfg", header, segmentWriters, staticSegmentWriters);
 
-			// open the binary file
-			std::ofstream outputFile;
-			outputFile.open(header.frameDataFileName.c_str(),std::ios::binary);
-			if (!outputFile)
+			// open the binary file (and the frame index)
+			FrameWriter frameWriter(header.frameDataFileName, segmentWriters, staticSegmentWriters, std::max(writeQueue,0));
+			if (not frameWriter.good())
 			{
 				std::cerr << "Cannot open \"" << header.frameDataFileName << "\" for output!\nQuitting...";
 				return 1;
 			}
-			else
+
+			// and the profile
+			std::ofstream profileOutput;
+			bool profileJSON = profileFile.size()>=5 and profileFile.substr(profileFile.size()-5)==".json";
+			if (not profileFile.empty())
 			{
-				SimulationWriter::writeFrameDataHeader(outputFile);
-				if (not staticSegmentWriters.empty())
-					SimulationWriter::writeStaticSegments(outputFile, staticSegmentWriters);
+				profileOutput.open(profileFile.c_str());
+				if (!profileOutput)
+				{
+					std::cerr << "Cannot open \"" << profileFile << "\" for output!\nQuitting...";
+					return 1;
+				}
+				if (not profileJSON) simulation->profile().writeCSVHeader(profileOutput);
+				simulation->profile().setEnabled(true);
 			}
 
 			// start the simulation
@@ -257,8 +296,14 @@ int main(int argc, char** argv)
 			while(true)
 			{
 				bool hasCompletedAStep = simulation->substep();
+
+				// (the profile only holds the last capacity() substeps)
+				if (simulation->profile().size()==simulation->profile().capacity())
+					flushProfile(simulation->profile(),profileOutput,profileJSON);
+
 				if (simulation->state()==simulation->UNSTABLE)
 				{
+					flushProfile(simulation->profile(),profileOutput,profileJSON);
 					std::cout << "Simulation has become unstable. Quitting...\n";
 					return 0;
 				}
@@ -267,24 +312,9 @@ int main(int argc, char** argv)
 				{
 					if ((stepNumber)%stepsPerFrame == 0)
 					{
-						// output current frame
-						// first compute frame size by writing the segment data to a temporary buffer
+						// output current frame (it is written to disk while simulating the next ones)
 						std::cout << "Computed frame " <<  frameNumber << std::endl;
-						std::ostringstream oss(std::ios::binary);
-						BOOST_FOREACH(SegmentWriter* sw, segmentWriters)
-							SimulationWriter::writeSegment(oss, *sw);
-						std::string os = oss.str();
-
-						// then construct the appropriate header
-						SimulationIO_Base::FrameHeader fhdr;
-						fhdr.sizeInBytes = (unsigned int)(os.length());
-						fhdr.number = frameNumber;
-						fhdr.time = simulation->t();
-						fhdr.step = simulation->steps();
-
-						// now write the frame header and frame data to out
-						SimulationWriter::writeFrameHeader(outputFile,fhdr);
-						outputFile << os;
+						frameWriter.write(frameNumber, simulation->t(), simulation->steps());
 
 						// increase frame number
 						frameNumber++;
@@ -299,6 +329,13 @@ int main(int argc, char** argv)
 				}
 			}
 
+			flushProfile(simulation->profile(),profileOutput,profileJSON);
+			frameWriter.flush();
+			if (not frameWriter.good())
+			{
+				std::cerr << "Couldn't write all the frames to \"" << header.frameDataFileName << "\"!\n";
+				return 1;
+			}
 			std::cout << "Complete.\n";
 		}
 	}
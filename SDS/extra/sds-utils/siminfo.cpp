@@ -20,6 +20,7 @@
 
 #include "simulationio.h"
 #include "segmentio.h"
+#include "framemap.h"
 #include "face.h"
 #include "cell.h"
 #include "processmodel.h"
@@ -30,6 +31,8 @@ namespace po = boost::program_options;
 namespace fi = boost::filesystem;
 
 void dumpMeshAsPly(Mesh* m, std::string filename);
+void dumpMeshAsPly(const MeshView& m, const MeshTopology& t, std::string filename);
+int scan(std::string file, std::string directory, int skip, bool dumpMesh);
 
 int main(int argc, char** argv)
 {
@@ -39,6 +42,7 @@ int main(int argc, char** argv)
 	bool dumpMesh = false;
 	bool dumpMorphogens = false;
 	bool countFrames = false;
+	bool scanFrames = false;
 
 	// set up command line options
 	po::options_description desc("Allowed options");
@@ -50,6 +54,7 @@ int main(int argc, char** argv)
 		("skip,s", po::value<int>(&skip)->default_value(0), "skip N frames per frame") 
 		("morphogens", "Dump morphogen values to stdout")
 		("count,c", "Count the number of frames in the file.")
+		("scan", "Only output the counts and bounds (and surface meshes) of the frames, read straight from the frame data without loading them. Much faster for long simulations.")
 	;
 
 	try
@@ -77,6 +82,9 @@ int main(int argc, char** argv)
 
 		if (vm.count("count")>0)
 			countFrames = true;
+
+		if (vm.count("scan")>0)
+			scanFrames = true;
 	}
 	catch(...) // due to probs with program_options, gcc, and fvisibility, we can't see the exception being thrown
 	{
@@ -84,6 +92,9 @@ int main(int argc, char** argv)
 		return 1;
 	}
 
+	if (scanFrames)
+		return scan(file,directory,skip,dumpMesh);
+
 	try
 	{
 		SimulationLoader loader(file);
@@ -291,6 +302,80 @@ int main(int argc, char** argv)
 	return 0;
 }
 
+/**
+ * Outputs the counts and bounds of each frame, read through a FrameMap.
+ * The surface meshes are dumped with the topology of their keyframe.
+ */
+int scan(std::string file, std::string directory, int skip, bool dumpMesh)
+{
+	try
+	{
+		FrameMap map(file);
+		std::cout << "Loaded " << file << "\n";
+
+		bool hasMesh = map.segmentIndex(MeshSegmentIO::type) >= 0;
+		MeshTopology topology;
+		int keyframe = -1;
+		for(int f=0;f<map.numberOfFrames();f+=skip+1)
+		{
+			SimulationIO_Base::FrameHeader frame = map.frameHeader(f);
+			std::cout << "Frame " << frame.number << "\n"
+
+					<< "\n\tt: " << frame.time << "s"
+					<< "\n\tsize: " << frame.sizeInBytes << "b"
+					<< "\n\tstep: " << frame.step << "\n";
+
+			if (not hasMesh) continue;
+
+			MeshView m;
+			if (not map.mesh(f,m))
+			{
+				std::cout << "Couldn't read the mesh of frame " << frame.number << ".\n";
+				return 1;
+			}
+
+			// (reading the keyframe may unmap the mesh, so it is read again)
+			if (dumpMesh and keyframe!=(int)(f - m.keyframeDistance()))
+			{
+				keyframe = f - m.keyframeDistance();
+				MeshView key;
+				if (not (map.mesh(keyframe,key) and key.topology(topology)))
+				{
+					std::cout << "Couldn't read the mesh of keyframe " << keyframe << ".\n";
+					return 1;
+				}
+				map.mesh(f,m);
+			}
+
+			std::cout << "mesh\n";
+			std::cout << "# vertices: " << m.numberOfVertices() << "\n";
+			std::cout << "# edges: " << m.numberOfEdges() << "\n";
+			std::cout << "# tetras: " << m.numberOfTetras() << "\n";
+			std::cout << "aabb ";
+			AABB aabb = m.aabb();
+			for(int i=0;i<6;i++)
+			{
+				std::cout << aabb[i] << ", ";
+			}
+			std::cout << "\n";
+
+			if (dumpMesh)
+			{
+				std::ostringstream oss;
+				oss << std::setw(5) << std::setfill('0') << frame.number;
+				fi::path target = fi::path(directory) / fi::path(oss.str() + ".ply");
+				dumpMeshAsPly(m,topology,target.file_string());
+			}
+		}
+	}
+	catch (SimulationLoader::LoadException& le)
+	{
+		std::cout << le.why() << "\n";
+		return 1;
+	}
+	return 0;
+}
+
 /*
  * ply
 format ascii 1.0           { ascii/binary, format version number }
@@ -368,3 +453,69 @@ void dumpMeshAsPly(Mesh* m, std::string filename)
 			<< vm[&f->v(2)] << "\n";
 	}
 }
+
+/**
+ * As above, from a mesh segment and the topology of its keyframe.
+ */
+void dumpMeshAsPly(const MeshView& m, const MeshTopology& t, std::string filename)
+{
+	std::ofstream file;
+	file.open(filename.c_str(),std::ios::binary);
+	if (!file)
+		return;
+
+	std::vector<Vector3d> x;
+	m.positions(x);
+
+	// the normal of a vertex is the sum of the normals of its faces (as Vertex::n)
+	std::vector<Vector3d> n(x.size(),Vector3d::ZERO);
+	for(unsigned int i=0;i<t.faces.size();i+=3)
+	{
+		const unsigned int* v = &t.faces[i];
+		Vector3d fn = cross(x[v[1]]-x[v[0]],x[v[2]]-x[v[0]]).normaliseInPlace();
+		for(int j=0;j<3;j++)
+			n[v[j]] += fn;
+	}
+
+	int countSurfaceVerts = 0;
+	for(unsigned int i=0;i<x.size();i++)
+	{
+		if (t.surface[i]) countSurfaceVerts++;
+	}
+
+	file << "ply\n"
+			<< "format ascii 1.0\n"
+			<< "comment made by siminfo\n"
+			<< "element vertex " << countSurfaceVerts << "\n"
+			<< "property float x\n"
+			<< "property float y\n"
+			<< "property float z\n"
+			<< "property float nx\n"
+			<< "property float ny\n"
+			<< "property float nz\n"
+			<< "element face " << t.faces.size()/3 << "\n"
+			<< "property list uchar int vertex_index\n"
+			<< "end_header\n";
+
+	std::vector<int> vm(x.size(),-1);
+	int index = 0;
+	for(unsigned int i=0;i<x.size();i++)
+	{
+		if (t.surface[i])
+		{
+			vm[i] = index;
+			index++;
+			n[i].normaliseInPlace();
+			file << x[i].x() << " " << x[i].y() << " " << x[i].z() << " "
+				<< n[i].x() << " " << n[i].y() << " " << n[i].z() << "\n";
+		}
+	}
+
+	for(unsigned int i=0;i<t.faces.size();i+=3)
+	{
+		file << "3 "
+			<< vm[t.faces[i]] << " "
+			<< vm[t.faces[i+1]] << " "
+			<< vm[t.faces[i+2]] << "\n";
+	}
+}
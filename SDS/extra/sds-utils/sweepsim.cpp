@@ -0,0 +1,533 @@
+/**
+ * A command-line simulator for parameter sweeps.
+ *
+ * Runs many variants of one simulation, which differ only in the physical
+ * parameters of the header (kD, kV, kDamp, viscosity, ...) or in the parameters
+ * of the process model (see ProcessModel::set).
+ *
+ * The input is read once: the organism and the static meshes are loaded once, each
+ * run simulates a copy of the organism (see Organism::copy) and shares the static meshes.
+ * The runs are spread over the cores, each has its own SimulationContext.
+ *
+ * Each run writes its own simulation (<output>.<run>.cfg and .bin), and a row
+ * of <output>.summary.csv (the parameters, steps, wall time, final number of
+ * cells and why it failed, if it did).
+ *
+ * e.g., sweepsim -i limb.cfg -o sweep --set kD=1,2,4 --set kV=2,4 --set diffusion=.1,.2
+ * runs the 12 combinations.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/program_options.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "simulationio.h"
+#include "segmentio.h"
+#include "simulationcontext.h"
+#include "sdssimulation.h"
+#include "organism.h"
+#include "oworld.h"
+#include "physics.h"
+#include "collision.h"
+
+namespace po = boost::program_options;
+
+// the parameter values of a run (which aren't taken from the input)
+typedef std::map<std::string,double> Run;
+
+// the parameters which are in the simulation header, the rest belong to the process model
+const char* HEADER_PARAMETERS[] = {"kD", "kSM", "kV", "kDamp", "density", "viscosity", "gravity", "dt", "collisionInterval"};
+const int NUM_HEADER_PARAMETERS = sizeof(HEADER_PARAMETERS)/sizeof(HEADER_PARAMETERS[0]);
+
+bool isHeaderParameter(const std::string& name)
+{
+	for(int i=0;i<NUM_HEADER_PARAMETERS;i++)
+		if (name==HEADER_PARAMETERS[i]) return true;
+	return false;
+}
+
+void setHeaderParameter(SimulationIO_Base::SimulationHeader& hdr, const std::string& name, double value)
+{
+	if (name=="kD") hdr.kD = value;
+	else if (name=="kSM") hdr.kSM = value;
+	else if (name=="kV") hdr.kV = value;
+	else if (name=="kDamp") hdr.kDamp = value;
+	else if (name=="density") hdr.density = value;
+	else if (name=="viscosity") hdr.viscosity = value;
+	else if (name=="gravity") hdr.gravity = value;
+	else if (name=="dt") hdr.dt = value;
+	else if (name=="collisionInterval") hdr.collisionInterval = (int)value;
+}
+
+/// parse "name=value"
+std::pair<std::string,std::string> parseAssignment(const std::string& s)
+{
+	std::string::size_type eq = s.find('=');
+	if (eq==std::string::npos or eq==0)
+		throw std::runtime_error("Expected name=value, not \"" + s + "\"");
+	return std::make_pair(boost::trim_copy(s.substr(0,eq)),boost::trim_copy(s.substr(eq+1)));
+}
+
+double parseValue(const std::string& s)
+{
+	try
+	{
+		return boost::lexical_cast<double>(boost::trim_copy(s));
+	}
+	catch(boost::bad_lexical_cast&)
+	{
+		throw std::runtime_error("Not a number: \"" + s + "\"");
+	}
+}
+
+/// the runs listed in a file, one per line, e.g., "kD=2 kV=4 diffusion=.1"
+std::vector<Run> readRuns(std::string file)
+{
+	std::ifstream in(file.c_str());
+	if (!in) throw std::runtime_error("Can't open the list of runs \"" + file + "\"");
+
+	std::vector<Run> runs;
+	std::string line;
+	while (std::getline(in,line))
+	{
+		boost::trim(line);
+		if (line.empty() or line[0]=='#') continue;
+
+		std::vector<std::string> assignments;
+		boost::split(assignments,line,boost::is_any_of(" \t"),boost::token_compress_on);
+
+		Run run;
+		BOOST_FOREACH(std::string a, assignments)
+		{
+			std::pair<std::string,std::string> p = parseAssignment(a);
+			run[p.first] = parseValue(p.second);
+		}
+		runs.push_back(run);
+	}
+	return runs;
+}
+
+/// every run with every value of a parameter, from "name=v1,v2,..."
+std::vector<Run> sweep(const std::vector<Run>& runs, std::string set)
+{
+	std::pair<std::string,std::string> p = parseAssignment(set);
+	std::vector<std::string> values;
+	boost::split(values,p.second,boost::is_any_of(","));
+
+	std::vector<Run> result;
+	BOOST_FOREACH(const Run& run, runs)
+		BOOST_FOREACH(std::string v, values)
+		{
+			Run r = run;
+			r[p.first] = parseValue(v);
+			result.push_back(r);
+		}
+	return result;
+}
+
+// the outcome of a run (a row of the summary)
+struct Result
+{
+	std::string state;
+	int steps;
+	int frames;
+	double time;
+	double wallTime;
+	int cells;
+	std::string error;
+
+	Result():state("complete"),steps(0),frames(0),time(0),wallTime(0),cells(0){}
+};
+
+std::string csvQuote(std::string s)
+{
+	boost::replace_all(s,"\"","\"\"");
+	boost::replace_all(s,"\n"," ");
+	return "\"" + s + "\"";
+}
+
+// everything the runs share, which is read in once
+struct Input
+{
+	SimulationIO_Base::SimulationHeader header;
+	Organism* organism;
+	std::list<Mesh*> staticMeshes;
+	// the static segments, as they are written to each run's frame data
+	std::string staticSegments;
+};
+
+void simulate(const Input& in, const Run& run, std::string output, int numFrames, int stepsPerFrame, bool dirty, std::string comments, Result& result)
+{
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+	SimulationContext context;
+	SDSSimulation simulation(&context);
+	if (dirty)
+		simulation.setContinueOnError(true);
+
+	// the static meshes have already been loaded
+	SimulationIO_Base::SimulationHeader hdr = in.header;
+	hdr.staticMeshes.clear();
+	ProcessModel* pm = NULL;
+	Organism* o = NULL;
+
+	// (copying writes the vertex map of the organism's mesh)
+	#pragma omp critical(sweepsim_copy)
+	{
+		pm = in.organism->processModel() ? in.organism->processModel()->copy() : NULL;
+		o = in.organism->copy(pm);
+	}
+
+	BOOST_FOREACH(const Run::value_type& p, run)
+	{
+		if (isHeaderParameter(p.first))
+			setHeaderParameter(hdr,p.first,p.second);
+		else
+			pm->set(p.first,p.second);
+	}
+
+	simulation.initialiseFromHeader(hdr);
+	BOOST_FOREACH(Mesh* m, in.staticMeshes)
+		simulation.addSharedStaticMesh(m);
+
+	OWorld* ow = new OWorld();
+	ow->addOrganism(o);
+	ow->setBounds(hdr.worldBounds);
+	simulation.setWorld(ow);
+
+	// dump the simulation header and set up the segment writers
+	SimulationIO_Base::SimulationHeader header;
+	simulation.writeHeader(header);
+	header.frameDataFileName = output + ".bin";
+	header.comments = comments;
+
+	MeshSegmentIO outmio(o->mesh(),"topodelta");
+	OrganismSegmentIO outoio(o);
+	ProcessModelSegmentIO outpio(o);
+	std::list<SegmentWriter*> segmentWriters;
+	segmentWriters.push_back(&outmio);
+	segmentWriters.push_back(&outoio);
+	segmentWriters.push_back(&outpio);
+
+	// (only their types are written to the header)
+	std::list<SegmentWriter*> staticSegmentWriters;
+	BOOST_FOREACH(Mesh* m, in.staticMeshes)
+		staticSegmentWriters.push_back(new MeshSegmentIO(m));
+
+	SimulationWriter::writeSimulationHeader(output+".cfg", header, segmentWriters, staticSegmentWriters);
+	BOOST_FOREACH(SegmentWriter* sw, staticSegmentWriters) delete sw;
+
+	std::ofstream outputFile(header.frameDataFileName.c_str(),std::ios::binary);
+	if (!outputFile)
+		throw std::runtime_error("Cannot open \"" + header.frameDataFileName + "\" for output");
+	SimulationWriter::writeFrameDataHeader(outputFile);
+	outputFile << in.staticSegments;
+
+	std::ofstream outputIndexFile(SimulationWriter::frameIndexFileName(header.frameDataFileName).c_str(),std::ios::binary);
+	SimulationWriter::writeFrameIndexHeader(outputIndexFile);
+
+	int stepNumber = 0;
+	while (result.frames < numFrames)
+	{
+		bool hasCompletedAStep = simulation.substep();
+		if (simulation.state()==SDSSimulation::UNSTABLE)
+		{
+			result.state = "unstable";
+			result.error = simulation.getErrorMessage();
+			break;
+		}
+
+		if (hasCompletedAStep)
+		{
+			if (stepNumber%stepsPerFrame == 0)
+			{
+				SimulationIO_Base::FrameHeader fhdr;
+				fhdr.number = result.frames;
+				fhdr.time = simulation.t();
+				fhdr.step = simulation.steps();
+
+				boost::uint64_t offset = outputFile.tellp();
+				SimulationWriter::writeFrame(outputFile,fhdr.number,fhdr.time,fhdr.step,segmentWriters);
+
+				// index it after the frame, as basicsim does
+				SimulationWriter::writeFrameIndexEntry(outputIndexFile,offset,fhdr);
+				result.frames++;
+			}
+			stepNumber++;
+		}
+	}
+
+	result.steps = simulation.steps();
+	result.time = simulation.t();
+	result.cells = o->cells().size();
+	result.wallTime = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds()*1e-6;
+}
+
+int main(int argc, char** argv)
+{
+	std::string input, output, runsFile, summaryFile;
+	std::vector<std::string> sets;
+	int frame;
+	int numFrames;
+	int stepsPerFrame;
+	bool dirty = false;
+	int jobs;
+
+	std::string fullCommandLine = std::string(argv[0]);
+	for(int i=1;i<argc;i++)
+	{
+		fullCommandLine += " ";
+		fullCommandLine += argv[i];
+	}
+
+	// set up command line options
+	po::options_description desc("Allowed options");
+	desc.add_options()
+		("help", "produce help message")
+		("input,i", po::value<std::string>(&input), "input simulation header (*.cfg)")
+		("output,o", po::value<std::string>(&output), "output file prefix (generates <output>.<run>.cfg and .bin files, and <output>.summary.csv.) Default is \"input.sweep\"")
+		("set,s", po::value<std::vector<std::string> >(&sets)->composing(), "sweep a parameter over a list of values, e.g., kD=1,2,4 (can be repeated, every combination is run)")
+		("runs,r", po::value<std::string>(&runsFile), "file listing the runs, one per line, e.g., \"kD=2 kV=4\" (combined with any --set)")
+		("summary", po::value<std::string>(&summaryFile), "summary file (default = <output>.summary.csv)")
+		("startFrame", po::value<int>(&frame)->default_value(0), "frame from input simulation to use as the start of the runs (-1 indicates the last frame)")
+		("numFrames", po::value<int>(&numFrames)->default_value(100), "number of frames to simulate in each run (default = 100)")
+		("stepsPerFrame", po::value<int>(&stepsPerFrame)->default_value(1), "number of simulator steps to take per frame (default==1)")
+		("dirty", "Try to fix errors in a hacky way -- may result in a longer simulation but with stranger results")
+		("jobs,j", po::value<int>(&jobs)->default_value(0), "number of runs simulated at once (0 = all cores, default==0)")
+	;
+
+	std::vector<Run> runs(1);
+	try
+	{
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help")) {
+			std::cout << desc << "\n"
+				<< "Parameters: " << boost::join(std::vector<std::string>(HEADER_PARAMETERS,HEADER_PARAMETERS+NUM_HEADER_PARAMETERS),", ")
+				<< ", or any parameter of the process model.\n";
+			return 1;
+		}
+
+		dirty = vm.count("dirty")>0;
+
+		if (vm.count("input")==0)
+		{
+			std::cout << "** Input file is required. **\n" << desc << "\n";
+			return 1;
+		}
+
+		if (vm.count("output")==0)
+			output = input + ".sweep";
+		if (vm.count("summary")==0)
+			summaryFile = output + ".summary.csv";
+	}
+	catch(...) // due to probs with program_options, gcc, and fvisibility, we can't see the exception being thrown
+	{
+		std::cout << "** Error parsing command line. **\n" << desc;
+		return 1;
+	}
+
+	try
+	{
+		if (not runsFile.empty())
+			runs = readRuns(runsFile);
+		BOOST_FOREACH(std::string s, sets)
+			runs = sweep(runs,s);
+
+		// the swept parameters, in order, for the summary
+		std::vector<std::string> names;
+		BOOST_FOREACH(const Run& run, runs)
+			BOOST_FOREACH(const Run::value_type& p, run)
+				if (std::find(names.begin(),names.end(),p.first)==names.end())
+					names.push_back(p.first);
+
+		// read in the input once
+		Input in;
+		SimulationLoader loader(input);
+		in.header = loader.simulationHeader();
+
+		if (!(loader.hasSegment("mesh") and
+			loader.hasSegment("organism") and
+			loader.hasSegment("processinfo")))
+		{
+			throw(std::runtime_error("Simulation file must contain mesh, organism and processinfo segments."));
+		}
+
+		ProcessModel* p = in.header.processModel;
+		BOOST_FOREACH(std::string name, names)
+		{
+			if (isHeaderParameter(name)) continue;
+			std::list<std::string> params;
+			if (p) params = p->parameters();
+			if (std::find(params.begin(),params.end(),name)==params.end())
+				throw std::runtime_error("\"" + name + "\" isn't a parameter of the simulation or of its process model");
+		}
+
+		// at the moment we just deal with Mesh type static objects
+		std::list<SegmentLoader*> staticSegmentLoaders;
+		std::list<Mesh*> segmentMeshes;
+		BOOST_FOREACH(std::string seg, loader.staticSegments())
+		{
+			if (seg!=MeshSegmentIO::type)
+			{
+				std::cerr << "Encountered a static object of type " << seg << ". Can only read \"mesh\" objects." << std::endl;
+			}
+			else
+			{
+				Mesh* m = new Mesh();
+				segmentMeshes.push_back(m);
+				staticSegmentLoaders.push_back(new MeshSegmentIO(m));
+			}
+		}
+
+		if (not loader.loadData())
+			throw std::runtime_error("Can't load the simulation data.");
+
+		if (not segmentMeshes.empty())
+		{
+			std::cout << "Reading in static mesh info ... ";
+			if (not loader.loadStaticSegments(staticSegmentLoaders))
+			{
+				std::cerr << "error!" << std::endl;
+				return -1;
+			}
+			std::cout << "finished." << std::endl;
+		}
+		BOOST_FOREACH(SegmentLoader* sl, staticSegmentLoaders) delete sl;
+
+		in.staticMeshes = segmentMeshes;
+		std::list<Mesh*> headerMeshes = SDSSimulation::loadStaticMeshes(in.header);
+		in.staticMeshes.insert(in.staticMeshes.end(),headerMeshes.begin(),headerMeshes.end());
+
+		// the static segments are the same in every run, so they are only written once
+		{
+			std::list<SegmentWriter*> staticSegmentWriters;
+			BOOST_FOREACH(Mesh* m, in.staticMeshes)
+				staticSegmentWriters.push_back(new MeshSegmentIO(m));
+			std::ostringstream oss(std::ios::binary);
+			SimulationWriter::writeStaticSegments(oss,staticSegmentWriters);
+			in.staticSegments = oss.str();
+			BOOST_FOREACH(SegmentWriter* sw, staticSegmentWriters) delete sw;
+		}
+
+		if (frame==-1)
+			frame = loader.countFrames()-1;
+
+		// jump to the required frame
+		if (!loader.setFrame(frame)) throw(std::runtime_error("Simulation file doesn't have that many frames."));
+
+		// read in organism data
+		Mesh* m = new Mesh();
+		MeshSegmentIO ml(m);
+		loader.initialiseSegmentLoader(&ml);
+		loader.loadSegment(&ml);
+
+		in.organism = new Organism(m);
+		OrganismSegmentIO oio(in.organism);
+		loader.initialiseSegmentLoader(&oio);
+		loader.loadSegment(&oio);
+
+		in.organism->setProcessModel(p);
+		if (p)
+		{
+			ProcessModelSegmentIO pml(in.organism);
+			if (loader.initialiseSegmentLoader(&pml))
+				loader.loadSegment(&pml);
+			else throw(std::runtime_error("Couldn't load process info!"));
+		}
+
+		std::ofstream summary(summaryFile.c_str());
+		if (!summary) throw std::runtime_error("Cannot open \"" + summaryFile + "\" for output");
+		summary << "run";
+		BOOST_FOREACH(std::string name, names)
+			summary << "," << name;
+		summary << ",state,steps,frames,time,wallTime,cells,error" << std::endl;
+		summary << std::setprecision(10);
+
+		// each run simulates with one thread, as the runs are simulated at the same time
+		Physics::NUM_THREADS = 1;
+		Collision::NUM_THREADS = 1;
+#ifdef _OPENMP
+		if (jobs <= 0) jobs = omp_get_max_threads();
+#else
+		jobs = 1;
+#endif
+
+		std::cout << "Simulating " << runs.size() << " runs, " << jobs << " at a time...\n";
+
+		const int numRuns = runs.size();
+		const int width = boost::lexical_cast<std::string>(numRuns-1).size();
+		int failed = 0;
+
+		#pragma omp parallel for schedule(dynamic) num_threads(jobs) reduction(+:failed)
+		for(int i=0;i<numRuns;i++)
+		{
+			std::ostringstream name;
+			name << output << "." << std::setw(width) << std::setfill('0') << i;
+
+			std::ostringstream comments;
+			comments << fullCommandLine << "\nrun " << i << ":";
+			BOOST_FOREACH(const Run::value_type& p, runs[i])
+				comments << " " << p.first << "=" << p.second;
+
+			Result result;
+			try
+			{
+				simulate(in,runs[i],name.str(),numFrames,stepsPerFrame,dirty,comments.str(),result);
+			}
+			catch(std::exception& e)
+			{
+				// (an exception can't leave the parallel loop)
+				result.state = "error";
+				result.error = e.what();
+			}
+			if (result.state!="complete") failed++;
+
+			#pragma omp critical(sweepsim_summary)
+			{
+				summary << i;
+				BOOST_FOREACH(std::string n, names)
+				{
+					summary << ",";
+					Run::const_iterator it = runs[i].find(n);
+					if (it!=runs[i].end()) summary << it->second;
+				}
+				summary << "," << result.state << "," << result.steps << "," << result.frames << "," << result.time
+					<< "," << result.wallTime << "," << result.cells << "," << csvQuote(result.error) << std::endl;
+
+				std::cout << "Run " << i << " " << result.state << " after " << result.steps << " steps ("
+					<< result.wallTime << "s)" << (result.error.empty() ? "" : ": " + result.error) << std::endl;
+			}
+		}
+
+		std::cout << "Complete, " << failed << " of " << numRuns << " runs failed.\n";
+	}
+	catch(std::runtime_error& e)
+	{
+		std::cerr << "Runtime Error: " << e.what() << std::endl;
+		return 1;
+	}
+	catch(std::exception& e)
+	{
+		std::cerr << "Unknown Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
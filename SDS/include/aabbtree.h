@@ -0,0 +1,58 @@
+#ifndef AABBTREE_H
+#define AABBTREE_H
+
+/* AABBTree: A bounding volume hierarchy over a fixed set of boxes.
+ * - Built once (top down, splitting at the median centre along the longest axis),
+ *   it doesn't support moving or adding boxes, rebuild it instead.
+ * - Items are referred to by the index of their box in the vector given to build().
+ *
+ * Used by Collision for the static meshes, which never move.
+ */
+
+#include "aabb.h"
+#include "vector3.h"
+
+#include <vector>
+
+class AABBTree
+{
+	public:
+
+	AABBTree();
+
+	void clear();
+	/// build the tree over boxes
+	void build(const std::vector<AABB>& boxes);
+
+	/// append the indices of the boxes that contain p to result
+	void query(const Vector3d& p, std::vector<unsigned int>& result) const;
+	/// append the indices of the boxes that overlap box to result
+	void query(const AABB& box, std::vector<unsigned int>& result) const;
+
+	inline unsigned int size() const {return mItems.size();}
+	inline bool empty() const {return mItems.empty();}
+	/// the bounds of all the boxes
+	inline const AABB& bounds() const {return mNodes.front().box;}
+
+	protected:
+
+	/// boxes per leaf
+	const static unsigned int LEAF_SIZE = 4;
+
+	struct Node
+	{
+		AABB box;
+		// an inner node has children mNodes[first] and mNodes[second],
+		// a leaf holds mItems[first] .. mItems[second-1]
+		unsigned int first, second;
+		bool leaf;
+	};
+
+	unsigned int build(unsigned int begin, unsigned int end, const std::vector<AABB>& boxes, const std::vector<Vector3d>& centres);
+
+	std::vector<Node> mNodes; // mNodes[0] is the root
+	std::vector<unsigned int> mItems;
+	std::vector<AABB> mBoxes;
+};
+
+#endif
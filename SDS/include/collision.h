@@ -10,6 +10,7 @@
 
 #include "mesh.h"
 #include "aabb.h"
+#include "aabbtree.h"
 
 #include "vector3.h"
 
@@ -24,8 +25,11 @@ class Vertex;
 class Face;
 class Collision
 {
-	// XXX: right size?
-	const static int HASH_TABLE_SIZE = 2999;
+	/// The hash tables have about twice as many buckets as entries, but never fewer than this
+	const static unsigned int MIN_HASH_TABLE_SIZE = 2999;
+	/// Number of tetras (or vertices, for the static tetras) in each chunk of the parallel point-tetra test
+	const static int TETRA_CHUNK_SIZE = 256;
+	const static int VERTEX_CHUNK_SIZE = 1024;
 
 	/// Physical Parameters
 	const static double CO_RESTITUTION = 0; // 0.001;
@@ -75,6 +79,10 @@ class Collision
 
 	public:
 
+	/// Number of threads used for the point-tetra test (0 = all available, 1 = serial)
+	/// (the result is the same for any number of threads)
+	static int NUM_THREADS;
+
 	Collision();
 	~Collision();
 
@@ -82,7 +90,10 @@ class Collision
 	/// PRE: called only at initialisation
 		/// PRE: Mesh* doesn't changed structure
 		void addMesh(Mesh*);
-		void addStaticMesh(Mesh*); // a static mesh does not move!
+		/// a static mesh does not move! (its tetras and outer faces are put in a tree on the next collision step)
+		/// a shared static mesh may be used by other simulations at the same time, so it is only read
+		/// (its tetras aren't tagged as intersected)
+		void addStaticMesh(Mesh*, bool shared = false);
 		void setWorldBounds(AABB);
 		AABB bounds(){return mWorldBounds;}
 
@@ -125,8 +136,65 @@ class Collision
 
 	protected:
 
-	inline unsigned int hash(int i, int j, int k);
-	inline unsigned int hash(int* i);
+	/**
+	 * A spatial hash table stored in flat arrays.
+	 * Entries are add()ed with their bucket, then build() counting sorts them into
+	 * the buckets (keeping the order they were added in within each bucket).
+	 * The arrays are kept between steps, so they only reallocate when the table grows.
+	 */
+	template <typename T>
+	struct HashTable
+	{
+		/// number of buckets
+		unsigned int size;
+		/// bucket h is items[start[h]] .. items[start[h+1]-1]
+		std::vector<unsigned int> start;
+		std::vector<T> items;
+
+		/// entries added since the last reset, and their buckets
+		std::vector<T> added;
+		std::vector<unsigned int> addedBuckets;
+		std::vector<unsigned int> next;
+
+		HashTable():size(0){}
+
+		/// empty the table, and resize it if it is too small or much too big for n entries
+		void reset(unsigned int n);
+		inline void add(unsigned int bucket, T item){added.push_back(item); addedBuckets.push_back(bucket);}
+		void build();
+	};
+
+	/// a vertex found inside a tetra
+	struct Hit
+	{
+		Tetra* t;
+		Vertex* v;
+	};
+
+	/// a vertex found inside the static tetra mStaticTetras[tetra]
+	struct StaticHit
+	{
+		unsigned int tetra;
+		Vertex* v;
+
+		bool operator<(const StaticHit& h) const {return tetra < h.tetra;}
+	};
+
+	/// the number of threads to use (resolves NUM_THREADS==0)
+	static int numThreads();
+
+	inline unsigned int hash(int i, int j, int k, unsigned int size);
+	inline unsigned int hash(int* i, unsigned int size);
+
+	/// set the cell size to the mean rest length of the edges of all the meshes
+	void updateCellSize();
+	/// hash the unfrozen vertices of the (non static) meshes into mVertexTable
+	void hashVertices();
+	/// put the tetras and outer faces of the static meshes into trees
+	void buildStaticTrees();
+	/// test an intersecting edge against an outer face, keeping the intersection nearest to ei->b
+	void intersect(Face* f, EInfo* ei);
+
 	inline void toGridCoords(const Vector3d& worldCoords, int* pGridCoords);
 	inline Vector3i toGridCoords(const Vector3d& wc);
 	inline void toGridCoords(const double* worldCoords, int* pGridCoords);
@@ -137,11 +205,28 @@ class Collision
 	double mCellSize;
 	std::list<Mesh*> mMeshList;
 	std::list<Mesh*> mStaticMeshList;
+	std::set<Mesh*> mSharedStaticMeshes;
 	std::list<Mesh*> mAllMeshes;
 	AABB mWorldBounds;
 
-	std::list<Vertex*>* mpHashTable;
-	std::list<EInfo*>* mpEdgeHashTable;
+	HashTable<Vertex*> mVertexTable;
+	HashTable<EInfo*> mEdgeTable;
+
+	// the tetras of all meshes, and the hits in each chunk of them
+	std::vector<Tetra*> mTetras;
+	std::vector<std::vector<Hit> > mTetraHits;
+
+	// the static meshes never move, so their tetras and outer faces are kept in trees
+	bool mStaticTreesValid;
+	std::vector<Tetra*> mStaticTetras;
+	std::vector<char> mStaticTetraShared;
+	std::vector<Face*> mStaticFaces;
+	AABBTree mStaticTetraTree;
+	AABBTree mStaticFaceTree;
+	// the hits in each chunk of vertices, and all of them in static tetra order
+	std::vector<std::vector<StaticHit> > mStaticHits;
+	std::vector<StaticHit> mSortedStaticHits;
+	std::vector<Tetra*> mIntersectedStaticTetras;
 
 	// collision information
 	std::set<Vertex*> mProcessedVertices;
@@ -155,6 +240,8 @@ class Collision
 
 	// derived params
 	int mTotalNumberOfEdges;
+	double mStaticEdgeLength;
+	int mStaticNumberOfEdges;
 
 	// CDBGDRAW stuff
 	std::list<AABB> mIntersectingFaceVoxels;
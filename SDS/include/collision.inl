@@ -3,17 +3,17 @@ std::vector<Collision::EInfo>& Collision::intersectingEdgeInfo(){return mInterse
 
 std::list<AABB>& Collision::DBG_intersectingFaceVoxels(){return mIntersectingFaceVoxels;}
 
-unsigned int Collision::hash(int i, int j, int k)
+unsigned int Collision::hash(int i, int j, int k, unsigned int size)
 {
 	static const int p1 = 73856093, p2 = 19349663, p3 = 83492791;
-	int result = (i*p1 + j*p2 + k*p3) % HASH_TABLE_SIZE;
-	if (result < 0) result += HASH_TABLE_SIZE;
+	int result = (i*p1 + j*p2 + k*p3) % (int)size;
+	if (result < 0) result += size;
 	return result;
 }
 
-unsigned int Collision::hash(int* i)
+unsigned int Collision::hash(int* i, unsigned int size)
 {
-	return hash(i[0],i[1],i[2]);
+	return hash(i[0],i[1],i[2],size);
 }
 
 void Collision::toGridCoords(const Vector3d& v, int* p)
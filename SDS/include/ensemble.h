@@ -0,0 +1,72 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+/* Ensemble: Runs many independent simulations in one process.
+ * - Each simulation has its own SimulationContext, so the simulations can have different
+ *   physical parameters, and don't share the state of their transformations or random numbers.
+ * - Static meshes can be shared by all of the simulations, so they are only loaded once.
+ *   The simulations only read them.
+ * - step() takes a full step of every running simulation, spread over a pool of threads.
+ *   Each simulation is stepped by one thread at a time, in its own context.
+ */
+
+#include "sdssimulation.h"
+#include "simulationcontext.h"
+
+#include <vector>
+#include <list>
+
+class Mesh;
+
+class Ensemble
+{
+	public:
+
+	/// threads: the number of threads used to step the simulations (0 = all available, 1 = serial)
+	Ensemble(int threads = 0);
+	/// deletes the simulations, their contexts and the shared static meshes
+	~Ensemble();
+
+	/**
+	 * Add a simulation, with a context with the default parameters.
+	 * Set it up (i.e., set its parameters, load its organism and call setWorld)
+	 * in a SimulationContext::Scope of its context.
+	 */
+	SDSSimulation* add();
+
+	/// share the static mesh m with all of the simulations (added before or after), the ensemble deletes it
+	/// PRE: called before the simulations' setWorld
+	void addStaticMesh(Mesh* m);
+	const std::list<Mesh*>& staticMeshes() const {return mStaticMeshes;}
+
+	unsigned int size() const {return mSimulations.size();}
+	SDSSimulation* simulation(unsigned int i){return mSimulations[i];}
+	SimulationContext& context(unsigned int i){return *mContexts[i];}
+
+	/// is simulation i still running? (it stops when it becomes unstable, or throws an exception)
+	bool running(unsigned int i);
+	/// stop stepping simulation i
+	void stop(unsigned int i){mStopped[i] = true;}
+
+	/**
+	 * Take a full step (see SDSSimulation::substep) of each running simulation.
+	 * Returns the number of simulations still running.
+	 */
+	int step();
+
+	void setNumThreads(int threads){mThreads = threads;}
+	int numThreads() const;
+
+	protected:
+
+	/// take a full step of simulation i
+	void step(unsigned int i);
+
+	int mThreads;
+	std::vector<SDSSimulation*> mSimulations;
+	std::vector<SimulationContext*> mContexts;
+	std::vector<char> mStopped;
+	std::list<Mesh*> mStaticMeshes;
+};
+
+#endif
@@ -27,6 +27,7 @@ public:
 
 	inline const Vertex& cv(int i) const;
 	inline Vertex& v(int i) const;
+	/// NB: the mesh index keys faces by their sorted vertices, so reordering them in place keeps the index valid
 	inline void setVertices(Vertex* a, Vertex* b, Vertex* c);
 
 	// vertex and edge composition tests
@@ -0,0 +1,100 @@
+#ifndef FRAMECACHE_H
+#define FRAMECACHE_H
+
+/* FrameCache: Plays back a simulation file (see SimulationLoader) without loading all of its frames.
+ * - The frame times come from the frame index, so the first frame can be shown straight away.
+ * - Frames are decoded when they are asked for (see frame()), and the ones used most recently
+ *   are kept, as long as they fit in a budget of bytes (the size of a frame is estimated from
+ *   the number of its elements). The current frame is always kept.
+ * - prefetch() decodes the next frames in the direction of playback (forwards, unless the last
+ *   frame asked for was before the current one), e.g., from a background thread, so that
+ *   playback doesn't have to wait for them.
+ * - Static segments aren't loaded.
+ *
+ * A FrameCache isn't thread safe, callers must serialise their calls (e.g., SDSPlayer locks a
+ * mutex around each call).
+ */
+
+#include "simulationio.h"
+
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+class Organism;
+
+class FrameCache
+{
+	public:
+
+	/// PRE: the simulation has mesh and organism segments
+	FrameCache(std::string header, unsigned long budget = DEFAULT_BUDGET) throw(SimulationLoader::LoadException);
+	~FrameCache();
+
+	SimulationIO_Base::SimulationHeader simulationHeader(){return mLoader.simulationHeader();}
+
+	int numberOfFrames() const {return mTimes.size();}
+	const std::vector<double>& frameTimes() const {return mTimes;}
+
+	/**
+	 * The organism of frame f, which is decoded if it isn't cached.
+	 * f becomes the current frame, its organism is valid until another frame becomes current.
+	 * Returns NULL if the frame can't be read.
+	 */
+	Organism* frame(int f);
+	int current() const {return mCurrent;}
+	/// +1 when playing forwards, -1 when backwards
+	int direction() const {return mDirection;}
+
+	/**
+	 * Decode the nearest frame in the direction of playback that isn't cached, within ahead frames
+	 * of the current one, if it fits in the budget without evicting the frames up to it.
+	 * Returns false if there was nothing to do.
+	 */
+	bool prefetch(int ahead = DEFAULT_PREFETCH);
+
+	/// the bytes that the decoded frames may take (evicts frames if they no longer fit)
+	void setBudget(unsigned long bytes);
+	unsigned long budget() const {return mBudget;}
+	/// the estimated bytes that the decoded frames take
+	unsigned long bytes() const {return mBytes;}
+	bool isCached(int f) const {return mFrames.count(f) > 0;}
+	int numberOfCachedFrames() const {return mFrames.size();}
+
+	/// the estimated bytes of an organism
+	static unsigned long bytes(Organism* o);
+
+	static const unsigned long DEFAULT_BUDGET = 512*1024*1024;
+	static const int DEFAULT_PREFETCH = 32;
+
+	protected:
+
+	struct Entry
+	{
+		Organism* organism;
+		unsigned long bytes;
+		std::list<int>::iterator used;
+	};
+
+	// decode frame f and cache it, returns NULL if it can't be read
+	Organism* decode(int f);
+	// evict the least recently used frames (except the frames from the current one to last, in the
+	// direction of playback) until bytes more fit in the budget, returns false if they can't be made to fit
+	bool evict(unsigned long bytes, int last);
+	void remove(std::map<int,Entry>::iterator it);
+
+	SimulationLoader mLoader;
+	ProcessModel* mProcessModel;
+	std::vector<double> mTimes;
+
+	std::map<int,Entry> mFrames;
+	// the cached frames, the most recently used first
+	std::list<int> mUsed;
+	unsigned long mBudget;
+	unsigned long mBytes;
+	int mCurrent;
+	int mDirection;
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef FRAMEMAP_H
+#define FRAMEMAP_H
+
+/* FrameMap: Reads the frame data of a simulation file (see SimulationLoader) through a memory mapping.
+ * - Each frame, and each of its segments, is a span of the mapped bytes, nothing is copied or decoded.
+ * - MeshView reads the counts, bounds and vertex positions of a mesh segment straight from the
+ *   mapping, and its topology (of keyframes) into flat vectors of ids, without building a Mesh.
+ *   For tools that only need the positions (e.g., siminfo --scan, plotting, exporting surfaces),
+ *   so that scanning a long simulation is limited by reading the file rather than by allocating.
+ * - The whole file is mapped if the address space allows it, otherwise a window around the frames
+ *   asked for (see setWindow()).
+ *
+ * The frame data is in the byte order of the machine that wrote it (see bstreamable.h).
+ */
+
+#include "simulationio.h"
+#include "aabb.h"
+#include "vector3.h"
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+class MeshView;
+
+class FrameMap
+{
+	public:
+
+	/// some bytes of the mapping
+	struct Span
+	{
+		const char* data;
+		unsigned long size;
+
+		Span():data(NULL),size(0){}
+		Span(const char* d, unsigned long s):data(d),size(s){}
+		bool empty() const {return data==NULL;}
+	};
+
+	/// PRE: the frame data exists
+	FrameMap(std::string header) throw(SimulationLoader::LoadException);
+	~FrameMap();
+
+	SimulationIO_Base::SimulationHeader simulationHeader(){return mLoader.simulationHeader();}
+	/// the segment types, in the order they are in a frame
+	const std::vector<std::string>& segments() const {return mSegments;}
+	/// the index of a segment type (or -1 if the frames don't have it)
+	int segmentIndex(std::string type) const;
+	/// the version of the mesh segment (see MeshSegmentIO)
+	std::string meshVersion() const {return mMeshVersion;}
+
+	int numberOfFrames() const {return mIndex.size();}
+	/// pick up the frames written since (the spans are no longer valid)
+	int refresh();
+
+	/**
+	 * The segments of frame f (without its header), or an empty span if it can't be mapped.
+	 * The spans of a frame are valid until a frame outside of the window is asked for.
+	 */
+	Span frame(int f);
+	/// PRE: 0 <= f < numberOfFrames()
+	SimulationIO_Base::FrameHeader frameHeader(int f);
+	/// the data of a segment of frame f (without its size), or an empty span
+	Span segment(int f, int index);
+	Span segment(int f, std::string type);
+
+	/// the mesh segment of frame f, false if it can't be read
+	bool mesh(int f, MeshView& view);
+
+	/// map at least bytes at a time, or the whole file if 0 (the default, unless there isn't room for it)
+	void setWindow(boost::uint64_t bytes);
+	boost::uint64_t window() const {return mWindow;}
+	/// the bytes of the frame data
+	boost::uint64_t fileSize() const {return mFileSize;}
+
+	static const unsigned long DEFAULT_WINDOW = 256*1024*1024;
+
+	protected:
+
+	// map the bytes at offset (in the window), returns their address (or NULL)
+	const char* map(boost::uint64_t offset, boost::uint64_t size);
+	void unmap();
+
+	SimulationLoader mLoader;
+	std::vector<std::string> mSegments;
+	std::string mMeshVersion;
+	std::vector<SimulationIO_Base::FrameIndexEntry> mIndex;
+
+	std::string mFileName;
+	boost::uint64_t mFileSize;
+	boost::uint64_t mWindow;
+	unsigned long mGranularity;
+
+	// the file and the mapped window
+	#ifdef _WIN32
+	void* mFile;
+	void* mMapping;
+	#else
+	int mFile;
+	#endif
+	char* mData;
+	boost::uint64_t mOffset;
+	boost::uint64_t mSize;
+};
+
+/**
+ * The topology of a mesh segment, with elements referred to by their ids (as in Mesh::bWriteFull,
+ * the id of an element is its position in the mesh).
+ */
+struct MeshTopology
+{
+	std::vector<char> surface; // of each vertex
+	// the neighbours of vertex i are neighbours[neighbourStart[i]..neighbourStart[i+1]-1]
+	std::vector<unsigned int> neighbourStart;
+	std::vector<unsigned int> neighbours;
+	std::vector<unsigned int> edges; // two vertices each
+	std::vector<unsigned int> faces; // the three vertices of each outer face
+	std::vector<unsigned int> tetras; // four vertices each
+	std::vector<int> tetraNeighbours; // four each (-1 if there is none)
+};
+
+/**
+ * A mesh segment in a FrameMap (see Mesh::bWriteFull and Mesh::bWriteContinuous for its layout).
+ * Valid as long as the span it was set to.
+ */
+class MeshView
+{
+	public:
+
+	MeshView();
+
+	/// false if the segment is too short, or the version is unknown
+	bool set(FrameMap::Span segment, std::string version);
+
+	/// a keyframe holds the topology, other frames ("topodelta") only what has changed since theirs
+	bool keyframe() const {return mKeyframeDistance==0;}
+	unsigned int keyframeDistance() const {return mKeyframeDistance;}
+
+	unsigned int numberOfVertices() const {return mNumberOfVertices;}
+	unsigned int numberOfEdges() const {return mNumberOfEdges;}
+	unsigned int numberOfTetras() const {return mNumberOfTetras;}
+	/// (keyframes only)
+	unsigned int numberOfOuterFaces() const {return mNumberOfOuterFaces;}
+	const AABB& aabb() const {return mAABB;}
+
+	/// the position of vertex i
+	/// PRE: i < numberOfVertices()
+	Vector3d x(unsigned int i) const;
+	void positions(std::vector<Vector3d>& xs) const;
+
+	/// the topology, false if it isn't a keyframe or the segment is too short
+	bool topology(MeshTopology& t) const;
+
+	/// the bytes of a vertex in a mesh segment
+	static const unsigned long VERTEX_SIZE = 10*sizeof(double) + sizeof(bool);
+
+	protected:
+
+	const char* mVertices;
+	const char* mEnd;
+	unsigned int mKeyframeDistance;
+	unsigned int mNumberOfVertices;
+	unsigned int mNumberOfEdges;
+	unsigned int mNumberOfTetras;
+	unsigned int mNumberOfOuterFaces;
+	AABB mAABB;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef FRAMEWRITER_H
+#define FRAMEWRITER_H
+
+/* FrameWriter: Writes the frame data of a simulation (and its frame index, see SimulationWriter)
+ * without making the simulation wait for the disk.
+ * - Frames are encoded straight into a buffer, in the layout of the file, and the sizes of the
+ *   frame and its segments are patched in afterwards (there is no copy).
+ * - With a queue, write() only takes a snapshot of each segment that can make one (see
+ *   SegmentWriter::snapshot, the mesh copies its state into plain arrays, which is much quicker
+ *   than encoding it), and encodes the others. The frames are then encoded, written to disk and
+ *   indexed on a background thread, in order. There are queueSize of them: write() waits for one
+ *   to be written when they are all full (2 by default, so one frame is written while the next
+ *   one is taken). With a queueSize of 0 the frames are encoded and written by write() itself.
+ * - A frame is indexed after it is written and flushed, so a reader never sees an entry for a
+ *   partial frame.
+ *
+ * The segment writers must stay valid while the writer is, but are only used by write().
+ */
+
+#include "simulationio.h"
+
+#include <string>
+#include <list>
+#include <vector>
+#include <deque>
+#include <fstream>
+
+#include <pthread.h>
+
+class FrameWriter
+{
+	public:
+
+	/// open the frame data file (and its index), and write the static segments (see good())
+	FrameWriter(std::string frameDataFileName, std::list<SegmentWriter*> segmentWriters, std::list<SegmentWriter*> staticSegmentWriters = std::list<SegmentWriter*>(), unsigned int queueSize = DEFAULT_QUEUE_SIZE);
+	/// (writes the frames that are waiting)
+	~FrameWriter();
+
+	/// false if the file couldn't be opened or written to
+	bool good();
+
+	/// encode the segments as a frame, to be written (waits while all the buffers are full)
+	void write(int number, double time, int step);
+	/// wait until the frames are on disk
+	void flush();
+
+	/// the frames written to disk so far
+	int numberOfFramesWritten();
+	unsigned int queueSize() const {return mQueueSize;}
+
+	static const unsigned int DEFAULT_QUEUE_SIZE = 2;
+
+	protected:
+
+	typedef std::vector<char> Buffer;
+
+	struct Frame
+	{
+		int number;
+		double time;
+		int step;
+		// for each segment, the writer encode() uses (a snapshot, deleted after it is encoded, if owned)
+		// or NULL if the segment was encoded into segments by take()
+		std::vector<SegmentWriter*> writers;
+		std::vector<Buffer> segments;
+		bool owned;
+		// the frame as it is written to the file
+		Buffer data;
+	};
+
+	// take the segments of a frame into f, as snapshots if they make them
+	void take(Frame& f, int number, double time, int step);
+	// encode the segments of a frame into f.data
+	void encode(Frame& f);
+	// write it to the file and index it
+	void writeOut(const Buffer& b);
+
+	static void* run(void* writer);
+
+	std::list<SegmentWriter*> mSegmentWriters;
+	std::ofstream mFile;
+	std::ofstream mIndexFile;
+	bool mOpen;
+	bool mGood;
+	int mNumberOfFramesWritten;
+
+	// the frames, mQueued are waiting to be written (oldest first), mFree can be taken into
+	unsigned int mQueueSize;
+	std::vector<Frame*> mFrames;
+	std::deque<Frame*> mQueued;
+	std::vector<Frame*> mFree;
+	// (one frame is being written by the thread)
+	bool mWriting;
+	bool mStop;
+
+	pthread_t mThread;
+	pthread_mutex_t mMutex;
+	pthread_cond_t mChanged;
+};
+
+#endif
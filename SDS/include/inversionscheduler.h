@@ -0,0 +1,117 @@
+#ifndef INVERSIONSCHEDULER_H
+#define INVERSIONSCHEDULER_H
+
+/* InversionScheduler: Finds the first tetra to invert during a physics step.
+ * - The vertices move linearly from their old positions (at the start of the step)
+ *   to their current positions (at the end of the step).
+ * - The search goes in rounds. Each round schedules the inversions of the tetras that are
+ *   inverted at the end of the current window, and the window then ends at the earliest one.
+ *   It ends when no other tetra is inverted at the end of the window.
+ * - Each inversion is solved once per round, and kept in a priority queue.
+ * - Only the first few rounds look at every tetra, and they rewind the whole mesh.
+ *   Later rounds only look at the tetras that can be inverted at some point in the window,
+ *   and rewind a copy of the positions in the slots of the mesh arrays (see MeshArrays) instead,
+ *   each slot only when it is looked at. The mesh is then rewound once at the end.
+ *
+ * Used by SDSSimulation::detectFirstInversion.
+ */
+
+#include "vector3.h"
+
+#include <vector>
+#include <queue>
+
+class Mesh;
+class MeshArrays;
+class Vertex;
+class Tetra;
+
+class InversionScheduler
+{
+	public:
+
+	InversionScheduler();
+
+	/// start a step of length dt, which ends at the current positions of m
+	void start(Mesh* m, double dt);
+
+	/// add the unfrozen tetras (except except) which are inverted at the end of the window to inverted
+	void findInverted(std::vector<Tetra*>& inverted, Tetra* except = NULL);
+
+	/// schedule the inversion of t, deltaH seconds back from the end of the window
+	void schedule(Tetra* t, double deltaH);
+	/// has anything been scheduled this round?
+	bool scheduled() const;
+	/// pop the earliest inversion scheduled this round (the first one scheduled on ties),
+	/// end the window at it, and start the next round
+	/// PRE: scheduled()
+	Tetra* next();
+	/// start the next round with the end of the window moved deltaH seconds back, without an inversion
+	/// (SDSSimulation::detectFirstInversion moves it a second forward when nothing is scheduled)
+	void skip(double deltaH);
+
+	/// the first time (from 0 to 1) in the window when the vertex of t passes through the plane of its other three vertices
+	/// (see SDSUtil::doVertexPlaneIntersect)
+	double intersect(Tetra* t) const;
+
+	/// the position of v and volume of t at the end of the window
+	Vector3d x(const Vertex* v) const;
+	double volume(Tetra* t) const;
+
+	/// seconds from the end of the window to the end of the step
+	inline double back() const {return mBack;}
+	/// seconds from the start of the step to the end of the window
+	inline double window() const {return mDt - mBack;}
+
+	/// rewind the mesh to the end of the window
+	void rewind();
+
+	protected:
+
+	/// the volume at the end of the window of the tetra with vertices in slots s0..s3
+	/// PRE: mRound >= FULL_SCAN_ROUNDS
+	double volume(unsigned int s0, unsigned int s1, unsigned int s2, unsigned int s3) const;
+
+	/// can the tetra with vertices in slots v be inverted at some point in the window?
+	/// PRE: mRound >= FULL_SCAN_ROUNDS
+	bool canInvert(const unsigned int* v) const;
+
+	/// the position of slot s at the end of the window, rewound one round at a time
+	/// from where it was last looked at
+	/// PRE: mRound >= FULL_SCAN_ROUNDS
+	const Vector3d& at(unsigned int s) const;
+
+	struct Event
+	{
+		unsigned int round;
+		double deltaH;
+		unsigned int order;
+		Tetra* t;
+
+		/// later rounds, then larger deltaH (earlier inversions), then earlier order come first
+		bool operator<(const Event& e) const;
+	};
+
+	Mesh* mMesh;
+	double mDt;
+	double mBack;
+	unsigned int mRound;
+	unsigned int mOrder;
+
+	std::priority_queue<Event> mEvents;
+
+	// the mesh arrays, and the positions of each slot at the start of the step and at the end of the window
+	// of round mXRound[s] (gathered once the first rounds are over)
+	const MeshArrays* mArrays;
+	std::vector<Vector3d> mOldX;
+	mutable std::vector<Vector3d> mX;
+	mutable std::vector<unsigned int> mXRound;
+	// how far each round moved the end of the window back (as a fraction of the window before it)
+	std::vector<double> mRewind;
+
+	// the tetras that can be inverted in the window (computed by the first round after the full scans)
+	std::vector<Tetra*> mCandidates;
+	bool mCandidatesValid;
+};
+
+#endif
@@ -18,8 +18,12 @@
 
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
 
 class World;
+class MeshIndex;
+class MeshArrays;
 class Mesh: public BStreamable {
 	public:
 
@@ -51,6 +55,9 @@ class Mesh: public BStreamable {
 	// XXX: Deprecated, we don't store all faces, only outer faces
 	inline const std::list<Face*>& faces() const;
 
+	/// a contiguous working copy of the vertex state, and the element tuples, for the physics (see MeshArrays), brought up to date if required
+	MeshArrays& arrays();
+
 	/**
 	 * Find an element (or all elements) that contains the specified vertices.
 	 *
@@ -58,6 +65,9 @@ class Mesh: public BStreamable {
 	 * calling getTetra(v1) will return an arbitrary tetrahedron
 	 * that contains v1.
 	 *
+	 * Lookups go through an index (see MeshIndex), so they are
+	 * O(log n) when all vertices are given, and O(deg(v1)) otherwise.
+	 *
 	 * @return The element, or null if doesn't exist.
 	 */
 	Edge* getEdge(Vertex* v1, Vertex* v2 = NULL) const;
@@ -77,8 +87,11 @@ class Mesh: public BStreamable {
 	static void addFaceNeighbourLinks(Face* f);
 
 	/// Higher-level accessing functions
-	/// Return a list of all adjacent tetrahedra
+	/// Return a list of all adjacent tetrahedra (in the order of tetras(), O(deg(v)) through the index)
 	std::list<Tetra*> getNeighbours(Vertex* v) const;
+	/// The same tetrahedra, without copying them.
+	/// WARNING: only valid until the mesh is next changed, so don't add or remove tetras while iterating over them.
+	const std::vector<Tetra*>& incidentTetras(Vertex* v) const;
 
 	/// Return the faces f1 and f2 that share edge e.
 	/// No particular order is guaranteed.
@@ -132,16 +145,102 @@ class Mesh: public BStreamable {
 	inline bool hasTopoChanged();
 	inline void topoChange();
 	inline void setTopoChanged(bool t);
+	/// changes whenever the topology does (no two topologies, of any meshes, share a version)
+	inline unsigned long topologyVersion() const;
 
 	/**
 	 * For debugging. Checks that the mesh data structure is valid.
 	 * E.g., all vertex neighbour pairs are represented by an edge, etc.
+	 * This is a full audit of the mesh, O(V+E+F+T).
 	 */
 	bool isSane();
 
-	/// read/write in full form
+	/**
+	 * Performs the same checks as isSane(), but only on the elements around vertices
+	 * that have been touched (by add* or remove*) since the last check.
+	 * The volume of every tetra is still checked, as tetras can invert without a topology change.
+	 * Falls back to a full audit if the element lists have been modified directly.
+	 */
+	bool isSaneIncremental();
+
+	/// number of elements examined by the last sanity check
+	inline unsigned int lastSanityCheckSize() const;
+	/// stop recording touched vertices until the next check (which will be a full one),
+	/// call this when the checks are skipped
+	inline void skipSanityChecks();
+
+	/**
+	 * Read/write in full form.
+	 * bReadFull returns false (leaving the mesh empty and the stream failed) if an element
+	 * refers to a vertex, face or tetra id that isn't in the data.
+	 */
 	void bWriteFull(std::ostream& bin);
-	void bReadFull(std::istream&,bool verbose=false);
+	bool bReadFull(std::istream&,bool verbose=false);
+
+	/**
+	 * Read/write only the data that changes every step: the vertex state and the
+	 * edge and tetra rest lengths/volumes (as written by bWriteFull).
+	 * The mesh read into must hold everything else, as written by bWriteFull and
+	 * bWriteSpringMultipliers when keyframeHash() was last the same.
+	 * bReadContinuous returns false if the number of elements differ.
+	 */
+	void bWriteContinuous(std::ostream& bin);
+	bool bReadContinuous(std::istream& bin);
+
+	/**
+	 * A hash of everything bWriteFull and bWriteSpringMultipliers write, except
+	 * what bWriteContinuous writes, i.e., the topology (elements, their vertices and neighbours,
+	 * in list order), spring coefficients, rest multipliers and face and tetra flags.
+	 * O(V+E+F+T).
+	 */
+	std::size_t keyframeHash();
+
+	/**
+	 * Everything bWriteFull, bWriteSpringMultipliers and bWriteFrozenVerts write, in plain arrays,
+	 * with the elements numbered by their position in the lists (as in bWriteFull).
+	 * Loading one into a mesh is the same as reading what it was taken from, without parsing the stream
+	 * (used to keep the last keyframe of a "topodelta" mesh segment, see MeshSegmentIO).
+	 * Writing one is the same as writing the mesh it was taken from (used to write a mesh segment
+	 * on another thread, see MeshSegmentIO::snapshot).
+	 */
+	struct Keyframe
+	{
+		AABB aabb;
+		// (bWriteFull writes this as the number of faces)
+		unsigned int numberOfOuterFaces;
+
+		// vertex state
+		std::vector<Vector3d> x, oldX, f;
+		std::vector<double> mass;
+		std::vector<char> tag, frozen, surface;
+		// the neighbours of vertex i are neighbours[neighbourStart[i]..neighbourStart[i+1]-1] (and the same for faces)
+		std::vector<unsigned int> neighbourStart, neighbours;
+		std::vector<unsigned int> faceNeighbourStart, faceNeighbours;
+
+		// two vertices per edge, three per face, four vertices and four neighbours (or -1) per tetra
+		std::vector<unsigned int> edgeVertices;
+		std::vector<double> edgeRest, edgeRestMultiplier, edgeSpringCoefficient;
+		std::vector<unsigned int> faceVertices;
+		std::vector<double> faceRest;
+		std::vector<unsigned int> tetraVertices;
+		std::vector<int> tetraNeighbours;
+		std::vector<double> tetraRest, tetraRestMultiplier, tetraSpringCoefficient;
+		std::vector<char> tetraOuter, tetraIntersected;
+	};
+
+	/// take a keyframe of this mesh, O(V+E+F+T)
+	void getKeyframe(Keyframe& k);
+	/// replace the contents of this mesh with a keyframe (and set vertexMapRead(), as bReadFull does)
+	void setKeyframe(const Keyframe& k);
+	/// take only what bWriteContinuous and bWriteFrozenVerts write (and the rest multipliers), O(V+E+T)
+	void getContinuous(Keyframe& k);
+
+	/// write a keyframe as the functions of the same name write the mesh it was taken from
+	/// (bWriteContinuous and bWriteFrozenVerts only need what getContinuous takes)
+	static void bWriteFull(std::ostream& bin, const Keyframe& k);
+	static void bWriteContinuous(std::ostream& bin, const Keyframe& k);
+	static void bWriteSpringMultipliers(std::ostream& bin, const Keyframe& k);
+	static void bWriteFrozenVerts(std::ostream& bin, const Keyframe& k);
 
 	/// coming soon?
 	void bWriteBare(std::ostream& bin){}
@@ -166,10 +265,34 @@ class Mesh: public BStreamable {
 	// retrieve the vertex->id map used when last called WriteNew
 	// used by organism to serialise
 	inline std::map<Vertex*,unsigned int>& vertexMapWrite();
-	inline std::map<unsigned int,Vertex*>& vertexMapRead();
+	// and the id->vertex table of the last bReadFull (the vertex with id i is at i)
+	inline std::vector<Vertex*>& vertexMapRead();
 
 	protected:
 
+	/// the lookup index, rebuilt (lazily) if it has been invalidated
+	const MeshIndex& index() const;
+	/// call this after modifying the element lists directly (i.e., not through add*/remove*)
+	inline void invalidateIndex();
+	/// empty the mesh and fail the stream, when bReadFull reads an id that isn't in the data (returns false)
+	bool badId(std::istream& istr, bool noisy);
+	/// a version no mesh has had yet (meshes can be changed by several threads, see Ensemble)
+	static inline unsigned long newTopologyVersion();
+
+	/// mark the vertices of an element as needing a sanity check
+	/// (and their slots as changed, see MeshArrays::changed)
+	void touch(Vertex* v);
+	inline void touch(Edge* e);
+	inline void touch(Face* f);
+	inline void touch(Tetra* t);
+
+	// sanity checks for individual elements (see isSane())
+	struct SanityLists;
+	bool isVertexSane(Vertex* v, const SanityLists& lists);
+	bool isEdgeSane(Edge* e);
+	bool isFaceSane(Face* f, const SanityLists& lists);
+	bool isTetraSane(Tetra* t);
+
 	std::list<Vertex*> mVertices;
 	std::list<Edge*> mEdges;
 	std::list<Tetra*> mTetras;
@@ -181,6 +304,28 @@ class Mesh: public BStreamable {
 	AABB mAABB;
 
 	bool mTopoChanged;
+	unsigned long mTopologyVersion;
+	static unsigned long sLastTopologyVersion;
+
+	MeshIndex* mIndex;
+	mutable bool mIndexValid;
+
+	MeshArrays* mArrays;
+	bool mArraysValid;
+
+	// the number of vertices, edges and tetras, kept by add* and remove* (std::list::size() walks the list),
+	// and recounted if the lists have been modified directly (see invalidateIndex())
+	unsigned int mNumVertices;
+	unsigned int mNumEdges;
+	unsigned int mNumTetras;
+	bool mCountsValid;
+	void countElements();
+
+	// vertices touched since the last sanity check (not recorded while mCheckAll)
+	std::set<Vertex*> mTouchedVertices;
+	// true if the next incremental sanity check must be a full one
+	bool mCheckAll;
+	unsigned int mLastSanityCheckSize;
 
 	/* serialising stuff... */
 	// SETUP PTR->ID MAPPING
@@ -188,7 +333,7 @@ class Mesh: public BStreamable {
 	std::map<Face*, unsigned int> mFaceMapWrite;
 	std::map<Tetra*, unsigned int> mTetraMapWrite;
 
-	std::map<unsigned int,Vertex*> mVertexMapRead;
+	std::vector<Vertex*> mVertexMapRead;
 	//
 
 	friend class MeshTools;
@@ -197,6 +342,12 @@ class Mesh: public BStreamable {
 	friend class Stepper;
 	friend class Collision;
 	friend class MeshInfo;
+
+	private:
+
+	// not copyable (the index and arrays are owned, and the elements aren't), see copy()
+	Mesh(const Mesh&);
+	Mesh& operator=(const Mesh&);
 };
 
 #include "mesh.inl"
@@ -10,8 +10,19 @@ const AABB& Mesh::aabb(){return mAABB;}
 bool Mesh::hasTopoChanged(){return mTopoChanged;}
 
 // call this whenever modifying the topology of the mesh
-void Mesh::topoChange(){mTopoChanged = true;}
+void Mesh::topoChange(){mTopoChanged = true; mTopologyVersion = newTopologyVersion();}
 void Mesh::setTopoChanged(bool t){mTopoChanged = t;}
+unsigned long Mesh::topologyVersion() const {return mTopologyVersion;}
+
+void Mesh::invalidateIndex(){mIndexValid = false; mArraysValid = false; mCountsValid = false; mCheckAll = true; mTopologyVersion = newTopologyVersion();}
+unsigned long Mesh::newTopologyVersion(){return __sync_add_and_fetch(&sLastTopologyVersion,1);}
+
+void Mesh::touch(Edge* e){touch(e->v(0)); touch(e->v(1));}
+void Mesh::touch(Face* f){touch(&f->v(0)); touch(&f->v(1)); touch(&f->v(2));}
+void Mesh::touch(Tetra* t){touch(t->pv(0)); touch(t->pv(1)); touch(t->pv(2)); touch(t->pv(3));}
+
+unsigned int Mesh::lastSanityCheckSize() const {return mLastSanityCheckSize;}
+void Mesh::skipSanityChecks(){mCheckAll = true; if (not mTouchedVertices.empty()) mTouchedVertices.clear();}
 
 std::map<Vertex*,unsigned int>& Mesh::vertexMapWrite(){return mVertexMapWrite;}
-std::map<unsigned int,Vertex*>& Mesh::vertexMapRead(){return mVertexMapRead;}
+std::vector<Vertex*>& Mesh::vertexMapRead(){return mVertexMapRead;}
@@ -0,0 +1,135 @@
+#ifndef MESHARRAYS_H
+#define MESHARRAYS_H
+
+/* MeshArrays: A contiguous working copy of the vertex state of a Mesh, for the physics.
+ * - This is not the storage of the mesh. Vertex, Edge and Tetra still hold their own
+ *   state and are what the rest of SDS reads and writes. Physics gathers the state
+ *   into these arrays before a pass (see gather()) and scatters the forces back after
+ *   it (see scatterForces()).
+ * - Every vertex in the mesh has a slot (a stable index, see Vertex::slot()),
+ *   slots of removed vertices are put on a free list and reused.
+ * - The copies of position, velocity, force, mass and frozen state are separate
+ *   arrays indexed by slot.
+ * - Edges and tetras are listed as tuples of slots (in mesh list order).
+ * - For the parallel force pass, the edges and tetras can be coloured so that no
+ *   two elements of the same colour share a vertex (see rebuildColouring()).
+ * - Each slot has flags for what has changed around it since the spring coefficients
+ *   and rest values of its elements were last computed (see Mesh::touch()), so only
+ *   those elements need be recomputed.
+ *
+ * The arrays are owned and maintained by Mesh (see Mesh::arrays()).
+ */
+
+#include "vector3.h"
+
+#include <vector>
+#include <list>
+
+class Vertex;
+class Edge;
+class Tetra;
+
+class MeshArrays
+{
+	public:
+
+	struct EdgeTuple
+	{
+		unsigned int v[2];
+		Edge* e;
+	};
+
+	struct TetraTuple
+	{
+		unsigned int v[4];
+		Tetra* t;
+	};
+
+	MeshArrays();
+
+	void clear();
+	/// clear and assign new slots to all the vertices
+	void rebuild(const std::list<Vertex*>& vertices);
+	/// rebuild the edge and tetra tuples (vertices must all have slots)
+	void rebuildElements(const std::list<Edge*>& edges, const std::list<Tetra*>& tetras);
+
+	void addVertex(Vertex* v);
+	void removeVertex(Vertex* v);
+	/// call when an edge or tetra has been added or removed
+	inline void invalidateElements(){mElementsValid = false; mColoured = false;}
+	inline bool elementsValid() const {return mElementsValid;}
+
+	/**
+	 * Greedily colour the edge and tetra tuples, and build the per-slot
+	 * incidence lists of the force contributions. Only needs to be redone when
+	 * the elements change (see coloured()).
+	 */
+	void rebuildColouring();
+	inline bool coloured() const {return mColoured;}
+	inline unsigned int numEdgeColours() const {return edgeColourStart.size()-1;}
+	inline unsigned int numTetraColours() const {return tetraColourStart.size()-1;}
+
+	/// number of slots in use
+	inline unsigned int numVertices() const {return vertices.size() - mFreeSlots.size();}
+	/// true if v has a slot in this
+	bool owns(const Vertex* v) const;
+
+	/// copy x, v, f, m and frozen from the vertices into the arrays
+	void gather();
+	/// copy f back into the vertices
+	void scatterForces();
+	/// freeze the vertex in slot s (and the Vertex itself)
+	void freeze(unsigned int s);
+
+	/// what has changed around a slot (bits of changed)
+	enum Changed {CHANGED_SPRINGS = 1, CHANGED_REST = 2, CHANGED_ALL = 3};
+	/// flag the slot of vtx (if it has one) as changed
+	void markChanged(const Vertex* vtx, unsigned char what = CHANGED_ALL);
+	/// clear the bits what of every slot
+	void clearChanged(unsigned char what);
+
+	/// the slots (NULL for a free slot)
+	std::vector<Vertex*> vertices;
+
+	std::vector<Vector3d> x;
+	std::vector<Vector3d> v;
+	std::vector<Vector3d> f;
+	std::vector<double> m;
+	std::vector<char> frozen;
+
+	/// the Changed bits of each slot (new slots have them all set)
+	std::vector<unsigned char> changed;
+	/// the cell radius the rest values around each slot were last computed with
+	/// (see SDSSimulation::updatePhysicalParameters())
+	std::vector<double> r;
+	/// the Physics::kD and Physics::kSM the spring coefficients were last computed with
+	/// (see Physics::UpdateEdgeSpringStrengths())
+	double springKD, springKSM;
+
+	std::vector<EdgeTuple> edges;
+	std::vector<TetraTuple> tetras;
+
+	/// element indices grouped by colour,
+	/// colour c is edgeOrder[edgeColourStart[c]] .. edgeOrder[edgeColourStart[c+1]-1] (and the same for tetras)
+	std::vector<unsigned int> edgeOrder, edgeColourStart;
+	std::vector<unsigned int> tetraOrder, tetraColourStart;
+
+	/// per-element force contributions (two per edge, then four per tetra)
+	std::vector<Vector3d> contributions;
+	/// the contributions to slot s, in mesh list order, are
+	/// contributions[incident[incidentStart[s]]] .. contributions[incident[incidentStart[s+1]-1]]
+	std::vector<unsigned int> incident, incidentStart;
+
+	/// scratch copy of f, for restarting a failed parallel pass
+	std::vector<Vector3d> savedF;
+
+	protected:
+
+	unsigned int allocateSlot();
+
+	std::vector<unsigned int> mFreeSlots;
+	bool mElementsValid;
+	bool mColoured;
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MESHINDEX_H
+#define MESHINDEX_H
+
+/* MeshIndex: Adjacency index for a Mesh.
+ * - Maps the (sorted) vertices of every edge, face and tetra to the element.
+ * - Also stores, per vertex, the elements incident to it, so that partial
+ *   queries (e.g., getTetra(a,b)) don't need to scan the whole mesh.
+ *
+ * The index is owned and maintained by Mesh (see Mesh::add*, Mesh::remove*),
+ * you shouldn't need to use it directly.
+ */
+
+#include <vector>
+#include <list>
+#include <map>
+
+class Vertex;
+class Edge;
+class Face;
+class Tetra;
+
+class MeshIndex
+{
+	public:
+
+	/// The elements incident to a vertex (in insertion order)
+	struct Incidence
+	{
+		std::vector<Edge*> edges;
+		std::vector<Face*> faces;
+		std::vector<Tetra*> tetras;
+	};
+
+	MeshIndex();
+
+	void clear();
+	/// clear and rebuild from the mesh element lists
+	void rebuild(const std::list<Edge*>& edges, const std::list<Face*>& faces, const std::list<Tetra*>& tetras);
+
+	void addEdge(Edge* e);
+	void addFace(Face* f);
+	void addTetra(Tetra* t);
+	void removeEdge(Edge* e);
+	void removeFace(Face* f);
+	void removeTetra(Tetra* t);
+	void removeVertex(Vertex* v);
+
+	/**
+	 * Exact lookups. All vertices must be non-null and distinct.
+	 * @return The element, or null if doesn't exist.
+	 */
+	Edge* edge(Vertex* a, Vertex* b) const;
+	Face* face(Vertex* a, Vertex* b, Vertex* c) const;
+	Tetra* tetra(Vertex* a, Vertex* b, Vertex* c, Vertex* d) const;
+
+	/// The elements incident to v, or an empty incidence if there are none.
+	const Incidence& incident(Vertex* v) const;
+
+	protected:
+
+	/// Keys are the element's vertices in ascending (address) order
+	template <int N> struct Key
+	{
+		const Vertex* v[N];
+		bool operator<(const Key& k) const;
+	};
+
+	typedef Key<2> EdgeKey;
+	typedef Key<3> FaceKey;
+	typedef Key<4> TetraKey;
+
+	static EdgeKey makeKey(Vertex* a, Vertex* b);
+	static FaceKey makeKey(Vertex* a, Vertex* b, Vertex* c);
+	static TetraKey makeKey(Vertex* a, Vertex* b, Vertex* c, Vertex* d);
+
+	typedef std::map<EdgeKey, Edge*> EdgeMap;
+	typedef std::map<FaceKey, Face*> FaceMap;
+	typedef std::map<TetraKey, Tetra*> TetraMap;
+	typedef std::map<const Vertex*, Incidence> IncidenceMap;
+
+	EdgeMap mEdges;
+	FaceMap mFaces;
+	TetraMap mTetras;
+	IncidenceMap mIncidence;
+
+	static const Incidence sNoIncidence;
+};
+
+#endif
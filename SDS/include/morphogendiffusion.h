@@ -0,0 +1,74 @@
+#ifndef MORPHOGENDIFFUSION_H
+#define MORPHOGENDIFFUSION_H
+
+/* MorphogenDiffusion: Simulates the diffusion-decay of the morphogens of an organism's cells.
+ * - The discrete laplacian of the cell graph is stored as a sparse (CSR) matrix,
+ *   which is only rebuilt when the mesh topology, or the set of cells, changes.
+ * - The weight of an edge (1/length) is shared by both of its cells. The weights are
+ *   recomputed every step, because the cells move.
+ * - The morphogens are copied into flat arrays, all of them are updated in one sweep
+ *   over the cells, then they are copied back.
+ *
+ * The result is exactly that of updating each morphogen in turn, in place, cell by cell
+ * in the order of Organism::cells() (as ProcessModel::simulateMorphogenDiffusion used to).
+ */
+
+#include <vector>
+
+class Organism;
+class Mesh;
+class Cell;
+
+class MorphogenDiffusion
+{
+	public:
+
+	/// a flag per cell, in the order of Organism::cells()
+	typedef std::vector<char> CellMask;
+
+	MorphogenDiffusion();
+
+	/**
+	 * Simulate one step of diffusion-decay of the first numMorphogens morphogens,
+	 * where diffusion[i] and decay[i] are the coefficients of morphogen i.
+	 *
+	 * The cells in skip are left alone, for all morphogens if skipMorphogen is negative,
+	 * else only for morphogen skipMorphogen. The cells past the end of skip are not skipped.
+	 */
+	void step(Organism* o, double dt, int numMorphogens, const double* diffusion, const double* decay, const CellMask& skip, int skipMorphogen = -1);
+
+	/// forget the laplacian (it is rebuilt by the next step)
+	void clear();
+
+	inline unsigned int numCells() const {return mCells.size();}
+	inline unsigned int numEdges() const {return mWeights.size();}
+
+	protected:
+
+	/// does the laplacian still match the cells of o?
+	bool isValid(Organism* o) const;
+	void build(Organism* o);
+
+	Organism* mOrganism;
+	Mesh* mMesh;
+	unsigned long mTopologyVersion;
+
+	std::vector<Cell*> mCells;
+
+	// the neighbours of cell i are mNeighbours[mRowStart[i]] .. mNeighbours[mRowStart[i+1]-1]
+	// (in the order of the neighbours of its vertex), and mEdge[j] is the edge to mNeighbours[j]
+	std::vector<unsigned int> mRowStart;
+	std::vector<unsigned int> mNeighbours;
+	std::vector<unsigned int> mEdge;
+	// the two cells of each edge are mEnds[2*e] and mEnds[2*e+1]
+	std::vector<unsigned int> mEnds;
+
+	// updated every step
+	std::vector<double> mWeights;
+	std::vector<double> mVolumes;
+	// mValues[i*numMorphogens + m] is morphogen m of cell i
+	std::vector<double> mValues;
+	std::vector<double> mLaplacian;
+};
+
+#endif
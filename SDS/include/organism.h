@@ -57,6 +57,13 @@ public:
 	 */
 	void clear();
 
+	/**
+	 * Make a duplicate of this organism, with a copy of its mesh (see Mesh::copy),
+	 * and of its cells and their contents, which are read into the process model pm.
+	 * NOTE: This writes the vertex map of the mesh, so only copy an organism in one thread at a time.
+	 */
+	Organism* copy(ProcessModel* pm);
+
 	void setMesh(Mesh* m) ;
 	void setProcessModel(ProcessModel* pm) ;
 	ProcessModel* processModel(){return mProcessModel;}
@@ -87,7 +94,7 @@ public:
 	/// TODO: hide?
 	// the edge between a and b
 	// or NULL if none exist
-	// XXX: O(|E|) at the moment
+	// (indexed lookup, see Mesh::getEdge)
 	Edge* edge(Cell* a, Cell* b) const;
 	const std::list<Cell*>& cells() {return mCells;}
 	Mesh* mesh() {return mMesh;}
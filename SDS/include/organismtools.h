@@ -20,6 +20,8 @@ public:
 
 	// Construct an organism from a TPS mesh.
 	static Organism* loadMesh(std::string filename) ;
+	// Construct an organism with a cell at each vertex of m, sized by the lengths of the edges.
+	static Organism* fromMesh(Mesh* m);
 
 	// Test Organisms
 	static Organism* loadOneTet();
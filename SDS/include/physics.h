@@ -4,10 +4,12 @@
 #include <string>
 
 #include "mesh.h"
+#include "simulationcontext.h"
 
 class Edge;
 class Face;
 class Tetra;
+class MeshArrays;
 
 /**
  * Physics handles the simulation of a mesh object.
@@ -16,7 +18,7 @@ class Tetra;
  *
  * The primary method is step() which takes a single time-step forward.
  * Different parameters of the simulation can be set and modified.
- *
+ *
  */
 class Physics
 {
@@ -24,28 +26,43 @@ class Physics
 
 	/**
 	 * Take a step forward by dt time units.
-	 * This method simply calls calculateForces() and the takeVerletStep() in sequence.
+	 * This method simply calls calculateForces() and integrate() in sequence.
 	 *
 	 * If checkForStability = true then the method checks if the mesh is becoming unstable
-	 * and returns false if it has.
+	 * and returns false if it has.
 	 */
 	static bool step(Mesh* m, double dt, bool checkForStability = false);
 
 	static void zeroForces(Mesh* m);
 	static void calculateForces(Mesh* m, bool zeroForcesFirst=true, bool dirty=false);
 	static bool takeVerletStep(Mesh* m, double dt, bool checkForStability = false, bool dirty=false);
+	/**
+	 * Take a backward Euler step instead (see physics_implicit.cpp), which stays stable with much
+	 * larger steps than takeVerletStep() when the springs are stiff. The forces must have been
+	 * calculated first, as for takeVerletStep(). The vertices move from mX along a straight line,
+	 * and mOldX is left where they started, so inversions are found in the same way.
+	 */
+	static bool takeImplicitStep(Mesh* m, double dt, bool checkForStability = false, bool dirty=false);
+	/// takeVerletStep() or takeImplicitStep(), as INTEGRATOR says
+	static bool integrate(Mesh* m, double dt, bool checkForStability = false, bool dirty=false);
 
 	/**
 	 * Goes through all the edges in m and sets their spring coefficients to the correct values.
 	 */
 	static void SetAllEdgeSpringStrengths(Mesh* m);
+	/**
+	 * As SetAllEdgeSpringStrengths(), but only for the edges around the slots flagged
+	 * CHANGED_SPRINGS in m->arrays() (or all of them if kD or kSM have changed).
+	 */
+	static void UpdateEdgeSpringStrengths(Mesh* m);
 
 	/**
 	 * Notify the simulator that the previous step was modified.
 	 * This is called by e.g., SDSSimulation when it rewinds the simulation to handle
-	 * cell movement.
+	 * cell movement.
 	 */
 	static void setLastStepSize(double dt){Physics::sLastStepSize = dt;}
+	static double lastStepSize(){return Physics::sLastStepSize;}
 
 	/**
 	 * DENSITY: The density multiplier of the mesh.
@@ -54,15 +71,44 @@ class Physics
 	 * kSM: Surfac strength multiplier (edges on the surface has kSM*kD spring strength)
 	 * kDamp: Default spring damping
 	 * kV: Default simplex spring strength
-	 * GRAVITY: Gravity!
+	 * GRAVITY: Gravity!
+	 * NUM_THREADS: Number of threads used to compute forces (0 = all available, 1 = serial)
+	 * DETERMINISTIC: If true, the multithreaded force computation gives exactly the same results as the serial one
+	 * INTEGRATOR: How integrate() steps (see Integrator)
+	 * CG_MAX_ITERATIONS, CG_TOLERANCE: The limits of the conjugate gradient solve of takeImplicitStep()
+	 *   (the tolerance is relative to the size of the right hand side)
+	 *
+	 * The physical parameters belong to the current SimulationContext, the others to the process.
 	 */
-	static double DENSITY;
-	static double VISCOSITY;
-	static double kD;
-	static double kSM;
-	static double kDamp;
-	static double kV;
-	static double GRAVITY;
+	static SimulationContext::Value<double,&SimulationContext::density> DENSITY;
+	static SimulationContext::Value<double,&SimulationContext::viscosity> VISCOSITY;
+	static SimulationContext::Value<double,&SimulationContext::kD> kD;
+	static SimulationContext::Value<double,&SimulationContext::kSM> kSM;
+	static SimulationContext::Value<double,&SimulationContext::kDamp> kDamp;
+	static SimulationContext::Value<double,&SimulationContext::kV> kV;
+	static SimulationContext::Value<double,&SimulationContext::gravity> GRAVITY;
+	static int NUM_THREADS;
+	static bool DETERMINISTIC;
+	static SimulationContext::Value<int,&SimulationContext::integrator> INTEGRATOR;
+	static int CG_MAX_ITERATIONS;
+	static double CG_TOLERANCE;
+
+	enum Integrator
+	{
+		VERLET, // takeVerletStep()
+		IMPLICIT_EULER // takeImplicitStep()
+	};
+	/// the name of an integrator in the simulation header ("verlet" or "implicit")
+	static std::string integratorName(int integrator);
+	/// set INTEGRATOR by name, returns false if there's no such integrator
+	static bool setIntegrator(std::string name);
+
+	/// the number of tetras whose forces are computed at once (see FVBatch), 8 with AVX-512
+#if defined(__AVX512F__)
+	enum {FV_BATCH = 8};
+#else
+	enum {FV_BATCH = 4};
+#endif
 
 	protected:
 
@@ -84,6 +130,46 @@ class Physics
 	// compute spring force from tet
 	static bool FV(Tetra* t, FVInfo* fv = NULL);
 
+	// the same computations on raw vertex state (see MeshArrays), forces are added to fa, fb and f[i]
+	// mass is the sum of the masses of both endpoints, damp is kDamp
+	// (they don't read the parameters, so they can be called by threads without the current SimulationContext)
+	static bool FD(const Vector3d& ax, const Vector3d& bx, double mass, double rest, double k, Vector3d& fa, Vector3d& fb, FDInfo* fd = NULL);
+	static bool FV(const Vector3d* const x[4], const Vector3d* const v[4], double rest, double k, double damp, Vector3d* const f[4], FVInfo* fv = NULL);
+
+	/// the forces of a batch of tetras
+	struct FVBatchInfo
+	{
+		double f[4][3][FV_BATCH]; // f[j][c][i] is component c of the force on vertex j of tetra i
+		double energy[FV_BATCH];
+		int nan; // bit i is set if the force on tetra i is not a number
+	};
+
+	/**
+	 * FV of n <= FV_BATCH tetras at once, with SIMD instructions (see physics_simd.cpp).
+	 * Tetra i has its vertices in slots s[i][0..3] of x and v, and rest volume rest[i] and coefficient k[i].
+	 * The forces are returned in info rather than added, so the caller can add them in its own order,
+	 * they are exactly those FV computes.
+	 */
+	static void FVBatch(const Vector3d* x, const Vector3d* v, const unsigned int* const s[], const double rest[], const double k[], int n, double damp, FVBatchInfo& info);
+
+	/**
+	 * The force pass of one thread, over the mesh lists rather than the arrays: the state of a
+	 * vertex is together in its Vertex, so gathering it into the arrays doesn't pay for one thread
+	 * (see physics_bench). The tetras still go through FVBatch, with the vertices of each batch copied
+	 * out of their Vertex objects. Gives exactly the same forces as accumulateForces.
+	 */
+	static void calculateForcesSerial(Mesh* m, bool zero, bool dirty);
+	/**
+	 * Add the edge and tetra forces into arrays.f.
+	 * The parallel versions colour the elements so that no two elements in a colour share a vertex,
+	 * or compute each element's contribution separately and then sum them in serial order (DETERMINISTIC).
+	 * They return false if a bad number is computed, the serial version then handles the error.
+	 */
+	static bool accumulateForces(MeshArrays& arrays, bool dirty, double& edgeEnergy, double& tetraEnergy);
+	static bool accumulateForcesColoured(MeshArrays& arrays, int threads, double& edgeEnergy, double& tetraEnergy);
+	static bool accumulateForcesDeterministic(MeshArrays& arrays, int threads, double& edgeEnergy, double& tetraEnergy);
+	static int numThreads();
+
 	// string-based parameter interface to the physics parameters
 	static bool setParam(std::string param, std::string value);
 
@@ -92,7 +178,7 @@ class Physics
 	static void setKV(double d){kV = d;}
 	static void setGravity(double g){GRAVITY = g;}
 
-	static double sLastStepSize;
+	static SimulationContext::Value<double,&SimulationContext::lastStepSize> sLastStepSize;
 };
 
 #endif
@@ -15,6 +15,7 @@
 #include "organism.h"
 #include "bstreamable.h"
 #include "random.h"
+#include "morphogendiffusion.h"
 
 #include "libconfig.h++"
 
@@ -72,6 +73,7 @@ protected:
 	double* mVars;
 
 	friend class ProcessModel;
+	friend class MorphogenDiffusion;
 };
 
 class ProcessModel {
@@ -88,6 +90,9 @@ public:
 	};
 
 public:
+	/// a bit per cell, in the order of Organism::cells()
+	typedef MorphogenDiffusion::CellMask CellMask;
+
 	ProcessModel(int numMorphogens = 0, int numVars = 0);
 	virtual ~ProcessModel();
 
@@ -111,12 +116,18 @@ public:
 	virtual bool reset(){return false;}
 
 	virtual void beforePhysicalStep(Organism* o, double dt){}
+	/// true if beforePhysicalStep() adds forces to the vertices
+	/// (else the simulator zeroes the forces as it computes them, after it)
+	virtual bool addsForces(){return false;}
 	virtual void step(Organism* o, double dt){}
 
 	/// skip, cells to skip in morphogen function
-	virtual void simulateMorphogenDiffusion(Organism* o, double dt, std::set<Cell*> skip = std::set<Cell*>());
+	virtual void simulateMorphogenDiffusion(Organism* o, double dt, const CellMask& skip = CellMask());
 	/// (skip, morph) skip some cells only for a specific morphogen
-	virtual void simulateMorphogenDiffusion(Organism* o, double dt, std::set<Cell*> skip, int morph);
+	virtual void simulateMorphogenDiffusion(Organism* o, double dt, const CellMask& skip, int morph);
+
+	/// the cells of o of a type (e.g., to skip in simulateMorphogenDiffusion)
+	static CellMask cellsOfType(Organism* o, int type);
 
 	// load or save a new process model from a setting
 	static ProcessModel* loadFromSetting(libconfig::Setting& setting) throw(NoProcessModelException);
@@ -142,6 +153,9 @@ public:
 
 	static ProcessModel* create(std::string s);
 
+	/// a new process model of the same type with the same parameters (see saveToSetting)
+	ProcessModel* copy();
+
 	/// returns a new processinfo instance created from the (binary) inputstream
 	virtual CellContents* newCellContents();
 	virtual CellContents* readCellContents(std::istream& input);
@@ -178,6 +192,8 @@ protected:
 	double* mDiffusion;
 	double* mDecay;
 
+	MorphogenDiffusion mMorphogenDiffusion;
+
 	Organism* mOrganism;
 };
 typedef ProcessModel NoProcessModel;
@@ -68,6 +68,7 @@ public:
 	TentacleWithAttractor();
 
 	virtual void beforePhysicalStep(Organism* o, double dt);
+	virtual bool addsForces(){return true;}
 	void step(Organism* o, double dt);
 
 	// parameter interface
@@ -0,0 +1,156 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/* Profile: Where the time of a simulation goes.
+ * - Records the wall time of each phase of a substep (see Phase), and counts of the elements
+ *   worked on and the events that happened (see Counter), for each of the last capacity()
+ *   substeps, in a ring buffer.
+ * - Each SimulationContext has one (see SDSSimulation::profile()), the phases are timed in
+ *   the profile of the current context.
+ * - The code marks its phases with PROFILE_PHASE, and counts with PROFILE_COUNT
+ *   (these need simulationcontext.h).
+ * - It is disabled until setEnabled(true), when each mark only tests a flag.
+ *   Compiling with SDS_NO_PROFILE (scons profile=none) removes the marks, and it can't be enabled.
+ */
+
+#include "propertylist.h"
+
+#include <vector>
+#include <iosfwd>
+
+class Profile
+{
+	public:
+
+	/// the phases of a substep (the time of a phase includes the phases inside it)
+	enum Phase
+	{
+		SUBSTEP, // all of SDSSimulation::substep
+		SANITY_CHECK, // Mesh::isSane or isSaneIncremental
+		SPRING_STRENGTHS, // Physics::UpdateEdgeSpringStrengths
+		FORCES, // Physics::zeroForces and calculateForces
+		BEFORE_PHYSICAL_STEP, // ProcessModel::beforePhysicalStep
+		COLLISION, // collision detection and response
+		INTEGRATION, // Physics::integrate
+		STEP_CONTROL, // judging a step, and rolling it back (with adaptive stepping, see StepController)
+		INVERSION_DETECTION, // finding the first inversion in a step
+		MOVE, // moving a cell past an inversion (the transformation)
+		PROCESS_MODEL, // ProcessModel::step
+		DIFFUSION, // morphogen diffusion (in ProcessModel::step)
+		DIVISION, // cell divisions (in ProcessModel::step)
+		NUM_PHASES
+	};
+
+	/// the counts of a substep
+	enum Counter
+	{
+		VERTICES, // in the organism's mesh
+		TETRAS,
+		SANITY_CHECK_ELEMENTS, // elements checked for sanity
+		INVERSIONS, // tetras found inverted
+		MOVES, // cell movements performed
+		DIVISIONS, // cells divided
+		COLLISIONS, // vertices found inside another tetra
+		CG_ITERATIONS, // iterations of the solve in Physics::takeImplicitStep
+		REJECTED_STEPS, // steps rolled back by adaptive stepping
+		NUM_COUNTERS
+	};
+
+	/// the profile of a substep
+	struct Record
+	{
+		int step; // SDSSimulation::steps() at the start of the substep
+		double t; // the simulation time at the start of the substep
+		double time[NUM_PHASES]; // seconds
+		long count[NUM_COUNTERS];
+	};
+
+	/// keeps the last capacity substeps
+	Profile(unsigned int capacity = 1024);
+
+	void setEnabled(bool enabled);
+	bool enabled() const
+	{
+		#ifdef SDS_NO_PROFILE
+		return false;
+		#else
+		return mEnabled;
+		#endif
+	}
+
+	/// keep the last n substeps (and forget the substeps recorded so far)
+	void setCapacity(unsigned int n);
+	unsigned int capacity() const {return mRecords.size();}
+	void clear();
+
+	/// the number of substeps recorded (at most capacity())
+	unsigned int size() const {return mSize;}
+	/// substep i of those recorded, the oldest first
+	const Record& record(unsigned int i) const;
+	int step(unsigned int i) const {return record(i).step;}
+	double t(unsigned int i) const {return record(i).t;}
+	double time(unsigned int i, Phase p) const {return record(i).time[p];}
+	long count(unsigned int i, Counter c) const {return record(i).count[c];}
+
+	static const char* phaseName(Phase p);
+	static const char* counterName(Counter c);
+
+	/// start and finish recording a substep (see SDSSimulation::substep)
+	void beginSubstep(int step, double t);
+	void endSubstep();
+
+	/// add to the substep being recorded
+	void addTime(Phase p, double seconds){mCurrent.time[p] += seconds;}
+	void addCount(Counter c, long n){mCurrent.count[c] += n;}
+
+	/// add the times (us) and counts of the last substep recorded to properties
+	void addLastTo(PropertyList& properties) const;
+
+	/// the substeps recorded, one per line, after a line of the column names (see writeCSVHeader)
+	/// the times are in microseconds
+	void writeCSV(std::ostream& os) const;
+	void writeCSVHeader(std::ostream& os) const;
+	/// the substeps recorded, one JSON object per line, with the same names as the CSV columns
+	void writeJSON(std::ostream& os) const;
+
+	/// a wall clock (seconds)
+	static double now();
+
+	/// times phase p while it is in scope, if profile is enabled
+	class Timer
+	{
+		public:
+		Timer(Profile& profile, Phase p)
+		:mProfile(profile.enabled() ? &profile : NULL),mPhase(p),mStart(mProfile ? now() : 0){}
+		~Timer(){if (mProfile) mProfile->addTime(mPhase, now() - mStart);}
+
+		private:
+		Profile* mProfile;
+		Phase mPhase;
+		double mStart;
+	};
+
+	private:
+
+	bool mEnabled;
+	Record mCurrent;
+	std::vector<Record> mRecords;
+	// where the next substep is recorded
+	unsigned int mNext;
+	unsigned int mSize;
+};
+
+#define PROFILE_CONCAT_(a,b) a##b
+#define PROFILE_CONCAT(a,b) PROFILE_CONCAT_(a,b)
+
+#ifdef SDS_NO_PROFILE
+	#define PROFILE_PHASE(phase)
+	#define PROFILE_COUNT(counter,n)
+#else
+	/// time the rest of the enclosing block as Profile::phase
+	#define PROFILE_PHASE(phase) Profile::Timer PROFILE_CONCAT(profileTimer,__LINE__)(SimulationContext::current().profile, Profile::phase)
+	/// add n to Profile::counter (n is only evaluated if profiling)
+	#define PROFILE_COUNT(counter,n) {Profile& profile_ = SimulationContext::current().profile; if (profile_.enabled()) profile_.addCount(Profile::counter, n);}
+#endif
+
+#endif
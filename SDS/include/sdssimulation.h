@@ -14,6 +14,9 @@
 #include "propertylist.h"
 #include "collision.h"
 #include "simulationio.h"
+#include "inversionscheduler.h"
+#include "stepcontroller.h"
+#include "simulationcontext.h"
 
 #include <boost/tuple/tuple.hpp>
 #include <boost/any.hpp>
@@ -28,14 +31,24 @@
 class SDSSimulation {
 
 public:
-	SDSSimulation();
+	/// a simulation in context c (or the global SimulationContext), which is made current while the simulation is working
+	/// (set up the organism in a SimulationContext::Scope of c too, see Ensemble)
+	SDSSimulation(SimulationContext* c = NULL);
 	~SDSSimulation();
 
+	SimulationContext& context(){return *mContext;}
+
 	/**
 	 * Initialise the simulation from a header.
 	 */
 	void initialiseFromHeader(SimulationIO_Base::SimulationHeader&);
 
+	/**
+	 * Load the static meshes listed in a header (skipping those which can't be loaded).
+	 * initialiseFromHeader adds them to the simulation.
+	 */
+	static std::list<Mesh*> loadStaticMeshes(SimulationIO_Base::SimulationHeader&);
+
 	/**
 	 * Write the current simulation params into a header.
 	 */
@@ -50,6 +63,13 @@ public:
 	OWorld* world(){return mOWorld;}
 	std::list<Mesh*> getStaticMeshes(){return mStaticMeshes;}
 
+	/**
+	 * Add a static mesh which other simulations may be using at the same time (see Ensemble).
+	 * The simulation only reads it, and doesn't delete it.
+	 * Add it before calling setWorld.
+	 */
+	void addSharedStaticMesh(Mesh* m);
+
 	/**
 	 * MUST call this before simulating.
 	 * ATM only one organism in the world is simulated.
@@ -65,6 +85,18 @@ public:
 	*/
 	bool substep();
 
+	/**
+	 * Where the time of the substeps goes (see Profile), disabled by default.
+	 * When it is enabled, the times of the last substep are also added to lastStepProperties.
+	 */
+	Profile& profile(){return mContext->profile;}
+
+	/**
+	 * What the transformations have done (see TransformTrace), enabled by default.
+	 * Transform::properties() and Transform::allProperties() are converted from it.
+	 */
+	TransformTrace& transformTrace(){return mContext->transformTrace;}
+
 	/**
 	* reset the parameters of the simulation
 	* NOTE: this will not reset the organism,
@@ -80,6 +112,20 @@ public:
 	void setStepSize(double dt);
 	double stepSize();
 
+	/**
+	 * Adaptive stepping (disabled by default): the size of each step is chosen from an estimate of
+	 * its error (see StepController), starting at stepSize(), within [minStepSize,maxStepSize]
+	 * (0 for stepSize()/1024 and 64*stepSize()).
+	 * A step which becomes unstable, or whose error is too large, is rolled back and taken again
+	 * with a smaller step (instead of making the simulation UNSTABLE), unless it is already of minStepSize.
+	 * Each rejected step is a substep of its own, with the property "step rejected".
+	 * NOTE: ProcessModel::beforePhysicalStep() is called again for the retried step.
+	 */
+	void setAdaptiveStepping(bool adaptive, double minStepSize = 0, double maxStepSize = 0);
+	bool adaptiveStepping(){return mAdaptiveStepping;}
+	/// the size of the step being taken (stepSize(), unless adaptive stepping has changed it)
+	double currentStepSize(){return mStepSize;}
+
 	void setTime(double t){mTime = t;}
 
 	/// total simulation time
@@ -108,6 +154,17 @@ public:
 	void setContinueOnError(bool c);
 	bool continueOnError();
 
+	/**
+	 * How the mesh is checked for sanity before each substep.
+	 * SANITY_CHECK_FULL audits the whole mesh (see Mesh::isSane()),
+	 * SANITY_CHECK_INCREMENTAL only re-checks what has changed (see Mesh::isSaneIncremental()).
+	 * The default is incremental, unless compiled with DEBUG.
+	 * The cost of each check is reported in lastStepProperties.
+	 */
+	enum SanityCheckMode{SANITY_CHECK_FULL, SANITY_CHECK_INCREMENTAL};
+	void setSanityCheckMode(SanityCheckMode m){mSanityCheckMode = m;}
+	SanityCheckMode sanityCheckMode(){return mSanityCheckMode;}
+
 	/**
 	* The interface to inspect the current state of the Simulation
 	* A Property is a (string,something) pair that exposes some interesting information about the current step
@@ -128,18 +185,25 @@ private:
 	// update the physical parameters, such as spring stiffness, etc...
 	void updatePhysicalParameters();
 
+	// substep() in the simulation's context
+	bool takeSubstep();
+
 	// steps the physical simulator and reacts to movements (called by substep())
 	bool physicalSubStep();
 
 	/// returns false if simulation has become unstable
 	bool stepForward();
 
+	/// with adaptive stepping, judge the step just taken, and roll it back if it must be taken again
+	/// returns false if it was rolled back
+	bool judgeStep(bool stable);
+
 	bool detectFirstInversion();
 	void handleInversion();
 
 	/**
 	 * linearly interpolates the time back when t first inverted
-	 * PRE: t has inverted in the last time step [sTime,sTime+dt]
+	 * PRE: t has inverted in the window of mInversions, of length dt, [sTime,sTime+dt]
 	 * returns: number of seconds back to inversion (>= 0)
 	 */
 	double timeBackToInversion(Tetra* t, double dt);
@@ -171,9 +235,14 @@ private:
 	// mark the simulation as unstable
 	void setUnstable();
 
+	/// check the sanity of the organism's mesh, and record the cost in lastStepProperties
+	bool checkSanity();
+
 
 private:
 	double mSuggestedStepSize;
+	// the size of the current step
+	double mStepSize;
 	double mLastStepSize;
 	double mTime;
 	int mSteps;
@@ -185,6 +254,8 @@ private:
 	/// attempt to continue after (hackily) fixing the error
 	bool mContinueOnError;
 
+	SanityCheckMode mSanityCheckMode;
+
 	Movement mFirstMove;
 	// current location in algorithm, corresponds to mProperties["step"], empty if not a substep
 	Step mCurrentStep;
@@ -192,8 +263,18 @@ private:
 	OWorld* mOWorld;
 	Organism* mOrganism;
 	Collision mCollision;
+	// orders the inversions in a step (see detectFirstInversion)
+	InversionScheduler mInversions;
+
+	bool mAdaptiveStepping;
+	double mMinStepSize, mMaxStepSize;
+	StepController mStepControl;
 
 	std::list<Mesh*> mStaticMeshes;
+	std::list<Mesh*> mSharedStaticMeshes;
+
+	// the physical parameters, etc. of this simulation
+	SimulationContext* mContext;
 };
 
 #endif /* SDSSIMULATION_H_ */
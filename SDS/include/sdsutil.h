@@ -27,6 +27,9 @@ public:
 	/// find the (non-world) time (0,1) when a intersects the moving plane defined by b,c,d
 	/// returns <0 if no intersection in that time period occurs
 	static double doVertexPlaneIntersect(Tetra* t, int ai, int bi, int ci, int di);
+	/// as above, where a,b,c,d move from q0,b0,c0,d0 to q1,b1,c1,d1
+	static double doVertexPlaneIntersect(const Vector3d& q0, const Vector3d& q1, const Vector3d& b0, const Vector3d& b1,
+			const Vector3d& c0, const Vector3d& c1, const Vector3d& d0, const Vector3d& d1);
 
 	/// rewind all vertices positions back by dh seconds, given current position occurs dt seconds after xOld
 	/// keeps xOld the same
@@ -22,11 +22,30 @@
 class SegmentLoader
 {
 public:
+	virtual ~SegmentLoader(){}
+
 	virtual bool load(std::istream& bin) = 0;
 	virtual std::string getType() = 0;
 
 	// set the parameters of this segment loader
 	virtual bool initialise(libconfig::Setting& s) = 0;
+
+	/**
+	 * Some segments only store what has changed since an earlier frame (a keyframe).
+	 * Returns how many frames back the keyframe of this segment is, or 0 if this is one.
+	 * The SimulationLoader then loads the keyframe before this segment.
+	 * bin is at the start of the segment data and must be left there.
+	 */
+	virtual unsigned int keyframeDistance(std::istream& bin){return 0;}
+
+	/**
+	 * The SimulationLoader keeps the last keyframe loaded of each segment type, so the frames after it
+	 * don't all load it again. After loading a keyframe, copyKeyframe() returns a new loader that holds
+	 * a copy of it (or NULL if this segment doesn't keep copies), and loadKeyframe() loads such a copy
+	 * as if the keyframe had been loaded from the frame data.
+	 */
+	virtual SegmentLoader* copyKeyframe(){return NULL;}
+	virtual bool loadKeyframe(SegmentLoader* keyframe){return false;}
 };
 
 /**
@@ -35,6 +54,8 @@ public:
 class SegmentWriter
 {
 public:
+	virtual ~SegmentWriter(){}
+
 	/**
 	 * Write out the segment data to this binary stream.
 	 * Don't need to write out sizeInBytes as this is computed afterwards.
@@ -42,6 +63,13 @@ public:
 	virtual void write(std::ostream& bin) = 0;
 	virtual std::string getType() = 0;
 
+	/**
+	 * Instead of write(), return a new writer that holds a copy of what write() would write now,
+	 * so that it can be written later by another thread (see FrameWriter), and is then deleted.
+	 * Returns NULL if this segment doesn't make copies (write() is called instead).
+	 */
+	virtual SegmentWriter* snapshot(){return NULL;}
+
 	// set the libconfig::Setting for this segment
 	// assumes that s is empty
 	virtual void setSetting(libconfig::Setting& s) = 0;
@@ -51,6 +79,10 @@ public:
  * Mesh versions:
  * 	"full": initial version, stores all the data every frame
  *  "withspringmultipliers": stores the spring multipliers appended to the mesh data
+ *  "19042010": as above, plus the frozen vertices
+ *  "topodelta": as "19042010" in keyframes, which are written when the topology (or anything
+ *  	else in Mesh::keyframeHash) changes and every keyframeInterval frames,
+ *  	other frames only store the vertex state and rest lengths (see Mesh::bWriteContinuous)
  */
 class MeshSegmentIO: public SegmentLoader, public SegmentWriter
 {
@@ -61,7 +93,7 @@ public:
 	std::string version;
 
 	MeshSegmentIO(Mesh* mesh, std::string version="19042010");
-	virtual ~MeshSegmentIO(){}
+	virtual ~MeshSegmentIO();
 
 	// version="bare" implies that mesh is in compact form
 	// else mesh is in more complete form
@@ -74,6 +106,26 @@ public:
 	// write
 	virtual void write(std::ostream& bin);
 	virtual void setSetting(libconfig::Setting& s);
+	virtual SegmentWriter* snapshot();
+
+	// "topodelta" only
+	virtual unsigned int keyframeDistance(std::istream& bin);
+	virtual SegmentLoader* copyKeyframe();
+	virtual bool loadKeyframe(SegmentLoader* keyframe);
+	unsigned int keyframeInterval;
+
+protected:
+	// count the frame being written, and start a new keyframe if it is time to ("topodelta" only)
+	void nextFrame();
+	// write the keyframe held by a snapshot
+	void writeSnapshot(std::ostream& bin);
+
+	// frames written since the last keyframe (-1 before the first)
+	int mFramesSinceKeyframe;
+	std::size_t mKeyframeHash;
+	// the keyframe held by a copy (see copyKeyframe and snapshot), NULL otherwise
+	// (a snapshot of a frame that isn't a keyframe only holds what Mesh::getContinuous takes)
+	Mesh::Keyframe* mKeyframe;
 };
 
 /**
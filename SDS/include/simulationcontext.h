@@ -0,0 +1,75 @@
+#ifndef SIMULATIONCONTEXT_H
+#define SIMULATIONCONTEXT_H
+
+/* SimulationContext: The global state of a simulation.
+ * - Holds the physical parameters (see Physics), the state of the transformations
+ *   (see Transform), their trace (see TransformTrace) and the profile of the simulation
+ *   (see Profile).
+ * - Each thread has a current context, which Physics and Transform read and write.
+ *   It is the global context, unless another one has been made current (see Scope).
+ * - An SDSSimulation makes its context current while it is working, so each simulation
+ *   in a process can have its own context (see Ensemble).
+ */
+
+#include "profile.h"
+#include "transformtrace.h"
+
+#include <string>
+
+class SimulationContext
+{
+	public:
+
+	/// a context with the default parameters
+	SimulationContext();
+
+	/// the context of this thread
+	static SimulationContext& current();
+	/// the context used by threads which haven't made another one current
+	static SimulationContext& global();
+
+	/// makes a context current in this thread until it goes out of scope
+	class Scope
+	{
+		public:
+		Scope(SimulationContext& c);
+		~Scope();
+
+		private:
+		SimulationContext* mPrevious;
+	};
+
+	/// a member of the current context, which is read and written like a variable
+	/// (see the parameters of Physics)
+	template <typename T, T SimulationContext::*M>
+	class Value
+	{
+		public:
+		operator T&() const {return current().*M;}
+		T& operator=(const T& t) const {return current().*M = t;}
+	};
+
+	// physical parameters (see Physics)
+	double density;
+	double viscosity;
+	double kD;
+	double kSM;
+	double kDamp;
+	double kV;
+	double gravity;
+	// how the vertices are moved (see Physics::Integrator)
+	int integrator;
+	// the size of the last physical step (see Physics::setLastStepSize)
+	double lastStepSize;
+
+	// the state of the transformations (see Transform::State)
+	int transformState;
+	std::string transformErrorMessage;
+	// what they have done
+	TransformTrace transformTrace;
+
+	// where the time of the simulation goes (see Profile)
+	Profile profile;
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include <list>
 #include <fstream>
 #include <map>
+#include <vector>
+#include <boost/cstdint.hpp>
 #include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem.hpp>
@@ -55,6 +57,7 @@ public:
 		double kDamp;
 		double density;
 		double viscosity; // from 0 to 1
+		std::string integrator; // "verlet" or "implicit" (see Physics::Integrator)
 		std::string frameDataFileName;
 		boost::posix_time::ptime time;
 		std::string comments;
@@ -78,6 +81,26 @@ public:
 
 		static int size(){return 3*sizeof(unsigned int) + sizeof(double);}
 	};
+
+	/**
+	 * The frame index is stored next to the frame data, in "<framedata>.idx" (see frameIndexFileName()).
+	 * It holds an entry for each frame, so that a loader can jump straight to it.
+	 *
+	 * Format: INDEX_MAGICNUMBER, INDEX_VERSION, then an entry per frame.
+	 */
+	static const unsigned int INDEX_MAGICNUMBER = 18022010;
+	static const unsigned int INDEX_VERSION = 1;
+
+	struct FrameIndexEntry
+	{
+		boost::uint64_t offset; // position of the frame header in the frame data file
+		double time;
+		unsigned int step;
+
+		static int size(){return sizeof(boost::uint64_t) + sizeof(double) + sizeof(unsigned int);}
+	};
+
+	static std::string frameIndexFileName(std::string frameDataFileName){return frameDataFileName + ".idx";}
 };
 
 class SimulationWriter: public SimulationIO_Base
@@ -93,6 +116,14 @@ public:
 	static void writeFrameDataHeader(std::ostream& o);
 	static void writeFrameHeader(std::ostream& o, FrameHeader& fh);
 	static void writeSegment(std::ostream& o, SegmentWriter& sw);
+
+	/**
+	 * Write the frame index (see FrameIndexEntry).
+	 * Write the header once, and then an entry after writing each frame,
+	 * where offset is the position of the frame header in the frame data file.
+	 */
+	static void writeFrameIndexHeader(std::ostream& idx);
+	static void writeFrameIndexEntry(std::ostream& idx, boost::uint64_t offset, const FrameHeader& fh);
 };
 
 /**
@@ -131,13 +162,23 @@ public:
 	SimulationHeader simulationHeader(){return mSimulationHeader;}
 
 	/**
-	 * A simulation header may not specify how many frames it has. Call this function iterate through
-	 * the binary data and count all the valid frames.
+	 * A simulation header may not specify how many frames it has. Call this function to count
+	 * all the valid frames (using the frame index, see frameIndex()).
 	 *
 	 * After calling it, the current frame is reset to 0.
 	 */
 	int countFrames();
 
+	/**
+	 * The position, time and step of every complete frame in the frame data.
+	 *
+	 * The index is read from the index file if there is one. Frames missing from it
+	 * (or all of them, if there is no index file) are found by walking the frame headers once,
+	 * and the index file is written if there wasn't a usable one.
+	 * The index is extended if the frame data grows.
+	 */
+	const std::vector<FrameIndexEntry>& frameIndex();
+
 	/**
 	 * True if a particular segment type exists.
 	 */
@@ -195,7 +236,7 @@ public:
 	bool nextFrame();
 
 	/**
-	 * Choose a specific frame.
+	 * Choose a specific frame. Seeks directly to it using the frame index.
 	 * Returns false if there is a problem.
 	 */
 	bool setFrame(int f);
@@ -205,8 +246,10 @@ public:
 	 * Should be called when in a frame.
 	 *
 	 * WARNING:
-	 *   Throws up if the segment doesn't exist or the segment loader fails for some reason.
+	 *   Throws up (a new std::runtime_error) if the segment or its keyframe doesn't exist.
 	 *
+	 * The keyframe of a segment that only stores changes is loaded first,
+	 * from a copy if it was the last keyframe loaded for that segment type (see SegmentLoader::copyKeyframe).
 	 */
 	void loadSegment(SegmentLoader* sl) ;
 
@@ -218,6 +261,18 @@ private:
 
 	bool skipStaticSegment();
 	void readFrameHeader();
+
+	bool readFrameIndexFile(std::string fileName);
+	void writeFrameIndexFile(std::string fileName);
+	// offset of the first frame header in the frame data (or -1 if the data is invalid)
+	boost::int64_t firstFrameOffset(std::istream& data);
+	// position of the current frame in the frame index (or -1)
+	int currentFrameIndex();
+	// seek to the start of the data of the index'th segment in the current frame
+	void seekSegment(int index);
+	// keep a copy of the keyframe (frame f) sl has just loaded, in place of the last one of its type
+	void keepKeyframe(SegmentLoader* sl, int f);
+	void clearKeyframes();
 	// void setCurrentFrameToZero();
 
 private:
@@ -243,6 +298,13 @@ private:
 	std::ifstream::pos_type mStartSegmentPos;
 	std::ifstream::pos_type mCurrentSegmentPos;
 	FrameHeader mCurrentFrame;
+
+	std::vector<FrameIndexEntry> mFrameIndex;
+	bool mFrameIndexValid;
+	boost::uint64_t mIndexedFileSize;
+
+	// the last keyframe loaded of each segment type: its frame index and a copy of it
+	std::map<std::string, std::pair<int,SegmentLoader*> > mKeyframes;
 };
 
 #endif /* SDSSERIAL_H_ */
@@ -0,0 +1,89 @@
+#ifndef STEPCONTROLLER_H
+#define STEPCONTROLLER_H
+
+/* StepController: Chooses the size of each physical step of an SDSSimulation (adaptive stepping).
+ * - Estimates the error of a step in two ways: from how much the acceleration of each vertex
+ *   has changed since the last step (the displacement this leaves out, relative to the radius of
+ *   its cell), and from how far the step took each tetra towards inversion (the volume it lost,
+ *   relative to its volume at the start of the step).
+ * - The next step is the one that would bring the larger estimate to its tolerance, but it grows
+ *   at most MAX_GROWTH times a step, and stays within the bounds given to start().
+ * - A step that was unstable, or went over a tolerance, is rejected: the vertices are put back
+ *   where they were before it (see snapshot()) and it is taken again with a smaller step.
+ *   Steps of the smallest size are never rejected.
+ *
+ * Used by SDSSimulation when adaptive stepping is enabled (see SDSSimulation::setAdaptiveStepping).
+ */
+
+#include "vector3.h"
+
+#include <vector>
+
+class Mesh;
+
+class StepController
+{
+	public:
+
+	StepController();
+
+	/// start with steps of dt, and keep them within [minDt,maxDt]
+	void start(double dt, double minDt, double maxDt);
+	/// forget everything, started() is false until the next start()
+	void reset();
+	inline bool started() const {return mStarted;}
+
+	/// the size of the next step
+	inline double stepSize() const {return mStepSize;}
+
+	/// remember the positions and velocities of the vertices of m (before a step)
+	void snapshot(Mesh* m);
+	/// put the vertices of m back as they were at the last snapshot
+	/// PRE: the vertices of m are the ones of the snapshot
+	void restore(Mesh* m);
+
+	/**
+	 * Judge the step of size h just taken on m (from the positions of the last snapshot,
+	 * with the forces still in m->arrays()), and choose the size of the next one.
+	 * Returns false if the step must be rejected (see restore()).
+	 */
+	bool judge(Mesh* m, double h, bool stable);
+	/// the judged step was kept, and the simulation moved forward dt seconds (less than the step if it was rewound to an inversion)
+	void accept(Mesh* m, double dt);
+
+	/// the estimates of the last step judged, relative to their tolerances
+	inline double accelerationError() const {return mAccelerationError;}
+	inline double volumeError() const {return mVolumeError;}
+
+	/// the displacement a step may leave out, relative to the radii of the cells
+	static double ACCELERATION_TOLERANCE;
+	/// the fraction of its volume a tetra may lose in a step
+	static double VOLUME_TOLERANCE;
+	/// the largest factor a step grows by
+	static double MAX_GROWTH;
+
+	protected:
+
+	bool mStarted;
+	double mStepSize;
+	double mMinStepSize;
+	double mMaxStepSize;
+
+	double mAccelerationError;
+	double mVolumeError;
+
+	// the snapshot (by slot of the mesh arrays)
+	std::vector<Vector3d> mX;
+	std::vector<Vector3d> mOldX;
+	std::vector<Vector3d> mV;
+	double mLastStepSize;
+
+	// the accelerations at the start of the judged step, and of the last step kept (by slot),
+	// the topology of the mesh then, and the time since then
+	std::vector<Vector3d> mA;
+	std::vector<Vector3d> mLastA;
+	unsigned long mLastTopology;
+	double mLastDt;
+};
+
+#endif
@@ -94,6 +94,8 @@ class Tetra
 	Vector3d bary(const Vector3d& p) const;
 
 	const AABB& updateAABB();
+	/// the AABB of the current positions, without storing it
+	AABB computeAABB() const;
 	inline const AABB& bounds() const;
 	inline const AABB& aabb() const;
 
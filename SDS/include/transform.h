@@ -17,6 +17,7 @@
 #include "cell.h"
 #include "vector3.h"
 #include "propertylist.h"
+#include "simulationcontext.h"
 #include "log.h"
 
 class Transform {
@@ -28,11 +29,14 @@ public:
 	// properties contains information related to the very last transformation performed
 	// it is cleared automatically
 	// allProperties stores all properties until it is reset - it is used to have a list of all transformations performed in a single step
+	// (both are converted from the trace the transformations record, see TransformTrace)
+	// (the state, trace and error message belong to the current SimulationContext)
 	enum State{TRANSFORM_ERROR,TRANSFORM_COMPLETED,TRANSFORM_TRANSFORMING};
-	static State state;
-	static PropertyList properties;
-	static std::list<PropertyList> allProperties;
-	static void clearAllProperties(){allProperties.clear();}
+	static SimulationContext::Value<int,&SimulationContext::transformState> state;
+	static TransformTrace& trace(){return SimulationContext::current().transformTrace;}
+	static PropertyList properties(){return trace().properties();}
+	static std::list<PropertyList> allProperties(){return trace().allProperties();}
+	static void clearAllProperties(){trace().clearStep();}
 
 	static std::string getErrorMessage();
 	static void setErrorMessage(std::string msg);
@@ -41,9 +45,6 @@ public:
 	/// reset the propertylist, state, etc..
 	static void reset();
 
-private:
-	static std::string sErrorMessage;
-
 public:
 
 	/// HIGH LEVEL CELL DIVISION
@@ -172,8 +173,8 @@ public:
 	static bool checkTetraNeighbour(Tetra* t, int index);
 private:
 
-	// adds the property ("Transformation",s) to properties, each transformation should add its own name to the property list
-	static void called(std::string s);
+	// adds the property ("Transformation",s) to properties, each transformation should add its own name (a string literal) to the property list
+	static void called(const char* s);
 
 
 	/**
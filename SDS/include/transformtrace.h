@@ -0,0 +1,138 @@
+#ifndef TRANSFORMTRACE_H
+#define TRANSFORMTRACE_H
+
+/* TransformTrace: What the transformations have done (see Transform), for the tools that inspect it.
+ * - The transformations record typed events (a key and a small fixed value, see Event) in a
+ *   ring buffer preallocated for the last capacity() events. Recording a key that is a string
+ *   literal doesn't allocate, or format anything.
+ * - Each SimulationContext has one. It is enabled by default, when disabled, recording only tests
+ *   a flag (e.g., basicsim disables it, as nobody reads it).
+ * - Transform::properties() and Transform::allProperties() convert it to PropertyLists on demand
+ *   (e.g., for the inspector of SDSSimulator).
+ * - The transformations finished since the start of the step are counted even when it is
+ *   disabled (SDSSimulation stops the step after one).
+ */
+
+#include "propertylist.h"
+#include "vector3.h"
+
+#include <string>
+#include <vector>
+#include <list>
+
+class Cell;
+class Vertex;
+class Edge;
+class Face;
+class Tetra;
+
+class TransformTrace
+{
+	public:
+
+	enum Type
+	{
+		BEGIN, // a transformation starts (Transform::reset)
+		END, // and finishes (Transform::finaliseProperties)
+		PROPERTY // a property of the transformation
+	};
+
+	/// the value of a property
+	enum Value
+	{
+		NONE, // only the key
+		STRING, // a string literal (p[0])
+		CELL, // (p[0])
+		VERTEX,
+		EDGE,
+		FACE,
+		TETRA,
+		TRIANGLE, // three vertices (p[0..2])
+		POINT, // (x[0..2])
+		SEGMENT // two points (x[0..5])
+	};
+
+	/// a property is shown as its key, followed by its index and point (if they have been set), and its value
+	struct Event
+	{
+		Type type;
+		Value value;
+		const char* key; // a string literal (or NULL if the trace has kept a copy of the key)
+		int index; // < 0 if not set
+		bool hasPoint; // the point is x[3..5]
+		void* p[3];
+		double x[6];
+
+		/// set the value (each returns the event, so that they can be chained)
+		Event& text(const char* s);
+		Event& cell(Cell* c);
+		Event& vertex(Vertex* v);
+		Event& edge(Edge* e);
+		Event& face(Face* f);
+		Event& tetra(Tetra* t);
+		Event& triangle(Vertex* a, Vertex* b, Vertex* c);
+		Event& point(const Vector3d& a);
+		Event& segment(const Vector3d& a, const Vector3d& b);
+		/// set the index, or point, of the key
+		Event& at(int i);
+		/// PRE: the value isn't a segment
+		Event& at(const Vector3d& a);
+	};
+
+	/// keep the last capacity events
+	TransformTrace(unsigned int capacity = 1024);
+
+	void setEnabled(bool enabled);
+	inline bool enabled() const {return mEnabled;}
+
+	/// keep the last n events (and forget the ones recorded so far)
+	/// PRE: n > 0
+	void setCapacity(unsigned int n);
+	inline unsigned int capacity() const {return mEvents.size();}
+
+	/// record an event (which is thrown away if the trace is disabled)
+	void begin();
+	void end();
+	/// PRE: key is a string literal
+	inline Event& add(const char* key)
+	{
+		if (not mEnabled) return mDiscarded;
+		Event& e = next(PROPERTY);
+		e.key = key;
+		return e;
+	}
+	/// (copies the key, for keys that are formatted, which should only be done if enabled())
+	Event& add(const std::string& key);
+
+	/// start a new step
+	void clearStep();
+	/// the transformations finished since clearStep()
+	inline unsigned int transformations() const {return mTransformations;}
+
+	/// the properties of the last transformation begun
+	PropertyList properties() const;
+	/// the properties of each transformation finished since clearStep()
+	/// (the events that have been overwritten are left out)
+	std::list<PropertyList> allProperties() const;
+
+	protected:
+
+	Event& next(Type type);
+	PropertyList::property_type property(unsigned long n) const;
+	// the first event that is still kept
+	unsigned long oldest() const;
+
+	bool mEnabled;
+	std::vector<Event> mEvents;
+	// the copied keys (by slot)
+	std::vector<std::string> mKeys;
+	// the number of events recorded, and the number when the last transformation and the step began
+	unsigned long mRecorded;
+	unsigned long mBegin;
+	unsigned long mStep;
+	unsigned int mTransformations;
+	// recorded into when disabled
+	Event mDiscarded;
+};
+
+#endif
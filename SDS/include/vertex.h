@@ -65,6 +65,9 @@ public:
 	inline bool tag() const;
 	inline void tag(bool t);
 
+	/// index of this vertex in its mesh's arrays (see MeshArrays)
+	inline unsigned int slot() const;
+
 	// expose this for some things, generally NOT_A_GOOD_IDEA (TM)
 	Vector3d mX; // position
 	Vector3d mOldX; // last position (for the verlet integrator)
@@ -83,6 +86,8 @@ protected:
 
 	bool mTag; // collision tag
 
+	unsigned int mSlot; // slot in MeshArrays
+
 	// derived vars
 	Vector3d mV; // velocity (derived from mX and mOldX)
 	double mR; // radius
@@ -91,11 +96,13 @@ protected:
 	friend class Mesh;
 	friend class Tetra;
 	friend class Physics;
+	friend class StepController;
 	friend class Face;
 	friend class Edge;
 	friend class Stepper;
 	friend class MeshTester;
 	friend class Collision;
+	friend class MeshArrays;
 };
 
 #include "vertex.inl"
@@ -22,6 +22,8 @@ void Vertex::setFrozen(bool f) {mIsFrozen = f;}
 bool Vertex::tag() const {return mTag;}
 void Vertex::tag(bool t){mTag = t;}
 
+unsigned int Vertex::slot() const {return mSlot;}
+
 const std::list<Face*>&	Vertex::surfaceFaces() const {return mFaceNeighbours;}
 const std::list<Vertex*>& Vertex::neighbours() const {return mNeighbours;}
 
@@ -0,0 +1,119 @@
+#include "aabbtree.h"
+
+#include <algorithm>
+
+// orders item indices by one coordinate of their centres
+struct CentreLess
+{
+	const std::vector<Vector3d>& centres;
+	int axis;
+
+	CentreLess(const std::vector<Vector3d>& c, int a):centres(c),axis(a){}
+	bool operator()(unsigned int a, unsigned int b) const {return centres[a][axis] < centres[b][axis];}
+};
+
+static inline bool overlaps(const AABB& a, const AABB& b)
+{
+	const double* pa = a.cpts();
+	const double* pb = b.cpts();
+	return pa[0]<=pb[3] and pb[0]<=pa[3]
+		and pa[1]<=pb[4] and pb[1]<=pa[4]
+		and pa[2]<=pb[5] and pb[2]<=pa[5];
+}
+
+AABBTree::AABBTree()
+{
+}
+
+void AABBTree::clear()
+{
+	mNodes.clear();
+	mItems.clear();
+	mBoxes.clear();
+}
+
+void AABBTree::build(const std::vector<AABB>& boxes)
+{
+	clear();
+	if (boxes.empty()) return;
+	mBoxes = boxes;
+
+	std::vector<Vector3d> centres(boxes.size());
+	mItems.resize(boxes.size());
+	for(unsigned int i=0;i<boxes.size();i++)
+	{
+		centres[i] = boxes[i].c();
+		mItems[i] = i;
+	}
+
+	mNodes.reserve(2*(boxes.size()/LEAF_SIZE + 1));
+	build(0,boxes.size(),boxes,centres);
+}
+
+unsigned int AABBTree::build(unsigned int begin, unsigned int end, const std::vector<AABB>& boxes, const std::vector<Vector3d>& centres)
+{
+	unsigned int index = mNodes.size();
+	mNodes.push_back(Node());
+
+	AABB box = boxes[mItems[begin]];
+	for(unsigned int i=begin+1;i<end;i++)
+		box += boxes[mItems[i]];
+	box.valid(true);
+	mNodes[index].box = box;
+
+	if (end-begin <= LEAF_SIZE)
+	{
+		mNodes[index].first = begin;
+		mNodes[index].second = end;
+		mNodes[index].leaf = true;
+		return index;
+	}
+
+	// split at the median along the longest axis
+	int axis = 0;
+	if (box.dy() > box.dx()) axis = 1;
+	if (box.dz() > ((axis==0)?box.dx():box.dy())) axis = 2;
+
+	unsigned int middle = begin + (end-begin)/2;
+	std::nth_element(mItems.begin()+begin,mItems.begin()+middle,mItems.begin()+end,CentreLess(centres,axis));
+
+	// (mNodes may reallocate, so don't hold a reference across the recursion)
+	unsigned int left = build(begin,middle,boxes,centres);
+	unsigned int right = build(middle,end,boxes,centres);
+	mNodes[index].first = left;
+	mNodes[index].second = right;
+	mNodes[index].leaf = false;
+	return index;
+}
+
+void AABBTree::query(const Vector3d& p, std::vector<unsigned int>& result) const
+{
+	query(AABB(p,p),result);
+}
+
+void AABBTree::query(const AABB& box, std::vector<unsigned int>& result) const
+{
+	if (mNodes.empty()) return;
+
+	// the tree is balanced, so its depth is about log2(n/LEAF_SIZE)
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top>0)
+	{
+		const Node& node = mNodes[stack[--top]];
+		if (not overlaps(node.box,box)) continue;
+
+		if (node.leaf)
+		{
+			for(unsigned int i=node.first;i<node.second;i++)
+				if (overlaps(mBoxes[mItems[i]],box))
+					result.push_back(mItems[i]);
+		}
+		else
+		{
+			stack[top++] = node.second;
+			stack[top++] = node.first;
+		}
+	}
+}
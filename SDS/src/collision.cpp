@@ -8,6 +8,7 @@
 
 #include <cmath>
 #include <set>
+#include <algorithm>
 #include <cfloat>
 #include <iostream>
 #include <iomanip>
@@ -16,6 +17,10 @@
 
 #include "log.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 inline void throwif(bool condition, std::string msg)
 {
 	if (condition) throw Collision::Exception(msg);
@@ -30,44 +35,154 @@ const char* Collision::Exception::what() const throw(){
 	return mDescription.c_str();
 }
 
+int Collision::NUM_THREADS = 1;
+
 Collision::Collision()
 :mCellSize(0),
- mTotalNumberOfEdges(0)
+ mStaticTreesValid(false),
+ mTotalNumberOfEdges(0),
+ mStaticEdgeLength(0),
+ mStaticNumberOfEdges(0)
 {
-	mpHashTable = new std::list<Vertex*>[HASH_TABLE_SIZE]; // XXX: adjust size? dynamically?
-	mpEdgeHashTable = new std::list<EInfo*>[HASH_TABLE_SIZE]; // XXX: what should the size of this hashtable be?
 }
 
 Collision::~Collision()
 {
-	delete[]mpHashTable;
-	delete[]mpEdgeHashTable;
 }
 
-void Collision::detectCollisions()
+int Collision::numThreads()
 {
-	LOG(__FILE__ << __LINE__);
+#ifdef _OPENMP
+	return (NUM_THREADS > 0) ? NUM_THREADS : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+static bool isPrime(unsigned int n)
+{
+	if (n<2) return false;
+	for(unsigned int d=2;d*d<=n;d++)
+		if (n%d==0) return false;
+	return true;
+}
 
-	// XXX: The paper mentions an efficiency gain by NOT DOING THIS
-	// clean up pass
-	// reset all vertex lists in the hash table
-	for(int i=0;i<HASH_TABLE_SIZE;i++)
-		mpHashTable[i].clear();
+template <typename T>
+void Collision::HashTable<T>::reset(unsigned int n)
+{
+	added.clear();
+	addedBuckets.clear();
+
+	// only resize when the load is above 1 or below 1/8, so a slowly growing mesh doesn't resize every step
+	if (size==0 or size<n or (size>8*n and size>MIN_HASH_TABLE_SIZE))
+	{
+		size = std::max(2*n,MIN_HASH_TABLE_SIZE);
+		while (not isPrime(size)) size++;
+	}
+}
+
+template <typename T>
+void Collision::HashTable<T>::build()
+{
+	// counting sort by bucket
+	start.assign(size+1,0);
+	for(unsigned int i=0;i<addedBuckets.size();i++)
+		start[addedBuckets[i]+1]++;
+	for(unsigned int h=0;h<size;h++)
+		start[h+1] += start[h];
+
+	items.resize(added.size());
+	next.assign(start.begin(),start.end()-1);
+	for(unsigned int i=0;i<added.size();i++)
+		items[next[addedBuckets[i]]++] = added[i];
+}
+
+void Collision::buildStaticTrees()
+{
+	std::vector<AABB> boxes;
+
+	mStaticTetras.clear();
+	mStaticTetraShared.clear();
+	BOOST_FOREACH(Mesh* m, mStaticMeshList)
+	{
+		const bool shared = mSharedStaticMeshes.count(m)>0;
+		BOOST_FOREACH(Tetra* t, m->mTetras)
+		{
+			AABB aabb;
+			if (shared)
+				aabb = t->computeAABB();
+			else
+			{
+				t->setIntersected(false);
+				aabb = t->updateAABB();
+			}
+			throwif(not aabb.valid(),"AABB not valid");
+			mStaticTetras.push_back(t);
+			mStaticTetraShared.push_back(shared);
+			boxes.push_back(aabb);
+		}
+	}
+	mStaticTetraTree.build(boxes);
+
+	boxes.clear();
+	mStaticFaces.clear();
+	BOOST_FOREACH(Mesh* m, mStaticMeshList)
+		BOOST_FOREACH(Face* f, m->outerFaces())
+		{
+			mStaticFaces.push_back(f);
+			boxes.push_back(f->aabb());
+		}
+	mStaticFaceTree.build(boxes);
+
+	mIntersectedStaticTetras.clear();
+	mStaticTreesValid = true;
+}
+
+void Collision::updateCellSize()
+{
+	// (the static meshes don't change, so their edges are only summed once)
+	double edgeLength = mStaticEdgeLength;
+	mTotalNumberOfEdges = mStaticNumberOfEdges;
+	BOOST_FOREACH(Mesh* m, mMeshList)
+	{
+		BOOST_FOREACH(Edge* e, m->mEdges)
+			edgeLength += e->rest();
+		mTotalNumberOfEdges += m->mEdges.size();
+	}
+
+	if (mTotalNumberOfEdges>0 and edgeLength>0)
+		mCellSize = edgeLength / mTotalNumberOfEdges;
+}
+
+void Collision::hashVertices()
+{
+	updateCellSize();
+
+	unsigned int n = 0;
+	BOOST_FOREACH(Mesh* m, mMeshList)
+		n += m->mVertices.size();
+	mVertexTable.reset(n);
 
-	// first pass
-	//   hash all vertices into hashtable
 	BOOST_FOREACH(Mesh* m, mMeshList)
 		BOOST_FOREACH(Vertex* v, m->mVertices)
 		{
 			// ignore frozen verts
 			if (v->isFrozen()) continue;
 
-			Vector3d p = v->x();
-			int i = (int)std::floor(p.x() / mCellSize), j = (int)std::floor(p.y() / mCellSize), k = (int)std::floor(p.z() / mCellSize);
-			unsigned int hash_index = hash(i,j,k);
-
-			mpHashTable[hash_index].push_back(v);
+			int gc[3];
+			toGridCoords(v->x(),gc);
+			mVertexTable.add(hash(gc,mVertexTable.size),v);
 		}
+	mVertexTable.build();
+}
+
+void Collision::detectCollisions()
+{
+	LOG(__FILE__ << __LINE__);
+
+	// first pass
+	//   hash all vertices into hashtable
+	hashVertices();
 
 	// second pass
 	// hash tetras to hashtable, and detect intersections...
@@ -94,11 +209,12 @@ void Collision::detectCollisions()
 			for(int iy=min[1];iy<=max[1];++iy)
 			for(int iz=min[2];iz<=max[2];++iz)
 			{
-				unsigned int hash_index = hash(ix,iy,iz);
-				const std::list<Vertex*>& vlist = mpHashTable[hash_index];
+				unsigned int hash_index = hash(ix,iy,iz,mVertexTable.size);
 
-				BOOST_FOREACH(const Vertex* v, vlist)
+				for(unsigned int vi=mVertexTable.start[hash_index];vi<mVertexTable.start[hash_index+1];++vi)
 				{
+					const Vertex* v = mVertexTable.items[vi];
+
 					// ignore those the vertices of t
 					if (t->isVertex(v)) continue;
 
@@ -136,30 +252,23 @@ void Collision::addMesh(Mesh* m)
 	mMeshList.push_back(m);
 
 	// adjust the cell size to an appropriate size
-	double edgeLength = 0;
-	BOOST_FOREACH(Edge* e, m->mEdges)
-		edgeLength += e->rest();
-
-	double otel = mTotalNumberOfEdges * mCellSize;
-	mTotalNumberOfEdges += m->mEdges.size();
-
-	mCellSize = (otel + edgeLength) / mTotalNumberOfEdges;
+	// (this is redone every step, as the edges grow)
+	updateCellSize();
 }
 
-void Collision::addStaticMesh(Mesh* m)
+void Collision::addStaticMesh(Mesh* m, bool shared)
 {
 	mAllMeshes.push_back(m);
 	mStaticMeshList.push_back(m);
+	if (shared) mSharedStaticMeshes.insert(m);
+	mStaticTreesValid = false;
 
-	// adjust the cell size to an appropriate size
-	double edgeLength = 0;
 	BOOST_FOREACH(Edge* e, m->mEdges)
-		edgeLength += e->rest();
-
-	double otel = mTotalNumberOfEdges * mCellSize;
-	mTotalNumberOfEdges += m->mEdges.size();
+		mStaticEdgeLength += e->rest();
+	mStaticNumberOfEdges += m->mEdges.size();
 
-	mCellSize = (otel + edgeLength) / mTotalNumberOfEdges;
+	// adjust the cell size to an appropriate size
+	updateCellSize();
 }
 
 void Collision::setWorldBounds(AABB a)
@@ -171,9 +280,13 @@ void Collision::reset()
 {
 	mMeshList.clear();
 	mStaticMeshList.clear();
+	mSharedStaticMeshes.clear();
 	mAllMeshes.clear();
 	mTotalNumberOfEdges = 0;
 	mCellSize = 0;
+	mStaticTreesValid = false;
+	mStaticEdgeLength = 0;
+	mStaticNumberOfEdges = 0;
 }
 
 /* estimateCollisionDepthAndDirection:
@@ -194,35 +307,18 @@ void Collision::estimateCollisionDepthAndDirection()
 
 	mIntersectingFaceVoxels.clear();
 
+	if (not mStaticTreesValid)
+		buildStaticTrees();
+
 	// 1 point-tetra collision detection
 	// classify all points as colliding or non-colliding
 
-	// XXX: The paper mentions an efficiency gain by NOT DOING THIS
-	// clean up pass
-	// reset all vertex lists in the hash table
-	for(int i=0;i<HASH_TABLE_SIZE;++i)
-	{
-		mpHashTable[i].clear();
-		mpEdgeHashTable[i].clear();
-	}
-
 	// first pass
 	// hash all vertices into hashtable
 	// untag all verts
-	BOOST_FOREACH(Mesh* m, mMeshList)
-	BOOST_FOREACH(Vertex* v, m->mVertices)
-	{
-		// ignore frozen verts
-		if (v->isFrozen()) continue;
-
-		Vector3d p = v->x();
-		int gc[3];
-		toGridCoords(p,gc);
-		unsigned int hash_index = hash(gc);
-		mpHashTable[hash_index].push_back(v);
-
-		v->tag(false);
-	}
+	hashVertices();
+	for(unsigned int i=0;i<mVertexTable.items.size();++i)
+		mVertexTable.items[i]->tag(false);
 
 	// second pass
 	// hash tetras to hashtable, and detect intersections...
@@ -232,10 +328,29 @@ void Collision::estimateCollisionDepthAndDirection()
 	std::list<VInfo> collidedVertInfo;
 	std::set<const Vertex*> collidedVerts;
 
+	mTetras.clear();
+	BOOST_FOREACH(Mesh* m, mMeshList)
+		mTetras.insert(mTetras.end(),m->mTetras.begin(),m->mTetras.end());
+
+	// The tetras are tested in chunks (in parallel), each chunk records the vertices inside its tetras
+	// and the hits are then merged in tetra order, which gives exactly the same result as a serial pass.
+	const int numTetras = mTetras.size();
+	const int numChunks = (numTetras + TETRA_CHUNK_SIZE - 1) / TETRA_CHUNK_SIZE;
+	if ((int)mTetraHits.size() < numChunks)
+		mTetraHits.resize(numChunks);
+	bool invalidAABB = false;
+
 	// XXX: We have AABB for mesh, so use it to quickly cull inviable collisions
-	BOOST_FOREACH(Mesh* m, mAllMeshes)
-		BOOST_FOREACH(Tetra* t, m->mTetras)
+	#pragma omp parallel for schedule(dynamic) num_threads(numThreads()) if(numThreads()>1 and numChunks>1) reduction(||:invalidAABB)
+	for(int c=0;c<numChunks;c++)
+	{
+		std::vector<Hit>& hits = mTetraHits[c];
+		hits.clear();
+
+		const int end = std::min(numTetras,(c+1)*TETRA_CHUNK_SIZE);
+		for(int ti=c*TETRA_CHUNK_SIZE;ti<end;ti++)
 		{
+			Tetra* t = mTetras[ti];
 			t->setIntersected(false);
 
 			// update AABB
@@ -243,7 +358,12 @@ void Collision::estimateCollisionDepthAndDirection()
 			const double* cpts = aabb.cpts();
 
 			// XXX: assume valid
-			throwif(!aabb.valid(),"AABB not valid");
+			// (can't throw out of the parallel loop, so throw after it)
+			if (!aabb.valid())
+			{
+				invalidAABB = true;
+				continue;
+			}
 
 			// get min,max Z coords...
 			int min[3], max[3];
@@ -256,13 +376,11 @@ void Collision::estimateCollisionDepthAndDirection()
 			for(int iy=min[1];iy<=max[1];++iy)
 			for(int iz=min[2];iz<=max[2];++iz)
 			{
-				unsigned int hash_index = hash(ix,iy,iz);
-				const std::list<Vertex*>& vlist = mpHashTable[hash_index];
+				unsigned int hash_index = hash(ix,iy,iz,mVertexTable.size);
 
-				BOOST_FOREACH(Vertex* v, vlist)
+				for(unsigned int vi=mVertexTable.start[hash_index];vi<mVertexTable.start[hash_index+1];++vi)
 				{
-					// only check non collided verts
-					if (collidedVerts.count(v)==1) continue;
+					Vertex* v = mVertexTable.items[vi];
 
 					// ignore those the vertices of t
 					if (t->isVertex(v)) continue;
@@ -277,13 +395,8 @@ void Collision::estimateCollisionDepthAndDirection()
 						if (b.x() >= 0 and b.y() >= 0 and b.z() >= 0 and (b.x()+b.y()+b.z()) <= 1)
 						{
 							// we have an intersection
-
-							// tag tetra as collided
-							// create a new vertex collision struct
-							t->setIntersected(true);
-							VInfo vi = {v, false};
-							collidedVertInfo.push_back(vi);
-							collidedVerts.insert(v);
+							Hit hit = {t, v};
+							hits.push_back(hit);
 						}
 
 						// else no intersection
@@ -294,6 +407,87 @@ void Collision::estimateCollisionDepthAndDirection()
 				}
 			}
 		}
+	}
+
+	throwif(invalidAABB,"AABB not valid");
+
+	// The static tetras don't move, so rather than hashing them each vertex is looked up in
+	// the tree of static tetras, and the first static tetra that contains it is recorded.
+	BOOST_FOREACH(Tetra* t, mIntersectedStaticTetras)
+		t->setIntersected(false);
+	mIntersectedStaticTetras.clear();
+
+	const int numVertices = mVertexTable.items.size();
+	const int numVertexChunks = mStaticTetraTree.empty() ? 0 : (numVertices + VERTEX_CHUNK_SIZE - 1) / VERTEX_CHUNK_SIZE;
+	if ((int)mStaticHits.size() < numVertexChunks)
+		mStaticHits.resize(numVertexChunks);
+
+	#pragma omp parallel for schedule(dynamic) num_threads(numThreads()) if(numThreads()>1 and numVertexChunks>1)
+	for(int c=0;c<numVertexChunks;c++)
+	{
+		std::vector<StaticHit>& hits = mStaticHits[c];
+		hits.clear();
+		std::vector<unsigned int> tetras;
+
+		const int end = std::min(numVertices,(c+1)*VERTEX_CHUNK_SIZE);
+		for(int vi=c*VERTEX_CHUNK_SIZE;vi<end;vi++)
+		{
+			Vertex* v = mVertexTable.items[vi];
+			tetras.clear();
+			mStaticTetraTree.query(v->x(),tetras);
+
+			unsigned int first = mStaticTetras.size();
+			BOOST_FOREACH(unsigned int ti, tetras)
+			{
+				if (ti > first) continue;
+				Vector3d b = mStaticTetras[ti]->bary(v->x());
+				if (b.x() >= 0 and b.y() >= 0 and b.z() >= 0 and (b.x()+b.y()+b.z()) <= 1)
+					first = ti;
+			}
+
+			if (first < mStaticTetras.size())
+			{
+				StaticHit hit = {first, v};
+				hits.push_back(hit);
+			}
+		}
+	}
+
+	// a vertex is assigned to the first tetra found that contains it
+	// (the tetras of the moving meshes first, then the static tetras in order)
+	for(int c=0;c<numChunks;c++)
+		BOOST_FOREACH(const Hit& hit, mTetraHits[c])
+		{
+			// only check non collided verts
+			if (collidedVerts.count(hit.v)==1) continue;
+
+			// tag tetra as collided
+			// create a new vertex collision struct
+			hit.t->setIntersected(true);
+			VInfo vi = {hit.v, false};
+			collidedVertInfo.push_back(vi);
+			collidedVerts.insert(hit.v);
+		}
+
+	mSortedStaticHits.clear();
+	for(int c=0;c<numVertexChunks;c++)
+		mSortedStaticHits.insert(mSortedStaticHits.end(),mStaticHits[c].begin(),mStaticHits[c].end());
+	std::stable_sort(mSortedStaticHits.begin(),mSortedStaticHits.end());
+
+	BOOST_FOREACH(const StaticHit& hit, mSortedStaticHits)
+	{
+		if (collidedVerts.count(hit.v)==1) continue;
+
+		Tetra* t = mStaticTetras[hit.tetra];
+		if (not mStaticTetraShared[hit.tetra] and not t->intersected())
+		{
+			t->setIntersected(true);
+			mIntersectedStaticTetras.push_back(t);
+		}
+		VInfo vi = {hit.v, false};
+		collidedVertInfo.push_back(vi);
+		collidedVerts.insert(hit.v);
+	}
 
 	// 2 intersection point calculation
 	// identify "border points" and "intersecting edges"
@@ -327,6 +521,8 @@ void Collision::estimateCollisionDepthAndDirection()
 
 	// LOG("c" << __LINE__ << "\n");
 	LOG("mIntersectingEdges: " << mIntersectingEdges.size() << "\n");
+	mEdgeTable.reset(mIntersectingEdges.size());
+	std::vector<unsigned int> mHashes; // the buckets of the current edge (an edge crosses only a few voxels)
 	BOOST_FOREACH(EInfo& ei, mIntersectingEdges)
 	{
 		Vector3d a = ei.a->x(), b = ei.b->x();
@@ -338,19 +534,19 @@ void Collision::estimateCollisionDepthAndDirection()
 		b /= mCellSize;
 		bma /= mCellSize;
 
-		std::set<unsigned int> mHashes;
+		mHashes.clear();
 
 		// special case
 		if (ap==bp)
 		{
-			mpEdgeHashTable[hash(ap)].push_back(&ei);
+			mEdgeTable.add(hash(ap,mEdgeTable.size),&ei);
 			continue;
 		}
 
 		// perform voxel traversal from ap->bp
 		// 	foreach (i,j,k) grid location
 		// 		hi = hash(i,j,k)
-		// 		mpEdgeHashTable[hi].push_back(ei)
+		// 		mEdgeTable.add(hi,ei)
 
 		// using the quick voxel traversal algo of
 		// Amanatides&Woo 1987
@@ -396,11 +592,11 @@ void Collision::estimateCollisionDepthAndDirection()
 		{
 			// this edge inhabits the < x,y,z > voxel
 			// add it to the hashmap
-			unsigned int h = hash(x,y,z);
-			if (mHashes.count(h)==0)
+			unsigned int h = hash(x,y,z,mEdgeTable.size);
+			if (std::find(mHashes.begin(),mHashes.end(),h)==mHashes.end())
 			{
-				mHashes.insert(h);
-				mpEdgeHashTable[h].push_back(&ei);
+				mHashes.push_back(h);
+				mEdgeTable.add(h,&ei);
 			}
 
 			// step to the next voxel
@@ -438,11 +634,11 @@ void Collision::estimateCollisionDepthAndDirection()
 		while (continu);
 
 		// have ap!=bp, so need to add bp
-		unsigned int h = hash(bp);
-		if (mHashes.count(h)==0)
+		unsigned int h = hash(bp,mEdgeTable.size);
+		if (std::find(mHashes.begin(),mHashes.end(),h)==mHashes.end())
 		{
-			mHashes.insert(h);
-			mpEdgeHashTable[h].push_back(&ei);
+			mHashes.push_back(h);
+			mEdgeTable.add(h,&ei);
 		}
 
 		//std::list<EInfo*>& elist = mpEdgeHashTable[h];
@@ -450,6 +646,7 @@ void Collision::estimateCollisionDepthAndDirection()
 		//assert(std::find(elist.begin(),elist.end(),&ei)==elist.end());
 		//elist.push_back(&ei);
 	}
+	mEdgeTable.build();
 	// LOG(__LINE__ << "\n");
 
 	// foreach outer face f:
@@ -460,7 +657,7 @@ void Collision::estimateCollisionDepthAndDirection()
 	// 			computing Barycentric coords of intersection point
 	// 			use Bcoords to interpolate a smooth surface normal at the intersect point
 
-	BOOST_FOREACH(Mesh* m, mAllMeshes)
+	BOOST_FOREACH(Mesh* m, mMeshList)
 	BOOST_FOREACH(Face* f, m->outerFaces())
 	{
 		// calculate AABB for this face
@@ -497,70 +694,28 @@ void Collision::estimateCollisionDepthAndDirection()
 				mIntersectingFaceVoxels.push_back(fromVoxelSpaceToAABB(Vector3i(i,j,k))));
 				#endif
 
-				BOOST_FOREACH(EInfo* ei,mpEdgeHashTable[hash(i,j,k)])
-				{
-					// Note: The intersecting edge may intersect MORE THAN ONE face
-					// in this case we will classify it's intersection point as the
-					// point nearest to its non-colliding vertex
-					// see NEAREST
-
-					// ignore edges that belong to this face
-					// and ignore if ei has been set and tested against this face
-					if (f->contains(ei->a) or f->contains(ei->b)) continue;
-					if (ei->set and ei->f==f) continue;
-
-					// if intersect then
-					// set intersection position ei->p, and interpolate face normal ei->n
-
-					// find point in plane of edge intersection
-					// double pdotn = dot(p,n), adotn = dot(ei->a->x(),n), bdotn = dot(ei->b->x(),n);
-					double qdotn = dot(q,norm), adotn = dot(ei->a->x(),norm), bdotn = dot(ei->b->x(),norm);
-					double t = (qdotn - adotn)/(bdotn - adotn);
-					if (0 <= t and t <= 1) // then we have a plane intersection
-					{
-						Vector3d intersectionPt = ei->a->x()*(1-t) + ei->b->x()*t;
-
-						// see if this point falls within the face
-						// by computing its barycentric coords
-
-						double b1,b2;
-						Vector3d a = f->v(0).x(), b = f->v(1).x(), c = f->v(2).x();
-						Math::baryTri(a,b,c,intersectionPt,b1,b2);
-
-						// std::cerr << "bary: " << ei->a->x() << "\t" << ei->b->x() << "\t[" << b1 << ":" << b2 << "]\n";
-
-						if (b1>=0 and b2>=0 and (b1+b2)<=1) // then edge intersects this face
-						{
-							// NEAREST
-							if (ei->set==false or
-									sqdist(intersectionPt,ei->b->x()) < sqdist(ei->p,ei->b->x())
-									)
-							{
-								ei->p = intersectionPt;
-								ei->set = true;
-								ei->f = f;
-							}
-							else
-								continue;
-
-							// Interpolate face norm
-							// f = outerface ==> f.v(i).surface()==true (and hence we can compute the vertex (interpolated) normals)
-							Vector3d an = f->v(0).n(), bn = f->v(1).n(), cn = f->v(2).n();
-
-							// interpolate using the distance from ei->p to a,b,c
-							double p2a = dist(a,ei->p), p2b = dist(b,ei->p), p2c = dist(c,ei->p);
-							double totalDist = p2a+p2b+p2c;
-							double at = totalDist - p2a/totalDist, bt = totalDist - p2b/totalDist, ct = totalDist - p2c/totalDist;
-
-							ei->n = (an*at + bn*bt + cn*ct).normalise();
-
-						}
-					}
-				}
+				unsigned int h = hash(i,j,k,mEdgeTable.size);
+				for(unsigned int ej=mEdgeTable.start[h];ej<mEdgeTable.start[h+1];++ej)
+					intersect(f,mEdgeTable.items[ej]);
 			}
 		}
 	}
 
+	// the outer faces of the static meshes are found with the tree instead
+	if (not mStaticFaceTree.empty())
+	{
+		std::vector<unsigned int> faces;
+		BOOST_FOREACH(EInfo& ei, mIntersectingEdges)
+		{
+			faces.clear();
+			AABB aabb(ei.a->x(),ei.a->x());
+			aabb += AABB(ei.b->x(),ei.b->x());
+			mStaticFaceTree.query(aabb,faces);
+			BOOST_FOREACH(unsigned int i, faces)
+				intersect(mStaticFaces[i],&ei);
+		}
+	}
+
 	// let IP(p) = {v: v is an intersection point and v is adjacent to p}
 	// let w(a,b) = 1/sqlength(a-b)
 	// let nv = surface normal at v
@@ -730,6 +885,70 @@ void Collision::estimateCollisionDepthAndDirection()
 	}
 }
 
+void Collision::intersect(Face* f, EInfo* ei)
+{
+	const Vector3d& norm = f->n();
+	const Vector3d& q = f->q();
+
+	// Note: The intersecting edge may intersect MORE THAN ONE face
+	// in this case we will classify it's intersection point as the
+	// point nearest to its non-colliding vertex
+	// see NEAREST
+
+	// ignore edges that belong to this face
+	// and ignore if ei has been set and tested against this face
+	if (f->contains(ei->a) or f->contains(ei->b)) return;
+	if (ei->set and ei->f==f) return;
+
+	// if intersect then
+	// set intersection position ei->p, and interpolate face normal ei->n
+
+	// find point in plane of edge intersection
+	// double pdotn = dot(p,n), adotn = dot(ei->a->x(),n), bdotn = dot(ei->b->x(),n);
+	double qdotn = dot(q,norm), adotn = dot(ei->a->x(),norm), bdotn = dot(ei->b->x(),norm);
+	double t = (qdotn - adotn)/(bdotn - adotn);
+	if (0 <= t and t <= 1) // then we have a plane intersection
+	{
+		Vector3d intersectionPt = ei->a->x()*(1-t) + ei->b->x()*t;
+
+		// see if this point falls within the face
+		// by computing its barycentric coords
+
+		double b1,b2;
+		Vector3d a = f->v(0).x(), b = f->v(1).x(), c = f->v(2).x();
+		Math::baryTri(a,b,c,intersectionPt,b1,b2);
+
+		// std::cerr << "bary: " << ei->a->x() << "\t" << ei->b->x() << "\t[" << b1 << ":" << b2 << "]\n";
+
+		if (b1>=0 and b2>=0 and (b1+b2)<=1) // then edge intersects this face
+		{
+			// NEAREST
+			if (ei->set==false or
+					sqdist(intersectionPt,ei->b->x()) < sqdist(ei->p,ei->b->x())
+					)
+			{
+				ei->p = intersectionPt;
+				ei->set = true;
+				ei->f = f;
+			}
+			else
+				return;
+
+			// Interpolate face norm
+			// f = outerface ==> f.v(i).surface()==true (and hence we can compute the vertex (interpolated) normals)
+			Vector3d an = f->v(0).n(), bn = f->v(1).n(), cn = f->v(2).n();
+
+			// interpolate using the distance from ei->p to a,b,c
+			double p2a = dist(a,ei->p), p2b = dist(b,ei->p), p2c = dist(c,ei->p);
+			double totalDist = p2a+p2b+p2c;
+			double at = totalDist - p2a/totalDist, bt = totalDist - p2b/totalDist, ct = totalDist - p2c/totalDist;
+
+			ei->n = (an*at + bn*bt + cn*ct).normalise();
+
+		}
+	}
+}
+
 // a trivial response procedure
 // simply push back the penetrating vertices out of the mesh
 // and set the outgoing velocity to be proportional to the penetration dist
@@ -886,7 +1105,8 @@ std::string Collision::str()
 {
 	std::ostringstream info;
 	info <<
-		"HASH_TABLE_SIZE: " << HASH_TABLE_SIZE << std::endl <<
+		"Vertex hash table size: " << mVertexTable.size << std::endl <<
+		"Edge hash table size: " << mEdgeTable.size << std::endl <<
 		"CO_RESTITUTION: " <<  CO_RESTITUTION << std::endl <<
 		"CO_KINETIC_FRICTION: " << CO_KINETIC_FRICTION << std::endl <<
 		"CO_STATIC_FRICTION: " << CO_STATIC_FRICTION << std::endl;
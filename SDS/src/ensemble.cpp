@@ -0,0 +1,94 @@
+#include "ensemble.h"
+
+#include "mesh.h"
+
+#include <exception>
+#include <boost/foreach.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+Ensemble::Ensemble(int threads)
+:mThreads(threads)
+{
+}
+
+Ensemble::~Ensemble()
+{
+	for(unsigned int i=0;i<mSimulations.size();i++)
+	{
+		delete mSimulations[i];
+		delete mContexts[i];
+	}
+
+	BOOST_FOREACH(Mesh* m, mStaticMeshes)
+		delete m;
+}
+
+SDSSimulation* Ensemble::add()
+{
+	SimulationContext* c = new SimulationContext();
+	SDSSimulation* s = new SDSSimulation(c);
+	BOOST_FOREACH(Mesh* m, mStaticMeshes)
+		s->addSharedStaticMesh(m);
+
+	mContexts.push_back(c);
+	mSimulations.push_back(s);
+	mStopped.push_back(false);
+	return s;
+}
+
+void Ensemble::addStaticMesh(Mesh* m)
+{
+	mStaticMeshes.push_back(m);
+	BOOST_FOREACH(SDSSimulation* s, mSimulations)
+		s->addSharedStaticMesh(m);
+}
+
+bool Ensemble::running(unsigned int i)
+{
+	return not mStopped[i] and mSimulations[i]->world()!=NULL and mSimulations[i]->state()!=SDSSimulation::UNSTABLE;
+}
+
+int Ensemble::numThreads() const
+{
+#ifdef _OPENMP
+	return (mThreads > 0) ? mThreads : omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+int Ensemble::step()
+{
+	const int n = mSimulations.size();
+	int numRunning = 0;
+
+	// (the simulations take very different times, so they are handed out one at a time)
+	#pragma omp parallel for schedule(dynamic) num_threads(numThreads()) reduction(+:numRunning)
+	for(int i=0;i<n;i++)
+	{
+		if (not running(i)) continue;
+		step(i);
+		if (running(i)) numRunning++;
+	}
+	return numRunning;
+}
+
+void Ensemble::step(unsigned int i)
+{
+	SDSSimulation* s = mSimulations[i];
+	try
+	{
+		// (substep also returns true when the simulation becomes unstable)
+		while (not s->substep())
+			;
+	}
+	catch(std::exception& e)
+	{
+		// (an exception can't leave the parallel loop)
+		s->setErrorMessage(e.what());
+		mStopped[i] = true;
+	}
+}
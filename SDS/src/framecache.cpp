@@ -0,0 +1,219 @@
+#include "framecache.h"
+
+#include "organism.h"
+#include "mesh.h"
+#include "vertex.h"
+#include "edge.h"
+#include "face.h"
+#include "tetra.h"
+#include "cell.h"
+#include "segmentio.h"
+
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/foreach.hpp>
+
+const unsigned long FrameCache::DEFAULT_BUDGET;
+const int FrameCache::DEFAULT_PREFETCH;
+
+// what each element costs on top of its object (the containers of the mesh and organism, the maps of ids)
+const unsigned long ELEMENT_OVERHEAD = 64;
+
+FrameCache::FrameCache(std::string header, unsigned long budget) throw(SimulationLoader::LoadException)
+:mLoader(header)
+,mProcessModel(NULL)
+,mBudget(budget)
+,mBytes(0)
+,mCurrent(-1)
+,mDirection(1)
+{
+	if (not (mLoader.hasSegment(MeshSegmentIO::type) and mLoader.hasSegment(OrganismSegmentIO::type)))
+		throw SimulationLoader::LoadException("Simulation file must contain mesh and organism segments.");
+	if (not mLoader.loadData())
+		throw SimulationLoader::LoadException("Simulation frame data cannot be read.");
+
+	// (the frame headers only)
+	BOOST_FOREACH(const SimulationIO_Base::FrameIndexEntry& e, mLoader.frameIndex())
+		mTimes.push_back(e.time);
+
+	mProcessModel = mLoader.simulationHeader().processModel;
+	if (mProcessModel!=NULL and not mLoader.hasSegment(ProcessModelSegmentIO::type))
+		mProcessModel = NULL;
+}
+
+FrameCache::~FrameCache()
+{
+	while (not mFrames.empty())
+		remove(mFrames.begin());
+	delete mLoader.simulationHeader().processModel;
+}
+
+Organism* FrameCache::frame(int f)
+{
+	if (f < 0 or f >= numberOfFrames())
+		return NULL;
+
+	if (mCurrent >= 0 and f!=mCurrent)
+		mDirection = (f < mCurrent) ? -1 : 1;
+
+	std::map<int,Entry>::iterator it = mFrames.find(f);
+	Organism* o = NULL;
+	if (it!=mFrames.end())
+	{
+		// most recently used
+		mUsed.splice(mUsed.begin(),mUsed,it->second.used);
+		o = it->second.organism;
+	}
+	else
+	{
+		o = decode(f);
+		if (o==NULL) return NULL;
+	}
+	mCurrent = f;
+
+	// (the current frame is kept even if it doesn't fit)
+	evict(0,f);
+	return o;
+}
+
+bool FrameCache::prefetch(int ahead)
+{
+	if (mCurrent < 0)
+		return false;
+
+	for(int i=1;i<=ahead;i++)
+	{
+		int f = mCurrent + i*mDirection;
+		if (f < 0 or f >= numberOfFrames())
+			return false;
+		if (isCached(f))
+			continue;
+
+		// (as large as the current frame, near enough)
+		unsigned long estimate = mFrames.count(mCurrent) ? mFrames[mCurrent].bytes : 0;
+		if (not evict(estimate,f))
+			return false;
+
+		// the prefetched frame is used after the ones before it
+		std::list<int>::iterator before = mUsed.end();
+		for(int j=i-1;j>=0;j--)
+		{
+			std::map<int,Entry>::iterator it = mFrames.find(mCurrent + j*mDirection);
+			if (it!=mFrames.end())
+			{
+				before = it->second.used;
+				break;
+			}
+		}
+
+		if (decode(f)==NULL)
+			return false;
+		if (before!=mUsed.end())
+			mUsed.splice(before,mUsed,mFrames[f].used);
+		return true;
+	}
+	return false;
+}
+
+void FrameCache::setBudget(unsigned long bytes)
+{
+	mBudget = bytes;
+	evict(0,mCurrent);
+}
+
+unsigned long FrameCache::bytes(Organism* o)
+{
+	Mesh* m = o->mesh();
+	unsigned long n = m->vertices().size() + m->edges().size() + m->faces().size() + m->tetras().size() + o->cells().size();
+	return m->vertices().size()*sizeof(Vertex)
+		+ m->edges().size()*sizeof(Edge)
+		+ m->faces().size()*sizeof(Face)
+		+ m->tetras().size()*sizeof(Tetra)
+		+ o->cells().size()*sizeof(Cell)
+		+ n*ELEMENT_OVERHEAD
+		+ sizeof(Mesh) + sizeof(Organism);
+}
+
+Organism* FrameCache::decode(int f)
+{
+	if (not mLoader.setFrame(f))
+		return NULL;
+
+	// (as Simulator::loadFrame)
+	Organism* o = NULL;
+	try
+	{
+		Mesh* m = new Mesh();
+		o = new Organism(m);
+
+		MeshSegmentIO ml(m);
+		mLoader.initialiseSegmentLoader(&ml);
+		mLoader.loadSegment(&ml);
+
+		OrganismSegmentIO oio(o);
+		mLoader.initialiseSegmentLoader(&oio);
+		mLoader.loadSegment(&oio);
+
+		if (mProcessModel)
+		{
+			o->setProcessModel(mProcessModel);
+			ProcessModelSegmentIO pml(o);
+			if (not mLoader.initialiseSegmentLoader(&pml))
+				throw std::runtime_error("Couldn't load process info!");
+			mLoader.loadSegment(&pml);
+		}
+	}
+	catch (std::exception& e)
+	{
+		std::cerr << "FrameCache: can't read frame " << f << ": " << e.what() << std::endl;
+		if (o)
+		{
+			o->setProcessModel(NULL);
+			delete o;
+		}
+		return NULL;
+	}
+
+	Entry entry;
+	entry.organism = o;
+	entry.bytes = bytes(o);
+	mUsed.push_front(f);
+	entry.used = mUsed.begin();
+	mFrames[f] = entry;
+	mBytes += entry.bytes;
+	return o;
+}
+
+bool FrameCache::evict(unsigned long bytes, int last)
+{
+	// the frames from the current one to last are kept
+	int first = std::min(mCurrent,last), end = std::max(mCurrent,last);
+
+	std::list<int>::iterator it = mUsed.end();
+	while (mBytes + bytes > mBudget and it!=mUsed.begin())
+	{
+		--it;
+		if (*it >= first and *it <= end)
+			continue;
+
+		std::list<int>::iterator next = it;
+		++next;
+		remove(mFrames.find(*it));
+		it = next;
+	}
+	return mBytes + bytes <= mBudget;
+}
+
+void FrameCache::remove(std::map<int,Entry>::iterator it)
+{
+	Organism* o = it->second.organism;
+	// (the process model is shared)
+	o->setProcessModel(NULL);
+	delete o;
+
+	mBytes -= it->second.bytes;
+	mUsed.erase(it->second.used);
+	mFrames.erase(it);
+}
@@ -0,0 +1,390 @@
+#include "framemap.h"
+
+#include "segmentio.h"
+
+#include <cstring>
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+const unsigned long FrameMap::DEFAULT_WINDOW;
+const unsigned long MeshView::VERTEX_SIZE;
+
+// read a T from p and move past it (the data in the mapping isn't aligned)
+template <typename T>
+static inline T get(const char*& p)
+{
+	T t;
+	std::memcpy(&t,p,sizeof(T));
+	p += sizeof(T);
+	return t;
+}
+
+FrameMap::FrameMap(std::string header) throw(SimulationLoader::LoadException)
+:mLoader(header)
+,mFileSize(0)
+,mWindow(0)
+,mGranularity(1)
+,mData(NULL)
+,mOffset(0)
+,mSize(0)
+{
+	BOOST_FOREACH(std::string s, mLoader.segments())
+		mSegments.push_back(s);
+	if (mLoader.hasSegment(MeshSegmentIO::type))
+	{
+		MeshSegmentIO ml(NULL);
+		mLoader.initialiseSegmentLoader(&ml);
+		mMeshVersion = ml.version;
+	}
+
+	SimulationIO_Base::SimulationHeader hdr = mLoader.simulationHeader();
+	mFileName = hdr.getAbsolutePath(hdr.frameDataFileName);
+
+	#ifdef _WIN32
+	mMapping = NULL;
+	mFile = CreateFileA(mFileName.c_str(),GENERIC_READ,FILE_SHARE_READ|FILE_SHARE_WRITE,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+	if (mFile==INVALID_HANDLE_VALUE)
+		throw SimulationLoader::LoadException("Simulation frame data cannot be opened.");
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	mGranularity = si.dwAllocationGranularity;
+	#else
+	mFile = open(mFileName.c_str(),O_RDONLY);
+	if (mFile < 0)
+		throw SimulationLoader::LoadException("Simulation frame data cannot be opened.");
+	mGranularity = sysconf(_SC_PAGESIZE);
+	#endif
+
+	refresh();
+	mWindow = (sizeof(void*) >= 8) ? 0 : DEFAULT_WINDOW;
+}
+
+FrameMap::~FrameMap()
+{
+	unmap();
+	#ifdef _WIN32
+	CloseHandle(mFile);
+	#else
+	close(mFile);
+	#endif
+	delete mLoader.simulationHeader().processModel;
+}
+
+int FrameMap::segmentIndex(std::string type) const
+{
+	std::vector<std::string>::const_iterator it = std::find(mSegments.begin(),mSegments.end(),type);
+	return (it==mSegments.end()) ? -1 : (it - mSegments.begin());
+}
+
+int FrameMap::refresh()
+{
+	unmap();
+	mIndex = mLoader.frameIndex();
+	try
+	{
+		mFileSize = boost::filesystem::file_size(mFileName);
+	}
+	catch(boost::filesystem::filesystem_error& e)
+	{
+		mFileSize = 0;
+		mIndex.clear();
+	}
+	return mIndex.size();
+}
+
+FrameMap::Span FrameMap::frame(int f)
+{
+	if (f < 0 or f >= numberOfFrames())
+		return Span();
+
+	SimulationIO_Base::FrameHeader fh = frameHeader(f);
+	boost::uint64_t offset = mIndex[f].offset + SimulationIO_Base::FrameHeader::size();
+	if (offset + fh.sizeInBytes > mFileSize)
+		return Span();
+	const char* data = map(offset,fh.sizeInBytes);
+	return data ? Span(data,fh.sizeInBytes) : Span();
+}
+
+SimulationIO_Base::FrameHeader FrameMap::frameHeader(int f)
+{
+	SimulationIO_Base::FrameHeader fh;
+	fh.sizeInBytes = fh.number = fh.step = 0;
+	fh.time = 0;
+
+	const char* p = map(mIndex[f].offset,SimulationIO_Base::FrameHeader::size());
+	if (p)
+	{
+		fh.sizeInBytes = get<unsigned int>(p);
+		fh.number = get<unsigned int>(p);
+		fh.time = get<double>(p);
+		fh.step = get<unsigned int>(p);
+	}
+	return fh;
+}
+
+FrameMap::Span FrameMap::segment(int f, int index)
+{
+	Span fr = frame(f);
+	if (fr.empty() or index < 0)
+		return Span();
+
+	// each segment starts with its size (see SimulationWriter::writeSegment)
+	const char* p = fr.data;
+	const char* end = fr.data + fr.size;
+	for(int i=0;;i++)
+	{
+		if (end - p < (long)sizeof(unsigned long))
+			return Span();
+		unsigned long size = get<unsigned long>(p);
+		if ((unsigned long)(end - p) < size)
+			return Span();
+		if (i==index)
+			return Span(p,size);
+		p += size;
+	}
+}
+
+FrameMap::Span FrameMap::segment(int f, std::string type)
+{
+	return segment(f,segmentIndex(type));
+}
+
+bool FrameMap::mesh(int f, MeshView& view)
+{
+	Span s = segment(f,MeshSegmentIO::type);
+	return (not s.empty()) and view.set(s,mMeshVersion);
+}
+
+void FrameMap::setWindow(boost::uint64_t bytes)
+{
+	unmap();
+	mWindow = bytes;
+}
+
+const char* FrameMap::map(boost::uint64_t offset, boost::uint64_t size)
+{
+	if (offset + size > mFileSize)
+		return NULL;
+	if (mData and offset >= mOffset and offset + size <= mOffset + mSize)
+		return mData + (offset - mOffset);
+	unmap();
+
+	// (the whole file, or a window starting at the bytes asked for)
+	boost::uint64_t begin = 0, length = mFileSize;
+	if (mWindow > 0)
+	{
+		begin = offset - offset%mGranularity;
+		length = std::min(std::max(offset + size - begin, mWindow), mFileSize - begin);
+	}
+	if (length==0 or (boost::uint64_t)(std::size_t)length!=length)
+		return NULL;
+
+	#ifdef _WIN32
+	mMapping = CreateFileMappingA(mFile,NULL,PAGE_READONLY,0,0,NULL);
+	if (mMapping==NULL)
+		return NULL;
+	void* data = MapViewOfFile(mMapping,FILE_MAP_READ,(DWORD)(begin >> 32),(DWORD)begin,(SIZE_T)length);
+	if (data==NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+		return NULL;
+	}
+	#else
+	void* data = mmap(NULL,length,PROT_READ,MAP_SHARED,mFile,(off_t)begin);
+	if (data==MAP_FAILED)
+	{
+		// (there may not be room for the whole file)
+		if (mWindow > 0 or length <= DEFAULT_WINDOW)
+			return NULL;
+		mWindow = DEFAULT_WINDOW;
+		return map(offset,size);
+	}
+	// the frames are mostly read in order
+	posix_madvise(data,length,POSIX_MADV_SEQUENTIAL);
+	#endif
+
+	mData = static_cast<char*>(data);
+	mOffset = begin;
+	mSize = length;
+	return mData + (offset - mOffset);
+}
+
+void FrameMap::unmap()
+{
+	if (mData==NULL)
+		return;
+
+	#ifdef _WIN32
+	UnmapViewOfFile(mData);
+	CloseHandle(mMapping);
+	mMapping = NULL;
+	#else
+	munmap(mData,mSize);
+	#endif
+	mData = NULL;
+	mOffset = mSize = 0;
+}
+
+/*********************************************************************************************/
+
+MeshView::MeshView()
+:mVertices(NULL)
+,mEnd(NULL)
+,mKeyframeDistance(0)
+,mNumberOfVertices(0)
+,mNumberOfEdges(0)
+,mNumberOfTetras(0)
+,mNumberOfOuterFaces(0)
+{}
+
+bool MeshView::set(FrameMap::Span segment, std::string version)
+{
+	mVertices = NULL;
+	mKeyframeDistance = 0;
+	mNumberOfVertices = mNumberOfEdges = mNumberOfTetras = mNumberOfOuterFaces = 0;
+	if (segment.empty())
+		return false;
+
+	const char* p = segment.data;
+	mEnd = segment.data + segment.size;
+
+	// (as MeshSegmentIO::load)
+	unsigned long headerSize = 4*sizeof(unsigned int) + 6*sizeof(double);
+	if (version=="topodelta")
+	{
+		if (segment.size < sizeof(unsigned int))
+			return false;
+		mKeyframeDistance = get<unsigned int>(p);
+		if (mKeyframeDistance > 0)
+			headerSize -= sizeof(unsigned int);
+	}
+	else if (version!="19042010" and version!="withspringmultipliers" and version!="full")
+		return false;
+	if ((unsigned long)(mEnd - p) < headerSize)
+		return false;
+
+	mNumberOfVertices = get<unsigned int>(p);
+	mNumberOfEdges = get<unsigned int>(p);
+	mNumberOfTetras = get<unsigned int>(p);
+	if (keyframe())
+		mNumberOfOuterFaces = get<unsigned int>(p);
+	for(int i=0;i<6;i++)
+		mAABB[i] = get<double>(p);
+	mAABB.validate();
+
+	if ((unsigned long)(mEnd - p)/VERTEX_SIZE < mNumberOfVertices)
+		return false;
+	mVertices = p;
+	return true;
+}
+
+Vector3d MeshView::x(unsigned int i) const
+{
+	const char* p = mVertices + i*VERTEX_SIZE;
+	double x = get<double>(p);
+	double y = get<double>(p);
+	double z = get<double>(p);
+	return Vector3d(x,y,z);
+}
+
+void MeshView::positions(std::vector<Vector3d>& xs) const
+{
+	xs.resize(mNumberOfVertices);
+	for(unsigned int i=0;i<mNumberOfVertices;i++)
+		xs[i] = x(i);
+}
+
+// the largest id in ids (or 0)
+static unsigned int maxId(const std::vector<unsigned int>& ids)
+{
+	return ids.empty() ? 0 : *std::max_element(ids.begin(),ids.end());
+}
+
+bool MeshView::topology(MeshTopology& t) const
+{
+	if (mVertices==NULL or not keyframe())
+		return false;
+
+	const unsigned int nv = mNumberOfVertices;
+	const char* p = mVertices + nv*VERTEX_SIZE;
+	const unsigned long UINT = sizeof(unsigned int);
+
+	// (as Mesh::bReadFull)
+	t.surface.resize(nv);
+	t.neighbourStart.resize(nv+1);
+	t.neighbours.clear();
+	for(unsigned int i=0;i<nv;i++)
+	{
+		if (mEnd - p < 1)
+			return false;
+		t.surface[i] = get<char>(p);
+		if (t.surface[i]==1)
+		{
+			// (the faces of a vertex can be found from the faces)
+			if ((unsigned long)(mEnd - p) < UINT)
+				return false;
+			unsigned int n = get<unsigned int>(p);
+			if ((unsigned long)(mEnd - p)/UINT < n)
+				return false;
+			p += n*UINT;
+		}
+
+		if ((unsigned long)(mEnd - p) < UINT)
+			return false;
+		unsigned int n = get<unsigned int>(p);
+		if ((unsigned long)(mEnd - p)/UINT < n)
+			return false;
+		t.neighbourStart[i] = t.neighbours.size();
+		for(unsigned int j=0;j<n;j++)
+			t.neighbours.push_back(get<unsigned int>(p));
+	}
+	t.neighbourStart[nv] = t.neighbours.size();
+
+	const unsigned long EDGE_SIZE = 2*UINT + 2*sizeof(double);
+	const unsigned long FACE_SIZE = 3*UINT + sizeof(double);
+	const unsigned long TETRA_SIZE = 4*UINT + 4*sizeof(int) + 2*sizeof(double) + 2*sizeof(bool);
+	if ((unsigned long)(mEnd - p) < mNumberOfEdges*EDGE_SIZE + mNumberOfOuterFaces*FACE_SIZE + mNumberOfTetras*TETRA_SIZE)
+		return false;
+
+	t.edges.resize(2*mNumberOfEdges);
+	for(unsigned int i=0;i<mNumberOfEdges;i++)
+	{
+		t.edges[2*i] = get<unsigned int>(p);
+		t.edges[2*i+1] = get<unsigned int>(p);
+		p += 2*sizeof(double); // rest, spring coefficient
+	}
+
+	t.faces.resize(3*mNumberOfOuterFaces);
+	for(unsigned int i=0;i<mNumberOfOuterFaces;i++)
+	{
+		for(int j=0;j<3;j++)
+			t.faces[3*i+j] = get<unsigned int>(p);
+		p += sizeof(double); // rest
+	}
+
+	t.tetras.resize(4*mNumberOfTetras);
+	t.tetraNeighbours.resize(4*mNumberOfTetras);
+	for(unsigned int i=0;i<mNumberOfTetras;i++)
+	{
+		for(int j=0;j<4;j++)
+			t.tetras[4*i+j] = get<unsigned int>(p);
+		for(int j=0;j<4;j++)
+			t.tetraNeighbours[4*i+j] = get<int>(p);
+		p += 2*sizeof(double) + 2*sizeof(bool); // spring coefficient, outer, rest, intersected
+	}
+
+	// (the ids are used to look up positions)
+	return maxId(t.neighbours) < nv and maxId(t.edges) < nv and maxId(t.faces) < nv and maxId(t.tetras) < nv;
+}
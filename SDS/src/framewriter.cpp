@@ -0,0 +1,270 @@
+#include "framewriter.h"
+
+#include "bstreamable.h"
+
+#include <cstring>
+#include <algorithm>
+#include <streambuf>
+#include <ostream>
+
+#include <boost/foreach.hpp>
+
+const unsigned int FrameWriter::DEFAULT_QUEUE_SIZE;
+
+// appends what is written to a buffer (which keeps its capacity from frame to frame)
+class BufferStreambuf: public std::streambuf
+{
+	public:
+
+	BufferStreambuf(std::vector<char>& b):mBuffer(b){}
+
+	protected:
+
+	virtual int_type overflow(int_type c)
+	{
+		if (c!=traits_type::eof())
+			mBuffer.push_back(traits_type::to_char_type(c));
+		return traits_type::not_eof(c);
+	}
+
+	virtual std::streamsize xsputn(const char* s, std::streamsize n)
+	{
+		mBuffer.insert(mBuffer.end(),s,s+n);
+		return n;
+	}
+
+	std::vector<char>& mBuffer;
+};
+
+// overwrite the T at position at of b
+template <typename T>
+static void patch(std::vector<char>& b, std::size_t at, T t)
+{
+	std::memcpy(&b[at],&t,sizeof(T));
+}
+
+FrameWriter::FrameWriter(std::string frameDataFileName, std::list<SegmentWriter*> segmentWriters, std::list<SegmentWriter*> staticSegmentWriters, unsigned int queueSize)
+:mSegmentWriters(segmentWriters)
+,mOpen(false)
+,mGood(false)
+,mNumberOfFramesWritten(0)
+,mQueueSize(queueSize)
+,mWriting(false)
+,mStop(false)
+{
+	mFile.open(frameDataFileName.c_str(),std::ios::binary);
+	mOpen = mFile.is_open();
+	if (mOpen)
+	{
+		SimulationWriter::writeFrameDataHeader(mFile);
+		if (not staticSegmentWriters.empty())
+			SimulationWriter::writeStaticSegments(mFile, staticSegmentWriters);
+
+		mIndexFile.open(SimulationWriter::frameIndexFileName(frameDataFileName).c_str(),std::ios::binary);
+		SimulationWriter::writeFrameIndexHeader(mIndexFile);
+		mGood = mFile.good();
+	}
+
+	// (one frame is enough to write from the calling thread)
+	for(unsigned int i=0;i<std::max(mQueueSize,1u);i++)
+	{
+		mFrames.push_back(new Frame());
+		mFree.push_back(mFrames.back());
+	}
+
+	pthread_mutex_init(&mMutex,NULL);
+	pthread_cond_init(&mChanged,NULL);
+	if (mQueueSize > 0 and pthread_create(&mThread,NULL,&FrameWriter::run,this)!=0)
+		mQueueSize = 0;
+}
+
+FrameWriter::~FrameWriter()
+{
+	if (mQueueSize > 0)
+	{
+		pthread_mutex_lock(&mMutex);
+		mStop = true;
+		pthread_cond_broadcast(&mChanged);
+		pthread_mutex_unlock(&mMutex);
+		pthread_join(mThread,NULL);
+	}
+	pthread_cond_destroy(&mChanged);
+	pthread_mutex_destroy(&mMutex);
+
+	BOOST_FOREACH(Frame* f, mFrames)
+		delete f;
+}
+
+bool FrameWriter::good()
+{
+	pthread_mutex_lock(&mMutex);
+	bool good = mGood;
+	pthread_mutex_unlock(&mMutex);
+	return good;
+}
+
+void FrameWriter::write(int number, double time, int step)
+{
+	if (not mOpen)
+		return;
+
+	if (mQueueSize==0)
+	{
+		// (encoded straight from the segment writers)
+		Frame& f = *mFree.front();
+		f.number = number;
+		f.time = time;
+		f.step = step;
+		f.writers.assign(mSegmentWriters.begin(),mSegmentWriters.end());
+		f.owned = false;
+		encode(f);
+		writeOut(f.data);
+		return;
+	}
+
+	// wait for a frame
+	pthread_mutex_lock(&mMutex);
+	while (mFree.empty())
+		pthread_cond_wait(&mChanged,&mMutex);
+	Frame* f = mFree.back();
+	mFree.pop_back();
+	pthread_mutex_unlock(&mMutex);
+
+	take(*f,number,time,step);
+
+	pthread_mutex_lock(&mMutex);
+	mQueued.push_back(f);
+	pthread_cond_broadcast(&mChanged);
+	pthread_mutex_unlock(&mMutex);
+}
+
+void FrameWriter::flush()
+{
+	pthread_mutex_lock(&mMutex);
+	while (not mQueued.empty() or mWriting)
+		pthread_cond_wait(&mChanged,&mMutex);
+	pthread_mutex_unlock(&mMutex);
+}
+
+int FrameWriter::numberOfFramesWritten()
+{
+	pthread_mutex_lock(&mMutex);
+	int n = mNumberOfFramesWritten;
+	pthread_mutex_unlock(&mMutex);
+	return n;
+}
+
+void FrameWriter::take(Frame& f, int number, double time, int step)
+{
+	f.number = number;
+	f.time = time;
+	f.step = step;
+	f.writers.clear();
+	f.segments.resize(mSegmentWriters.size());
+	f.owned = true;
+
+	int i = 0;
+	BOOST_FOREACH(SegmentWriter* sw, mSegmentWriters)
+	{
+		SegmentWriter* s = sw->snapshot();
+		f.writers.push_back(s);
+		if (s==NULL)
+		{
+			Buffer& b = f.segments[i];
+			b.clear();
+			BufferStreambuf buf(b);
+			std::ostream out(&buf);
+			sw->write(out);
+		}
+		i++;
+	}
+}
+
+void FrameWriter::encode(Frame& f)
+{
+	Buffer& b = f.data;
+	b.clear();
+	BufferStreambuf buf(b);
+	std::ostream out(&buf);
+
+	// (as SimulationWriter::writeFrame, with the sizes patched in afterwards)
+	SimulationIO_Base::FrameHeader fh;
+	fh.sizeInBytes = 0;
+	fh.number = f.number;
+	fh.time = f.time;
+	fh.step = f.step;
+	SimulationWriter::writeFrameHeader(out,fh);
+
+	for(unsigned int i=0;i<f.writers.size();i++)
+	{
+		std::size_t at = b.size();
+		::write(out,(unsigned long)0);
+		if (f.writers[i]!=NULL)
+		{
+			f.writers[i]->write(out);
+			if (f.owned)
+				delete f.writers[i];
+		}
+		else
+			b.insert(b.end(),f.segments[i].begin(),f.segments[i].end());
+		patch(b,at,(unsigned long)(b.size() - at - sizeof(unsigned long)));
+	}
+	f.writers.clear();
+	patch(b,0,(unsigned int)(b.size() - SimulationIO_Base::FrameHeader::size()));
+}
+
+void FrameWriter::writeOut(const Buffer& b)
+{
+	SimulationIO_Base::FrameHeader fh;
+	std::memcpy(&fh.sizeInBytes,&b[0],sizeof(unsigned int));
+	std::memcpy(&fh.number,&b[sizeof(unsigned int)],sizeof(unsigned int));
+	std::memcpy(&fh.time,&b[2*sizeof(unsigned int)],sizeof(double));
+	std::memcpy(&fh.step,&b[2*sizeof(unsigned int) + sizeof(double)],sizeof(unsigned int));
+
+	boost::uint64_t offset = mFile.tellp();
+	mFile.write(&b[0],b.size());
+	mFile.flush();
+
+	// and index it (after the frame, so a reader never sees an entry for a partial frame)
+	if (mIndexFile)
+	{
+		SimulationWriter::writeFrameIndexEntry(mIndexFile,offset,fh);
+		mIndexFile.flush();
+	}
+
+	bool good = mFile.good();
+	pthread_mutex_lock(&mMutex);
+	mGood = mGood and good;
+	mNumberOfFramesWritten++;
+	pthread_mutex_unlock(&mMutex);
+}
+
+void* FrameWriter::run(void* writer)
+{
+	FrameWriter& w = *static_cast<FrameWriter*>(writer);
+
+	pthread_mutex_lock(&w.mMutex);
+	while (true)
+	{
+		while (w.mQueued.empty() and not w.mStop)
+			pthread_cond_wait(&w.mChanged,&w.mMutex);
+		// (the frames that are waiting are written before stopping)
+		if (w.mQueued.empty())
+			break;
+
+		Frame* f = w.mQueued.front();
+		w.mQueued.pop_front();
+		w.mWriting = true;
+		pthread_mutex_unlock(&w.mMutex);
+
+		w.encode(*f);
+		w.writeOut(f->data);
+
+		pthread_mutex_lock(&w.mMutex);
+		w.mWriting = false;
+		w.mFree.push_back(f);
+		pthread_cond_broadcast(&w.mChanged);
+	}
+	pthread_mutex_unlock(&w.mMutex);
+	return NULL;
+}
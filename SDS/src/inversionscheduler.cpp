@@ -0,0 +1,195 @@
+#include "inversionscheduler.h"
+
+#include "mesh.h"
+#include "mesharrays.h"
+#include "vertex.h"
+#include "tetra.h"
+#include "sdsutil.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/foreach.hpp>
+
+// relative tolerance of canInvert
+const double CAN_INVERT_TOLERANCE = 1e-9;
+// the rounds which look at every tetra (most searches end within them)
+const unsigned int FULL_SCAN_ROUNDS = 3;
+
+bool InversionScheduler::Event::operator<(const Event& e) const
+{
+	// std::priority_queue pops the largest
+	if (round!=e.round) return round < e.round;
+	if (deltaH!=e.deltaH) return deltaH < e.deltaH;
+	return order > e.order;
+}
+
+InversionScheduler::InversionScheduler()
+:mMesh(NULL)
+,mDt(0)
+,mBack(0)
+,mRound(0)
+,mOrder(0)
+,mArrays(NULL)
+,mCandidatesValid(false)
+{
+}
+
+void InversionScheduler::start(Mesh* m, double dt)
+{
+	mMesh = m;
+	mDt = dt;
+	mBack = 0;
+	mRound = 0;
+	mOrder = 0;
+	mEvents = std::priority_queue<Event>();
+	mArrays = NULL;
+	mRewind.clear();
+	mCandidates.clear();
+	mCandidatesValid = false;
+}
+
+Vector3d InversionScheduler::x(const Vertex* v) const
+{
+	if (mRound<FULL_SCAN_ROUNDS) return v->x();
+	return at(v->slot());
+}
+
+double InversionScheduler::volume(Tetra* t) const
+{
+	if (mRound<FULL_SCAN_ROUNDS) return t->volume();
+	return volume(t->pv(0)->slot(),t->pv(1)->slot(),t->pv(2)->slot(),t->pv(3)->slot());
+}
+
+double InversionScheduler::volume(unsigned int s0, unsigned int s1, unsigned int s2, unsigned int s3) const
+{
+	// as Tetra::volume
+	const Vector3d& x0 = at(s0);
+	return (1.0/6) * dot(at(s1)-x0,cross(at(s2)-x0,at(s3)-x0));
+}
+
+double InversionScheduler::intersect(Tetra* t) const
+{
+	if (mRound<FULL_SCAN_ROUNDS) return SDSUtil::doVertexPlaneIntersect(t,0,1,2,3);
+	unsigned int s0 = t->pv(0)->slot(), s1 = t->pv(1)->slot(), s2 = t->pv(2)->slot(), s3 = t->pv(3)->slot();
+	return SDSUtil::doVertexPlaneIntersect(mOldX[s0],at(s0),mOldX[s1],at(s1),mOldX[s2],at(s2),mOldX[s3],at(s3));
+}
+
+bool InversionScheduler::canInvert(const unsigned int* v) const
+{
+	// the volume is a cubic in time, whose Bernstein coefficients over the window
+	// are (scaled) averages of the determinants of the edges at its start (a) and end (b),
+	// so it can only be negative if one of the coefficients is
+	const Vector3d& a0 = mOldX[v[0]];
+	const Vector3d& b0 = at(v[0]);
+	Vector3d a1 = mOldX[v[1]] - a0, a2 = mOldX[v[2]] - a0, a3 = mOldX[v[3]] - a0;
+	Vector3d b1 = at(v[1]) - b0, b2 = at(v[2]) - b0, b3 = at(v[3]) - b0;
+
+	Vector3d a23 = cross(a2,a3), b23 = cross(b2,b3);
+	Vector3d m23 = cross(b2,a3) + cross(a2,b3);
+
+	double c0 = dot(a1,a23);
+	double c1 = (dot(b1,a23) + dot(a1,m23))/3;
+	double c2 = (dot(a1,b23) + dot(b1,m23))/3;
+	double c3 = dot(b1,b23);
+
+	double tolerance = CAN_INVERT_TOLERANCE * std::max(std::fabs(c0),std::fabs(c3));
+	return std::min(std::min(c0,c1),std::min(c2,c3)) < tolerance;
+}
+
+void InversionScheduler::findInverted(std::vector<Tetra*>& inverted, Tetra* except)
+{
+	// the first rounds look at every tetra (as most searches end there),
+	// the next one finds the tetras that can be inverted in the rest of the rounds
+	if (mRound<FULL_SCAN_ROUNDS)
+	{
+		BOOST_FOREACH(Tetra* t, mMesh->tetras())
+			if (t!=except and not t->isFrozen() and t->volume() < 0)
+				inverted.push_back(t);
+	}
+	else
+	{
+		if (not mCandidatesValid)
+		{
+			BOOST_FOREACH(const MeshArrays::TetraTuple& tt, mArrays->tetras)
+				if (not tt.t->isFrozen() and canInvert(tt.v))
+					mCandidates.push_back(tt.t);
+			mCandidatesValid = true;
+		}
+
+		BOOST_FOREACH(Tetra* t, mCandidates)
+			if (t!=except and not t->isFrozen() and volume(t) < 0)
+				inverted.push_back(t);
+	}
+}
+
+void InversionScheduler::schedule(Tetra* t, double deltaH)
+{
+	Event e;
+	e.round = mRound;
+	e.deltaH = deltaH;
+	e.order = mOrder++;
+	e.t = t;
+	mEvents.push(e);
+}
+
+bool InversionScheduler::scheduled() const
+{
+	return not mEvents.empty() and mEvents.top().round==mRound;
+}
+
+Tetra* InversionScheduler::next()
+{
+	Event e = mEvents.top();
+	mEvents.pop();
+	skip(e.deltaH);
+	return e.t;
+}
+
+void InversionScheduler::skip(double deltaH)
+{
+	double dt = window();
+	mRewind.push_back((dt-deltaH)/dt);
+	mBack += deltaH;
+	mRound++;
+
+	// the first rounds rewind the mesh
+	if (mRound<FULL_SCAN_ROUNDS)
+	{
+		SDSUtil::rewindAllVertices(mMesh,deltaH,dt);
+		return;
+	}
+
+	// then the positions are gathered once, and each slot is rewound when it is looked at
+	if (mRound==FULL_SCAN_ROUNDS)
+	{
+		mArrays = &mMesh->arrays();
+		unsigned int n = mArrays->vertices.size();
+		mOldX.resize(n);
+		mX.resize(n);
+		for(unsigned int s=0;s<n;s++)
+		{
+			const Vertex* v = mArrays->vertices[s];
+			if (v==NULL) continue;
+			mOldX[s] = v->mOldX;
+			mX[s] = v->mX;
+		}
+		mXRound.assign(n,mRound-1);
+	}
+}
+
+const Vector3d& InversionScheduler::at(unsigned int s) const
+{
+	// (exactly as SDSUtil::rewindAllVertices would each round)
+	for(unsigned int& r = mXRound[s];r<mRound;r++)
+		mX[s] = mOldX[s] + (mX[s] - mOldX[s])*mRewind[r];
+	return mX[s];
+}
+
+void InversionScheduler::rewind()
+{
+	if (mRound<FULL_SCAN_ROUNDS) return;
+	for(unsigned int s=0;s<mArrays->vertices.size();s++)
+		if (mArrays->vertices[s]!=NULL)
+			mArrays->vertices[s]->mX = at(s);
+}
@@ -1,4 +1,6 @@
 #include "mesh.h"
+#include "meshindex.h"
+#include "mesharrays.h"
 #include "world.h"
 #include "edge.h"
 
@@ -7,6 +9,7 @@
 #include <cfloat>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
 
 #include <boost/foreach.hpp>
 
@@ -22,8 +25,21 @@
 	#define DUMPM(what) ;
 #endif
 
+unsigned long Mesh::sLastTopologyVersion = 0;
+
 Mesh::Mesh(bool tc)
 :mTopoChanged(tc)
+,mTopologyVersion(newTopologyVersion())
+,mIndex(new MeshIndex())
+,mIndexValid(false)
+,mArrays(new MeshArrays())
+,mArraysValid(false)
+,mNumVertices(0)
+,mNumEdges(0)
+,mNumTetras(0)
+,mCountsValid(true)
+,mCheckAll(true)
+,mLastSanityCheckSize(0)
  {
 	DUMPM("Mesh::Mesh() for " << this);
  }
@@ -32,6 +48,8 @@ Mesh::~Mesh()
 {
 	DUMPM("Mesh::~Mesh() for " << this);
 	clear();
+	delete mIndex;
+	delete mArrays;
 }
 
 void Mesh::clear()
@@ -58,8 +76,18 @@ void Mesh::clear()
 	mFaces.clear();
 	mOuterFaces.clear();
 	mTopoChanged = false;
+	mTopologyVersion = newTopologyVersion();
 	mAABB = AABB::ZERO;
 
+	mIndex->clear();
+	mIndexValid = false;
+	mArrays->clear();
+	mArraysValid = false;
+	mNumVertices = mNumEdges = mNumTetras = 0;
+	mCountsValid = true;
+	mTouchedVertices.clear();
+	mCheckAll = true;
+
 	mVertexMapWrite.clear();
 	mFaceMapWrite.clear();
 	mTetraMapWrite.clear();
@@ -84,12 +112,14 @@ void Mesh::scale(double sx, double sy, double sz)
 
 std::list<Tetra*> Mesh::getNeighbours(Vertex* v) const
 {
-	std::list<Tetra*> n;
-	BOOST_FOREACH(Tetra* t, mTetras)
-	{
-		if (t->contains(v)) n.push_back(t);
-	}
-	return n;
+	const std::vector<Tetra*>& n = incidentTetras(v);
+	return std::list<Tetra*>(n.begin(),n.end());
+}
+
+const std::vector<Tetra*>& Mesh::incidentTetras(Vertex* v) const
+{
+	// (the index keeps the tetras of each vertex in the order they are in mTetras)
+	return index().incident(v).tetras;
 }
 
 bool Mesh::getAdjacentFaces(Edge* e, Face* &f1, Face* &f2) const
@@ -141,16 +171,29 @@ bool Mesh::getAdjacentFaces(Vertex* v1, Vertex* v2, Face* &f1, Face* &f2) const
 	return foundf1 and foundf2;
 }
 
+void Mesh::touch(Vertex* v)
+{
+	if (not mCheckAll) mTouchedVertices.insert(v);
+	if (mArraysValid) mArrays->markChanged(v);
+}
+
 /// change content of mesh
 void Mesh::addVertex(Vertex* v)
 {
 	mVertices.push_back(v);
+	mNumVertices++;
+	if (mArraysValid) mArrays->addVertex(v);
+	touch(v);
 	topoChange();
 }
 
 void Mesh::addEdge(Edge* e)
 {
 	mEdges.push_back(e);
+	mNumEdges++;
+	if (mIndexValid) mIndex->addEdge(e);
+	mArrays->invalidateElements();
+	touch(e);
 	topoChange();
 }
 
@@ -167,6 +210,8 @@ void Mesh::addOuterFace(Face* f)
 	f->setOuter(true);
 	mOuterFaces.push_back(f);
 	mFaces.push_back(f);
+	if (mIndexValid) mIndex->addFace(f);
+	touch(f);
 	topoChange();
 }
 
@@ -174,12 +219,17 @@ void Mesh::setAsOuterFace(Face* f)
 {
 	f->setOuter(true);
 	mOuterFaces.push_back(f);
+	touch(f);
 	topoChange();
 }
 
 void Mesh::addTetra(Tetra* t)
 {
 	mTetras.push_back(t);
+	mNumTetras++;
+	if (mIndexValid) mIndex->addTetra(t);
+	mArrays->invalidateElements();
+	touch(t);
 	topoChange();
 }
 
@@ -187,6 +237,10 @@ void Mesh::addTetra(Tetra* t)
 void Mesh::removeTetra(Tetra* t)
 {
 	mTetras.remove(t);
+	mNumTetras--;
+	if (mIndexValid) mIndex->removeTetra(t);
+	mArrays->invalidateElements();
+	touch(t);
 	topoChange();
 }
 
@@ -194,18 +248,28 @@ void Mesh::removeFace(Face* f)
 {
 	mFaces.remove(f);
 	mOuterFaces.remove(f);
+	if (mIndexValid) mIndex->removeFace(f);
+	touch(f);
 	topoChange();
 }
 
 void Mesh::removeEdge(Edge* e)
 {
 	mEdges.remove(e);
+	mNumEdges--;
+	if (mIndexValid) mIndex->removeEdge(e);
+	mArrays->invalidateElements();
+	touch(e);
 	topoChange();
 }
 
 void Mesh::removeVertex(Vertex* v)
 {
 	mVertices.remove(v);
+	mNumVertices--;
+	if (mIndexValid) mIndex->removeVertex(v);
+	if (mArraysValid) mArrays->removeVertex(v);
+	mTouchedVertices.erase(v);
 	topoChange();
 }
 
@@ -266,35 +330,66 @@ double Mesh::energy() const
 	return energy;
 }
 
-Edge* Mesh::getEdge(Vertex* v1, Vertex* v2) const
+const MeshIndex& Mesh::index() const
 {
-	BOOST_FOREACH(Edge* e, mEdges)
+	if (not mIndexValid)
 	{
-		if (e->v(0)==v1 and (v2==NULL or e->v(1)==v2)) return e;
-		else if (e->v(1)==v1 and (v2==NULL or e->v(0)==v2)) return e;
+		mIndex->rebuild(mEdges,mFaces,mTetras);
+		mIndexValid = true;
 	}
-	return NULL;
+	return *mIndex;
 }
 
-std::list<Edge*> Mesh::getAllEdges(Vertex* v1) const
+void Mesh::countElements()
 {
-	std::list<Edge*> edges;
-	BOOST_FOREACH(Edge* e, mEdges)
+	mNumVertices = mVertices.size();
+	mNumEdges = mEdges.size();
+	mNumTetras = mTetras.size();
+	mCountsValid = true;
+}
+
+MeshArrays& Mesh::arrays()
+{
+	// (lists that have been modified directly are recounted, see invalidateIndex())
+	if (not mCountsValid) countElements();
+	if (not mArraysValid or mArrays->numVertices()!=mNumVertices)
 	{
-		if (e->v(0)==v1 or e->v(1)==v1) edges.push_back(e);
+		mArrays->rebuild(mVertices);
+		mArraysValid = true;
 	}
-	return edges;
+	if (not mArrays->elementsValid()
+		or mArrays->edges.size()!=mNumEdges
+		or mArrays->tetras.size()!=mNumTetras)
+	{
+		mArrays->rebuildElements(mEdges,mTetras);
+	}
+	return *mArrays;
+}
+
+Edge* Mesh::getEdge(Vertex* v1, Vertex* v2) const
+{
+	if (v2!=NULL) return index().edge(v1,v2);
+
+	const std::vector<Edge*>& edges = index().incident(v1).edges;
+	return edges.empty()?NULL:edges.front();
+}
+
+std::list<Edge*> Mesh::getAllEdges(Vertex* v1) const
+{
+	const std::vector<Edge*>& edges = index().incident(v1).edges;
+	return std::list<Edge*>(edges.begin(),edges.end());
 }
 
 Face* Mesh::getFace(Vertex* v1, Vertex* v2, Vertex* v3) const
 {
-	BOOST_FOREACH(Face* f, mFaces)
+	if (v2!=NULL and v3!=NULL and v1!=v2 and v1!=v3 and v2!=v3)
+		return index().face(v1,v2,v3);
+
+	BOOST_FOREACH(Face* f, index().incident(v1).faces)
 	{
-		if (f->contains(v1) and
-				(v2==NULL or
-						(f->contains(v2) and
-								(v3==NULL or f->contains(v3))
-						)
+		if (v2==NULL or
+				(f->contains(v2) and
+						(v3==NULL or f->contains(v3))
 				)
 			)
 			return f;
@@ -304,16 +399,18 @@ Face* Mesh::getFace(Vertex* v1, Vertex* v2, Vertex* v3) const
 
 Tetra* Mesh::getTetra(Vertex* v1, Vertex* v2, Vertex* v3, Vertex* v4) const
 {
-	BOOST_FOREACH(Tetra* t, mTetras)
+	if (v2!=NULL and v3!=NULL and v4!=NULL and
+			v1!=v2 and v1!=v3 and v1!=v4 and v2!=v3 and v2!=v4 and v3!=v4)
+		return index().tetra(v1,v2,v3,v4);
+
+	BOOST_FOREACH(Tetra* t, index().incident(v1).tetras)
 	{
-		if (t->contains(v1) and
-				(v2==NULL or
-						(t->contains(v2) and
-								(v3==NULL or
-										(t->contains(v3) and
-												(v4==NULL or
-														t->contains(v4)
-												)
+		if (v2==NULL or
+				(t->contains(v2) and
+						(v3==NULL or
+								(t->contains(v3) and
+										(v4==NULL or
+												t->contains(v4)
 										)
 								)
 						)
@@ -364,133 +461,184 @@ void Mesh::addFaceNeighbourLinks(Face* f)
 
 #define CHECKINV2(inv,msg) {if (not (inv)) {std::cerr << "mesh not sane: " << __FILE__ << ":" << __LINE__ << " [" << msg << "]\n"; return false;}}
 
+// membership sets used by the sanity checks
+struct Mesh::SanityLists
+{
+	std::set<Face*> faces;
+	std::set<Face*> outerFaces;
+
+	SanityLists(const std::list<Face*>& f, const std::list<Face*>& of)
+	:faces(f.begin(),f.end())
+	,outerFaces(of.begin(),of.end())
+	{}
+};
+
 bool Mesh::isSane()
 {
-	// check that all components are non-null
+	SanityLists lists(mFaces,mOuterFaces);
+	mLastSanityCheckSize = 0;
+
 	BOOST_FOREACH(Vertex* v, mVertices)
-	{
-		CHECKINV(v);
-		BOOST_FOREACH(Vertex* vn, v->neighbours())
-		{
-			CHECKINV(vn);
-			CHECKINV(getEdge(v,vn));
-		}
+		if (not isVertexSane(v,lists)) return false;
+	BOOST_FOREACH(Edge* e, mEdges)
+		if (not isEdgeSane(e)) return false;
+	BOOST_FOREACH(Face* f, mFaces)
+		if (not isFaceSane(f,lists)) return false;
+	BOOST_FOREACH(Face* f, mOuterFaces)
+		if (not isFaceSane(f,lists)) return false;
+	BOOST_FOREACH(Tetra* t, mTetras)
+		if (not isTetraSane(t)) return false;
 
-		if (v->surface())
-		{
-			BOOST_FOREACH(Face* f, v->surfaceFaces())
-			{
-				CHECKINV(f);
-				CHECKINV(f->contains(v));
-				CHECKINV(f->outer());
-				CHECKINV(std::find(mFaces.begin(),mFaces.end(),f)!=mFaces.end());
-				CHECKINV(std::find(mOuterFaces.begin(),mOuterFaces.end(),f)!=mOuterFaces.end());
-			}
-		}
+	if (not mTouchedVertices.empty()) mTouchedVertices.clear();
+	mCheckAll = false;
+	return true;
+}
+
+bool Mesh::isSaneIncremental()
+{
+	if (mCheckAll) return isSane();
+
+	mLastSanityCheckSize = 0;
+
+	// tetras can invert without any change in topology, so always check the volumes
+	BOOST_FOREACH(Tetra* t, mTetras)
+	{
+		mLastSanityCheckSize++;
+		CHECKINV2(t->volume() > -0.0001, "volume " << t << " = " << t->volume());
 	}
 
-	BOOST_FOREACH(Edge* e, mEdges)
+	if (mTouchedVertices.empty()) return true;
+
+	SanityLists lists(mFaces,mOuterFaces);
+	BOOST_FOREACH(Vertex* v, mTouchedVertices)
 	{
-		CHECKINV(e);
-		CHECKINV(e->v(0) && e->v(1));
+		if (not isVertexSane(v,lists)) return false;
+
+		const MeshIndex::Incidence& inc = index().incident(v);
+		BOOST_FOREACH(Edge* e, inc.edges)
+			if (not isEdgeSane(e)) return false;
+		BOOST_FOREACH(Face* f, inc.faces)
+			if (not isFaceSane(f,lists)) return false;
+		BOOST_FOREACH(Tetra* t, inc.tetras)
+			if (not isTetraSane(t)) return false;
+	}
+
+	mTouchedVertices.clear();
+	return true;
+}
 
-		const std::list<Vertex*>& v0n = e->v(0)->neighbours();
-		const std::list<Vertex*>& v1n = e->v(1)->neighbours();
+bool Mesh::isVertexSane(Vertex* v, const SanityLists& lists)
+{
+	mLastSanityCheckSize++;
 
-		CHECKINV(std::find(v0n.begin(),v0n.end(),e->v(1))!=v0n.end());
-		CHECKINV(std::find(v1n.begin(),v1n.end(),e->v(0))!=v1n.end());
+	CHECKINV(v);
+	BOOST_FOREACH(Vertex* vn, v->neighbours())
+	{
+		CHECKINV(vn);
+		CHECKINV(getEdge(v,vn));
 	}
 
-	BOOST_FOREACH(Face* f, mFaces)
+	if (v->surface())
 	{
-		CHECKINV(f);
-		CHECKINV(f->outer());
-		CHECKINV(std::find(mOuterFaces.begin(),mOuterFaces.end(),f)!=mOuterFaces.end());
+		BOOST_FOREACH(Face* f, v->surfaceFaces())
+		{
+			CHECKINV(f);
+			CHECKINV(f->contains(v));
+			CHECKINV(f->outer());
+			CHECKINV(lists.faces.count(f));
+			CHECKINV(lists.outerFaces.count(f));
+		}
+	}
+	return true;
+}
 
-		Vertex *v0 = &f->v(0), *v1 = &f->v(1), *v2 = &f->v(2);
+bool Mesh::isEdgeSane(Edge* e)
+{
+	mLastSanityCheckSize++;
 
-		CHECKINV(v0);
-		CHECKINV(v1);
-		CHECKINV(v2);
+	CHECKINV(e);
+	CHECKINV(e->v(0) && e->v(1));
 
-		CHECKINV(getEdge(v0,v1));
-		CHECKINV(getEdge(v0,v2));
-		CHECKINV(getEdge(v1,v2));
+	const std::list<Vertex*>& v0n = e->v(0)->neighbours();
+	const std::list<Vertex*>& v1n = e->v(1)->neighbours();
 
-		const std::list<Face*>& sf0 = v0->surfaceFaces(), &sf1 = v1->surfaceFaces(), &sf2 = v2->surfaceFaces();
-		CHECKINV(std::find(sf0.begin(),sf0.end(),f)!=sf0.end());
-		CHECKINV(std::find(sf1.begin(),sf1.end(),f)!=sf1.end());
-		CHECKINV(std::find(sf2.begin(),sf2.end(),f)!=sf2.end());
+	CHECKINV(std::find(v0n.begin(),v0n.end(),e->v(1))!=v0n.end());
+	CHECKINV(std::find(v1n.begin(),v1n.end(),e->v(0))!=v1n.end());
+	return true;
+}
 
-	}
+bool Mesh::isFaceSane(Face* f, const SanityLists& lists)
+{
+	mLastSanityCheckSize++;
 
-	BOOST_FOREACH(Face* f, mOuterFaces)
-	{
-		CHECKINV(f);
-		CHECKINV(f->outer());
-		CHECKINV(std::find(mFaces.begin(),mFaces.end(),f)!=mFaces.end());
+	CHECKINV(f);
+	CHECKINV(f->outer());
+	CHECKINV(lists.faces.count(f));
+	CHECKINV(lists.outerFaces.count(f));
 
-		Vertex *v0 = &f->v(0), *v1 = &f->v(1), *v2 = &f->v(2);
+	Vertex *v0 = &f->v(0), *v1 = &f->v(1), *v2 = &f->v(2);
 
-		CHECKINV(v0);
-		CHECKINV(v1);
-		CHECKINV(v2);
+	CHECKINV(v0);
+	CHECKINV(v1);
+	CHECKINV(v2);
 
-		CHECKINV(getEdge(v0,v1));
-		CHECKINV(getEdge(v0,v2));
-		CHECKINV(getEdge(v1,v2));
+	CHECKINV(getEdge(v0,v1));
+	CHECKINV(getEdge(v0,v2));
+	CHECKINV(getEdge(v1,v2));
 
-		const std::list<Face*>& sf0 = v0->surfaceFaces(), &sf1 = v1->surfaceFaces(), &sf2 = v2->surfaceFaces();
-		CHECKINV(std::find(sf0.begin(),sf0.end(),f)!=sf0.end());
-		CHECKINV(std::find(sf1.begin(),sf1.end(),f)!=sf1.end());
-		CHECKINV(std::find(sf2.begin(),sf2.end(),f)!=sf2.end());
-	}
+	const std::list<Face*>& sf0 = v0->surfaceFaces(), &sf1 = v1->surfaceFaces(), &sf2 = v2->surfaceFaces();
+	CHECKINV(std::find(sf0.begin(),sf0.end(),f)!=sf0.end());
+	CHECKINV(std::find(sf1.begin(),sf1.end(),f)!=sf1.end());
+	CHECKINV(std::find(sf2.begin(),sf2.end(),f)!=sf2.end());
+	return true;
+}
 
-	BOOST_FOREACH(Tetra* t, mTetras)
-	{
-		CHECKINV(t);
+bool Mesh::isTetraSane(Tetra* t)
+{
+	mLastSanityCheckSize++;
 
-		Vertex* v[4] = {&t->v(0), &t->v(1), &t->v(2), &t->v(3)};
-		CHECKINV2(getEdge(v[0],v[1]),t);
-		CHECKINV2(getEdge(v[0],v[2]),t);
-		CHECKINV2(getEdge(v[0],v[3]),t);
-		CHECKINV2(getEdge(v[1],v[2]),t);
-		CHECKINV2(getEdge(v[1],v[3]),t);
-		CHECKINV2(getEdge(v[2],v[3]),t);
+	CHECKINV(t);
 
-		// CHECKINV that size is positive, as all tetrahedra are oriented the same way
-		CHECKINV2(t->volume() > -0.0001, "volume " << t << " = " << t->volume() << ", vertex positions: " << v[0]->x() << ", " << v[1]->x() << ", " << v[2]->x() << ", " << v[3]->x() << ", ");
+	Vertex* v[4] = {&t->v(0), &t->v(1), &t->v(2), &t->v(3)};
+	CHECKINV2(getEdge(v[0],v[1]),t);
+	CHECKINV2(getEdge(v[0],v[2]),t);
+	CHECKINV2(getEdge(v[0],v[3]),t);
+	CHECKINV2(getEdge(v[1],v[2]),t);
+	CHECKINV2(getEdge(v[1],v[3]),t);
+	CHECKINV2(getEdge(v[2],v[3]),t);
 
-		for(int i=0;i<4;i++)
+	// CHECKINV that size is positive, as all tetrahedra are oriented the same way
+	CHECKINV2(t->volume() > -0.0001, "volume " << t << " = " << t->volume() << ", vertex positions: " << v[0]->x() << ", " << v[1]->x() << ", " << v[2]->x() << ", " << v[3]->x() << ", ");
+
+	for(int i=0;i<4;i++)
+	{
+		Tetra* tn = t->neighbour(i);
+		if (tn)
 		{
-			Tetra* tn = t->neighbour(i);
-			if (tn)
+			// then tn and t must share all the other verts
+			for(int j=1;j<4;j++)
 			{
-				// then tn and t must share all the other verts
-				for(int j=1;j<4;j++)
-				{
-					int k = (i + j)%4;
-					CHECKINV2(tn->contains(v[k]),tn << t << v[i] << v[k]);
-				}
-
-				// moreover the v[i] neighbour of tn must be t
-				bool found = false;
-				for(int k=0;k<4;k++)
-				{
-					if (t==tn->neighbour(k))
-						found = true;
-				}
-				CHECKINV2(found,"tn->t link not found. tn:" << tn << ", t:" << t);
-
-				// and furthermore, FACE(v[i+1],v[i+2],v[i+3]) shouldn't exist
-				CHECKINV(NULL==getFace(v[(i+1)%4],v[(i+2)%4],v[(i+3)%4]));
+				int k = (i + j)%4;
+				CHECKINV2(tn->contains(v[k]),tn << t << v[i] << v[k]);
 			}
-			else
+
+			// moreover the v[i] neighbour of tn must be t
+			bool found = false;
+			for(int k=0;k<4;k++)
 			{
-				Face* f = getFace(v[(i+1)%4],v[(i+2)%4],v[(i+3)%4]);
-				CHECKINV(f);
-				CHECKINV(f->outer());
+				if (t==tn->neighbour(k))
+					found = true;
 			}
+			CHECKINV2(found,"tn->t link not found. tn:" << tn << ", t:" << t);
+
+			// and furthermore, FACE(v[i+1],v[i+2],v[i+3]) shouldn't exist
+			CHECKINV(NULL==getFace(v[(i+1)%4],v[(i+2)%4],v[(i+3)%4]));
+		}
+		else
+		{
+			Face* f = getFace(v[(i+1)%4],v[(i+2)%4],v[(i+3)%4]);
+			CHECKINV(f);
+			CHECKINV(f->outer());
 		}
 	}
 
@@ -739,6 +887,8 @@ void Mesh::bRead(std::istream& istr)
 	mTetras.clear();
 	mOuterFaces.clear();
 	mAABB = AABB::ZERO;
+	invalidateIndex();
+	mTouchedVertices.clear();
 
 	// read in new data
 
@@ -1072,7 +1222,14 @@ void Mesh::bWriteFull(std::ostream& ostr)
 
 #define PRINT(what) {if (noisy) {std::cerr << __FILE__ << "(" << __LINE__ << "):" << what << std::endl; }}
 
-void Mesh::bReadFull(std::istream& istr, bool noisy)
+// the element with the given id read by bReadFull, or NULL if there's no such id
+template <typename T>
+static T* lookup(const std::vector<T*>& map, uint id)
+{
+	return id < map.size() ? map[id] : NULL;
+}
+
+bool Mesh::bReadFull(std::istream& istr, bool noisy)
 {
 	DUMP("bReadFull");
 
@@ -1095,6 +1252,8 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 	mTetras.clear();
 	mOuterFaces.clear();
 	mAABB = AABB::ZERO;
+	invalidateIndex();
+	mTouchedVertices.clear();
 
 	// read in new data
 
@@ -1120,10 +1279,11 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 	DUMP("numouterfaces = " << numouterfaces);
 	DUMP("mAABB = " << mAABB);
 
-	mVertexMapRead.clear();
-	std::map<uint,Vertex*>& vertexMap = mVertexMapRead;
-	std::map<uint,Face*> faceMap;
-	std::map<uint,Tetra*> tetraMap;
+	// (the id of an element is its position)
+	std::vector<Vertex*>& vertexMap = mVertexMapRead;
+	vertexMap.assign(numverts,NULL);
+	std::vector<Face*> faceMap(numouterfaces,NULL);
+	std::vector<Tetra*> tetraMap(numtetras,NULL);
 
 	// make the appropriate empty containers for these....
 	for(uint i=0;i<numverts;++i)
@@ -1193,9 +1353,12 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 
 			for(uint i=0;i<numfaceneighbours;++i)
 			{
-				uint id;
+				uint id = 0;
 				read(istr,id);
-				v->addFaceNeighbour(faceMap[id]);
+				Face* f = lookup(faceMap,id);
+				if (f==NULL)
+					return badId(istr,noisy);
+				v->addFaceNeighbour(f);
 
 				DUMP("faceMap[" << id << "]" << faceMap[id]);
 			}
@@ -1207,9 +1370,12 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 		DUMP("numneighbours = " << numneighbours);
 		for(uint i=0;i<numneighbours;++i)
 		{
-			uint id;
+			uint id = 0;
 			read(istr,id);
-			v->mNeighbours.push_back(vertexMap[id]);
+			Vertex* n = lookup(vertexMap,id);
+			if (n==NULL)
+				return badId(istr,noisy);
+			v->mNeighbours.push_back(n);
 
 			DUMP("vertexMap[" << id << "] = " << vertexMap[id]);
 		}
@@ -1217,10 +1383,12 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 
 	for(uint i=0;i<numedges;++i)
 	{
-		uint id1, id2;
+		uint id1 = 0, id2 = 0;
 		read(istr,id1);
 		read(istr,id2);
-		Vertex *v1 = vertexMap[id1], *v2 = vertexMap[id2];
+		Vertex *v1 = lookup(vertexMap,id1), *v2 = lookup(vertexMap,id2);
+		if (v1==NULL or v2==NULL)
+			return badId(istr,noisy);
 		double rest;
 		read(istr,rest);
 		Edge* e = new Edge(v1,v2,rest);
@@ -1235,13 +1403,15 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 
 	BOOST_FOREACH(Face* f, mFaces)
 	{
-		uint id1, id2, id3;
+		uint id1 = 0, id2 = 0, id3 = 0;
 		read(istr,id1);
 		read(istr,id2);
 		read(istr,id3);
-		Vertex *v1 = vertexMap[id1],
-					 *v2 = vertexMap[id2],
-					 *v3 = vertexMap[id3];
+		Vertex *v1 = lookup(vertexMap,id1),
+					 *v2 = lookup(vertexMap,id2),
+					 *v3 = lookup(vertexMap,id3);
+		if (v1==NULL or v2==NULL or v3==NULL)
+			return badId(istr,noisy);
 
 		f->mV[0] = v1;
 		f->mV[1] = v2;
@@ -1259,12 +1429,14 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 		DUMP("t = " << t);
 
 		// ...
-		uint v[4];
-		int n[4];
+		uint v[4] = {0,0,0,0};
+		int n[4] = {0,0,0,0};
 		for(int i=0;i<4;i++)
 		{
 			read(istr,v[i]);
-			t->mV[i] = vertexMap[v[i]];
+			t->mV[i] = lookup(vertexMap,v[i]);
+			if (t->mV[i]==NULL)
+				return badId(istr,noisy);
 
 			DUMP("vertexMap[v[" << i << "]] = " << vertexMap[v[i]]);
 		}
@@ -1278,7 +1450,10 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 			}
 			else
 			{
-				t->mN[i] = tetraMap[n[i]];
+				// (a negative id other than -1 is out of range too)
+				t->mN[i] = lookup(tetraMap,(uint)n[i]);
+				if (t->mN[i]==NULL)
+					return badId(istr,noisy);
 				DUMP("t->mN[" << i << "] = " << tetraMap[n[i]] << " (tetraMap[n[i]])");
 			}
 		}
@@ -1296,6 +1471,468 @@ void Mesh::bReadFull(std::istream& istr, bool noisy)
 
 		t->updateAABB();
 	}
+	return true;
+}
+
+bool Mesh::badId(std::istream& istr, bool noisy)
+{
+	PRINT("id out of range, the mesh data is corrupt")
+
+	clear();
+	mVertexMapRead.clear();
+	istr.setstate(std::ios::failbit);
+	return false;
+}
+
+void Mesh::bWriteContinuous(std::ostream& ostr)
+{
+	DUMP("Mesh::bWriteContinuous");
+
+	uint numverts = mVertices.size(),
+			numedges = mEdges.size(),
+			numtetras = mTetras.size();
+
+	write(ostr,numverts);
+	write(ostr,numedges);
+	write(ostr,numtetras);
+	writeAABB(ostr,mAABB);
+
+	// the same data, in the same order, as in bWriteFull
+	BOOST_FOREACH(Vertex* v, mVertices)
+	{
+		writeVec(ostr,v->mX);
+		writeVec(ostr,v->mOldX);
+		writeVec(ostr,v->mF);
+		write(ostr,v->mMass);
+		write(ostr,v->mTag);
+	}
+
+	BOOST_FOREACH(Edge* e, mEdges)
+		write(ostr,e->rest());
+
+	BOOST_FOREACH(Tetra* t, mTetras)
+		write(ostr,t->rest());
+}
+
+bool Mesh::bReadContinuous(std::istream& istr)
+{
+	DUMP("bReadContinuous");
+
+	uint numverts = 0,
+		numedges = 0,
+		numtetras = 0;
+
+	read(istr,numverts);
+	read(istr,numedges);
+	read(istr,numtetras);
+	if (numverts!=mVertices.size() or numedges!=mEdges.size() or numtetras!=mTetras.size())
+		return false;
+
+	readAABB(istr,mAABB);
+
+	BOOST_FOREACH(Vertex* v, mVertices)
+	{
+		readVec(istr,v->mX);
+		readVec(istr,v->mOldX);
+		readVec(istr,v->mF);
+		read(istr,v->mMass);
+		read(istr,v->mTag);
+		v->computeR();
+	}
+
+	// the rest lengths written include the multipliers (as in bReadSpringMultipliers)
+	BOOST_FOREACH(Edge* e, mEdges)
+	{
+		double rest;
+		read(istr,rest);
+		e->setRest(rest/e->restMultiplier());
+	}
+
+	BOOST_FOREACH(Tetra* t, mTetras)
+	{
+		double rest;
+		read(istr,rest);
+		t->setRest(rest/t->restMultiplier());
+		t->updateAABB();
+	}
+
+	return !!istr;
+}
+
+void Mesh::getKeyframe(Keyframe& k)
+{
+	// (the id of an element is its position)
+	std::map<Vertex*,unsigned int> vertexIds;
+	std::map<Face*,unsigned int> faceIds;
+	std::map<Tetra*,int> tetraIds;
+	unsigned int counter = 0;
+	BOOST_FOREACH(Vertex* v, mVertices)
+		vertexIds[v] = counter++;
+	counter = 0;
+	BOOST_FOREACH(Face* f, mFaces)
+		faceIds[f] = counter++;
+	counter = 0;
+	BOOST_FOREACH(Tetra* t, mTetras)
+		tetraIds[t] = counter++;
+
+	k.aabb = mAABB;
+	k.numberOfOuterFaces = mOuterFaces.size();
+
+	k.x.clear(); k.oldX.clear(); k.f.clear();
+	k.mass.clear(); k.tag.clear(); k.frozen.clear(); k.surface.clear();
+	k.neighbourStart.assign(1,0); k.neighbours.clear();
+	k.faceNeighbourStart.assign(1,0); k.faceNeighbours.clear();
+	BOOST_FOREACH(Vertex* v, mVertices)
+	{
+		k.x.push_back(v->mX);
+		k.oldX.push_back(v->mOldX);
+		k.f.push_back(v->mF);
+		k.mass.push_back(v->mMass);
+		k.tag.push_back(v->mTag);
+		k.frozen.push_back(v->mIsFrozen);
+		k.surface.push_back(v->surface());
+
+		// (only surface vertices have their faces written)
+		if (v->surface())
+		{
+			BOOST_FOREACH(Face* f, v->mFaceNeighbours)
+				k.faceNeighbours.push_back(faceIds[f]);
+		}
+		k.faceNeighbourStart.push_back(k.faceNeighbours.size());
+		BOOST_FOREACH(Vertex* n, v->mNeighbours)
+			k.neighbours.push_back(vertexIds[n]);
+		k.neighbourStart.push_back(k.neighbours.size());
+	}
+
+	k.edgeVertices.clear();
+	k.edgeRest.clear(); k.edgeRestMultiplier.clear(); k.edgeSpringCoefficient.clear();
+	BOOST_FOREACH(Edge* e, mEdges)
+	{
+		k.edgeVertices.push_back(vertexIds[e->mV[0]]);
+		k.edgeVertices.push_back(vertexIds[e->mV[1]]);
+		k.edgeRest.push_back(e->mRestLength);
+		k.edgeRestMultiplier.push_back(e->mRestMultiplier);
+		k.edgeSpringCoefficient.push_back(e->mSpringCoefficient);
+	}
+
+	k.faceVertices.clear();
+	k.faceRest.clear();
+	BOOST_FOREACH(Face* f, mFaces)
+	{
+		for(int i=0;i<3;i++)
+			k.faceVertices.push_back(vertexIds[f->mV[i]]);
+		k.faceRest.push_back(f->rest());
+	}
+
+	k.tetraVertices.clear(); k.tetraNeighbours.clear();
+	k.tetraRest.clear(); k.tetraRestMultiplier.clear(); k.tetraSpringCoefficient.clear();
+	k.tetraOuter.clear(); k.tetraIntersected.clear();
+	BOOST_FOREACH(Tetra* t, mTetras)
+	{
+		for(int i=0;i<4;i++)
+			k.tetraVertices.push_back(vertexIds[t->mV[i]]);
+		for(int i=0;i<4;i++)
+			k.tetraNeighbours.push_back(t->mN[i] ? tetraIds[t->mN[i]] : -1);
+		k.tetraRest.push_back(t->mRestVolume);
+		k.tetraRestMultiplier.push_back(t->mRestMultiplier);
+		k.tetraSpringCoefficient.push_back(t->mSpringCoefficient);
+		k.tetraOuter.push_back(t->mOuter);
+		k.tetraIntersected.push_back(t->mIntersected);
+	}
+}
+
+void Mesh::setKeyframe(const Keyframe& k)
+{
+	// (as bReadFull, then bReadSpringMultipliers and bReadFrozenVerts)
+	clear();
+	invalidateIndex();
+	mAABB = k.aabb;
+
+	unsigned int numverts = k.x.size(),
+		numedges = k.edgeRest.size(),
+		numtetras = k.tetraRest.size(),
+		numfaces = k.faceRest.size();
+
+	std::vector<Vertex*>& vertexMap = mVertexMapRead;
+	vertexMap.resize(numverts);
+	std::vector<Face*> faceMap(numfaces);
+	std::vector<Tetra*> tetraMap(numtetras);
+	for(unsigned int i=0;i<numverts;++i)
+	{
+		Vertex* v = new Vertex();
+		mVertices.push_back(v);
+		vertexMap[i] = v;
+	}
+	for(unsigned int i=0;i<numfaces;++i)
+	{
+		Face* f = new Face();
+		addOuterFace(f);
+		faceMap[i] = f;
+	}
+	for(unsigned int i=0;i<numtetras;++i)
+	{
+		Tetra* t = new Tetra();
+		mTetras.push_back(t);
+		tetraMap[i] = t;
+	}
+
+	for(unsigned int i=0;i<numverts;++i)
+	{
+		Vertex* v = vertexMap[i];
+		v->mX = k.x[i];
+		v->mOldX = k.oldX[i];
+		v->mF = k.f[i];
+		v->mMass = k.mass[i];
+		v->mTag = k.tag[i];
+		v->computeR();
+		v->setFrozen(k.frozen[i]);
+		v->setSurface(k.surface[i]);
+		for(unsigned int j=k.faceNeighbourStart[i];j<k.faceNeighbourStart[i+1];++j)
+			v->addFaceNeighbour(faceMap[k.faceNeighbours[j]]);
+		for(unsigned int j=k.neighbourStart[i];j<k.neighbourStart[i+1];++j)
+			v->mNeighbours.push_back(vertexMap[k.neighbours[j]]);
+	}
+
+	for(unsigned int i=0;i<numedges;++i)
+	{
+		Edge* e = new Edge(vertexMap[k.edgeVertices[2*i]],vertexMap[k.edgeVertices[2*i+1]],k.edgeRest[i]);
+		e->mRestMultiplier = k.edgeRestMultiplier[i];
+		e->mSpringCoefficient = k.edgeSpringCoefficient[i];
+		mEdges.push_back(e);
+	}
+
+	for(unsigned int i=0;i<numfaces;++i)
+	{
+		Face* f = faceMap[i];
+		for(int j=0;j<3;j++)
+			f->mV[j] = vertexMap[k.faceVertices[3*i+j]];
+		f->rest(k.faceRest[i]);
+	}
+
+	for(unsigned int i=0;i<numtetras;++i)
+	{
+		Tetra* t = tetraMap[i];
+		for(int j=0;j<4;j++)
+		{
+			t->mV[j] = vertexMap[k.tetraVertices[4*i+j]];
+			int n = k.tetraNeighbours[4*i+j];
+			t->mN[j] = (n==-1) ? NULL : tetraMap[n];
+		}
+		t->mSpringCoefficient = k.tetraSpringCoefficient[i];
+		t->mOuter = k.tetraOuter[i];
+		t->mRestVolume = k.tetraRest[i];
+		t->mRestMultiplier = k.tetraRestMultiplier[i];
+		t->mIntersected = k.tetraIntersected[i];
+		t->updateAABB();
+	}
+}
+
+void Mesh::getContinuous(Keyframe& k)
+{
+	k.aabb = mAABB;
+
+	k.x.clear(); k.oldX.clear(); k.f.clear();
+	k.mass.clear(); k.tag.clear(); k.frozen.clear();
+	BOOST_FOREACH(Vertex* v, mVertices)
+	{
+		k.x.push_back(v->mX);
+		k.oldX.push_back(v->mOldX);
+		k.f.push_back(v->mF);
+		k.mass.push_back(v->mMass);
+		k.tag.push_back(v->mTag);
+		k.frozen.push_back(v->mIsFrozen);
+	}
+
+	k.edgeRest.clear(); k.edgeRestMultiplier.clear();
+	BOOST_FOREACH(Edge* e, mEdges)
+	{
+		k.edgeRest.push_back(e->mRestLength);
+		k.edgeRestMultiplier.push_back(e->mRestMultiplier);
+	}
+
+	k.tetraRest.clear(); k.tetraRestMultiplier.clear();
+	BOOST_FOREACH(Tetra* t, mTetras)
+	{
+		k.tetraRest.push_back(t->mRestVolume);
+		k.tetraRestMultiplier.push_back(t->mRestMultiplier);
+	}
+}
+
+// write the vertex state of a keyframe (as bWriteFull and bWriteContinuous)
+static void writeVertices(std::ostream& ostr, const Mesh::Keyframe& k)
+{
+	AABB aabb = k.aabb;
+	writeAABB(ostr,aabb);
+
+	for(uint i=0;i<k.x.size();i++)
+	{
+		Vector3d x = k.x[i], oldX = k.oldX[i], f = k.f[i];
+		writeVec(ostr,x);
+		writeVec(ostr,oldX);
+		writeVec(ostr,f);
+		write(ostr,k.mass[i]);
+		write(ostr,(bool)k.tag[i]);
+	}
+}
+
+void Mesh::bWriteFull(std::ostream& ostr, const Keyframe& k)
+{
+	uint numverts = k.x.size(),
+		numedges = k.edgeRest.size(),
+		numtetras = k.tetraRest.size(),
+		numfaces = k.faceRest.size();
+
+	write(ostr,numverts);
+	write(ostr,numedges);
+	write(ostr,numtetras);
+	write(ostr,k.numberOfOuterFaces);
+	writeVertices(ostr,k);
+
+	for(uint i=0;i<numverts;i++)
+	{
+		write(ostr,(char)(k.surface[i] ? 1 : 0));
+		if (k.surface[i])
+		{
+			write(ostr,k.faceNeighbourStart[i+1] - k.faceNeighbourStart[i]);
+			for(uint j=k.faceNeighbourStart[i];j<k.faceNeighbourStart[i+1];j++)
+				write(ostr,k.faceNeighbours[j]);
+		}
+
+		write(ostr,k.neighbourStart[i+1] - k.neighbourStart[i]);
+		for(uint j=k.neighbourStart[i];j<k.neighbourStart[i+1];j++)
+			write(ostr,k.neighbours[j]);
+	}
+
+	for(uint i=0;i<numedges;i++)
+	{
+		write(ostr,k.edgeVertices[2*i]);
+		write(ostr,k.edgeVertices[2*i+1]);
+		write(ostr,k.edgeRest[i]*k.edgeRestMultiplier[i]);
+		write(ostr,k.edgeSpringCoefficient[i]);
+	}
+
+	for(uint i=0;i<numfaces;i++)
+	{
+		for(int j=0;j<3;j++)
+			write(ostr,k.faceVertices[3*i+j]);
+		write(ostr,k.faceRest[i]);
+	}
+
+	for(uint i=0;i<numtetras;i++)
+	{
+		for(int j=0;j<4;j++)
+			write(ostr,k.tetraVertices[4*i+j]);
+		// (as the neighbours of a Tetra are written, an int -1 or an unsigned int id)
+		for(int j=0;j<4;j++)
+		{
+			if (k.tetraNeighbours[4*i+j]==-1)
+				write(ostr,-1);
+			else
+				write(ostr,(uint)k.tetraNeighbours[4*i+j]);
+		}
+		write(ostr,k.tetraSpringCoefficient[i]);
+		write(ostr,(bool)k.tetraOuter[i]);
+		write(ostr,k.tetraRest[i]*k.tetraRestMultiplier[i]);
+		write(ostr,(bool)k.tetraIntersected[i]);
+	}
+}
+
+void Mesh::bWriteContinuous(std::ostream& ostr, const Keyframe& k)
+{
+	uint numverts = k.x.size(),
+		numedges = k.edgeRest.size(),
+		numtetras = k.tetraRest.size();
+
+	write(ostr,numverts);
+	write(ostr,numedges);
+	write(ostr,numtetras);
+	writeVertices(ostr,k);
+
+	for(uint i=0;i<numedges;i++)
+		write(ostr,k.edgeRest[i]*k.edgeRestMultiplier[i]);
+	for(uint i=0;i<numtetras;i++)
+		write(ostr,k.tetraRest[i]*k.tetraRestMultiplier[i]);
+}
+
+void Mesh::bWriteSpringMultipliers(std::ostream& ostr, const Keyframe& k)
+{
+	BOOST_FOREACH(double m, k.edgeRestMultiplier)
+		write(ostr,m);
+	BOOST_FOREACH(double m, k.tetraRestMultiplier)
+		write(ostr,m);
+}
+
+void Mesh::bWriteFrozenVerts(std::ostream& ostr, const Keyframe& k)
+{
+	BOOST_FOREACH(char f, k.frozen)
+		write(ostr,(bool)f);
+}
+
+// mix the bytes of x into h (as boost::hash_combine does)
+template <typename T>
+static void hashCombine(std::size_t& h, const T& x)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&x);
+	std::size_t v = 0;
+	for(unsigned int i=0;i<sizeof(T);i++)
+		v = v*131 + bytes[i];
+	h ^= v + 0x9e3779b9 + (h<<6) + (h>>2);
+}
+
+std::size_t Mesh::keyframeHash()
+{
+	std::size_t h = 0;
+	hashCombine(h,mVertices.size());
+	hashCombine(h,mEdges.size());
+	hashCombine(h,mFaces.size());
+	hashCombine(h,mOuterFaces.size());
+	hashCombine(h,mTetras.size());
+
+	BOOST_FOREACH(Vertex* v, mVertices)
+	{
+		hashCombine(h,v);
+		hashCombine(h,v->surface());
+		if (v->surface())
+		{
+			hashCombine(h,v->surfaceFaces().size());
+			BOOST_FOREACH(Face* f, v->surfaceFaces())
+				hashCombine(h,f);
+		}
+		hashCombine(h,v->neighbours().size());
+		BOOST_FOREACH(Vertex* n, v->neighbours())
+			hashCombine(h,n);
+	}
+
+	BOOST_FOREACH(Edge* e, mEdges)
+	{
+		hashCombine(h,e->v(0));
+		hashCombine(h,e->v(1));
+		hashCombine(h,e->springCoefficient());
+		hashCombine(h,e->restMultiplier());
+	}
+
+	BOOST_FOREACH(Face* f, mFaces)
+	{
+		hashCombine(h,&f->v(0));
+		hashCombine(h,&f->v(1));
+		hashCombine(h,&f->v(2));
+		hashCombine(h,f->rest());
+	}
+
+	BOOST_FOREACH(Tetra* t, mTetras)
+	{
+		for(int i=0;i<4;i++)
+		{
+			hashCombine(h,t->pv(i));
+			hashCombine(h,t->neighbour(i));
+		}
+		hashCombine(h,t->springCoefficient());
+		hashCombine(h,t->restMultiplier());
+		hashCombine(h,t->isOuter());
+		hashCombine(h,t->intersected());
+	}
+
+	return h;
 }
 
 void Mesh::bWriteSpringMultipliers(std::ostream& ostr)
@@ -1558,12 +2195,17 @@ Mesh* Mesh::copy()
 	// just use the streaming functionality already implementd
 	// not as fast as it could be, but its okay
 
+	// (with the spring multipliers and frozen vertices, as MeshSegmentIO writes them)
 	std::ostringstream str(std::ostringstream::out);
 	this->bWriteFull(str);
+	this->bWriteSpringMultipliers(str);
+	this->bWriteFrozenVerts(str);
 	std::istringstream data(str.str());
 	//uint numbytes;
 	//read(data,numbytes); // eat size info
 	m->bReadFull(data);
+	m->bReadSpringMultipliers(data);
+	m->bReadFrozenVerts(data);
 	//m->setWorld(mWorld);
 	return m;
 }
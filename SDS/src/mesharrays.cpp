@@ -0,0 +1,236 @@
+#include "mesharrays.h"
+
+#include "vertex.h"
+#include "edge.h"
+#include "tetra.h"
+
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+MeshArrays::MeshArrays()
+:springKD(-1)
+,springKSM(-1)
+,mElementsValid(false)
+,mColoured(false)
+{
+}
+
+void MeshArrays::clear()
+{
+	vertices.clear();
+	x.clear();
+	v.clear();
+	f.clear();
+	m.clear();
+	frozen.clear();
+	changed.clear();
+	r.clear();
+	springKD = springKSM = -1;
+	edges.clear();
+	tetras.clear();
+	mFreeSlots.clear();
+	mElementsValid = false;
+	mColoured = false;
+}
+
+void MeshArrays::rebuild(const std::list<Vertex*>& verts)
+{
+	clear();
+	vertices.reserve(verts.size());
+	BOOST_FOREACH(Vertex* vtx, verts)
+		addVertex(vtx);
+}
+
+unsigned int MeshArrays::allocateSlot()
+{
+	if (not mFreeSlots.empty())
+	{
+		unsigned int s = mFreeSlots.back();
+		mFreeSlots.pop_back();
+		changed[s] = CHANGED_ALL;
+		return s;
+	}
+
+	vertices.push_back(NULL);
+	x.push_back(Vector3d::ZERO);
+	v.push_back(Vector3d::ZERO);
+	f.push_back(Vector3d::ZERO);
+	m.push_back(0);
+	frozen.push_back(0);
+	changed.push_back(CHANGED_ALL);
+	r.push_back(0);
+	return vertices.size()-1;
+}
+
+void MeshArrays::addVertex(Vertex* vtx)
+{
+	unsigned int s = allocateSlot();
+	vertices[s] = vtx;
+	vtx->mSlot = s;
+}
+
+void MeshArrays::removeVertex(Vertex* vtx)
+{
+	if (not owns(vtx)) return;
+	vertices[vtx->mSlot] = NULL;
+	mFreeSlots.push_back(vtx->mSlot);
+	invalidateElements();
+}
+
+bool MeshArrays::owns(const Vertex* vtx) const
+{
+	return vtx->mSlot < vertices.size() and vertices[vtx->mSlot]==vtx;
+}
+
+void MeshArrays::markChanged(const Vertex* vtx, unsigned char what)
+{
+	if (owns(vtx)) changed[vtx->mSlot] |= what;
+}
+
+void MeshArrays::clearChanged(unsigned char what)
+{
+	const unsigned char keep = ~what;
+	BOOST_FOREACH(unsigned char& c, changed)
+		c &= keep;
+}
+
+void MeshArrays::rebuildElements(const std::list<Edge*>& es, const std::list<Tetra*>& ts)
+{
+	edges.resize(es.size());
+	tetras.resize(ts.size());
+
+	unsigned int i = 0;
+	BOOST_FOREACH(Edge* e, es)
+	{
+		EdgeTuple& et = edges[i++];
+		for(int j=0;j<2;j++)
+		{
+			assert(owns(e->v(j)));
+			et.v[j] = e->v(j)->mSlot;
+		}
+		et.e = e;
+	}
+
+	i = 0;
+	BOOST_FOREACH(Tetra* t, ts)
+	{
+		TetraTuple& tt = tetras[i++];
+		for(int j=0;j<4;j++)
+		{
+			assert(owns(t->pv(j)));
+			tt.v[j] = t->pv(j)->mSlot;
+		}
+		tt.t = t;
+	}
+
+	mElementsValid = true;
+	mColoured = false;
+}
+
+// Greedy colouring of elements with N vertices each.
+// vertexColours[s] holds the colours already used around slot s.
+template <int N, typename Tuple>
+static void colour(const std::vector<Tuple>& elements, unsigned int numSlots,
+		std::vector<unsigned int>& order, std::vector<unsigned int>& colourStart)
+{
+	std::vector<std::vector<unsigned int> > vertexColours(numSlots);
+	std::vector<unsigned int> elementColour(elements.size());
+	std::vector<unsigned int> forbidden; // forbidden[c]==i+1 iff c is used around element i
+	unsigned int numColours = 0;
+
+	for(unsigned int i=0;i<elements.size();i++)
+	{
+		for(int j=0;j<N;j++)
+			BOOST_FOREACH(unsigned int c, vertexColours[elements[i].v[j]])
+				forbidden[c] = i+1;
+
+		unsigned int c = 0;
+		while (c<numColours and forbidden[c]==i+1) c++;
+		if (c==numColours)
+		{
+			numColours++;
+			forbidden.push_back(0);
+		}
+
+		elementColour[i] = c;
+		for(int j=0;j<N;j++)
+			vertexColours[elements[i].v[j]].push_back(c);
+	}
+
+	// counting sort by colour (keeps list order within a colour)
+	colourStart.assign(numColours+1,0);
+	for(unsigned int i=0;i<elements.size();i++)
+		colourStart[elementColour[i]+1]++;
+	for(unsigned int c=0;c<numColours;c++)
+		colourStart[c+1] += colourStart[c];
+
+	order.resize(elements.size());
+	std::vector<unsigned int> next(colourStart.begin(),colourStart.end()-1);
+	for(unsigned int i=0;i<elements.size();i++)
+		order[next[elementColour[i]]++] = i;
+}
+
+void MeshArrays::rebuildColouring()
+{
+	const unsigned int n = vertices.size();
+	colour<2>(edges,n,edgeOrder,edgeColourStart);
+	colour<4>(tetras,n,tetraOrder,tetraColourStart);
+
+	// contributions to each slot, edges then tetras, each in list order
+	const unsigned int tetraBase = 2*edges.size();
+	contributions.resize(tetraBase + 4*tetras.size());
+
+	incidentStart.assign(n+1,0);
+	for(unsigned int i=0;i<edges.size();i++)
+		for(int j=0;j<2;j++)
+			incidentStart[edges[i].v[j]+1]++;
+	for(unsigned int i=0;i<tetras.size();i++)
+		for(int j=0;j<4;j++)
+			incidentStart[tetras[i].v[j]+1]++;
+	for(unsigned int s=0;s<n;s++)
+		incidentStart[s+1] += incidentStart[s];
+
+	incident.resize(contributions.size());
+	std::vector<unsigned int> next(incidentStart.begin(),incidentStart.end()-1);
+	for(unsigned int i=0;i<edges.size();i++)
+		for(int j=0;j<2;j++)
+			incident[next[edges[i].v[j]]++] = 2*i+j;
+	for(unsigned int i=0;i<tetras.size();i++)
+		for(int j=0;j<4;j++)
+			incident[next[tetras[i].v[j]]++] = tetraBase + 4*i+j;
+
+	mColoured = true;
+}
+
+void MeshArrays::gather()
+{
+	const unsigned int n = vertices.size();
+	for(unsigned int i=0;i<n;i++)
+	{
+		const Vertex* vtx = vertices[i];
+		if (vtx==NULL) continue;
+
+		x[i] = vtx->mX;
+		v[i] = vtx->mV;
+		m[i] = vtx->mMass;
+		frozen[i] = vtx->mIsFrozen;
+		f[i] = vtx->mF;
+	}
+}
+
+void MeshArrays::freeze(unsigned int s)
+{
+	frozen[s] = 1;
+	vertices[s]->setFrozen(true);
+}
+
+void MeshArrays::scatterForces()
+{
+	const unsigned int n = vertices.size();
+	for(unsigned int i=0;i<n;i++)
+	{
+		if (vertices[i]!=NULL)
+			vertices[i]->mF = f[i];
+	}
+}
@@ -0,0 +1,197 @@
+#include "meshindex.h"
+
+#include "vertex.h"
+#include "edge.h"
+#include "face.h"
+#include "tetra.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <boost/foreach.hpp>
+
+const MeshIndex::Incidence MeshIndex::sNoIncidence;
+
+template <int N>
+bool MeshIndex::Key<N>::operator<(const Key<N>& k) const
+{
+	// lexicographic (address) order
+	for(int i=0;i<N;i++)
+		if (v[i]!=k.v[i]) return std::less<const Vertex*>()(v[i],k.v[i]);
+	return false;
+}
+
+// sort a handful of vertices in place (insertion sort)
+template <int N>
+static void sortKey(const Vertex* (&v)[N])
+{
+	for(int i=1;i<N;i++)
+	{
+		const Vertex* x = v[i];
+		int j = i-1;
+		for(;j>=0 and v[j]>x;j--)
+			v[j+1] = v[j];
+		v[j+1] = x;
+	}
+}
+
+// remove all occurrences of x from vec, preserving order
+// (like std::list::remove, which is what Mesh uses)
+template <typename T>
+static void eraseFrom(std::vector<T*>& vec, T* x)
+{
+	vec.erase(std::remove(vec.begin(),vec.end(),x),vec.end());
+}
+
+MeshIndex::MeshIndex()
+{
+}
+
+void MeshIndex::clear()
+{
+	mEdges.clear();
+	mFaces.clear();
+	mTetras.clear();
+	mIncidence.clear();
+}
+
+void MeshIndex::rebuild(const std::list<Edge*>& edges, const std::list<Face*>& faces, const std::list<Tetra*>& tetras)
+{
+	clear();
+
+	BOOST_FOREACH(Edge* e, edges)
+		addEdge(e);
+	BOOST_FOREACH(Face* f, faces)
+		addFace(f);
+	BOOST_FOREACH(Tetra* t, tetras)
+		addTetra(t);
+}
+
+MeshIndex::EdgeKey MeshIndex::makeKey(Vertex* a, Vertex* b)
+{
+	EdgeKey k;
+	k.v[0] = a; k.v[1] = b;
+	sortKey(k.v);
+	return k;
+}
+
+MeshIndex::FaceKey MeshIndex::makeKey(Vertex* a, Vertex* b, Vertex* c)
+{
+	FaceKey k;
+	k.v[0] = a; k.v[1] = b; k.v[2] = c;
+	sortKey(k.v);
+	return k;
+}
+
+MeshIndex::TetraKey MeshIndex::makeKey(Vertex* a, Vertex* b, Vertex* c, Vertex* d)
+{
+	TetraKey k;
+	k.v[0] = a; k.v[1] = b; k.v[2] = c; k.v[3] = d;
+	sortKey(k.v);
+	return k;
+}
+
+// NB: if two elements share the same vertices then the first one added is
+// the one found (this matches the old linear search through the mesh lists)
+
+void MeshIndex::addEdge(Edge* e)
+{
+	mEdges.insert(std::make_pair(makeKey(e->v(0),e->v(1)),e));
+	mIncidence[e->v(0)].edges.push_back(e);
+	mIncidence[e->v(1)].edges.push_back(e);
+}
+
+void MeshIndex::addFace(Face* f)
+{
+	mFaces.insert(std::make_pair(makeKey(&f->v(0),&f->v(1),&f->v(2)),f));
+	for(int i=0;i<3;i++)
+		mIncidence[&f->v(i)].faces.push_back(f);
+}
+
+void MeshIndex::addTetra(Tetra* t)
+{
+	mTetras.insert(std::make_pair(makeKey(t->pv(0),t->pv(1),t->pv(2),t->pv(3)),t));
+	for(int i=0;i<4;i++)
+		mIncidence[t->pv(i)].tetras.push_back(t);
+}
+
+void MeshIndex::removeEdge(Edge* e)
+{
+	EdgeMap::iterator it = mEdges.find(makeKey(e->v(0),e->v(1)));
+	for(int i=0;i<2;i++)
+		eraseFrom(mIncidence[e->v(i)].edges,e);
+	if (it!=mEdges.end() and it->second==e)
+	{
+		// promote a duplicate edge, if there is one
+		mEdges.erase(it);
+		BOOST_FOREACH(Edge* o, mIncidence[e->v(0)].edges)
+			if (o->v(0)==e->v(1) or o->v(1)==e->v(1))
+			{
+				mEdges.insert(std::make_pair(makeKey(o->v(0),o->v(1)),o));
+				break;
+			}
+	}
+}
+
+void MeshIndex::removeFace(Face* f)
+{
+	FaceMap::iterator it = mFaces.find(makeKey(&f->v(0),&f->v(1),&f->v(2)));
+	for(int i=0;i<3;i++)
+		eraseFrom(mIncidence[&f->v(i)].faces,f);
+	if (it!=mFaces.end() and it->second==f)
+	{
+		mFaces.erase(it);
+		BOOST_FOREACH(Face* o, mIncidence[&f->v(0)].faces)
+			if (o->contains(&f->v(1)) and o->contains(&f->v(2)))
+			{
+				mFaces.insert(std::make_pair(makeKey(&o->v(0),&o->v(1),&o->v(2)),o));
+				break;
+			}
+	}
+}
+
+void MeshIndex::removeTetra(Tetra* t)
+{
+	TetraMap::iterator it = mTetras.find(makeKey(t->pv(0),t->pv(1),t->pv(2),t->pv(3)));
+	for(int i=0;i<4;i++)
+		eraseFrom(mIncidence[t->pv(i)].tetras,t);
+	if (it!=mTetras.end() and it->second==t)
+	{
+		mTetras.erase(it);
+		BOOST_FOREACH(Tetra* o, mIncidence[t->pv(0)].tetras)
+			if (o->contains(t->pv(1)) and o->contains(t->pv(2)) and o->contains(t->pv(3)))
+			{
+				mTetras.insert(std::make_pair(makeKey(o->pv(0),o->pv(1),o->pv(2),o->pv(3)),o));
+				break;
+			}
+	}
+}
+
+void MeshIndex::removeVertex(Vertex* v)
+{
+	mIncidence.erase(v);
+}
+
+Edge* MeshIndex::edge(Vertex* a, Vertex* b) const
+{
+	EdgeMap::const_iterator it = mEdges.find(makeKey(a,b));
+	return (it==mEdges.end())?NULL:it->second;
+}
+
+Face* MeshIndex::face(Vertex* a, Vertex* b, Vertex* c) const
+{
+	FaceMap::const_iterator it = mFaces.find(makeKey(a,b,c));
+	return (it==mFaces.end())?NULL:it->second;
+}
+
+Tetra* MeshIndex::tetra(Vertex* a, Vertex* b, Vertex* c, Vertex* d) const
+{
+	TetraMap::const_iterator it = mTetras.find(makeKey(a,b,c,d));
+	return (it==mTetras.end())?NULL:it->second;
+}
+
+const MeshIndex::Incidence& MeshIndex::incident(Vertex* v) const
+{
+	IncidenceMap::const_iterator it = mIncidence.find(v);
+	return (it==mIncidence.end())?sNoIncidence:it->second;
+}
@@ -14,6 +14,23 @@
 #include <vector>
 #include <list>
 #include <fstream>
+#include <algorithm>
+
+// a face of a tetra, for finding the neighbours of the tetras in cube()
+struct TetraFace
+{
+	Vertex* v[3]; // sorted
+	Tetra* t;
+	int i; // the face opposite vertex i of t
+
+	TetraFace(Tetra* t_, int i_):t(t_),i(i_)
+	{
+		for(int j=0;j<3;j++) v[j] = &t->v((i+1+j)%4);
+		std::sort(v,v+3);
+	}
+	bool operator<(const TetraFace& f) const {return std::lexicographical_compare(v,v+3,f.v,f.v+3);}
+	bool sameFace(const TetraFace& f) const {return std::equal(v,v+3,f.v);}
+};
 
 Mesh* MeshTester::CreateTestMesh(std::string name)
 {
@@ -84,6 +101,7 @@ Mesh* MeshTester::CreateEdgeTestMesh()
 	m->mVertices.push_back(b);
 
 	m->mEdges.push_back(new Edge(a,b,.5));
+	m->invalidateIndex();
 
 	m->mAABB = AABB(0,0,0,1,1,1);
 
@@ -109,6 +127,7 @@ Mesh* MeshTester::CreateTriTestMesh()
 	Face* f;
 	m->mFaces.push_back(f = new Face(a,b,c));
 	// f->rest(1);
+	m->invalidateIndex();
 
 	return m;
 }
@@ -132,6 +151,7 @@ Mesh* MeshTester::CreateDampingTestMesh()
 	m->mEdges.push_back(e);
 	(e=new Edge(c,a))->setRest(1);
 	m->mEdges.push_back(e);
+	m->invalidateIndex();
 
 	return m;
 }
@@ -155,6 +175,7 @@ Mesh* MeshTester::CreateDampingTestMeshB()
 	m->mEdges.push_back(e);
 	(e=new Edge(c,a))->setRest(.8);
 	m->mEdges.push_back(e);
+	m->invalidateIndex();
 
 	return m;
 }
@@ -318,6 +339,7 @@ void MeshTester::addYReflectedTetra(Vector3d a, Vector3d b, Vector3d c, Vector3d
 
 	m->mTetras.push_back(t);
 	m->mTetras.push_back(t2);
+	m->invalidateIndex();
 }
 
 /*
@@ -623,7 +645,8 @@ Mesh* MeshTester::cube(int xw, int yw, int zw, double w)
 							V(inf[ii*3+2][0],inf[ii*3+2][1],inf[ii*3+2][2]),
 							V(inf[ii*3+1][0],inf[ii*3+1][1],inf[ii*3+1][2]));
 
-					m->mFaces.push_back(f);
+					// (the mesh only keeps its outer faces, as a loaded mesh does)
+					delete f;
 				}
 
 				// Add Cube Outer Faces
@@ -682,8 +705,6 @@ Mesh* MeshTester::cube(int xw, int yw, int zw, double w)
 								V(fv[0][0],fv[0][1],fv[0][2]),
 								V(fv[2][0],fv[2][1],fv[2][2]),
 								V(fv[1][0],fv[1][1],fv[1][2]));
-						m->mFaces.push_back(f);
-
 						// if f is outer face
 						// XXX: oops this logic only works if the mesh is thicker than 1 triangle!
 						// some better logic follows
@@ -693,11 +714,14 @@ Mesh* MeshTester::cube(int xw, int yw, int zw, double w)
 								(j==0 and fv[0][1]==j and fv[1][1]==j and fv[2][1]==j) or
 								(k==0 and fv[0][2]==k and fv[1][2]==k and fv[2][2]==k))
 						{
+							f->setOuter(true);
+							m->mFaces.push_back(f);
 							m->mOuterFaces.push_back(f);
 							V(fv[0][0],fv[0][1],fv[0][2])->mFaceNeighbours.push_back(f);
 							V(fv[1][0],fv[1][1],fv[1][2])->mFaceNeighbours.push_back(f);
 							V(fv[2][0],fv[2][1],fv[2][2])->mFaceNeighbours.push_back(f);
 						}
+						else delete f;
 					}
 
 					// construct the end caps
@@ -716,6 +740,7 @@ Mesh* MeshTester::cube(int xw, int yw, int zw, double w)
 								V(fv[0][0],fv[0][1],fv[0][2]),
 								V(fv[2][0],fv[2][1],fv[2][2]),
 								V(fv[1][0],fv[1][1],fv[1][2]));
+						f->setOuter(true);
 						m->mFaces.push_back(f);
 						m->mOuterFaces.push_back(f);
 
@@ -770,6 +795,24 @@ Mesh* MeshTester::cube(int xw, int yw, int zw, double w)
 	BOOST_FOREACH(Tetra* tet, t)
 		m->mTetras.push_back(tet);
 
+	// link the neighbouring tetras (through the faces they share)
+	std::vector<TetraFace> tf;
+	tf.reserve(4*t.size());
+	BOOST_FOREACH(Tetra* tet, t)
+		for(int i=0;i<4;i++)
+			tf.push_back(TetraFace(tet,i));
+	std::sort(tf.begin(),tf.end());
+	for(unsigned int i=0;i+1<tf.size();i++)
+	{
+		if (tf[i].sameFace(tf[i+1]))
+		{
+			tf[i].t->setNeighbour(tf[i].i,tf[i+1].t);
+			tf[i+1].t->setNeighbour(tf[i+1].i,tf[i].t);
+			i++;
+		}
+	}
+	m->invalidateIndex();
+
 	delete[]vtx;
 	return m;
 }
@@ -1230,6 +1273,7 @@ void MeshTester::addcube(Vector3i dim, Vector3d origin, double w, Mesh* m)
 	// add all tetras to mesh
 	BOOST_FOREACH(Tetra* tet, t)
 		m->mTetras.push_back(tet);
+	m->invalidateIndex();
 
 	delete[]vtx;
 }
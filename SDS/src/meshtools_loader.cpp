@@ -372,6 +372,8 @@ Mesh* MeshTools::LoadTetgenMesh(std::string name)
 	delete[]tetrahedra;
 	delete[]edgeArray;
 
+	// (the lists were filled directly)
+	mesh->invalidateIndex();
 	return mesh;
 }
 
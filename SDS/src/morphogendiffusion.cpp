@@ -0,0 +1,157 @@
+#include "morphogendiffusion.h"
+
+#include "organism.h"
+#include "processmodel.h"
+#include "cell.h"
+#include "vertex.h"
+
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cassert>
+
+#include <boost/foreach.hpp>
+
+MorphogenDiffusion::MorphogenDiffusion()
+:mOrganism(NULL)
+,mMesh(NULL)
+,mTopologyVersion(0)
+{
+}
+
+void MorphogenDiffusion::clear()
+{
+	mOrganism = NULL;
+	mMesh = NULL;
+	mTopologyVersion = 0;
+	mCells.clear();
+	mRowStart.clear();
+	mNeighbours.clear();
+	mEdge.clear();
+	mEnds.clear();
+	mWeights.clear();
+}
+
+bool MorphogenDiffusion::isValid(Organism* o) const
+{
+	if (o!=mOrganism or o->mesh()!=mMesh or mMesh->topologyVersion()!=mTopologyVersion) return false;
+	if (o->cells().size()!=mCells.size()) return false;
+
+	// cells can be added and removed without changing the mesh
+	std::vector<Cell*>::const_iterator it = mCells.begin();
+	BOOST_FOREACH(Cell* c, o->cells())
+		if (c!=*it++) return false;
+	return true;
+}
+
+void MorphogenDiffusion::build(Organism* o)
+{
+	clear();
+	mOrganism = o;
+	mMesh = o->mesh();
+	mTopologyVersion = mMesh->topologyVersion();
+
+	std::map<Vertex*,unsigned int> cellIndex;
+	BOOST_FOREACH(Cell* c, o->cells())
+	{
+		cellIndex[c->v()] = mCells.size();
+		mCells.push_back(c);
+	}
+
+	std::map<std::pair<unsigned int,unsigned int>,unsigned int> edgeIndex;
+	mRowStart.reserve(mCells.size()+1);
+	for(unsigned int i=0;i<mCells.size();i++)
+	{
+		mRowStart.push_back(mNeighbours.size());
+		BOOST_FOREACH(Vertex* v, mCells[i]->v()->neighbours())
+		{
+			std::map<Vertex*,unsigned int>::const_iterator it = cellIndex.find(v);
+			assert(it!=cellIndex.end());
+			unsigned int j = it->second;
+
+			std::pair<unsigned int,unsigned int> ends(std::min(i,j),std::max(i,j));
+			std::map<std::pair<unsigned int,unsigned int>,unsigned int>::const_iterator e = edgeIndex.find(ends);
+			if (e==edgeIndex.end())
+			{
+				e = edgeIndex.insert(std::make_pair(ends,(unsigned int)edgeIndex.size())).first;
+				mEnds.push_back(ends.first);
+				mEnds.push_back(ends.second);
+			}
+
+			mNeighbours.push_back(j);
+			mEdge.push_back(e->second);
+		}
+	}
+	mRowStart.push_back(mNeighbours.size());
+	mWeights.resize(edgeIndex.size());
+}
+
+void MorphogenDiffusion::step(Organism* o, double dt, int numMorphogens, const double* diffusion, const double* decay, const CellMask& skip, int skipMorphogen)
+{
+	if (numMorphogens<=0) return;
+	if (not isValid(o)) build(o);
+
+	const unsigned int n = mCells.size();
+	const unsigned int nm = numMorphogens;
+
+	// gather (and copy value to oldvalue)
+	mValues.resize(n*nm);
+	mVolumes.resize(n);
+	mLaplacian.resize(nm);
+	for(unsigned int i=0;i<n;i++)
+	{
+		Morphogen* m = mCells[i]->getCellContents()->mMorphogens;
+		for(unsigned int k=0;k<nm;k++)
+		{
+			m[k].oldvalue = m[k].value;
+			mValues[i*nm+k] = m[k].value;
+		}
+		mVolumes[i] = mCells[i]->vol();
+	}
+
+	for(unsigned int e=0;e<mWeights.size();e++)
+		mWeights[e] = 1/dist(mCells[mEnds[2*e]]->v()->x(),mCells[mEnds[2*e+1]]->v()->x());
+
+	// for each cell, calculate the discrete laplacian, which is the weighted sum
+	// of the difference between morphogen levels of neighbours
+	// see e.g., http://en.wikipedia.org/wiki/Laplace_operator
+	// (the cells are updated in place, so later cells see the new values of earlier ones)
+	const unsigned int skipSize = skip.size();
+	double* laplacian = &mLaplacian[0];
+	for(unsigned int i=0;i<n;i++)
+	{
+		bool skipped = i<skipSize and skip[i];
+		if (skipped and skipMorphogen<0) continue;
+
+		double* cm = &mValues[i*nm];
+		double cvol = mVolumes[i];
+
+		std::fill(laplacian,laplacian+nm,0.);
+		for(unsigned int j=mRowStart[i];j<mRowStart[i+1];j++)
+		{
+			const double* cnm = &mValues[mNeighbours[j]*nm];
+			double cnvol = mVolumes[mNeighbours[j]];
+			double w = mWeights[mEdge[j]];
+			for(unsigned int k=0;k<nm;k++)
+				laplacian[k] += w*(std::min(cnm[k],cvol) - std::min(cm[k],cnvol));
+		}
+
+		for(unsigned int k=0;k<nm;k++)
+		{
+			if (skipped and (int)k==skipMorphogen) continue;
+
+			// TEMPORARY FIX!!
+			// double dcmdt = D*laplacian - C*cm;
+			double dcmdt = diffusion[k]*laplacian[k] - decay[k];
+			cm[k] = std::max(0., std::min(cm[k] + dcmdt * dt, cvol));
+		}
+	}
+
+	// scatter
+	for(unsigned int i=0;i<n;i++)
+	{
+		Morphogen* m = mCells[i]->getCellContents()->mMorphogens;
+		for(unsigned int k=0;k<nm;k++)
+			m[k].value = mValues[i*nm+k];
+	}
+}
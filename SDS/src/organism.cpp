@@ -12,6 +12,7 @@
 
 #include <boost/foreach.hpp>
 #include <ostream>
+#include <sstream>
 #include <stdexcept>
 #include <cassert>
 
@@ -44,6 +45,36 @@ Organism::~Organism()
 	clear();
 }
 
+Organism* Organism::copy(ProcessModel* pm)
+{
+	assert(mMesh!=NULL);
+
+	// like Mesh::copy, use the streaming functionality
+	// (copying the mesh fills in the vertex maps used to write and read the cells)
+	Organism* o = new Organism(mMesh->copy());
+
+	std::ostringstream cells(std::ios::binary);
+	bWrite(cells);
+	std::istringstream cellData(cells.str());
+	if (not o->bRead(cellData))
+	{
+		delete o;
+		throw std::runtime_error("Organism::copy: can't read the cells");
+	}
+
+	if (pm!=NULL)
+	{
+		std::ostringstream contents(std::ios::binary);
+		BOOST_FOREACH(Cell* c, mCells)
+			c->getCellContents()->write(contents);
+		std::istringstream contentData(contents.str());
+		BOOST_FOREACH(Cell* c, o->mCells)
+			c->setCellContents(pm->readCellContents(contentData));
+	}
+	o->setProcessModel(pm);
+	return o;
+}
+
 void Organism::clear()
 {
 	mVertexToCellMap.clear();
@@ -183,14 +214,13 @@ bool Organism::bRead(std::istream& bin)
 	DUMP("Organism::bRead");
 
 	// get the id->vertex map
-	std::map<unsigned int,Vertex*>& vm = mMesh->vertexMapRead();
+	std::vector<Vertex*>& vm = mMesh->vertexMapRead();
 
 	#ifdef DEBUG_BINARY
 		DUMP("mMesh->vertexMapRead");
-		std::map<unsigned int, Vertex*>::iterator it = vm.begin();
-		for(;it!=vm.end();it++)
+		for(unsigned int i=0;i<vm.size();i++)
 		{
-			DUMP(it->first << " -> " << it->second);
+			DUMP(i << " -> " << vm[i]);
 		}
 	#endif
 
@@ -206,13 +236,13 @@ bool Organism::bRead(std::istream& bin)
 
 		DUMP("vid " << i << " = " << vid);
 
-		if (vm.count(vid)!=1)
+		if (vid >= vm.size())
 		{
-			DUMP("vm.count(" << vid << ") = " << vm.count(vid));
+			DUMP("vm.size() = " << vm.size());
 			return false;
 		}
 
-		Vertex* v = vm.find(vid)->second;
+		Vertex* v = vm[vid];
 
 		DUMP("v = " << v);
 
@@ -285,7 +315,7 @@ Organism* Organism::read(std::istream& file, ProcessModel* pm)
 	o->setProcessModel(pm);
 
 	// get the id->vertex map
-	std::map<unsigned int,Vertex*>& vm = m->vertexMapRead();
+	std::vector<Vertex*>& vm = m->vertexMapRead();
 
 	unsigned int numCells = 0;
 	::read(file,numCells);
@@ -295,8 +325,8 @@ Organism* Organism::read(std::istream& file, ProcessModel* pm)
 	{
 		int vid;
 		::read(file,vid);
-		assert(vm.count(vid)==1);
-		Vertex* v = vm.find(vid)->second;
+		assert(vid >= 0 and vid < (int)vm.size());
+		Vertex* v = vm[vid];
 
 		double r, drdt;
 		::read(file, r);
@@ -201,6 +201,11 @@ Organism* OrganismTools::loadMesh(std::string filename)
 	Mesh* m = MeshTools::Load(filename);
 	if (m==NULL) throw(std::runtime_error(std::string("Can't load mesh: ")+filename));
 
+	return fromMesh(m);
+}
+
+Organism* OrganismTools::fromMesh(Mesh* m)
+{
 	Organism* o = new Organism(m);
 	BOOST_FOREACH(Vertex* v, m->vertices())
 	{
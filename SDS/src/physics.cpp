@@ -6,6 +6,7 @@
 #include "face.h"
 #include "tetra.h"
 #include "mesh.h"
+#include "mesharrays.h"
 
 #include <iostream>
 #include <sstream>
@@ -17,26 +18,28 @@
 
 #define PHYSICS_CHECK_PARTIALS
 
-// generalised spring coefficients
-double Physics::kD = 1; // dist
-double Physics::kSM = 1; // multiplier
-double Physics::kDamp = 0.001; // damp
-double Physics::kV = 2.0; // volume
+// generalised spring coefficients (the defaults are set by SimulationContext)
+SimulationContext::Value<double,&SimulationContext::kD> Physics::kD; // dist
+SimulationContext::Value<double,&SimulationContext::kSM> Physics::kSM; // multiplier
+SimulationContext::Value<double,&SimulationContext::kDamp> Physics::kDamp; // damp
+SimulationContext::Value<double,&SimulationContext::kV> Physics::kV; // volume
 
 //
-double Physics::GRAVITY = 10;
+SimulationContext::Value<double,&SimulationContext::gravity> Physics::GRAVITY;
 
 bool
 Physics::FD(Edge* e, FDInfo* fd)
 {
-	// Spring Force ... ((a - b)*k*(r - d(a,b)))/(r*r*d(a,b)) (not including damping...)
-	// verified with mathematica...springs.nb (near end) 09.10.07
-
 	Vertex* a = e->v(0);
 	Vertex* b = e->v(1);
-	const double& r = e->rest();
+	return FD(a->x(),b->x(),a->m()+b->m(),e->rest(),e->springCoefficient(),a->mF,b->mF,fd);
+}
 
-	const Vector3d &ax = a->x(), &bx = b->x(), &av = a->v(), &bv = b->v();
+bool
+Physics::FD(const Vector3d& ax, const Vector3d& bx, double mass, double r, double k, Vector3d& fa, Vector3d& fb, FDInfo* fd)
+{
+	// Spring Force ... ((a - b)*k*(r - d(a,b)))/(r*r*d(a,b)) (not including damping...)
+	// verified with mathematica...springs.nb (near end) 09.10.07
 
 	Vector3d diff = bx - ax;
 	double length = diff.length();
@@ -46,7 +49,7 @@ Physics::FD(Edge* e, FDInfo* fd)
 	double C = (length - r) / r;
 
 	// Compute adjusted spring coefficient
-	double adjSpringCoefficient = e->springCoefficient()*e->rest()*(a->m()+b->m());
+	double adjSpringCoefficient = k*r*mass;
 	double springPhysics = - adjSpringCoefficient * C;
 
 	/** Removed spring damping, added damping to tetrahedral springs
@@ -66,8 +69,8 @@ Physics::FD(Edge* e, FDInfo* fd)
 	*/
 
 	double totalPhysics = springPhysics; // + dampingPhysics;
-	a->addF(-totalPhysics * dCdb);
-	b->addF(totalPhysics * dCdb);
+	fa += -totalPhysics * dCdb;
+	fb += totalPhysics * dCdb;
 
 #ifdef PHYSICS_CHECK_PARTIALS
 	if (std::isnan(totalPhysics)
@@ -88,7 +91,7 @@ Physics::FD(Edge* e, FDInfo* fd)
 	{
 		fd->length = length;
 		fd->extension = C;
-		fd->energy = .5*e->springCoefficient()*C*C;
+		fd->energy = .5*k*C*C;
 	}
 
 	return true;
@@ -101,17 +104,24 @@ bool Physics::FV(Tetra* t, FVInfo* fv)
 	Vertex* v2 = &t->v(2);
 	Vertex* v3 = &t->v(3);
 
-	const Vector3d& a = v0->x();
-	const Vector3d& b = v1->x();
-	const Vector3d& c = v2->x();
-	const Vector3d& d = v3->x();
+	const Vector3d* x[] = {&v0->x(), &v1->x(), &v2->x(), &v3->x()};
+	const Vector3d* v[] = {&v0->v(), &v1->v(), &v2->v(), &v3->v()};
+	Vector3d* f[] = {&v0->mF, &v1->mF, &v2->mF, &v3->mF};
+	return FV(x,v,t->rest(),t->springCoefficient(),kDamp,f,fv);
+}
+
+bool Physics::FV(const Vector3d* const x[4], const Vector3d* const v[4], double rest, double k, double damp, Vector3d* const f[4], FVInfo* fv)
+{
+	const Vector3d& a = *x[0];
+	const Vector3d& b = *x[1];
+	const Vector3d& c = *x[2];
+	const Vector3d& d = *x[3];
 
 	const double &a1 = a.x(), &a2 = a.y(), &a3 = a.z(),
 				&b1 = b.x(), &b2 = b.y(), &b3 = b.z(),
 				&c1 = c.x(), &c2 = c.y(), &c3 = c.z(),
 				&d1 = d.x(), &d2 = d.y(), &d3 = d.z();
 
-	double rest = t->rest();
 	double factor = 1/(6*rest);
 
 	double dCdVParts[] =
@@ -135,16 +145,16 @@ bool Physics::FV(Tetra* t, FVInfo* fv)
 
 	double vol = (1./6)*dot(b-a,cross(c-a,d-a));
 	double C = (vol - rest) / rest;
-	double negKC = - t->springCoefficient()*C;
+	double negKC = - k*C;
 
 	// We apply damping to these springs
 	// double dampingPhysics = -kDamp * dot(dCdb,bv-av);
 	// e.g., damp(p0) = -kDamp * sum(dCdp * pv)
-	const Vector3d& av = v0->v();
-	const Vector3d& bv = v1->v();
-	const Vector3d& cv = v2->v();
-	const Vector3d& dv = v3->v();
-	double damping = -kDamp * (dot(dCda,av) + dot(dCdb,bv) + dot(dCdc,cv) + dot(dCdd,dv));
+	const Vector3d& av = *v[0];
+	const Vector3d& bv = *v[1];
+	const Vector3d& cv = *v[2];
+	const Vector3d& dv = *v[3];
+	double damping = -damp * (dot(dCda,av) + dot(dCdb,bv) + dot(dCdc,cv) + dot(dCdd,dv));
 	//LOG("-kC " << negKC << ",a d " << damping << "\n");
 	// double damping = 1;
 
@@ -162,10 +172,10 @@ bool Physics::FV(Tetra* t, FVInfo* fv)
 
 	double finalmult = damping+negKC;
 
-	v0->addF(dCda*finalmult);
-	v1->addF(dCdb*finalmult);
-	v2->addF(dCdc*finalmult);
-	v3->addF(dCdd*finalmult);
+	*f[0] += dCda*finalmult;
+	*f[1] += dCdb*finalmult;
+	*f[2] += dCdc*finalmult;
+	*f[3] += dCdd*finalmult;
 
 	#ifdef PHYSICS_CHECK_PARTIALS
 	if (std::isnan(finalmult)
@@ -179,7 +189,7 @@ bool Physics::FV(Tetra* t, FVInfo* fv)
 		LOG("Variables:\n");
 		LOG("finalmult = " << finalmult << "\n");
 		LOG("damping    = " << damping << "\n");
-		LOG("(expanded) = " << -kDamp << "*" << "(" << dot(dCda,av) << "+" << dot(dCdb,bv) << "+" << dot(dCdc,cv) << "+" << dot(dCdd,dv) << ")\n");
+		LOG("(expanded) = " << -damp << "*" << "(" << dot(dCda,av) << "+" << dot(dCdb,bv) << "+" << dot(dCdc,cv) << "+" << dot(dCdd,dv) << ")\n");
 		LOG("dCda = " << dCda << "\n");
 		LOG("av = " << av << "\n");
 		LOG("dCdb = " << dCdb << "\n");
@@ -204,7 +214,7 @@ bool Physics::FV(Tetra* t, FVInfo* fv)
 
 	if (fv)
 	{
-		fv->energy = .5*t->springCoefficient()*C*C;
+		fv->energy = .5*k*C*C;
 	}
 
 	return true;
@@ -236,9 +246,29 @@ bool Physics::setParam(std::string param, std::string value)
 		setGravity(val);
 		return true;
 	}
+	else if (param=="integrator")
+	{
+		return setIntegrator(value);
+	}
 	else return false;
 }
 
+std::string Physics::integratorName(int integrator)
+{
+	return (integrator==IMPLICIT_EULER) ? "implicit" : "verlet";
+}
+
+bool Physics::setIntegrator(std::string name)
+{
+	if (name=="verlet")
+		INTEGRATOR = VERLET;
+	else if (name=="implicit")
+		INTEGRATOR = IMPLICIT_EULER;
+	else
+		return false;
+	return true;
+}
+
 void Physics::SetAllEdgeSpringStrengths(Mesh* m)
 {
 	BOOST_FOREACH(Edge* e, m->edges())
@@ -252,3 +282,31 @@ void Physics::SetAllEdgeSpringStrengths(Mesh* m)
 
 	}
 }
+
+void Physics::UpdateEdgeSpringStrengths(Mesh* m)
+{
+	MeshArrays& arrays = m->arrays();
+	const double kd = Physics::kD, ksm = Physics::kSM;
+	const bool all = (kd!=arrays.springKD or ksm!=arrays.springKSM);
+
+	bool any = all;
+	for(unsigned int s=0;s<arrays.changed.size() and not any;s++)
+		any = arrays.changed[s] & MeshArrays::CHANGED_SPRINGS;
+	if (not any) return;
+
+	BOOST_FOREACH(const MeshArrays::EdgeTuple& et, arrays.edges)
+	{
+		if (not all and not ((arrays.changed[et.v[0]] | arrays.changed[et.v[1]]) & MeshArrays::CHANGED_SPRINGS))
+			continue;
+
+		Edge* e = et.e;
+		if (m->getSurfaceFace(e->v(0),e->v(1)))
+			e->setSpringCoefficient(kd * ksm);
+		else
+			e->setSpringCoefficient(kd);
+	}
+
+	arrays.clearChanged(MeshArrays::CHANGED_SPRINGS);
+	arrays.springKD = kd;
+	arrays.springKSM = ksm;
+}
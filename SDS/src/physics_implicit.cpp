@@ -0,0 +1,312 @@
+#include "physics.h"
+#include "mesharrays.h"
+#include "edge.h"
+#include "tetra.h"
+#include "vector3.h"
+#include "log.h"
+
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <boost/foreach.hpp>
+
+/*
+ * Backward Euler integration (see Baraff and Witkin, "Large steps in cloth simulation", 1998).
+ *
+ * One Newton step of v1 = v0 + h M^-1 f(x0 + h v1, v1), linearised about (x0,v0):
+ *   (M - h df/dv - h^2 df/dx) dv = h (f0 + h df/dx v0)
+ * solved by conjugate gradients, preconditioned with the diagonal, without forming the matrix.
+ * - Edge springs: the exact Jacobian, except that the part across a compressed spring is
+ *   dropped (so that the matrix stays positive definite).
+ * - Tetra volume springs: -k dC dC^T (dropping the curvature of the volume), and while the
+ *   damping isn't clamped (see FV), -kDamp dC dC^T for the velocities.
+ * - Frozen vertices don't move (their rows and columns are filtered out of the solve).
+ */
+
+int Physics::CG_MAX_ITERATIONS = 200;
+double Physics::CG_TOLERANCE = 1e-6;
+
+const double SOME_LARGE_NUMBER = 1e10; // used for stability checking
+
+namespace
+{
+	struct EdgeJacobian
+	{
+		unsigned int a, b;
+		Vector3d u; // unit vector from a to b
+		double k; // stiffness along u (the force on b is -k(length - rest)u)
+		double across; // the stiffness across u relative to k
+	};
+
+	// each tetra adds w dC dC^T to the matrix, and -k dC dC^T to df/dx
+	struct TetraJacobian
+	{
+		unsigned int v[4];
+		Vector3d dC[4];
+		double w;
+		double k;
+	};
+
+	// the linear system, on the slots of a MeshArrays
+	struct ImplicitSystem
+	{
+		std::vector<EdgeJacobian> edges;
+		std::vector<TetraJacobian> tetras;
+		std::vector<double> mass; // m*DENSITY, 0 for the slots that don't take part
+		double h;
+
+		// y = (-df/dx) d, the stiffness alone
+		void stiffness(const std::vector<Vector3d>& d, std::vector<Vector3d>& y) const
+		{
+			std::fill(y.begin(),y.end(),Vector3d::ZERO);
+			BOOST_FOREACH(const EdgeJacobian& e, edges)
+			{
+				Vector3d dd = d[e.b] - d[e.a];
+				double along = dot(e.u,dd);
+				Vector3d f = e.k*(along*e.u + e.across*(dd - along*e.u));
+				y[e.b] += f;
+				y[e.a] -= f;
+			}
+			BOOST_FOREACH(const TetraJacobian& t, tetras)
+			{
+				double s = dot(t.dC[0],d[t.v[0]]) + dot(t.dC[1],d[t.v[1]]) + dot(t.dC[2],d[t.v[2]]) + dot(t.dC[3],d[t.v[3]]);
+				for(int j=0;j<4;j++)
+					y[t.v[j]] += (t.k*s)*t.dC[j];
+			}
+		}
+
+		// y = A d, where A = M - h df/dv - h^2 df/dx
+		void multiply(const std::vector<Vector3d>& d, std::vector<Vector3d>& y) const
+		{
+			const double h2 = h*h;
+			for(unsigned int i=0;i<d.size();i++)
+				y[i] = mass[i]*d[i];
+			BOOST_FOREACH(const EdgeJacobian& e, edges)
+			{
+				Vector3d dd = d[e.b] - d[e.a];
+				double along = dot(e.u,dd);
+				Vector3d f = (h2*e.k)*(along*e.u + e.across*(dd - along*e.u));
+				y[e.b] += f;
+				y[e.a] -= f;
+			}
+			BOOST_FOREACH(const TetraJacobian& t, tetras)
+			{
+				double s = dot(t.dC[0],d[t.v[0]]) + dot(t.dC[1],d[t.v[1]]) + dot(t.dC[2],d[t.v[2]]) + dot(t.dC[3],d[t.v[3]]);
+				for(int j=0;j<4;j++)
+					y[t.v[j]] += (t.w*s)*t.dC[j];
+			}
+		}
+
+		// the diagonal of A
+		void diagonal(std::vector<Vector3d>& diag) const
+		{
+			const double h2 = h*h;
+			for(unsigned int i=0;i<diag.size();i++)
+				diag[i] = Vector3d(mass[i],mass[i],mass[i]);
+			BOOST_FOREACH(const EdgeJacobian& e, edges)
+			{
+				for(int c=0;c<3;c++)
+				{
+					double uc = e.u[c]*e.u[c];
+					double dc = h2*e.k*(uc + e.across*(1 - uc));
+					diag[e.a][c] += dc;
+					diag[e.b][c] += dc;
+				}
+			}
+			BOOST_FOREACH(const TetraJacobian& t, tetras)
+				for(int j=0;j<4;j++)
+					for(int c=0;c<3;c++)
+						diag[t.v[j]][c] += t.w*t.dC[j][c]*t.dC[j][c];
+		}
+
+		// zero the slots that don't take part
+		void filter(std::vector<Vector3d>& d) const
+		{
+			for(unsigned int i=0;i<d.size();i++)
+				if (mass[i]==0) d[i] = Vector3d::ZERO;
+		}
+	};
+
+	double inner(const std::vector<Vector3d>& a, const std::vector<Vector3d>& b)
+	{
+		double s = 0;
+		for(unsigned int i=0;i<a.size();i++)
+			s += dot(a[i],b[i]);
+		return s;
+	}
+}
+
+bool Physics::takeImplicitStep(Mesh* m, double h, bool check, bool dirty)
+{
+	if (sLastStepSize < 0)
+		sLastStepSize = h;
+
+	// (gathered again, as collision response may have moved the vertices since the forces were computed)
+	MeshArrays& arrays = m->arrays();
+	arrays.gather();
+
+	const unsigned int n = arrays.vertices.size();
+	const double lastStepSize = sLastStepSize, density = DENSITY, viscosity = VISCOSITY, damp = kDamp;
+
+	ImplicitSystem sys;
+	sys.h = h;
+	sys.mass.resize(n);
+
+	// the velocities, as takeVerletStep() sees them
+	std::vector<Vector3d> v0(n,Vector3d::ZERO);
+	for(unsigned int i=0;i<n;i++)
+	{
+		Vertex* v = arrays.vertices[i];
+		if (v==NULL or arrays.frozen[i])
+			continue;
+		sys.mass[i] = arrays.m[i]*density;
+		v0[i] = (v->mX - v->mOldX)/lastStepSize;
+	}
+
+	// the Jacobians of the edges and tetras
+	sys.edges.reserve(arrays.edges.size());
+	BOOST_FOREACH(const MeshArrays::EdgeTuple& et, arrays.edges)
+	{
+		Edge* e = et.e;
+		const Vector3d diff = arrays.x[et.v[1]] - arrays.x[et.v[0]];
+		const double length = diff.length(), r = e->rest();
+		if (not (length > 0)) continue;
+
+		EdgeJacobian ej;
+		ej.a = et.v[0];
+		ej.b = et.v[1];
+		ej.u = diff/length;
+		// (as FD)
+		ej.k = e->springCoefficient()*(arrays.m[ej.a] + arrays.m[ej.b])/r;
+		ej.across = std::max(0.,1 - r/length);
+		sys.edges.push_back(ej);
+	}
+
+	sys.tetras.reserve(arrays.tetras.size());
+	BOOST_FOREACH(const MeshArrays::TetraTuple& tt, arrays.tetras)
+	{
+		Tetra* t = tt.t;
+		const Vector3d &a = arrays.x[tt.v[0]], &b = arrays.x[tt.v[1]], &c = arrays.x[tt.v[2]], &d = arrays.x[tt.v[3]];
+		const double rest = t->rest(), k = t->springCoefficient();
+
+		TetraJacobian tj;
+		for(int j=0;j<4;j++)
+			tj.v[j] = tt.v[j];
+		tj.dC[1] = cross(c-a,d-a)/(6*rest);
+		tj.dC[2] = cross(d-a,b-a)/(6*rest);
+		tj.dC[3] = cross(b-a,c-a)/(6*rest);
+		tj.dC[0] = -(tj.dC[1] + tj.dC[2] + tj.dC[3]);
+		tj.k = k;
+
+		// the damping only depends on the velocities while it isn't clamped
+		const double vol = (1./6)*dot(b-a,cross(c-a,d-a));
+		const double negKC = -k*(vol - rest)/rest;
+		double damping = 0;
+		for(int j=0;j<4;j++)
+			damping -= damp*dot(tj.dC[j],v0[tt.v[j]]);
+		const double c_v = (std::abs(damping) <= std::abs(negKC)) ? damp : 0;
+		tj.w = h*c_v + h*h*k;
+		sys.tetras.push_back(tj);
+	}
+
+	// b = h (f0 + h df/dx v0)
+	std::vector<Vector3d> rhs(n), kv(n);
+	sys.stiffness(v0,kv);
+	for(unsigned int i=0;i<n;i++)
+		rhs[i] = h*(arrays.f[i] - h*kv[i]);
+	sys.filter(rhs);
+
+	// solve A dv = b
+	std::vector<Vector3d> dv(n,Vector3d::ZERO), res(rhs), z(n), p(n), q(n), diag(n);
+	sys.diagonal(diag);
+	for(unsigned int i=0;i<n;i++)
+		for(int c=0;c<3;c++)
+			diag[i][c] = (diag[i][c] > 0) ? 1/diag[i][c] : 0;
+
+	const double bb = inner(rhs,rhs);
+	for(unsigned int i=0;i<n;i++)
+		z[i] = Vector3d(diag[i].x()*res[i].x(),diag[i].y()*res[i].y(),diag[i].z()*res[i].z());
+	p = z;
+	double rz = inner(res,z);
+	int iterations = 0;
+	while (iterations < CG_MAX_ITERATIONS and inner(res,res) > CG_TOLERANCE*CG_TOLERANCE*bb)
+	{
+		sys.multiply(p,q);
+		sys.filter(q);
+		const double pq = inner(p,q);
+		if (not (pq > 0)) break;
+
+		const double alpha = rz/pq;
+		for(unsigned int i=0;i<n;i++)
+		{
+			dv[i] += alpha*p[i];
+			res[i] -= alpha*q[i];
+		}
+		for(unsigned int i=0;i<n;i++)
+			z[i] = Vector3d(diag[i].x()*res[i].x(),diag[i].y()*res[i].y(),diag[i].z()*res[i].z());
+		const double rzNew = inner(res,z);
+		const double beta = rzNew/rz;
+		rz = rzNew;
+		for(unsigned int i=0;i<n;i++)
+			p[i] = z[i] + beta*p[i];
+		iterations++;
+	}
+	PROFILE_COUNT(CG_ITERATIONS,iterations);
+	LOG("Physics::takeImplicitStep " << iterations << " iterations, residual " << std::sqrt(inner(res,res)/bb) << "\n");
+
+	// move along a straight line from mX, as takeVerletStep() does (see SDSSimulation::detectFirstInversion)
+	double min[3] = {DBL_MAX,DBL_MAX,DBL_MAX}, max[3] = {-DBL_MAX,-DBL_MAX,-DBL_MAX};
+	for(unsigned int i=0;i<n;i++)
+	{
+		Vertex* v = arrays.vertices[i];
+		if (v==NULL or v->isFrozen())
+			continue;
+
+		const Vector3d oldx = v->mX;
+		const Vector3d dx = (v0[i] + dv[i])*h;
+		v->mX = v->mX + (1-viscosity)*dx;
+		v->mV = (v->mX - oldx)/h;
+		v->mOldX = oldx;
+
+		// STABILITY CHECK
+		if (check)
+		{
+			if (
+					(std::isnan(v->x().x()) or std::isnan(v->x().y()) or std::isnan(v->x().z()))
+					or
+					(v->x().mlength() > SOME_LARGE_NUMBER)
+					or
+					(v->v().mlength() > SOME_LARGE_NUMBER)
+				)
+			{
+				LOG("Physics::takeImplicitStep instability detected"<< "\n");
+				LOG("old x = " << oldx << ", dv = " << dv[i] << ", mass = " << v->m()<< "\n");
+
+				if (dirty)
+				{
+					v->setFrozen(true);
+					continue;
+				}
+				else return false;
+			}
+		}
+
+		for(int c=0;c<3;c++)
+		{
+			if (v->mX[c] < min[c]) min[c] = v->mX[c];
+			if (v->mX[c] > max[c]) max[c] = v->mX[c];
+		}
+	}
+
+	AABB& mAABB = m->mAABB;
+	mAABB[0] = min[0];
+	mAABB[1] = min[1];
+	mAABB[2] = min[2];
+	mAABB[3] = max[0];
+	mAABB[4] = max[1];
+	mAABB[5] = max[2];
+	mAABB.valid(true);
+
+	sLastStepSize = h;
+	return true;
+}
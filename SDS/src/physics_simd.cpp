@@ -0,0 +1,258 @@
+#include "physics.h"
+
+/*
+ * Physics::FVBatch, the volume spring forces of several tetras at once.
+ *
+ * Each lane of a Pack holds one tetra, and the arithmetic is the same as in FV, operation
+ * for operation, so the forces are exactly those of FV (as long as the compiler doesn't
+ * fuse multiplies and adds, which it only does when told to with -mfma or -march).
+ *
+ * Compile with -mavx512f (scons simd=avx512) to use 512 bit registers, which makes
+ * FV_BATCH 8, or with -mavx2 (scons simd=avx2) to use 256 bit registers and gathers.
+ * SSE2 (which every x86-64 has) is used otherwise, and plain doubles elsewhere.
+ * (AVX-512 has fused multiply-adds of its own, so simd=avx512 also turns off -ffp-contract.)
+ */
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+// FV_BATCH doubles
+class Pack
+{
+	public:
+
+#if defined(__AVX512F__)
+
+	Pack(){}
+	explicit Pack(double d):r(_mm512_set1_pd(d)){}
+	Pack(__m512d r_):r(r_){}
+
+	/// base[idx[i]] in lane i
+	static Pack gather(const double* base, const int idx[Physics::FV_BATCH])
+	{
+		return _mm512_i32gather_pd(_mm256_loadu_si256((const __m256i*)idx),base,8);
+	}
+	static Pack load(const double* d){return _mm512_loadu_pd(d);}
+	void store(double* d) const {_mm512_storeu_pd(d,r);}
+
+	friend Pack operator+(const Pack& a, const Pack& b){return _mm512_add_pd(a.r,b.r);}
+	friend Pack operator-(const Pack& a, const Pack& b){return _mm512_sub_pd(a.r,b.r);}
+	friend Pack operator*(const Pack& a, const Pack& b){return _mm512_mul_pd(a.r,b.r);}
+	friend Pack operator/(const Pack& a, const Pack& b){return _mm512_div_pd(a.r,b.r);}
+	// (flips the sign bit, as the unary minus of a double does, the xor of doubles needs AVX-512DQ)
+	Pack operator-() const {return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(r),_mm512_set1_epi64(0x8000000000000000ULL)));}
+
+	// masks, all bits of a lane set where true (the compares give a bit per lane, see fromBits())
+	friend Pack operator>(const Pack& a, const Pack& b){return fromBits(_mm512_cmp_pd_mask(a.r,b.r,_CMP_GT_OQ));}
+	friend Pack operator<(const Pack& a, const Pack& b){return fromBits(_mm512_cmp_pd_mask(a.r,b.r,_CMP_LT_OQ));}
+	friend Pack operator|(const Pack& a, const Pack& b){return _mm512_castsi512_pd(_mm512_or_si512(_mm512_castpd_si512(a.r),_mm512_castpd_si512(b.r)));}
+	Pack isnan() const {return fromBits(_mm512_cmp_pd_mask(r,r,_CMP_UNORD_Q));}
+	/// where mask then a else b
+	static Pack select(const Pack& mask, const Pack& a, const Pack& b){return _mm512_mask_blend_pd(mask.toBits(),b.r,a.r);}
+	/// bit i set if lane i of the mask is
+	int bits() const {return toBits();}
+
+	private:
+	static Pack fromBits(__mmask8 m){return _mm512_castsi512_pd(_mm512_maskz_set1_epi64(m,-1));}
+	__mmask8 toBits() const {return _mm512_test_epi64_mask(_mm512_castpd_si512(r),_mm512_castpd_si512(r));}
+
+	__m512d r;
+
+#elif defined(__AVX2__)
+
+	Pack(){}
+	explicit Pack(double d):r(_mm256_set1_pd(d)){}
+	Pack(__m256d r_):r(r_){}
+
+	/// base[idx[i]] in lane i
+	static Pack gather(const double* base, const int idx[Physics::FV_BATCH])
+	{
+		return _mm256_i32gather_pd(base,_mm_loadu_si128((const __m128i*)idx),8);
+	}
+	static Pack load(const double* d){return _mm256_loadu_pd(d);}
+	void store(double* d) const {_mm256_storeu_pd(d,r);}
+
+	friend Pack operator+(const Pack& a, const Pack& b){return _mm256_add_pd(a.r,b.r);}
+	friend Pack operator-(const Pack& a, const Pack& b){return _mm256_sub_pd(a.r,b.r);}
+	friend Pack operator*(const Pack& a, const Pack& b){return _mm256_mul_pd(a.r,b.r);}
+	friend Pack operator/(const Pack& a, const Pack& b){return _mm256_div_pd(a.r,b.r);}
+	// (flips the sign bit, as the unary minus of a double does)
+	Pack operator-() const {return _mm256_xor_pd(r,_mm256_set1_pd(-0.0));}
+
+	// masks, all bits of a lane set where true
+	friend Pack operator>(const Pack& a, const Pack& b){return _mm256_cmp_pd(a.r,b.r,_CMP_GT_OQ);}
+	friend Pack operator<(const Pack& a, const Pack& b){return _mm256_cmp_pd(a.r,b.r,_CMP_LT_OQ);}
+	friend Pack operator|(const Pack& a, const Pack& b){return _mm256_or_pd(a.r,b.r);}
+	Pack isnan() const {return _mm256_cmp_pd(r,r,_CMP_UNORD_Q);}
+	/// where mask then a else b
+	static Pack select(const Pack& mask, const Pack& a, const Pack& b){return _mm256_blendv_pd(b.r,a.r,mask.r);}
+	/// bit i set if lane i of the mask is
+	int bits() const {return _mm256_movemask_pd(r);}
+
+	private:
+	__m256d r;
+
+#elif defined(__SSE2__)
+
+	Pack(){}
+	explicit Pack(double d):lo(_mm_set1_pd(d)),hi(lo){}
+	Pack(__m128d lo_, __m128d hi_):lo(lo_),hi(hi_){}
+
+	static Pack gather(const double* base, const int idx[Physics::FV_BATCH])
+	{
+		return Pack(_mm_set_pd(base[idx[1]],base[idx[0]]),_mm_set_pd(base[idx[3]],base[idx[2]]));
+	}
+	static Pack load(const double* d){return Pack(_mm_loadu_pd(d),_mm_loadu_pd(d+2));}
+	void store(double* d) const {_mm_storeu_pd(d,lo); _mm_storeu_pd(d+2,hi);}
+
+	friend Pack operator+(const Pack& a, const Pack& b){return Pack(_mm_add_pd(a.lo,b.lo),_mm_add_pd(a.hi,b.hi));}
+	friend Pack operator-(const Pack& a, const Pack& b){return Pack(_mm_sub_pd(a.lo,b.lo),_mm_sub_pd(a.hi,b.hi));}
+	friend Pack operator*(const Pack& a, const Pack& b){return Pack(_mm_mul_pd(a.lo,b.lo),_mm_mul_pd(a.hi,b.hi));}
+	friend Pack operator/(const Pack& a, const Pack& b){return Pack(_mm_div_pd(a.lo,b.lo),_mm_div_pd(a.hi,b.hi));}
+	Pack operator-() const
+	{
+		const __m128d sign = _mm_set1_pd(-0.0);
+		return Pack(_mm_xor_pd(lo,sign),_mm_xor_pd(hi,sign));
+	}
+
+	friend Pack operator>(const Pack& a, const Pack& b){return Pack(_mm_cmpgt_pd(a.lo,b.lo),_mm_cmpgt_pd(a.hi,b.hi));}
+	friend Pack operator<(const Pack& a, const Pack& b){return Pack(_mm_cmplt_pd(a.lo,b.lo),_mm_cmplt_pd(a.hi,b.hi));}
+	friend Pack operator|(const Pack& a, const Pack& b){return Pack(_mm_or_pd(a.lo,b.lo),_mm_or_pd(a.hi,b.hi));}
+	Pack isnan() const {return Pack(_mm_cmpunord_pd(lo,lo),_mm_cmpunord_pd(hi,hi));}
+	static Pack select(const Pack& mask, const Pack& a, const Pack& b)
+	{
+		return Pack(_mm_or_pd(_mm_and_pd(mask.lo,a.lo),_mm_andnot_pd(mask.lo,b.lo)),
+				_mm_or_pd(_mm_and_pd(mask.hi,a.hi),_mm_andnot_pd(mask.hi,b.hi)));
+	}
+	int bits() const {return _mm_movemask_pd(lo) | (_mm_movemask_pd(hi) << 2);}
+
+	private:
+	__m128d lo, hi;
+
+#else
+
+	Pack(){}
+	explicit Pack(double d){for(int i=0;i<N;i++) r[i] = d;}
+
+	static Pack gather(const double* base, const int idx[Physics::FV_BATCH])
+	{
+		Pack p;
+		for(int i=0;i<N;i++) p.r[i] = base[idx[i]];
+		return p;
+	}
+	static Pack load(const double* d){Pack p; for(int i=0;i<N;i++) p.r[i] = d[i]; return p;}
+	void store(double* d) const {for(int i=0;i<N;i++) d[i] = r[i];}
+
+	#define PACK_OP(op,expr) friend Pack operator op(const Pack& a, const Pack& b){Pack p; for(int i=0;i<N;i++) p.r[i] = (expr); return p;}
+	PACK_OP(+,a.r[i] + b.r[i])
+	PACK_OP(-,a.r[i] - b.r[i])
+	PACK_OP(*,a.r[i] * b.r[i])
+	PACK_OP(/,a.r[i] / b.r[i])
+	PACK_OP(>,(a.r[i] > b.r[i]) ? 1. : 0.)
+	PACK_OP(<,(a.r[i] < b.r[i]) ? 1. : 0.)
+	PACK_OP(|,(a.r[i]!=0 or b.r[i]!=0) ? 1. : 0.)
+	#undef PACK_OP
+	Pack operator-() const {Pack p; for(int i=0;i<N;i++) p.r[i] = -r[i]; return p;}
+
+	Pack isnan() const {Pack p; for(int i=0;i<N;i++) p.r[i] = (r[i]!=r[i]) ? 1. : 0.; return p;}
+	static Pack select(const Pack& mask, const Pack& a, const Pack& b)
+	{
+		Pack p;
+		for(int i=0;i<N;i++) p.r[i] = (mask.r[i]!=0) ? a.r[i] : b.r[i];
+		return p;
+	}
+	int bits() const {int b = 0; for(int i=0;i<N;i++) if (r[i]!=0) b |= 1<<i; return b;}
+
+	private:
+	enum {N = Physics::FV_BATCH};
+	double r[N];
+
+#endif
+};
+
+}
+
+void Physics::FVBatch(const Vector3d* x, const Vector3d* v, const unsigned int* const s[], const double rest[], const double k[], int n, double damp, FVBatchInfo& info)
+{
+	// the offsets of the vertices of each tetra, in doubles (unused lanes repeat the first tetra)
+	int idx[4][FV_BATCH];
+	double restLanes[FV_BATCH], kLanes[FV_BATCH];
+	for(int i=0;i<FV_BATCH;i++)
+	{
+		const int t = (i<n) ? i : 0;
+		for(int j=0;j<4;j++)
+			idx[j][i] = 3*s[t][j];
+		restLanes[i] = rest[t];
+		kLanes[i] = k[t];
+	}
+
+	// (a Vector3d is three doubles)
+	const double* xd = reinterpret_cast<const double*>(x);
+	const double* vd = reinterpret_cast<const double*>(v);
+
+	const Pack a1 = Pack::gather(xd,idx[0]), a2 = Pack::gather(xd+1,idx[0]), a3 = Pack::gather(xd+2,idx[0]),
+				b1 = Pack::gather(xd,idx[1]), b2 = Pack::gather(xd+1,idx[1]), b3 = Pack::gather(xd+2,idx[1]),
+				c1 = Pack::gather(xd,idx[2]), c2 = Pack::gather(xd+1,idx[2]), c3 = Pack::gather(xd+2,idx[2]),
+				d1 = Pack::gather(xd,idx[3]), d2 = Pack::gather(xd+1,idx[3]), d3 = Pack::gather(xd+2,idx[3]);
+
+	const Pack R = Pack::load(restLanes), K = Pack::load(kLanes);
+
+	const Pack factor = Pack(1)/(Pack(6)*R);
+
+	// (as in FV)
+	const Pack dCdVParts[] =
+	{(b3*(c2 - d2) + c3*d2 - c2*d3 + b2*(-c3 + d3)),
+	 (-c3*d1 + b3*(-c1 + d1) + b1*(c3 - d3) + c1*d3),
+	 (b2*(c1 - d1) + c2*d1 - c1*d2 + b1*(-c2 + d2)),
+	 (-c3*d2 + a3*(-c2 + d2) + a2*(c3 - d3) + c2*d3),
+	 (a3*(c1 - d1) + c3*d1 - c1*d3 + a1*(-c3 + d3)),
+	 (-c2*d1 + a2*(-c1 + d1) + a1*(c2 - d2) + c1*d2),
+	 (a3*(b2 - d2) + b3*d2 - b2*d3 + a2*(-b3 + d3)),
+	 (-b3*d1 + a3*(-b1 + d1) + a1*(b3 - d3) + b1*d3),
+	 (a2*(b1 - d1) + b2*d1 - b1*d2 + a1*(-b2 + d2)),
+	 (-b3*c2 + a3*(-b2 + c2) + a2*(b3 - c3) + b2*c3),
+	 (a3*(b1 - c1) + b3*c1 - b1*c3 + a1*(-b3 + c3)),
+	 (-b2*c1 + a2*(-b1 + c1) + a1*(b2 - c2) + b1*c2)};
+
+	Pack dC[12];
+	for(int p=0;p<12;p++)
+		dC[p] = dCdVParts[p]*factor;
+
+	// vol = (1./6)*dot(b-a,cross(c-a,d-a))
+	const Pack ba1 = b1 - a1, ba2 = b2 - a2, ba3 = b3 - a3;
+	const Pack ca1 = c1 - a1, ca2 = c2 - a2, ca3 = c3 - a3;
+	const Pack da1 = d1 - a1, da2 = d2 - a2, da3 = d3 - a3;
+	const Pack vol = Pack(1./6)*(ba1*(ca2*da3 - ca3*da2) + ba2*(ca3*da1 - ca1*da3) + ba3*(ca1*da2 - ca2*da1));
+	const Pack C = (vol - R)/R;
+	const Pack negKC = -K*C;
+
+	// damping = -damp * (dot(dCda,av) + dot(dCdb,bv) + dot(dCdc,cv) + dot(dCdd,dv))
+	Pack dots[4];
+	for(int j=0;j<4;j++)
+		dots[j] = dC[3*j]*Pack::gather(vd,idx[j]) + dC[3*j+1]*Pack::gather(vd+1,idx[j]) + dC[3*j+2]*Pack::gather(vd+2,idx[j]);
+	Pack damping = Pack(-damp)*(dots[0] + dots[1] + dots[2] + dots[3]);
+
+	// damping cannot be more than negKC (the branches of FV, lane by lane)
+	const Pack zero(0.);
+	const Pack ifPositive = Pack::select(damping > negKC, negKC, Pack::select(-damping > negKC, -negKC, damping));
+	const Pack ifNegative = Pack::select(damping < negKC, negKC, Pack::select(-damping < negKC, -negKC, damping));
+	damping = Pack::select(negKC > zero, ifPositive, ifNegative);
+
+	const Pack finalmult = damping + negKC;
+
+	for(int j=0;j<4;j++)
+		for(int c=0;c<3;c++)
+			(dC[3*j+c]*finalmult).store(info.f[j][c]);
+	(Pack(.5)*K*C*C).store(info.energy);
+
+	Pack nan = finalmult.isnan();
+	for(int p=0;p<12;p++)
+		nan = nan | dC[p].isnan();
+	info.nan = nan.bits() & ((1<<n) - 1);
+}
@@ -18,6 +18,7 @@
 #include "cell.h"
 #include "random.h"
 #include "bstreamable.h"
+#include "simulationcontext.h"
 
 #include <cfloat>
 #include <iostream>
@@ -183,111 +184,29 @@ void ProcessModel::setNumberOfMorphogens(int nm)
 	}
 }
 
-void ProcessModel::simulateMorphogenDiffusion(Organism* o, double dt, std::set<Cell*> skip)
+void ProcessModel::simulateMorphogenDiffusion(Organism* o, double dt, const CellMask& skip)
 {
-	// foreach morphogen:
-	//   simulate diffusion-decay
-	//   flag all conditions satisfied
-	for(int i=0;i<mNumMorphogens;i++)
-	{
-		double D = mDiffusion[i];
-		double C = mDecay[i];
-
-		// copy newvalue to old value
-		BOOST_FOREACH(Cell* c, o->cells())
-		{
-			CellContents* cc = c->getCellContents();
-			Morphogen* m = cc->mMorphogens;
-			m[i].oldvalue = m[i].value;
-		}
-
-		// XXX: Can speed this up by calculating each laplacian term per edge
-		// we are actually doing DOUBLE the work here... at the expense of readibility
+	PROFILE_PHASE(DIFFUSION);
+	mMorphogenDiffusion.step(o, dt, mNumMorphogens, mDiffusion, mDecay, skip);
+}
 
-		// for each cell, calculate the discrete laplacian
-		BOOST_FOREACH(Cell* c, o->cells())
-		{
-			if (skip.count(c)>0) continue;
-
-			CellContents* cc = c->getCellContents();
-			Morphogen* m = cc->mMorphogens;
-			double cm = m[i];
-			double cvol = c->vol();
-
-			// discrete laplacian is the weighted sum
-			// of the difference between morphogen levels of neighbours
-			// see e.g., http://en.wikipedia.org/wiki/Laplace_operator
-			double laplacian = 0;
-			BOOST_FOREACH(Cell* cn, o->getNeighbours(c))
-			{
-				double cnm = cn->getCellContents()->getMorphogen(i);
-				double distance = dist(c->v()->x(),cn->v()->x());
-				laplacian += (1/distance)*(std::min(cnm,cvol) - std::min(cm,cn->vol()));
-			}
-
-			// calculate new morphogen amount for this cell, and assert that it is valid
-			// TEMPORARY FIX!!
-			// double dcmdt = D*laplacian - C*cm;
-			double dcmdt = D*laplacian - C;
-
-			double newval = std::max(0., std::min(cm + dcmdt * dt, cvol));
-			c->getCellContents()->setMorphogen(i,newval);
-		}
-	}
+void ProcessModel::simulateMorphogenDiffusion(Organism* o, double dt, const CellMask& skip, int morph)
+{
+	PROFILE_PHASE(DIFFUSION);
+	mMorphogenDiffusion.step(o, dt, mNumMorphogens, mDiffusion, mDecay, skip, morph);
 }
 
-void ProcessModel::simulateMorphogenDiffusion(Organism* o, double dt, std::set<Cell*> skip, int morph)
+ProcessModel::CellMask ProcessModel::cellsOfType(Organism* o, int type)
 {
-	// foreach morphogen:
-	//   simulate diffusion-decay
-	//   flag all conditions satisfied
-	for(int i=0;i<mNumMorphogens;i++)
+	CellMask cells(o->cells().size());
+	unsigned int i = 0;
+	BOOST_FOREACH(Cell* c, o->cells())
 	{
-		double D = mDiffusion[i];
-		double C = mDecay[i];
-
-		// copy newvalue to old value
-		BOOST_FOREACH(Cell* c, o->cells())
-		{
-			CellContents* cc = c->getCellContents();
-			Morphogen* m = cc->mMorphogens;
-			m[i].oldvalue = m[i].value;
-		}
-
-		// XXX: Can speed this up by calculating each laplacian term per edge
-		// we are actually doing DOUBLE the work here... at the expense of readibility
-
-		// for each cell, calculate the discrete laplacian
-		BOOST_FOREACH(Cell* c, o->cells())
-		{
-			if (i==morph and skip.count(c)>0) continue;
-
-			CellContents* cc = c->getCellContents();
-			Morphogen* m = cc->mMorphogens;
-			double cm = m[i];
-			double cvol = c->vol();
-
-			// discrete laplacian is the weighted sum
-			// of the difference between morphogen levels of neighbours
-			// see e.g., http://en.wikipedia.org/wiki/Laplace_operator
-			double laplacian = 0;
-			BOOST_FOREACH(Cell* cn, o->getNeighbours(c))
-			{
-				double cnm = cn->getCellContents()->getMorphogen(i);
-				double distance = dist(c->v()->x(),cn->v()->x());
-				laplacian += (1/distance)*(std::min(cnm,cvol) - std::min(cm,cn->vol()));
-			}
-
-			// calculate new morphogen amount for this cell, and assert that it is valid
-			// TEMPORARY FIX!!
-			// double dcmdt = D*laplacian - C*cm;
-			double dcmdt = D*laplacian - C;
-
-			double newval = std::max(0., std::min(cm + dcmdt * dt, cvol));
-			c->getCellContents()->setMorphogen(i,newval);
-		}
+		if (c->getCellContents()->getType() == type)
+			cells[i] = 1;
+		i++;
 	}
-
+	return cells;
 }
 
 ProcessModel* ProcessModel::readStatic(std::istream& is)
@@ -387,6 +306,14 @@ void ProcessModel::saveToSetting(libconfig::Setting& setting)
 	}
 }
 
+ProcessModel* ProcessModel::copy()
+{
+	libconfig::Config config;
+	libconfig::Setting& setting = config.getRoot().add("processModel",libconfig::Setting::TypeGroup);
+	saveToSetting(setting);
+	return loadFromSetting(setting);
+}
+
 void ProcessModel::loadParamsFromSetting(libconfig::Setting& s)
 {
 	BOOST_FOREACH(std::string p, this->parameters())
@@ -83,12 +83,7 @@ void Curling::step(Organism* o, double dt)
 	static const int PZ_STIM = 2;
 	static const int GROWING_TIP = 3;
 
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == GROWING_TIP)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, GROWING_TIP);
 	simulateMorphogenDiffusion(o, dt, skip);
 
 	std::list<DivisionInfo> divisionsToBePerformed;
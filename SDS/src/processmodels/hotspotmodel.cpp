@@ -113,12 +113,7 @@ void HotSpotModel::step(Organism* o, double dt)
 	static const int SOURCE = 1;
 
 	// Distribute growth morphogen
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == SOURCE)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, SOURCE);
 	simulateMorphogenDiffusion(o, dt, skip);
 
 	// Stimulate growth
@@ -211,12 +211,7 @@ struct DivisionInfo
 void LimbBudModel::step(Organism* o, double dt) // simulate diffusion and activate rules
 {
 	// make sure the growing tip is replenished
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == 3)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, 3);
 
 	// simulate diffusion the new way
 	simulateMorphogenDiffusion(o, dt, skip);
@@ -383,12 +378,7 @@ void LimbBudModelWithGrowth::step(Organism* o, double dt)
 	// - grow slightly larger if you aren't involved in the limb growth
 
 	// make sure the growing tip is replenished
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == 3)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, 3);
 
 	// simulate diffusion the new way
 	simulateMorphogenDiffusion(o, dt, skip);
@@ -594,12 +584,7 @@ void TentacleWithAttractor::step(Organism* o, double dt)
 	// - grow slightly larger if you aren't involved in the limb growth
 
 	// make sure the growing tip is replenished
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == 3)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, 3);
 
 	// simulate diffusion the new way
 	simulateMorphogenDiffusion(o, dt, skip);
@@ -844,12 +829,7 @@ void LimbGrowth::step(Organism* o, double dt)
 	static const int PZ_STIM = 2;
 	static const int GROWING_TIP = 3;
 
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == GROWING_TIP)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, GROWING_TIP);
 	simulateMorphogenDiffusion(o, dt, skip);
 
 	std::list<DivisionInfo> divisionsToBePerformed;
@@ -1035,12 +1015,7 @@ void LimbGrowthWithFreeze::step(Organism* o, double dt)
 	static const int PZ_STIM = 2;
 	static const int GROWING_TIP = 3;
 
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == GROWING_TIP)
-			skip.insert(c);
-	}
+	CellMask skip = cellsOfType(o, GROWING_TIP);
 	simulateMorphogenDiffusion(o, dt, skip);
 
 	std::list<DivisionInfo> divisionsToBePerformed;
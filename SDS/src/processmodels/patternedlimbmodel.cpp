@@ -103,13 +103,7 @@ void StripedLimb::step(Organism* o, double dt)
 	static const int PZ_STIM = 2;
 	static const int GROWING_TIP = 3;
 
-	std::set<Cell*> skip;
-	BOOST_FOREACH(Cell* c, o->cells())
-	{
-		if (c->getCellContents()->getType() == GROWING_TIP)
-			skip.insert(c);
-		// c->getCellContents()->setMorphogen(0, c->vol());
-	}
+	CellMask skip = cellsOfType(o, GROWING_TIP);
 	simulateMorphogenDiffusion(o, dt, skip, 0);
 
 	std::list<DivisionInfo> divisionsToBePerformed;
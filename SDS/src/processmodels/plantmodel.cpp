@@ -237,7 +237,7 @@ void PlantModel::step(Organism* o, double dt)
 	static const int BUD_TIP = 5;
 
 
-	std::set<Cell*> skip;
+	CellMask skip;
 	BOOST_FOREACH(Cell* c, o->cells())
 	{
 		CellContents* cc = c->getCellContents();
@@ -265,10 +265,8 @@ void PlantModel::step(Organism* o, double dt)
 			else
 				cc->setMorphogen(3,c->vol());
 		}
-
-		//if (c->getCellContents()->getType() == GROWING_TIP)
-		//	skip.insert(c);
 	}
+	//skip = cellsOfType(o, GROWING_TIP);
 	simulateMorphogenDiffusion(o, dt, skip);
 
 	std::list<DivisionInfo> divisionsToBePerformed;
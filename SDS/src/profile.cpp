@@ -0,0 +1,160 @@
+#include "profile.h"
+
+#include <iostream>
+#include <cstring>
+#include <cassert>
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#include <boost/date_time/posix_time/posix_time.hpp>
+#endif
+
+static const char* sPhaseNames[Profile::NUM_PHASES] =
+{
+	"substep",
+	"sanity_check",
+	"spring_strengths",
+	"forces",
+	"before_physical_step",
+	"collision",
+	"integration",
+	"step_control",
+	"inversion_detection",
+	"move",
+	"process_model",
+	"diffusion",
+	"division"
+};
+
+static const char* sCounterNames[Profile::NUM_COUNTERS] =
+{
+	"vertices",
+	"tetras",
+	"sanity_check_elements",
+	"inversions",
+	"moves",
+	"divisions",
+	"collisions",
+	"cg_iterations",
+	"rejected_steps"
+};
+
+Profile::Profile(unsigned int capacity)
+:mEnabled(false)
+,mRecords(capacity)
+,mNext(0)
+,mSize(0)
+{
+	std::memset(&mCurrent,0,sizeof(Record));
+}
+
+void Profile::setEnabled(bool enabled)
+{
+	mEnabled = enabled;
+}
+
+void Profile::setCapacity(unsigned int n)
+{
+	mRecords.resize(n);
+	clear();
+}
+
+void Profile::clear()
+{
+	mNext = 0;
+	mSize = 0;
+}
+
+const Profile::Record& Profile::record(unsigned int i) const
+{
+	assert(i < mSize);
+	return mRecords[(mNext + mRecords.size() - mSize + i) % mRecords.size()];
+}
+
+const char* Profile::phaseName(Phase p)
+{
+	return sPhaseNames[p];
+}
+
+const char* Profile::counterName(Counter c)
+{
+	return sCounterNames[c];
+}
+
+void Profile::beginSubstep(int step, double t)
+{
+	std::memset(&mCurrent,0,sizeof(Record));
+	mCurrent.step = step;
+	mCurrent.t = t;
+}
+
+void Profile::endSubstep()
+{
+	if (mRecords.empty()) return;
+
+	mRecords[mNext] = mCurrent;
+	mNext = (mNext + 1) % mRecords.size();
+	if (mSize < mRecords.size()) mSize++;
+}
+
+void Profile::addLastTo(PropertyList& properties) const
+{
+	if (mSize==0) return;
+
+	const Record& r = record(mSize-1);
+	for(int p=0;p<NUM_PHASES;p++)
+		if (r.time[p] > 0)
+			properties.add(std::string("profile ") + sPhaseNames[p] + " (us)", r.time[p]*1e6);
+	for(int c=0;c<NUM_COUNTERS;c++)
+		if (r.count[c] > 0)
+			properties.add(std::string("profile ") + sCounterNames[c], r.count[c]);
+}
+
+void Profile::writeCSVHeader(std::ostream& os) const
+{
+	os << "step,t";
+	for(int p=0;p<NUM_PHASES;p++)
+		os << "," << sPhaseNames[p] << "_us";
+	for(int c=0;c<NUM_COUNTERS;c++)
+		os << "," << sCounterNames[c];
+	os << "\n";
+}
+
+void Profile::writeCSV(std::ostream& os) const
+{
+	for(unsigned int i=0;i<mSize;i++)
+	{
+		const Record& r = record(i);
+		os << r.step << "," << r.t;
+		for(int p=0;p<NUM_PHASES;p++)
+			os << "," << r.time[p]*1e6;
+		for(int c=0;c<NUM_COUNTERS;c++)
+			os << "," << r.count[c];
+		os << "\n";
+	}
+}
+
+void Profile::writeJSON(std::ostream& os) const
+{
+	for(unsigned int i=0;i<mSize;i++)
+	{
+		const Record& r = record(i);
+		os << "{\"step\": " << r.step << ", \"t\": " << r.t;
+		for(int p=0;p<NUM_PHASES;p++)
+			os << ", \"" << sPhaseNames[p] << "_us\": " << r.time[p]*1e6;
+		for(int c=0;c<NUM_COUNTERS;c++)
+			os << ", \"" << sCounterNames[c] << "\": " << r.count[c];
+		os << "}\n";
+	}
+}
+
+double Profile::now()
+{
+	#ifdef _OPENMP
+	return omp_get_wtime();
+	#else
+	static const boost::posix_time::ptime epoch = boost::posix_time::microsec_clock::universal_time();
+	return (boost::posix_time::microsec_clock::universal_time() - epoch).total_microseconds()*1e-6;
+	#endif
+}
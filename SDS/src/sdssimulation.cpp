@@ -20,6 +20,8 @@
 #include "meshtools.h"
 
 #include "physics.h"
+#include "mesh.h"
+#include "mesharrays.h"
 #include "vertex.h"
 #include "edge.h"
 #include "tetra.h"
@@ -37,6 +39,7 @@
 #include <boost/foreach.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <boost/tuple/tuple_io.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #ifdef DEBUG_MEMORY
 	#define DUMPM(what) {std::cout << what << std::endl; }
@@ -45,9 +48,19 @@
 #endif
 
 const double SMALLEST_CELL_RADIUS = 0.000001; // 0.001
+// the default bounds of adaptive stepping, relative to the suggested step size
+const double ADAPTIVE_MIN_STEP = 1.0/1024;
+const double ADAPTIVE_MAX_STEP = 64;
+
+// why the simulation is unstable, after a transformation failed
+static std::string transformErrorMessage()
+{
+	std::string msg = Transform::getErrorMessage();
+	return msg.empty() ? "Transform error." : "Transform error: " + msg;
+}
 
 // simulation state
-SDSSimulation::SDSSimulation()
+SDSSimulation::SDSSimulation(SimulationContext* c)
 :mOWorld(NULL),
  mOrganism(NULL),
  mTime(0),
@@ -55,7 +68,16 @@ SDSSimulation::SDSSimulation()
  mState(NOT_STARTED),
  mCurrentStep(START),
  mCollisionInterval(0),
- mContinueOnError(false)
+ mContinueOnError(false),
+#ifdef DEBUG
+ mSanityCheckMode(SANITY_CHECK_FULL),
+#else
+ mSanityCheckMode(SANITY_CHECK_INCREMENTAL),
+#endif
+ mAdaptiveStepping(false),
+ mMinStepSize(0),
+ mMaxStepSize(0),
+ mContext(c ? c : &SimulationContext::global())
 {
 	DUMPM("SDSSimulation::SDSSimulation() for " << this);
 }
@@ -69,6 +91,8 @@ SDSSimulation::~SDSSimulation()
 
 void SDSSimulation::initialiseFromHeader(SimulationIO_Base::SimulationHeader& hdr)
 {
+	SimulationContext::Scope scope(*mContext);
+
 	//globals
 	Physics::kD = hdr.kD;
 	Physics::kSM = hdr.kSM;
@@ -77,6 +101,11 @@ void SDSSimulation::initialiseFromHeader(SimulationIO_Base::SimulationHeader& hd
 	Physics::GRAVITY = hdr.gravity;
 	Physics::DENSITY = hdr.density;
 	Physics::VISCOSITY = hdr.viscosity;
+	if (not Physics::setIntegrator(hdr.integrator))
+	{
+		std::cerr << "Unknown integrator \"" << hdr.integrator << "\" in the simulation header, using verlet.\n";
+		Physics::INTEGRATOR = Physics::VERLET;
+	}
 
 	//locals
 	setStepSize(hdr.dt);
@@ -84,6 +113,13 @@ void SDSSimulation::initialiseFromHeader(SimulationIO_Base::SimulationHeader& hd
 	setCollisionInterval(hdr.collisionInterval);
 
 	// load static meshes
+	std::list<Mesh*> staticMeshes = loadStaticMeshes(hdr);
+	mStaticMeshes.insert(mStaticMeshes.end(),staticMeshes.begin(),staticMeshes.end());
+}
+
+std::list<Mesh*> SDSSimulation::loadStaticMeshes(SimulationIO_Base::SimulationHeader& hdr)
+{
+	std::list<Mesh*> staticMeshes;
 	BOOST_FOREACH(SimulationIO_Base::StaticMesh sm, hdr.staticMeshes)
 	{
 		std::cout << "filepath: " << hdr.mFilePath << std::endl;
@@ -97,14 +133,16 @@ void SDSSimulation::initialiseFromHeader(SimulationIO_Base::SimulationHeader& hd
 		{
 			m->move(sm.pos);
 			m->scale(sm.sx,sm.sy,sm.sz);
-			mStaticMeshes.push_back(m);
+			staticMeshes.push_back(m);
 		}
 	}
-
+	return staticMeshes;
 }
 
 void SDSSimulation::writeHeader(SimulationIO_Base::SimulationHeader& header)
 {
+	SimulationContext::Scope scope(*mContext);
+
 	header.t = t();
 	header.dt = stepSize();
 	header.kD = Physics::kD;
@@ -113,6 +151,7 @@ void SDSSimulation::writeHeader(SimulationIO_Base::SimulationHeader& header)
 	header.kDamp = Physics::kDamp;
 	header.density = Physics::DENSITY;
 	header.viscosity = Physics::VISCOSITY;
+	header.integrator = Physics::integratorName(Physics::INTEGRATOR);
 	header.collisionInterval = getCollisionInterval();
 	header.worldBounds = world()->bounds();
 	header.gravity = Physics::GRAVITY;
@@ -121,8 +160,11 @@ void SDSSimulation::writeHeader(SimulationIO_Base::SimulationHeader& header)
 
 void SDSSimulation::cleanup()
 {
+	// the world deletes its own static meshes, and the shared ones aren't ours
+	std::list<Mesh*> others = mSharedStaticMeshes;
 	if (mOWorld)
 	{
+		others.insert(others.end(),mOWorld->getStaticMeshes().begin(),mOWorld->getStaticMeshes().end());
 		delete mOWorld;
 		mOWorld = NULL;
 		reset();
@@ -130,9 +172,17 @@ void SDSSimulation::cleanup()
 
 	BOOST_FOREACH(Mesh* m, mStaticMeshes)
 	{
-		delete m;
+		if (std::find(others.begin(),others.end(),m)==others.end())
+			delete m;
 	}
 	mStaticMeshes.clear();
+	mSharedStaticMeshes.clear();
+}
+
+void SDSSimulation::addSharedStaticMesh(Mesh* m)
+{
+	mSharedStaticMeshes.push_back(m);
+	mStaticMeshes.push_back(m);
 }
 
 void SDSSimulation::setWorld(OWorld* o)
@@ -158,13 +208,16 @@ void SDSSimulation::setWorld(OWorld* o)
 
 	BOOST_FOREACH(Mesh* m, mStaticMeshes)
 	{
-		mCollision.addStaticMesh(m);
+		bool shared = std::find(mSharedStaticMeshes.begin(),mSharedStaticMeshes.end(),m)!=mSharedStaticMeshes.end();
+		mCollision.addStaticMesh(m,shared);
 	}
 }
 
 void SDSSimulation::setStepSize(double dt)
 {
 	mSuggestedStepSize = dt;
+	mStepSize = dt;
+	mStepControl.reset();
 }
 
 double SDSSimulation::stepSize()
@@ -172,14 +225,48 @@ double SDSSimulation::stepSize()
 	return mSuggestedStepSize;
 }
 
+void SDSSimulation::setAdaptiveStepping(bool adaptive, double minStepSize, double maxStepSize)
+{
+	mAdaptiveStepping = adaptive;
+	mMinStepSize = minStepSize;
+	mMaxStepSize = maxStepSize;
+	mStepControl.reset();
+}
+
 bool SDSSimulation::substep()
+{
+	SimulationContext::Scope scope(*mContext);
+
+	Profile& profile = mContext->profile;
+	if (not profile.enabled())
+		return takeSubstep();
+
+	profile.beginSubstep(mSteps,mTime);
+	profile.addCount(Profile::VERTICES,mOrganism->mesh()->vertices().size());
+	profile.addCount(Profile::TETRAS,mOrganism->mesh()->tetras().size());
+
+	bool fullStep;
+	{
+		Profile::Timer timer(profile,Profile::SUBSTEP);
+		fullStep = takeSubstep();
+	}
+
+	profile.endSubstep();
+	profile.addLastTo(lastStepProperties);
+	return fullStep;
+}
+
+bool SDSSimulation::takeSubstep()
 {
 	LOG("SDSSimulation::substep()\n");
 	bool fullStep = SDSSimulation::physicalSubStep();
 	if (fullStep)
 	{
 		// XXX: Quick and dirty -- step the process model
-		mOrganism->processModel()->step(mOrganism, mSuggestedStepSize);
+		{
+			PROFILE_PHASE(PROCESS_MODEL);
+			mOrganism->processModel()->step(mOrganism, mStepSize);
+		}
 
 		// check to see if any errors occurred...
 		// check the result
@@ -192,6 +279,7 @@ bool SDSSimulation::substep()
 			else
 			{
 				setUnstable();
+				setErrorMessage(transformErrorMessage());
 				return true;
 			}
 		}
@@ -208,7 +296,7 @@ bool SDSSimulation::substep()
 
 			updatePhysicalParameters();
 
-			if (not Transform::allProperties.empty())
+			if (Transform::trace().transformations() > 0)
 				return false;
 		}
 	}
@@ -222,31 +310,45 @@ void SDSSimulation::updatePhysicalParameters()
 
 	// XXX: Move this elsewhere?
 
-	// Grow the cells.
+	MeshArrays& arrays = mOrganism->mesh()->arrays();
+	std::vector<unsigned char>& changed = arrays.changed;
+	std::vector<double>& r = arrays.r;
+
+	// Grow the cells (and flag the slots of the ones whose radius has changed)
 	BOOST_FOREACH(Cell* c, mOrganism->cells())
 	{
-		if (c->v()->isFrozen()) continue;
+		if (not c->v()->isFrozen())
+		{
+			double newr = c->r() + mStepSize*c->drdt();
+			if (newr < SMALLEST_CELL_RADIUS)
+			{
+				LOG("Cell radius is below minimum!\n");
+				newr = SMALLEST_CELL_RADIUS;
+			}
+			c->setR(newr);
+		}
 
-		double newr = c->r() + mSuggestedStepSize*c->drdt();
-		if (newr < SMALLEST_CELL_RADIUS)
+		const unsigned int s = c->v()->slot();
+		if (r[s]!=c->r())
 		{
-			LOG("Cell radius is below minimum!\n");
-			newr = SMALLEST_CELL_RADIUS;
+			r[s] = c->r();
+			changed[s] |= MeshArrays::CHANGED_REST;
 		}
-		c->setR(newr);
 	}
 
-	// Update the rest lengths
-	BOOST_FOREACH(Edge* e, mOrganism->mesh()->edges())
-		e->setRest(mOrganism->getAssociatedCell(e->v(0))->r()+mOrganism->getAssociatedCell(e->v(1))->r());
-	BOOST_FOREACH(Tetra* t, mOrganism->mesh()->tetras())
+	// Update the rest lengths of the elements around the flagged slots
+	BOOST_FOREACH(const MeshArrays::EdgeTuple& et, arrays.edges)
+	{
+		if ((changed[et.v[0]] | changed[et.v[1]]) & MeshArrays::CHANGED_REST)
+			et.e->setRest(r[et.v[0]] + r[et.v[1]]);
+	}
+	BOOST_FOREACH(const MeshArrays::TetraTuple& tt, arrays.tetras)
 	{
-		Cell *c0 = mOrganism->getAssociatedCell(&t->v(0)),
-			*c1 = mOrganism->getAssociatedCell(&t->v(1)),
-			*c2 = mOrganism->getAssociatedCell(&t->v(2)),
-			*c3 = mOrganism->getAssociatedCell(&t->v(3));
-		t->setRest(Transform::tetrahedraRestVolume(c0,c1,c2,c3));
+		const unsigned int* s = tt.v;
+		if ((changed[s[0]] | changed[s[1]] | changed[s[2]] | changed[s[3]]) & MeshArrays::CHANGED_REST)
+			tt.t->setRest(Transform::tetrahedraRestVolume(r[s[0]],r[s[1]],r[s[2]],r[s[3]]));
 	}
+	arrays.clearChanged(MeshArrays::CHANGED_REST);
 }
 
 bool SDSSimulation::physicalSubStep()
@@ -256,9 +358,12 @@ bool SDSSimulation::physicalSubStep()
 	lastStepProperties.clear();
 
 	// DEBUG: check sanity of mesh
-	if (not mContinueOnError and not mOrganism->mesh()->isSane())
+	if (mContinueOnError)
+		mOrganism->mesh()->skipSanityChecks();
+	else if (not checkSanity())
 	{
 		setUnstable();
+		setErrorMessage("Mesh not sane.");
 		return true;
 	}
 
@@ -266,9 +371,28 @@ bool SDSSimulation::physicalSubStep()
 	{
 		Transform::clearAllProperties();
 
+		// (with adaptive stepping, from a snapshot to roll back to)
+		if (mAdaptiveStepping)
+		{
+			if (not mStepControl.started())
+			{
+				double minStepSize = mMinStepSize > 0 ? mMinStepSize : ADAPTIVE_MIN_STEP*mSuggestedStepSize;
+				double maxStepSize = mMaxStepSize > 0 ? mMaxStepSize : ADAPTIVE_MAX_STEP*mSuggestedStepSize;
+				mStepControl.start(mSuggestedStepSize,minStepSize,maxStepSize);
+			}
+			mStepSize = mStepControl.stepSize();
+			PROFILE_PHASE(STEP_CONTROL);
+			mStepControl.snapshot(mOrganism->mesh());
+		}
+		else
+			mStepSize = mSuggestedStepSize;
+
 		// step the physical SDSSimulation forward
 		bool stepWasStable = stepForward();
 
+		if (mAdaptiveStepping and mState!=UNSTABLE and not judgeStep(stepWasStable))
+			return false;
+
 		if (stepWasStable)
 		{
 
@@ -298,7 +422,7 @@ bool SDSSimulation::physicalSubStep()
 				}
 				else
 				{
-					mLastStepSize = mSuggestedStepSize;
+					mLastStepSize = mStepSize;
 				}
 
 				// else mLastStepSize has been set appropriately
@@ -306,6 +430,9 @@ bool SDSSimulation::physicalSubStep()
 				Physics::setLastStepSize(mLastStepSize);
 				mSteps++;
 
+				if (mAdaptiveStepping)
+					mStepControl.accept(mOrganism->mesh(),mLastStepSize);
+
 				return not hamInversion;
 			}
 			else
@@ -320,6 +447,7 @@ bool SDSSimulation::physicalSubStep()
 			LOG("Last step was not stable\n");
 
 			setUnstable();
+			setErrorMessage("Physical step was not stable.");
 			return true;
 		}
 	}
@@ -344,51 +472,85 @@ bool SDSSimulation::stepForward()
 {
 	LOG("SDSSimulation::stepForward()\n");
 
-	// TODO: only do this only new elements
-	Physics::SetAllEdgeSpringStrengths(mOrganism->mesh());
+	// (only the edges around vertices touched since the last step)
+	{
+		PROFILE_PHASE(SPRING_STRENGTHS);
+		Physics::UpdateEdgeSpringStrengths(mOrganism->mesh());
+	}
 
-	Physics::zeroForces(mOrganism->mesh());
-	mOrganism->processModel()->beforePhysicalStep(mOrganism,mSuggestedStepSize);
-	Physics::calculateForces(mOrganism->mesh(),false,mContinueOnError);
+	// The forces are zeroed as they are gathered for the force pass, unless the
+	// process model adds some of its own first.
+	const bool externalForces = mOrganism->processModel()->addsForces();
+	if (externalForces)
+	{
+		PROFILE_PHASE(FORCES);
+		Physics::zeroForces(mOrganism->mesh());
+	}
+	{
+		PROFILE_PHASE(BEFORE_PHYSICAL_STEP);
+		mOrganism->processModel()->beforePhysicalStep(mOrganism,mStepSize);
+	}
+	{
+		PROFILE_PHASE(FORCES);
+		Physics::calculateForces(mOrganism->mesh(),not externalForces,mContinueOnError);
+	}
 
 	// Collision Detection and Response
 	// May modify mX and mOldX
 	if (mCollisionInterval>0 and (mSteps%mCollisionInterval) == 0)
 	{
+		PROFILE_PHASE(COLLISION);
 		try {
 			mCollision.estimateCollisionDepthAndDirection();
+			PROFILE_COUNT(COLLISIONS,mCollision.penetrationInfo().size());
 			mCollision.simpleResponseB();
 		}
 		catch (Collision::Exception& e)
 		{
 			std::cerr << "Simulation became unstable due to the exception: " << e.what() << std::endl;
 			setUnstable();
+			setErrorMessage(std::string("Collision error: ") + e.what());
 			return false;
 		}
 	}
 
-	return Physics::takeVerletStep(mOrganism->mesh(),mSuggestedStepSize,true, mContinueOnError);
+	PROFILE_PHASE(INTEGRATION);
+	return Physics::integrate(mOrganism->mesh(),mStepSize,true, mContinueOnError);
 
 	//return Physics::step(mOrganism->mesh(),mSuggestedStepSize,true);
 }
 
+bool SDSSimulation::judgeStep(bool stable)
+{
+	PROFILE_PHASE(STEP_CONTROL);
+
+	Mesh* m = mOrganism->mesh();
+	if (mStepControl.judge(m,mStepSize,stable))
+		return true;
+
+	LOG("Step of " << mStepSize << " rejected, trying " << mStepControl.stepSize() << "\n");
+	mStepControl.restore(m);
+	PROFILE_COUNT(REJECTED_STEPS,1);
+
+	lastStepProperties.add("step rejected");
+	std::ostringstream oss;
+	oss << "step size: " << mStepSize << " -> " << mStepControl.stepSize();
+	lastStepProperties.add(oss.str());
+	return false;
+}
+
 // XXX: This fails if there is a point EXACTLY on a plane
 // in which case the system will not be able to step back
 bool SDSSimulation::detectFirstInversion()
 {
 	LOG("SDSSimulation::detectFirstInversion()\n");
+	PROFILE_PHASE(INVERSION_DETECTION);
 
-	std::list<Tetra*> allInvertedTets;
-
-	// collect all tetrahedra that have been inverted
-	BOOST_FOREACH(Tetra* t, mOrganism->mesh()->tetras())
-	{
-		// ignore the frozen ones
-		if (t->isFrozen()) continue;
-
-		if (t->volume() < 0)
-			allInvertedTets.push_back(t);
-	}
+	// collect all tetrahedra that have been inverted (ignoring the frozen ones)
+	mInversions.start(mOrganism->mesh(),mStepSize);
+	std::vector<Tetra*> allInvertedTets;
+	mInversions.findInverted(allInvertedTets);
+	PROFILE_COUNT(INVERSIONS,allInvertedTets.size());
 
 	if (allInvertedTets.size()==0)
 	{
@@ -401,15 +563,13 @@ bool SDSSimulation::detectFirstInversion()
 	}
 
 	// rewind SDSSimulation until first inversion is detected
-	//double tn = t() + mSuggestedStepSize;
-	double totalr = 0;
+	// (the scheduler rewinds a copy of the positions, the mesh is rewound once at the end)
 	Tetra* tetr = NULL;
 	while (allInvertedTets.size() > 0)
 	{
-		double deltaT = mSuggestedStepSize - totalr; // step size of last SDSSimulation step
+		double deltaT = mInversions.window(); // step size of last SDSSimulation step
 
-		// find the tetrahedra whose inversion happens first
-		double tr = -1;
+		// schedule the inversions
 		BOOST_FOREACH(Tetra* t, allInvertedTets)
 		{
 			double deltaH = timeBackToInversion(t,deltaT);
@@ -422,15 +582,11 @@ bool SDSSimulation::detectFirstInversion()
 			}
 			else if (mState==UNSTABLE) break;
 
-			if (deltaH >= 0 and deltaH < deltaT
-					and deltaH > tr)
-			{
-				tr = deltaH;
-				tetr = t;
-			}
+			if (deltaH >= 0 and deltaH < deltaT)
+				mInversions.schedule(t,deltaH);
 		}
 
-		if (mContinueOnError and tr < 0)
+		if (mContinueOnError and not mInversions.scheduled())
 		{
 			// all bad tets have been frozen, so let's continue on
 			return false;
@@ -438,23 +594,19 @@ bool SDSSimulation::detectFirstInversion()
 
 		if (mState==UNSTABLE) return false;
 
-		// rewind ALL vertices back by (an additional) tr seconds
-		SDSUtil::rewindAllVertices(mOrganism->mesh(),tr,deltaT);
-		totalr += tr;
+		// the tetrahedra whose inversion happens first
+		// (if there isn't one, the end of the window is moved back by -1 seconds)
+		if (mInversions.scheduled())
+			tetr = mInversions.next();
+		else
+			mInversions.skip(-1);
 
-		// recompute all tetrahedra volumes, note that tetr's volume = 0
+		// find the tetrahedra inverted at that time, note that tetr's volume = 0
 		allInvertedTets.clear();
-		BOOST_FOREACH(Tetra* t, mOrganism->mesh()->tetras())
-		{
-			if (t==tetr) continue;
-			if (!t->isFrozen() and t->volume() < 0)
-			{
-				allInvertedTets.push_back(t);
-			}
-		}
+		mInversions.findInverted(allInvertedTets,tetr);
 
 		// if |allInvertedTets| > 0 then tetr was not the first, so we can continue to rewind
-		if (totalr > mSuggestedStepSize)
+		if (mInversions.back() > mStepSize)
 		{
 			setUnstable();
 			setErrorMessage("Simulation was rewound back past last time step. This should not happen.");
@@ -462,13 +614,16 @@ bool SDSSimulation::detectFirstInversion()
 		}
 	}
 
-	if(tetr==NULL)
+	if (tetr==NULL)
 	{
 		setUnstable();
 		setErrorMessage("Simulation error.");
 		return false;
 	}
 
+	// rewind ALL vertices back to the first inversion
+	mInversions.rewind();
+
 	// we have found the first tetrahedral inversion, and rewound the clock
 	// determine the type of intersection
 	determineIntersectionType(tetr);
@@ -490,7 +645,7 @@ bool SDSSimulation::detectFirstInversion()
 	}
 
 	// set the clock appropriately
-	mLastStepSize = mSuggestedStepSize - totalr;
+	mLastStepSize = mStepSize - mInversions.back();
 
 	return true;
 }
@@ -562,7 +717,7 @@ double SDSSimulation::timeBackToInversion(Tetra* t, double dt)
 	}
 	 */
 
-	double minT = SDSUtil::doVertexPlaneIntersect(t,0,1,2,3) * dt;
+	double minT = mInversions.intersect(t) * dt;
 	if (minT < tFirst)
 	{
 		tFirst = minT;
@@ -582,6 +737,7 @@ double SDSSimulation::timeBackToInversion(Tetra* t, double dt)
 		LOG(t << " -> tfirst = " << tFirst << "\n");
 		lastStepProperties.add("bad tetra",t);
 		setUnstable();
+		setErrorMessage("Invalid time of inversion of a tetra.");
 	}
 
 	// return time needed to rewind
@@ -591,6 +747,7 @@ double SDSSimulation::timeBackToInversion(Tetra* t, double dt)
 void SDSSimulation::performMove(const SDSSimulation::Movement& move)
 {
 	LOG("SDSSimulation::performMove()\n");
+	PROFILE_PHASE(MOVE);
 
 	switch(move.type)
 	{
@@ -623,10 +780,12 @@ void SDSSimulation::performMove(const SDSSimulation::Movement& move)
 	if (Transform::state == Transform::TRANSFORM_ERROR)
 	{
 		setUnstable();
+		setErrorMessage(transformErrorMessage());
 	}
 	else if (Transform::state == Transform::TRANSFORM_COMPLETED)
 	{
 		mCurrentStep = FINISH;
+		PROFILE_COUNT(MOVES,1);
 	}
 	else if (Transform::state==Transform::TRANSFORM_TRANSFORMING)
 	{
@@ -674,6 +833,23 @@ void SDSSimulation::setUnstable()
 	lastStepProperties.add("Simulation State","unstable");
 }
 
+bool SDSSimulation::checkSanity()
+{
+	using namespace boost::posix_time;
+	PROFILE_PHASE(SANITY_CHECK);
+
+	Mesh* m = mOrganism->mesh();
+	ptime start = microsec_clock::universal_time();
+	bool sane = (mSanityCheckMode==SANITY_CHECK_FULL)?m->isSane():m->isSaneIncremental();
+	time_duration elapsed = microsec_clock::universal_time() - start;
+
+	lastStepProperties.add("sanity check",std::string((mSanityCheckMode==SANITY_CHECK_FULL)?"full":"incremental"));
+	lastStepProperties.add("sanity check elements",m->lastSanityCheckSize());
+	lastStepProperties.add("sanity check time (us)",elapsed.total_microseconds());
+	PROFILE_COUNT(SANITY_CHECK_ELEMENTS,m->lastSanityCheckSize());
+	return sane;
+}
+
 void SDSSimulation::setContinueOnError(bool c)
 {
 	mContinueOnError = c;
@@ -17,7 +17,7 @@ std::map<Tetra*, std::list<Tetra*> > SDSUtil::getTetTopoGraph(Cell* c, Organism*
 {
 	std::map<Tetra*, std::list<Tetra*> > adjList;
 
-	std::list<Tetra*> itlist = o->mesh()->getNeighbours(c->v());
+	const std::vector<Tetra*>& itlist = o->mesh()->incidentTetras(c->v());
 	std::set<Tetra*> incidentTets = std::set<Tetra*>(itlist.begin(),itlist.end());
 
 	// for each tetrahedra in the list,
@@ -44,12 +44,12 @@ std::map<Tetra*, std::list<Tetra*> > SDSUtil::getTetTopoGraph(Cell* c, Organism*
 double SDSUtil::doVertexPlaneIntersect(Tetra* tet, int ai, int bi, int ci, int di)
 {
 	Vertex *qv = &tet->v(ai), *bv = &tet->v(bi), *cv = &tet->v(ci), *dv = &tet->v(di);
+	return doVertexPlaneIntersect(qv->mOldX, qv->x(), bv->mOldX, bv->x(), cv->mOldX, cv->x(), dv->mOldX, dv->x());
+}
 
-	Vector3d b1 = bv->x(), b0 = bv->mOldX,
-	c1 = cv->x(), c0 = cv->mOldX,
-	d1 = dv->x(), d0 = dv->mOldX,
-	q1 = qv->x(), q0 = qv->mOldX;
-
+double SDSUtil::doVertexPlaneIntersect(const Vector3d& q0, const Vector3d& q1, const Vector3d& b0, const Vector3d& b1,
+		const Vector3d& c0, const Vector3d& c1, const Vector3d& d0, const Vector3d& d1)
+{
 	/*
 	std::cerr << "vpi\n"
 		<< b0 << "\n"
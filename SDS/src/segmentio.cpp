@@ -16,32 +16,88 @@ const std::string ProcessModelSegmentIO::type = "processinfo";
 MeshSegmentIO::MeshSegmentIO(Mesh* m, std::string v)
 :mesh(m)
 ,version(v)
+,keyframeInterval(50)
+,mFramesSinceKeyframe(-1)
+,mKeyframeHash(0)
+,mKeyframe(NULL)
 {}
 
+MeshSegmentIO::~MeshSegmentIO()
+{
+	delete mKeyframe;
+}
+
 bool MeshSegmentIO::load(std::istream& bin)
 {
 	if (version=="19042010")
 	{
-		mesh->bReadFull(bin);
+		if (not mesh->bReadFull(bin))
+			return false;
 		mesh->bReadSpringMultipliers(bin);
 		mesh->bReadFrozenVerts(bin);
 		return true;
 	}
 	else if (version=="withspringmultipliers")
 	{
-		mesh->bReadFull(bin);
+		if (not mesh->bReadFull(bin))
+			return false;
 		mesh->bReadSpringMultipliers(bin);
 		return true;
 	}
 	else if (version=="full")
 	{
-		mesh->bReadFull(bin);
+		return mesh->bReadFull(bin);
+	}
+	else if (version=="topodelta")
+	{
+		unsigned int framesSinceKeyframe = 0;
+		::read(bin,framesSinceKeyframe);
+		if (framesSinceKeyframe==0)
+		{
+			if (not mesh->bReadFull(bin))
+				return false;
+			mesh->bReadSpringMultipliers(bin);
+		}
+		else if (not mesh->bReadContinuous(bin))
+			return false; // mesh doesn't hold the keyframe
+		mesh->bReadFrozenVerts(bin);
 		return true;
 	}
 	else
 		return false;
 }
 
+unsigned int MeshSegmentIO::keyframeDistance(std::istream& bin)
+{
+	if (version!="topodelta") return 0;
+
+	std::streampos pos = bin.tellg();
+	unsigned int framesSinceKeyframe = 0;
+	::read(bin,framesSinceKeyframe);
+	bin.seekg(pos);
+	return framesSinceKeyframe;
+}
+
+SegmentLoader* MeshSegmentIO::copyKeyframe()
+{
+	if (version!="topodelta") return NULL;
+
+	MeshSegmentIO* copy = new MeshSegmentIO(NULL,version);
+	copy->mKeyframe = new Mesh::Keyframe();
+	mesh->getKeyframe(*copy->mKeyframe);
+	return copy;
+}
+
+bool MeshSegmentIO::loadKeyframe(SegmentLoader* keyframe)
+{
+	MeshSegmentIO* copy = dynamic_cast<MeshSegmentIO*>(keyframe);
+	if (copy==NULL or copy->mKeyframe==NULL or copy->version!=version)
+		return false;
+
+	mesh->setKeyframe(*copy->mKeyframe);
+	return true;
+}
+
 bool MeshSegmentIO::initialise(libconfig::Setting& s)
 {
 	if (s.exists("version"))
@@ -61,6 +117,10 @@ bool MeshSegmentIO::initialise(libconfig::Setting& s)
 		{
 			version = v;
 		}
+		else if (v=="topodelta")
+		{
+			version = v;
+		}
 		else
 		{
 			std::cerr << "MeshSegmentIO: Unknown \"version\".\n";
@@ -73,6 +133,12 @@ bool MeshSegmentIO::initialise(libconfig::Setting& s)
 
 void MeshSegmentIO::write(std::ostream& bin)
 {
+	if (mKeyframe!=NULL)
+	{
+		writeSnapshot(bin);
+		return;
+	}
+
 	if (version=="19042010")
 	{
 		mesh->bWriteFull(bin);
@@ -88,6 +154,90 @@ void MeshSegmentIO::write(std::ostream& bin)
 	{
 		mesh->bWriteFull(bin);
 	}
+	else if (version=="topodelta")
+	{
+		nextFrame();
+		::write(bin,(unsigned int)mFramesSinceKeyframe);
+		if (mFramesSinceKeyframe==0)
+		{
+			mesh->bWriteFull(bin);
+			mesh->bWriteSpringMultipliers(bin);
+		}
+		else
+			mesh->bWriteContinuous(bin);
+		mesh->bWriteFrozenVerts(bin);
+	}
+}
+
+void MeshSegmentIO::nextFrame()
+{
+	std::size_t keyframe = mesh->keyframeHash();
+	if (mFramesSinceKeyframe<0 or keyframe!=mKeyframeHash
+		or mFramesSinceKeyframe+1>=(int)keyframeInterval)
+	{
+		mFramesSinceKeyframe = 0;
+		mKeyframeHash = keyframe;
+	}
+	else
+		mFramesSinceKeyframe++;
+}
+
+SegmentWriter* MeshSegmentIO::snapshot()
+{
+	MeshSegmentIO* copy = new MeshSegmentIO(NULL,version);
+	copy->mKeyframe = new Mesh::Keyframe();
+	if (version=="topodelta")
+	{
+		nextFrame();
+		copy->mFramesSinceKeyframe = mFramesSinceKeyframe;
+	}
+
+	if (version=="topodelta" and mFramesSinceKeyframe>0)
+		mesh->getContinuous(*copy->mKeyframe);
+	else
+	{
+		mesh->getKeyframe(*copy->mKeyframe);
+
+		// (the organism segment writes its cells' vertices with the ids of the last bWriteFull)
+		std::map<Vertex*,unsigned int>& vertexMap = mesh->vertexMapWrite();
+		vertexMap.clear();
+		unsigned int counter = 0;
+		BOOST_FOREACH(Vertex* v, mesh->vertices())
+			vertexMap[v] = counter++;
+	}
+	return copy;
+}
+
+void MeshSegmentIO::writeSnapshot(std::ostream& bin)
+{
+	const Mesh::Keyframe& k = *mKeyframe;
+	if (version=="19042010")
+	{
+		Mesh::bWriteFull(bin,k);
+		Mesh::bWriteSpringMultipliers(bin,k);
+		Mesh::bWriteFrozenVerts(bin,k);
+	}
+	else if (version=="withspringmultipliers")
+	{
+		Mesh::bWriteFull(bin,k);
+		Mesh::bWriteSpringMultipliers(bin,k);
+	}
+	else if (version=="full")
+	{
+		Mesh::bWriteFull(bin,k);
+	}
+	else if (version=="topodelta")
+	{
+		::write(bin,(unsigned int)mFramesSinceKeyframe);
+		if (mFramesSinceKeyframe==0)
+		{
+			Mesh::bWriteFull(bin,k);
+			Mesh::bWriteSpringMultipliers(bin,k);
+		}
+		else
+			Mesh::bWriteContinuous(bin,k);
+		Mesh::bWriteFrozenVerts(bin,k);
+	}
 }
 
 void MeshSegmentIO::setSetting(libconfig::Setting& s)
@@ -0,0 +1,42 @@
+#include "simulationcontext.h"
+
+#include "transform.h"
+
+// the current context of each thread, NULL for the global one
+static __thread SimulationContext* sCurrent = NULL;
+
+SimulationContext::SimulationContext()
+:density(1.0)
+,viscosity(0.01)
+,kD(1) // dist
+,kSM(1) // multiplier
+,kDamp(0.001) // damp
+,kV(2.0) // volume
+,gravity(10)
+,integrator(0) // Physics::VERLET
+,lastStepSize(-1)
+,transformState(Transform::TRANSFORM_COMPLETED)
+{
+}
+
+SimulationContext& SimulationContext::current()
+{
+	return sCurrent ? *sCurrent : global();
+}
+
+SimulationContext& SimulationContext::global()
+{
+	static SimulationContext context;
+	return context;
+}
+
+SimulationContext::Scope::Scope(SimulationContext& c)
+:mPrevious(sCurrent)
+{
+	sCurrent = &c;
+}
+
+SimulationContext::Scope::~Scope()
+{
+	sCurrent = mPrevious;
+}
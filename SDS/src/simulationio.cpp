@@ -22,6 +22,8 @@ using namespace libconfig;
 
 const unsigned int SimulationIO_Base::MAGICNUMBER;
 const unsigned int SimulationIO_Base::VERSION;
+const unsigned int SimulationIO_Base::INDEX_MAGICNUMBER;
+const unsigned int SimulationIO_Base::INDEX_VERSION;
 
 SimulationIO_Base::StaticMesh::StaticMesh(std::string prefix)
 :filePrefix(prefix),pos(),sx(1),sy(1),sz(1)
@@ -31,6 +33,7 @@ SimulationIO_Base::SimulationHeader::SimulationHeader()
 :t(0),dt(0),numFrames(-1)
 ,collisionInterval(1),worldBounds()
 ,gravity(0),kD(0),kSM(1),kV(0),kDamp(0),density(1),viscosity(0.01)
+,integrator("verlet")
 ,frameDataFileName("")
 ,time(boost::posix_time::second_clock::local_time())
 ,comments("")
@@ -62,6 +65,7 @@ void SimulationWriter::writeSimulationHeader(std::string file, SimulationHeader&
 	sim.add("kDamp",Setting::TypeFloat) = sh.kDamp;
 	sim.add("density",Setting::TypeFloat) = sh.density;
 	sim.add("viscosity",Setting::TypeFloat) = sh.viscosity;
+	sim.add("integrator",Setting::TypeString) = sh.integrator;
 	sim.add("framedata", Setting::TypeString) = sh.frameDataFileName;
 	sim.add("time",Setting::TypeString) = boost::posix_time::to_simple_string(sh.time);
 	sim.add("comments", Setting::TypeString) = sh.comments;
@@ -165,9 +169,9 @@ void SimulationWriter::writeFrame(std::ostream& out, int number, double time, in
 	//std::cout << "Frame header size: " << SimulationIO_Base::FrameHeader::size() << "b\n";
 
 	fhdr.sizeInBytes = (unsigned int)(os.length());
-	fhdr.number = 0;
-	fhdr.time = 0;
-	fhdr.step = 0;
+	fhdr.number = number;
+	fhdr.time = time;
+	fhdr.step = step;
 
 	SimulationWriter::writeFrameHeader(out,fhdr);
 	out.write(os.c_str(), os.length());
@@ -210,6 +214,19 @@ void SimulationWriter::writeSegment(std::ostream& o, SegmentWriter& sw)
     DUMP("dumped entire segment");
 }
 
+void SimulationWriter::writeFrameIndexHeader(std::ostream& idx)
+{
+	write(idx,INDEX_MAGICNUMBER);
+	write(idx,INDEX_VERSION);
+}
+
+void SimulationWriter::writeFrameIndexEntry(std::ostream& idx, boost::uint64_t offset, const FrameHeader& fh)
+{
+	write(idx,offset);
+	write(idx,fh.time);
+	write(idx,fh.step);
+}
+
 /*********************************************************************************************
  *********************************************************************************************
  *********************************************************************************************
@@ -217,6 +234,7 @@ void SimulationWriter::writeSegment(std::ostream& o, SegmentWriter& sw)
 
 SimulationLoader::SimulationLoader(std::string header_filename) throw(SimulationLoader::LoadException)
 :mSimulationHeader(),mConfig(),mFrameData(NULL)
+,mFrameIndexValid(false),mIndexedFileSize(0)
 {
 	try
 	{
@@ -267,6 +285,11 @@ SimulationLoader::SimulationLoader(std::string header_filename) throw(Simulation
 			sim.lookupValue("viscosity",mSimulationHeader.viscosity);
 		}
 
+		if (sim.exists("integrator"))
+		{
+			sim.lookupValue("integrator",mSimulationHeader.integrator);
+		}
+
 		if (sim.exists("numFrames"))
 		{
 			sim.lookupValue("numFrames",mSimulationHeader.numFrames);
@@ -439,24 +462,168 @@ SimulationLoader::SimulationLoader(std::string header_filename) throw(Simulation
 
 SimulationLoader::~SimulationLoader()
 {
+	clearKeyframes();
 	delete mFrameData;
 }
 
 int SimulationLoader::countFrames()
 {
 	if (!loadData()) return 0;
+	return frameIndex().size();
+}
+
+const std::vector<SimulationIO_Base::FrameIndexEntry>& SimulationLoader::frameIndex()
+{
+	std::string dataFileName = mSimulationHeader.getAbsolutePath(mSimulationHeader.frameDataFileName);
+
+	boost::uint64_t fileSize = 0;
+	try
+	{
+		fileSize = boost::filesystem::file_size(dataFileName);
+	}
+	catch(boost::filesystem::filesystem_error& e)
+	{
+		mFrameIndex.clear();
+		mFrameIndexValid = false;
+		return mFrameIndex;
+	}
+
+	if (mFrameIndexValid and fileSize==mIndexedFileSize)
+		return mFrameIndex;
+
+	std::ifstream data(dataFileName.c_str(),std::ios::binary);
+	std::string indexFileName = frameIndexFileName(dataFileName);
+	if (not mFrameIndexValid)
+	{
+		if (not readFrameIndexFile(indexFileName))
+			mFrameIndex.clear();
+	}
+	bool hadIndex = not mFrameIndex.empty();
+
+	// find where the indexed frames end, dropping any entries that don't
+	// match the frame data (e.g., the last frame is still being written)
+	boost::int64_t pos = -1;
+	FrameHeader fh;
+	while (not mFrameIndex.empty())
+	{
+		const FrameIndexEntry& e = mFrameIndex.back();
+		data.clear();
+		data.seekg((std::streamoff)e.offset);
+		read(data,fh.sizeInBytes);
+		read(data,fh.number);
+		read(data,fh.time);
+		read(data,fh.step);
+		if (data and fh.time==e.time and fh.step==e.step
+			and e.offset + FrameHeader::size() + fh.sizeInBytes <= fileSize)
+		{
+			pos = e.offset + FrameHeader::size() + fh.sizeInBytes;
+			break;
+		}
+		mFrameIndex.pop_back();
+	}
+	if (mFrameIndex.empty())
+	{
+		hadIndex = false;
+		pos = firstFrameOffset(data);
+		if (pos < 0)
+		{
+			mFrameIndexValid = false;
+			return mFrameIndex;
+		}
+	}
+
+	// then walk the rest of the frame headers
+	bool found = false;
+	while ((boost::uint64_t)pos + FrameHeader::size() <= fileSize)
+	{
+		data.clear();
+		data.seekg((std::streamoff)pos);
+		read(data,fh.sizeInBytes);
+		read(data,fh.number);
+		read(data,fh.time);
+		read(data,fh.step);
+		if (not data or (boost::uint64_t)pos + FrameHeader::size() + fh.sizeInBytes > fileSize)
+			break;
+
+		FrameIndexEntry e;
+		e.offset = pos;
+		e.time = fh.time;
+		e.step = fh.step;
+		mFrameIndex.push_back(e);
+		found = true;
+
+		pos += FrameHeader::size() + fh.sizeInBytes;
+	}
+
+	mFrameIndexValid = true;
+	mIndexedFileSize = fileSize;
+
+	// save it for next time, unless someone else is keeping it up to date
+	if (found and not hadIndex)
+		writeFrameIndexFile(indexFileName);
+
+	return mFrameIndex;
+}
+
+bool SimulationLoader::readFrameIndexFile(std::string fileName)
+{
+	std::ifstream idx(fileName.c_str(),std::ios::binary);
+	if (not idx) return false;
+
+	unsigned int magicnumber = 0, version = 0;
+	read(idx,magicnumber);
+	read(idx,version);
+	if (not idx or magicnumber!=INDEX_MAGICNUMBER or version!=INDEX_VERSION)
+		return false;
 
-	// skip to first frame
-	if (mHasStaticSegment and not skipStaticSegment()) return 0;
+	mFrameIndex.clear();
+	FrameIndexEntry e;
+	while (true)
+	{
+		read(idx,e.offset);
+		read(idx,e.time);
+		read(idx,e.step);
+		if (not idx) break;
+		mFrameIndex.push_back(e);
+	}
+	return true;
+}
+
+void SimulationLoader::writeFrameIndexFile(std::string fileName)
+{
+	// not being able to write the index (e.g., read-only directory) is fine
+	std::ofstream idx(fileName.c_str(),std::ios::binary);
+	if (not idx) return;
 
-	int count = 1;
-	while (nextFrame())
-		count++;
+	SimulationWriter::writeFrameIndexHeader(idx);
+	BOOST_FOREACH(const FrameIndexEntry& e, mFrameIndex)
+	{
+		write(idx,e.offset);
+		write(idx,e.time);
+		write(idx,e.step);
+	}
+}
+
+boost::int64_t SimulationLoader::firstFrameOffset(std::istream& data)
+{
+	data.clear();
+	data.seekg(0);
 
-	// then reset the data pointer
-	loadData();
+	unsigned int magicnumber = 0, version = 0;
+	read(data,magicnumber);
+	read(data,version);
+	if (not data or magicnumber!=MAGICNUMBER or version>VERSION)
+		return -1;
 
-	return count;
+	// skip the static segment (see loadData())
+	if (version > 1 and not mStaticSegmentTypes.empty())
+	{
+		unsigned long sizeOfStaticSegmentInBytes = 0;
+		read(data,sizeOfStaticSegmentInBytes);
+		if (not data) return -1;
+		return (boost::int64_t)data.tellg() + sizeOfStaticSegmentInBytes;
+	}
+	return data.tellg();
 }
 
 /**
@@ -578,11 +745,17 @@ bool SimulationLoader::nextFrame()
 
 bool SimulationLoader::setFrame(int f)
 {
-	if (not loadData()) return false;
-	if (mHasStaticSegment and not skipStaticSegment()) return false;
-	for(int i=0;i<f;i++)
-		if (not nextFrame()) return false;
-	return true;
+	const std::vector<FrameIndexEntry>& index = frameIndex();
+	if (f < 0 or f >= (int)index.size()) return false;
+	if (mFrameData==NULL and not loadData()) return false;
+
+	// jump straight to the frame (static segments are skipped, as if we had iterated to it)
+	mFrameData->clear();
+	mAtStartOfStaticSegment = false;
+	mCurrentFramePos = (std::streamoff)index[f].offset;
+	mFrameData->seekg(mCurrentFramePos);
+	readFrameHeader();
+	return !!(*mFrameData);
 }
 
 /**
@@ -602,6 +775,79 @@ void SimulationLoader::loadSegment(SegmentLoader* sl)
 		throw(new std::runtime_error("Segment doesn't exist!"));
 	int index = mSegmentIndexes[sl->getType()];
 
+	seekSegment(index);
+
+	// a segment that only stores changes needs its keyframe loaded first
+	unsigned int keyframeDistance = sl->keyframeDistance(*mFrameData);
+	int f = currentFrameIndex();
+	if (keyframeDistance > 0)
+	{
+		int k = f - (int)keyframeDistance;
+		if (k < 0)
+			throw(new std::runtime_error("Keyframe of segment doesn't exist!"));
+
+		// (the frames after a keyframe all need it, so the last one is kept)
+		std::map<std::string, std::pair<int,SegmentLoader*> >::iterator it = mKeyframes.find(sl->getType());
+		if (it==mKeyframes.end() or it->second.first!=k or not sl->loadKeyframe(it->second.second))
+		{
+			if (not setFrame(k))
+				throw(new std::runtime_error("Keyframe of segment doesn't exist!"));
+			seekSegment(index);
+			if (not sl->load(*mFrameData))
+				throw(new std::runtime_error("Keyframe of segment can't be read!"));
+			keepKeyframe(sl,k);
+
+			// then come back
+			setFrame(f);
+			seekSegment(index);
+		}
+		sl->load(*mFrameData);
+	}
+	else if (sl->load(*mFrameData))
+		keepKeyframe(sl,f);
+}
+
+void SimulationLoader::keepKeyframe(SegmentLoader* sl, int f)
+{
+	std::map<std::string, std::pair<int,SegmentLoader*> >::iterator it = mKeyframes.find(sl->getType());
+	if (it!=mKeyframes.end())
+	{
+		if (it->second.first==f)
+			return;
+		delete it->second.second;
+		mKeyframes.erase(it);
+	}
+
+	SegmentLoader* copy = (f < 0) ? NULL : sl->copyKeyframe();
+	if (copy)
+		mKeyframes[sl->getType()] = std::make_pair(f,copy);
+}
+
+void SimulationLoader::clearKeyframes()
+{
+	typedef std::pair<const std::string, std::pair<int,SegmentLoader*> > Keyframe;
+	BOOST_FOREACH(Keyframe& k, mKeyframes)
+		delete k.second.second;
+	mKeyframes.clear();
+}
+
+int SimulationLoader::currentFrameIndex()
+{
+	// the index is in file order
+	const std::vector<FrameIndexEntry>& index = frameIndex();
+	boost::uint64_t pos = (std::streamoff)mCurrentFramePos;
+	int lo = 0, hi = index.size();
+	while (lo < hi)
+	{
+		int mid = (lo + hi)/2;
+		if (index[mid].offset < pos) lo = mid + 1;
+		else hi = mid;
+	}
+	return (lo < (int)index.size() and index[lo].offset==pos) ? lo : -1;
+}
+
+void SimulationLoader::seekSegment(int index)
+{
     DUMP("index = " << index);
     DUMP("startSegmentPos = " << mStartSegmentPos);
 
@@ -625,8 +871,6 @@ void SimulationLoader::loadSegment(SegmentLoader* sl)
 	read(*mFrameData, segSizeInBytes);
 
     DUMP("segSizeInBytes = " << segSizeInBytes);
-
-	sl->load(*mFrameData);
 }
 
 std::string SimulationLoader::getAbsolutePath(std::string filename) const
@@ -661,6 +905,7 @@ bool SimulationLoader::loadFrameData()
 	{
 		delete mFrameData;
 	}
+	clearKeyframes();
 
 	std::string absoluteFileName = mSimulationHeader.getAbsolutePath(mSimulationHeader.frameDataFileName);
 	mFrameData = new std::ifstream(absoluteFileName.c_str(),std::ios::binary);
@@ -712,6 +957,7 @@ bool SimulationLoader::loadData()
 	{
 		delete mFrameData;
 	}
+	clearKeyframes();
 
 	std::string absoluteFileName = mSimulationHeader.getAbsolutePath(mSimulationHeader.frameDataFileName);
 	mFrameData = new std::ifstream(absoluteFileName.c_str(),std::ios::binary);
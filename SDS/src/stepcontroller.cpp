@@ -0,0 +1,160 @@
+#include "stepcontroller.h"
+
+#include "mesh.h"
+#include "mesharrays.h"
+#include "vertex.h"
+#include "tetra.h"
+#include "physics.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/foreach.hpp>
+
+double StepController::ACCELERATION_TOLERANCE = 1e-3;
+double StepController::VOLUME_TOLERANCE = 0.5;
+double StepController::MAX_GROWTH = 2;
+
+// the next step is this much smaller than the one that would just reach a tolerance
+const double SAFETY = 0.8;
+// the largest factor a step shrinks by
+const double MAX_SHRINK = 4;
+// the volume (relative to the rest volume) under which a tetra's losses are measured against
+// this instead (so that the steps don't vanish as a tetra closes in on an inversion, which
+// SDSSimulation handles)
+const double SMALL_VOLUME = 0.1;
+
+StepController::StepController()
+:mStarted(false)
+,mStepSize(0)
+,mMinStepSize(0)
+,mMaxStepSize(0)
+,mAccelerationError(0)
+,mVolumeError(0)
+,mLastStepSize(-1)
+,mLastTopology(0)
+,mLastDt(0)
+{
+}
+
+void StepController::start(double dt, double minDt, double maxDt)
+{
+	reset();
+	mStarted = true;
+	mMinStepSize = minDt;
+	mMaxStepSize = maxDt;
+	mStepSize = std::min(std::max(dt,minDt),maxDt);
+}
+
+void StepController::reset()
+{
+	mStarted = false;
+	mAccelerationError = 0;
+	mVolumeError = 0;
+	mA.clear();
+	mLastA.clear();
+	mLastDt = 0;
+}
+
+void StepController::snapshot(Mesh* m)
+{
+	const std::vector<Vertex*>& vertices = m->arrays().vertices;
+	const unsigned int n = vertices.size();
+	mX.resize(n);
+	mOldX.resize(n);
+	mV.resize(n);
+	for(unsigned int i=0;i<n;i++)
+	{
+		Vertex* v = vertices[i];
+		if (v==NULL) continue;
+		mX[i] = v->mX;
+		mOldX[i] = v->mOldX;
+		mV[i] = v->mV;
+	}
+	mLastStepSize = Physics::lastStepSize();
+}
+
+void StepController::restore(Mesh* m)
+{
+	const std::vector<Vertex*>& vertices = m->arrays().vertices;
+	for(unsigned int i=0;i<vertices.size();i++)
+	{
+		Vertex* v = vertices[i];
+		if (v==NULL) continue;
+		v->mX = mX[i];
+		v->mOldX = mOldX[i];
+		v->mV = mV[i];
+	}
+	m->updateAABB();
+	Physics::setLastStepSize(mLastStepSize);
+}
+
+bool StepController::judge(Mesh* m, double h, bool stable)
+{
+	MeshArrays& arrays = m->arrays();
+	const unsigned int n = arrays.vertices.size();
+	mAccelerationError = 0;
+	mVolumeError = 0;
+
+	double factor = 1/MAX_SHRINK;
+	if (stable)
+	{
+		// the step takes the accelerations at its start as constant, so it leaves out about
+		// h^2/2 times their change over it (estimated from their change since the last step kept)
+		const double density = Physics::DENSITY;
+		const bool history = mLastDt > 0 and mLastTopology==m->topologyVersion() and mLastA.size()==n;
+		mA.resize(n);
+		for(unsigned int i=0;i<n;i++)
+		{
+			if (arrays.vertices[i]==NULL or arrays.frozen[i])
+				continue;
+
+			mA[i] = arrays.f[i]/(arrays.m[i]*density);
+			// (the cell radii are only known after the first step)
+			if (history and arrays.r[i] > 0)
+			{
+				double e = 0.5*h*h*(h/mLastDt)*(mA[i] - mLastA[i]).length()/(ACCELERATION_TOLERANCE*arrays.r[i]);
+				mAccelerationError = std::max(mAccelerationError,e);
+			}
+		}
+
+		// the volume each tetra has lost towards inversion (the vertices have moved from their old positions)
+		BOOST_FOREACH(const MeshArrays::TetraTuple& tt, arrays.tetras)
+		{
+			if (tt.t->isFrozen())
+				continue;
+
+			const Vertex* const a = arrays.vertices[tt.v[0]];
+			const Vertex* const b = arrays.vertices[tt.v[1]];
+			const Vertex* const c = arrays.vertices[tt.v[2]];
+			const Vertex* const d = arrays.vertices[tt.v[3]];
+			// (as Tetra::volume)
+			const double v0 = (1.0/6)*dot(b->mOldX-a->mOldX,cross(c->mOldX-a->mOldX,d->mOldX-a->mOldX));
+			const double v1 = (1.0/6)*dot(b->mX-a->mX,cross(c->mX-a->mX,d->mX-a->mX));
+			if (not (v0 > 0) or v1 >= v0)
+				continue;
+
+			double e = (v0 - v1)/(VOLUME_TOLERANCE*std::max(v0,SMALL_VOLUME*std::fabs(tt.t->rest())));
+			mVolumeError = std::max(mVolumeError,e);
+		}
+
+		// the step that would bring each estimate to its tolerance (the first grows as h^3, the second as h)
+		factor = MAX_GROWTH;
+		if (mAccelerationError > 0)
+			factor = std::min(factor,SAFETY*std::pow(mAccelerationError,-1./3));
+		if (mVolumeError > 0)
+			factor = std::min(factor,SAFETY/mVolumeError);
+		factor = std::max(factor,1/MAX_SHRINK);
+	}
+
+	const bool reject = (not stable or mAccelerationError > 1 or mVolumeError > 1) and h > mMinStepSize;
+	mStepSize = std::min(std::max(h*factor,mMinStepSize),mMaxStepSize);
+	return not reject;
+}
+
+void StepController::accept(Mesh* m, double dt)
+{
+	mLastA.swap(mA);
+	mLastTopology = m->topologyVersion();
+	mLastDt = dt;
+}
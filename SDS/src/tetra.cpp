@@ -57,8 +57,14 @@ Vector3d Tetra::centerOfMass() const
 }
 
 
-// XXX: Brute force
 const AABB& Tetra::updateAABB()
+{
+	mAABB = computeAABB();
+	return mAABB;
+}
+
+// XXX: Brute force
+AABB Tetra::computeAABB() const
 {
 	double min[3] = {DBL_MAX,DBL_MAX,DBL_MAX}, max[3] = {-DBL_MAX,-DBL_MAX,-DBL_MAX};
 
@@ -77,15 +83,9 @@ const AABB& Tetra::updateAABB()
 		if (z > max[2]) max[2] = z;
 	}
 
-	mAABB[0] = min[0];
-	mAABB[1] = min[1];
-	mAABB[2] = min[2];
-	mAABB[3] = max[0];
-	mAABB[4] = max[1];
-	mAABB[5] = max[2];
-	mAABB.valid(true);
-
-	return mAABB;
+	AABB aabb(min[0],min[1],min[2],max[0],max[1],max[2],false);
+	aabb.valid(true);
+	return aabb;
 }
 
 bool Tetra::isVertex(const Vertex* v) const // returns true if v==mV[i] for some i
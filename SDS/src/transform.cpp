@@ -23,40 +23,35 @@
 	#undef LOG
 	#define LOG(x) ;
 #endif
-// static State and Properties
+// State (of the current SimulationContext)
 
-Transform::State Transform::state = Transform::TRANSFORM_COMPLETED;
-PropertyList Transform::properties;
-std::list<PropertyList> Transform::allProperties;
-
-std::string Transform::sErrorMessage;
+SimulationContext::Value<int,&SimulationContext::transformState> Transform::state;
 
 double Transform::sDivideInternalAngleThreshold = .5; /* <0 disabled */ // in radians
 double Transform::sDivideSurfaceAngleThreshold = .5; /* <0 disabled */
 
-void Transform::called(std::string s)
+void Transform::called(const char* s)
 {
-	properties.add("Transformation",s);
+	trace().add("Transformation").text(s);
 	LOG("Transformation" << s);
 }
 
 void Transform::reset()
 {
-	properties.clear();
+	trace().begin();
 	state = TRANSFORM_COMPLETED;
 }
 
 void Transform::finaliseProperties()
 {
-	allProperties.push_back(properties);
+	trace().end();
 }
 
 boost::tuple<Cell*,Cell*> Transform::testQuit()
 {
 	state = TRANSFORM_ERROR;
-	std::string errorMessage = "Test Quit";
-	Transform::properties.add(errorMessage);
-	setErrorMessage(errorMessage);
+	trace().add("Test Quit");
+	setErrorMessage("Test Quit");
 	return boost::make_tuple<Cell*,Cell*>(NULL,NULL);
 }
 
@@ -69,20 +64,20 @@ boost::tuple<Cell*,Cell*> Transform::error(std::string s)
 		setErrorMessage(s);
 	}
 
-	std::string errorMessage = "Transform Error: " + getErrorMessage();
-	Transform::properties.add(errorMessage);
+	if (trace().enabled())
+		trace().add("Transform Error: " + getErrorMessage());
 
 	return boost::make_tuple<Cell*,Cell*>(NULL,NULL);
 }
 
 std::string Transform::getErrorMessage()
 {
-	return sErrorMessage;
+	return SimulationContext::current().transformErrorMessage;
 }
 
 void Transform::setErrorMessage(std::string msg)
 {
-	sErrorMessage = msg;
+	SimulationContext::current().transformErrorMessage = msg;
 }
 
 // Helper Utilities
@@ -95,8 +90,7 @@ Tetra* Transform::getTetraInDirection(Cell* c, Vector3d dir, Organism* o)
 
 	const Vertex* v = c->v();
 	Vector3d cx = v->x();
-	std::list<Tetra*> n = m->getNeighbours(c->v());
-	BOOST_FOREACH(Tetra* t, n)
+	BOOST_FOREACH(Tetra* t, m->incidentTetras(c->v()))
 	{
 		// first we check to see if the opposite face is in the direction dir from c->x()
 		int f[3];
@@ -363,8 +357,8 @@ bool Transform::findTetras(std::vector<Tetra*>& X, std::vector<int>& V, Tetra* t
 		if (LV < 0 or LV > 3)
 		{
 			state = TRANSFORM_ERROR;
-			properties.add("LX",LX);
-			properties.add(LV);
+			trace().add("LX").tetra(LX);
+			trace().add("").at(LV);
 			return false;
 		}
 
@@ -428,9 +422,7 @@ void Transform::projectPoints(std::vector<Vertex*>& points, Vertex* u1, Vertex*
 
 	BOOST_FOREACH(Vertex* v, points)
 	{
-		std::ostringstream oss;
-		oss << "lv " << v->x();
-		properties.add(oss.str(), v);
+		trace().add("lv ").at(v->x()).vertex(v);
 
 		Vector3d vmu1 = v->x() - u1->x();
 		double t = u2mu1dot / dot(vmu1,u2mu1);
@@ -457,9 +449,7 @@ void Transform::projectPoints(std::vector<Vertex*>& points, Vertex* u1, Vertex*
 		Vector3d lvproj = uvwi * v;
 		v = Vector3d(lvproj[1],lvproj[2],0); //swizzle coords
 
-		std::ostringstream oss;
-		oss << "lvproj " << v;
-		properties.add(oss.str());
+		trace().add("lvproj ").at(v);
 	}
 
 }
@@ -470,19 +460,17 @@ void Transform::projectTransformedPoints(std::vector<Vector3d>& points, Vertex*
 	Vector3d u2mu1 = u2->x() - u1->x();
 	double u2mu1dot = dot(u2mu1,u2mu1);
 
-	std::ostringstream oss;
+	//std::ostringstream oss;
 	//oss << "u1 " << u1->x() << " u2 " << u2->x();
-	//properties.add(oss.str());
+	//properties().add(oss.str());
 
 	BOOST_FOREACH(Vector3d& x, points)
 	{
-		oss.str("");
-		oss << "lv " << x;
-		properties.add(oss.str(),x);
+		trace().add("lv ").at(x).point(x);
 
 		Vector3d vmu1 = x - u1->x();
 		double t = u2mu1dot / dot(vmu1,u2mu1);
-		//properties.add("t",t);
+		//properties().add("t",t);
 		if (t <= 0)
 		{
 			error("projectTransformedPoints: t <= 0");
@@ -490,8 +478,7 @@ void Transform::projectTransformedPoints(std::vector<Vector3d>& points, Vertex*
 		}
 		Vector3d proj = u1->x() + vmu1 * t;
 
-		oss << "proj";
-		properties.add(oss.str(),proj);
+		trace().add("proj ").at(x).point(proj);
 		projected.push_back(proj);
 	}
 
@@ -510,9 +497,7 @@ void Transform::projectTransformedPoints(std::vector<Vector3d>& points, Vertex*
 		Vector3d lvproj = uvwi * v;
 		v = Vector3d(lvproj[1],lvproj[2],0); //swizzle coords
 
-		std::ostringstream oss;
-		oss << "lvproj " << v;
-		properties.add(oss.str());
+		trace().add("lvproj ").at(v);
 	}
 }
 
@@ -569,11 +554,8 @@ bool Transform::findTriangulation(std::vector<Vertex*>& points, Vertex* u1, Vert
 
 	for(unsigned int index=0; index<triangulation.size(); index++)
 	{
-		std::ostringstream oss;
-		oss << "triangle " << index;
 		const Vector3i& face = triangulation[index];
-		Vertex* verts[3] = {points[face[0]],points[face[1]],points[face[2]]};
-		properties.add(oss.str(),boost::make_tuple(verts[0],verts[1],verts[2]));
+		trace().add("triangle ").at(index).triangle(points[face[0]],points[face[1]],points[face[2]]);
 	}
 
 	return true;
@@ -7,7 +7,10 @@
 
 boost::tuple<Cell*,Cell*> Transform::Divide(Cell* c, Vector3d dir, Organism* o)
 {
-	return Transform::DivideBalanced(c,dir,o);
+	PROFILE_PHASE(DIVISION);
+	boost::tuple<Cell*,Cell*> res = Transform::DivideBalanced(c,dir,o);
+	if (state!=TRANSFORM_ERROR) PROFILE_COUNT(DIVISIONS,1);
+	return res;
 }
 
 boost::tuple<Cell*,Cell*> Transform::DivideSimple(Cell* c, Vector3d dir, Organism* o)
@@ -78,7 +81,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideSimple(Cell* c, Vector3d dir, Organis
 		if (ti==NULL)
 		{
 			// this shouldn't happen, but if it does, then just choose any tetra
-			ti = *m->getNeighbours(c->v()).begin();
+			ti = m->incidentTetras(c->v()).front();
 			LOG("c.x: " << c->x() << " dir: " << dir);
 		}
 		// assert(ti!=NULL);
@@ -228,9 +231,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideTetra(Cell* c, Face* f, Organism* o)
 		LOG("DivideTetra: error");
 
 		state = TRANSFORM_ERROR;
-		Transform::properties.add("error vertex v not in face f");
-		Transform::properties.add("v",v);
-		Transform::properties.add("f",f);
+		Transform::trace().add("error vertex v not in face f");
+		Transform::trace().add("v").vertex(v);
+		Transform::trace().add("f").face(f);
 		return boost::make_tuple<Cell*,Cell*>(NULL,NULL);
 	}
 
@@ -365,9 +368,9 @@ boost::tuple<Cell*, Cell*> Transform::DivideAway(Cell* c, Face* f, Organism* o)
 	if (iv0<0 or iv0>=3)
 	{
 		state = TRANSFORM_ERROR;
-		Transform::properties.add("error vertex v not in face f");
-		Transform::properties.add("v",v);
-		Transform::properties.add("f",f);
+		Transform::trace().add("error vertex v not in face f");
+		Transform::trace().add("v").vertex(v);
+		Transform::trace().add("f").face(f);
 		return boost::make_tuple<Cell*,Cell*>(NULL,NULL);
 	}
 	int iv1 = (iv0+1)%3;
@@ -417,9 +420,9 @@ boost::tuple<Cell*, Cell*> Transform::DivideAway(Cell* c, Face* f, Organism* o)
 
 	// Find the tetrahedra connected to face f
 	Tetra* t = NULL;
-	BOOST_FOREACH(Tetra* tet, m->tetras())
+	BOOST_FOREACH(Tetra* tet, m->incidentTetras(v0))
 	{
-		if (tet->contains(v0) and tet->contains(v1) and tet->contains(v2))
+		if (tet->contains(v1) and tet->contains(v2))
 		{
 			t = tet;
 			break;
@@ -479,7 +482,7 @@ boost::tuple<Cell*, Cell*> Transform::DivideInternal(Cell* c, Vector3d dir, Orga
 		if (ti==NULL)
 		{
 			// this shouldn't happen, but if it does, then just choose any tetra
-			ti = *m->getNeighbours(c->v()).begin();
+			ti = m->incidentTetras(c->v()).front();
 			LOG("c.x: " << c->x() << " dir: " << dir);
 		}
 		// assert(ti!=NULL);
@@ -527,9 +530,9 @@ boost::tuple<Cell*, Cell*> Transform::DivideAlong(Cell* c, Vector3d dir, Organis
 		{
 			// log an error and halt...
 			LOG("DivideAlong() error");
-			properties.add("DivideAlong() dir incorrect");
-			properties.add("cell",c);
-			properties.add("dir",boost::make_tuple(c->x(),c->x()+dir));
+			trace().add("DivideAlong() dir incorrect");
+			trace().add("cell").cell(c);
+			trace().add("dir").segment(c->x(),c->x()+dir);
 			return error("Cannot find face in specified direction");
 		}
 
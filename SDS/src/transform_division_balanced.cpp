@@ -24,14 +24,14 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 {
 	reset();
 	called("DivideBalanced");
-	Transform::properties.add("cell",c);
+	Transform::trace().add("cell").cell(c);
 
 	dir.normaliseInPlace();
 	Mesh* m = o->mesh();
 
 	if (c->isBoundary())
 		{
-			Transform::properties.add("boundary division");
+			Transform::trace().add("boundary division");
 
 			// get the neighbour cell closest to direction dir
 			Cell* nc = NULL;
@@ -70,7 +70,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 		}
 	else // is not boundary
 	{
-		Transform::properties.add("internal division");
+		Transform::trace().add("internal division");
 
 		// If the direction lies along an edge, then we split the edge.
 		// Otherwise we place the new cell inside the tetrahedra that lies in the direction dir
@@ -91,7 +91,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 			return Transform::DivideInternalEdge(c,o->edge(c,nc),o);
 		else /*** The balanced division algorithm happens! ***/
 		{
-			Transform::properties.add("balanced tetrahedralisation");
+			Transform::trace().add("balanced tetrahedralisation");
 
 			// Create F = {t}
 
@@ -99,7 +99,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 			if (t==NULL)
 			{
 				// this shouldn't happen, but if it does, then just choose any tetra
-				t = *m->getNeighbours(c->v()).begin();
+				t = m->incidentTetras(c->v()).front();
 				LOG("c.x: " << c->x() << " dir: " << dir);
 			}
 
@@ -194,7 +194,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 															vIndexMap[v2],
 															vIndexMap[v3]));
 
-				Transform::properties.add("hull", boost::make_tuple(v1,v2,v3));
+				Transform::trace().add("hull").triangle(v1,v2,v3);
 				LOG ("hull face " << vIndexMap[v1] <<
 						" " << vIndexMap[v2] <<
 						" " << vIndexMap[v3] << "\n");
@@ -236,7 +236,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 				/*
 				std::ostringstream oss;
 				oss << "face [" << face.get<0>() << "," << face.get<1>() << "," << face.get<2>() << "]" << " maps to " << id;
-				Transform::properties.add(oss.str());
+				Transform::properties().add(oss.str());
 				*/
 			}
 
@@ -272,9 +272,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 			}
 
 			LOG("pointsBefore: " << pSizeBefore << ", new verts: " << points.size() << ", new tets: " << newTetrahedra.size() << ", new edges: " << newEdges.size() << "\n");
-			Transform::properties.addStringAndValue("number of (new) vertices: ", points.size()-pSizeBefore);
-			Transform::properties.addStringAndValue("number of tets: ", newTetrahedra.size());
-			Transform::properties.addStringAndValue("number of edges: ", newEdges.size());
+			Transform::trace().add("number of (new) vertices: ").at(points.size()-pSizeBefore);
+			Transform::trace().add("number of tets: ").at(newTetrahedra.size());
+			Transform::trace().add("number of edges: ").at(newEdges.size());
 			assert(newTetrahedra.size()==newTetrahedraNeighbours.size());
 
 			// integrate the new tetrahedra and possibly new vertices into
@@ -293,7 +293,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 				verts.push_back(v);
 				cells.push_back(c);
 
-				Transform::properties.add("new cell", c);
+				Transform::trace().add("new cell").cell(c);
 			}
 
 			// add new vertices, edges, and tetras to mesh
@@ -319,7 +319,7 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 				o->mesh()->addTetra(newtet);
 				newTets.push_back(newtet);
 
-				Transform::properties.add("new tet", newtet);
+				Transform::trace().add("new tet").tetra(newtet);
 				LOG("new tetra @" << newtet << ". " << t0 << " " << t1 << " " << t2 << " " << t3 << "\n");
 			}
 
@@ -360,9 +360,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 
 					// sanity check
 					if (!checkTetraNeighbour(t,0)){
-						Transform::properties.add("Error in neighbour loop.");
-						Transform::properties.add("t",t);
-						Transform::properties.add("tn",tn);
+						Transform::trace().add("Error in neighbour loop.");
+						Transform::trace().add("t").tetra(t);
+						Transform::trace().add("tn").tetra(tn);
 						return testQuit();
 					}
 				}
@@ -383,9 +383,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 
 					// sanity check
 					if (!checkTetraNeighbour(t,1)){
-						Transform::properties.add("Error in neighbour loop.");
-						Transform::properties.add("t",t);
-						Transform::properties.add("tn",tn);
+						Transform::trace().add("Error in neighbour loop.");
+						Transform::trace().add("t").tetra(t);
+						Transform::trace().add("tn").tetra(tn);
 						return testQuit();
 					}
 				}
@@ -405,9 +405,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 
 					// sanity check
 					if (!checkTetraNeighbour(t,3)){
-						Transform::properties.add("Error in neighbour loop.");
-						Transform::properties.add("t",t);
-						Transform::properties.add("tn",tn);
+						Transform::trace().add("Error in neighbour loop.");
+						Transform::trace().add("t").tetra(t);
+						Transform::trace().add("tn").tetra(tn);
 						return testQuit();
 					}
 				}
@@ -426,9 +426,9 @@ boost::tuple<Cell*,Cell*> Transform::DivideBalanced(Cell* c, Vector3d dir, Organ
 
 					// sanity check
 					if (!checkTetraNeighbour(t,2)){
-						Transform::properties.add("Error in neighbour loop.");
-						Transform::properties.add("t",t);
-						Transform::properties.add("tn",tn);
+						Transform::trace().add("Error in neighbour loop.");
+						Transform::trace().add("t").tetra(t);
+						Transform::trace().add("tn").tetra(tn);
 						return testQuit();
 					}
 				}
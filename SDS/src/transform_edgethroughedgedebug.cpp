@@ -8,7 +8,8 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 
 	static std::string substep = "start";
 
-	properties.add("substep",substep);
+	if (trace().enabled())
+		trace().add("substep " + substep);
 
 	if (state == TRANSFORM_COMPLETED)
 	{
@@ -139,29 +140,32 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 			}
 
 			// debug: expose the tetras to the user
-			std::ostringstream puad;
-			puad << "processing UandD[" << i << "]";
-			properties.add("state",puad.str());
+			if (trace().enabled())
+			{
+				std::ostringstream puad;
+				puad << "state: processing UandD[" << i << "]";
+				trace().add(puad.str());
 
-			std::ostringstream num;
-			num << "t(" << i << ",";
+				std::ostringstream num;
+				num << "t(" << i << ",";
 
-			int counter = 0;
-			BOOST_FOREACH(Tetra* t, UandD[i])
-			{
-				std::ostringstream numout;
-				numout << num.str() << counter << ")";
-				properties.add(numout.str(),t);
-				counter++;
-			}
+				int counter = 0;
+				BOOST_FOREACH(Tetra* t, UandD[i])
+				{
+					std::ostringstream numout;
+					numout << num.str() << counter << ")";
+					trace().add(numout.str()).tetra(t);
+					counter++;
+				}
 
-			num.str("");
-			num << "v(" << i << ",";
-			for(unsigned int index=0;index<UVandDV[i].size();index++)
-			{
-				std::ostringstream numout;
-				numout << num.str() << index << ")";
-				properties.add(numout.str(),&(UandD[i][index]->v(UVandDV[i][index])));
+				num.str("");
+				num << "v(" << i << ",";
+				for(unsigned int index=0;index<UVandDV[i].size();index++)
+				{
+					std::ostringstream numout;
+					numout << num.str() << index << ")";
+					trace().add(numout.str()).vertex(&(UandD[i][index]->v(UVandDV[i][index])));
+				}
 			}
 
 			// increase i
@@ -327,8 +331,8 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 				hull.push_back(boost::make_tuple(uIndex,i1,i2));
 				hull.push_back(boost::make_tuple(uIndex+1,i2,i1));
 
-				properties.add(boost::make_tuple(verts[uIndex],verts[i1],verts[i2]));
-				properties.add(boost::make_tuple(verts[uIndex+1],verts[i2],verts[i1]));
+				trace().add("hull").triangle(verts[uIndex],verts[i1],verts[i2]);
+				trace().add("hull").triangle(verts[uIndex+1],verts[i2],verts[i1]);
 
 				if (i==(polySize-1))
 				{
@@ -336,18 +340,18 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 					hullN.push_back(tu2);
 					hullN.push_back(tu1);
 
-					if (tu2) properties.add(tu2);
-					if (tu1) properties.add(tu1);
+					if (tu2) trace().add("tu2").tetra(tu2);
+					if (tu1) trace().add("tu1").tetra(tu1);
 
 					if (tu2) hullI.push_back(tu2->getNeighbourIndex(t));
 					else hullI.push_back(-1);
 
-					if (tu2) properties.add(&tu2->v(tu2->getNeighbourIndex(t)));
+					if (tu2) trace().add("tu2 v").vertex(&tu2->v(tu2->getNeighbourIndex(t)));
 
 					if (tu1) hullI.push_back(tu1->getNeighbourIndex(t));
 					else hullI.push_back(-1);
 
-					if (tu1) properties.add(&tu1->v(tu1->getNeighbourIndex(t)));
+					if (tu1) trace().add("tu1 v").vertex(&tu1->v(tu1->getNeighbourIndex(t)));
 				}
 				else
 				{
@@ -355,18 +359,18 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 					hullN.push_back(tu2);
 					hullN.push_back(tu1);
 
-					if (tu2) properties.add(tu2);
-					if (tu1) properties.add(tu1);
+					if (tu2) trace().add("tu2").tetra(tu2);
+					if (tu1) trace().add("tu1").tetra(tu1);
 
 					if (tu2) hullI.push_back(tu2->getNeighbourIndex(X1[i]));
 					else hullI.push_back(-1);
 
-					if (tu2) properties.add(&tu2->v(tu2->getNeighbourIndex(X1[i])));
+					if (tu2) trace().add("tu2 v").vertex(&tu2->v(tu2->getNeighbourIndex(X1[i])));
 
 					if (tu1) hullI.push_back(tu1->getNeighbourIndex(X1[i]));
 					else hullI.push_back(-1);
 
-					if (tu1) properties.add(&tu1->v(tu1->getNeighbourIndex(X1[i])));
+					if (tu1) trace().add("tu1 v").vertex(&tu1->v(tu1->getNeighbourIndex(X1[i])));
 				}
 			}
 
@@ -403,7 +407,7 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 			for(unsigned int i=pSizeBefore;i<points.size();i++)
 			{
 				Vertex* v = new Vertex(points[i][0],points[i][1],points[i][2],averageMass);
-				properties.add(v);
+				trace().add("new vertex").vertex(v);
 
 				Cell* c = new Cell(v,Math::radiusOfSphereGivenVolume(averageMass));
 				o->mesh()->addVertex(v);
@@ -429,7 +433,7 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 				o->mesh()->addTetra(newtet);
 				newTets.push_back(newtet);
 
-				properties.add(newtet);
+				trace().add("new tet").tetra(newtet);
 			}
 
 			// fix up neighbourhood information
@@ -554,7 +558,7 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 			if (!findTriangulation(L,u1,u2,v1,v2,Lfaces))
 			{
 				sState = UNSTABLE;
-				properties.add("bad triangulation of collapsing tetra",t);
+				properties().add("bad triangulation of collapsing tetra",t);
 				return false;
 			}
 
@@ -581,8 +585,8 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 				if (t0->volume()<0 or t1->volume()<0)
 				{
 					sState = UNSTABLE;
-					properties.add("t0",t0);
-					properties.add("t1",t1);
+					properties().add("t0",t0);
+					properties().add("t1",t1);
 					return false;
 				}
 
@@ -599,10 +603,10 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 				// debug: output
 				std::ostringstream oss;
 				oss << "tetra " << t0;
-				properties.add(oss.str(),t0);
+				properties().add(oss.str(),t0);
 				oss.str("");
 				oss << "tetra " << t1;
-				properties.add(oss.str(),t1);
+				properties().add(oss.str(),t1);
 
 				// set face neighbours
 				t0->setNeighbour(0,t1);
@@ -969,7 +973,7 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 
 					std::ostringstream oss;
 					oss << "lv " << lv;
-					properties.add(oss.str(), lv);
+					properties().add(oss.str(), lv);
 				}
 				 */
 
@@ -1026,12 +1030,8 @@ void Transform::MoveEdgeThroughEdge(int ea, int eb, Tetra* t, Organism* o)
 					t1->setRest(Transform::tetrahedraRestVolume(c1,ca,cb,cc));
 
 					// debug: output
-					std::ostringstream oss;
-					oss << "tetra " << t0;
-					properties.add(oss.str(),t0);
-					oss.str("");
-					oss << "tetra " << t1;
-					properties.add(oss.str(),t1);
+					trace().add("tetra").tetra(t0);
+					trace().add("tetra").tetra(t1);
 
 					// set face neighbours
 					t0->setNeighbour(0,t1);
@@ -0,0 +1,233 @@
+#include "transformtrace.h"
+
+#include "vertex.h"
+#include "tetra.h"
+#include "cell.h"
+#include "edge.h"
+#include "face.h"
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+
+#include <boost/tuple/tuple.hpp>
+
+TransformTrace::Event& TransformTrace::Event::text(const char* s)
+{
+	value = STRING;
+	p[0] = const_cast<char*>(s);
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::cell(Cell* c)
+{
+	value = CELL;
+	p[0] = c;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::vertex(Vertex* v)
+{
+	value = VERTEX;
+	p[0] = v;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::edge(Edge* e)
+{
+	value = EDGE;
+	p[0] = e;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::face(Face* f)
+{
+	value = FACE;
+	p[0] = f;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::tetra(Tetra* t)
+{
+	value = TETRA;
+	p[0] = t;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::triangle(Vertex* a, Vertex* b, Vertex* c)
+{
+	value = TRIANGLE;
+	p[0] = a;
+	p[1] = b;
+	p[2] = c;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::point(const Vector3d& a)
+{
+	value = POINT;
+	for(int i=0;i<3;i++)
+		x[i] = a[i];
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::segment(const Vector3d& a, const Vector3d& b)
+{
+	value = SEGMENT;
+	for(int i=0;i<3;i++)
+	{
+		x[i] = a[i];
+		x[i+3] = b[i];
+	}
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::at(int i)
+{
+	index = i;
+	return *this;
+}
+
+TransformTrace::Event& TransformTrace::Event::at(const Vector3d& a)
+{
+	hasPoint = true;
+	for(int i=0;i<3;i++)
+		x[i+3] = a[i];
+	return *this;
+}
+
+TransformTrace::TransformTrace(unsigned int capacity)
+:mEnabled(true)
+,mEvents(capacity)
+,mKeys(capacity)
+,mRecorded(0)
+,mBegin(0)
+,mStep(0)
+,mTransformations(0)
+{
+	std::memset(&mDiscarded,0,sizeof(Event));
+}
+
+void TransformTrace::setEnabled(bool enabled)
+{
+	mEnabled = enabled;
+}
+
+void TransformTrace::setCapacity(unsigned int n)
+{
+	mEvents.resize(n);
+	mKeys.resize(n);
+	mRecorded = mBegin = mStep = 0;
+}
+
+TransformTrace::Event& TransformTrace::next(Type type)
+{
+	Event& e = mEvents[mRecorded%mEvents.size()];
+	mRecorded++;
+	e.type = type;
+	e.value = NONE;
+	e.key = NULL;
+	e.index = -1;
+	e.hasPoint = false;
+	return e;
+}
+
+void TransformTrace::begin()
+{
+	if (not mEnabled) return;
+	mBegin = mRecorded;
+	next(BEGIN);
+}
+
+void TransformTrace::end()
+{
+	mTransformations++;
+	if (not mEnabled) return;
+	next(END);
+}
+
+TransformTrace::Event& TransformTrace::add(const std::string& key)
+{
+	if (not mEnabled) return mDiscarded;
+	mKeys[mRecorded%mEvents.size()] = key;
+	return next(PROPERTY);
+}
+
+void TransformTrace::clearStep()
+{
+	mStep = mRecorded;
+	mTransformations = 0;
+}
+
+unsigned long TransformTrace::oldest() const
+{
+	return (mRecorded > mEvents.size()) ? mRecorded - mEvents.size() : 0;
+}
+
+PropertyList::property_type TransformTrace::property(unsigned long n) const
+{
+	const unsigned int slot = n%mEvents.size();
+	const Event& e = mEvents[slot];
+
+	std::ostringstream key;
+	key << (e.key ? e.key : mKeys[slot].c_str());
+	if (e.index >= 0)
+		key << e.index;
+	if (e.hasPoint)
+		key << Vector3d(e.x[3],e.x[4],e.x[5]);
+
+	boost::any value;
+	switch (e.value)
+	{
+		case NONE: break;
+		case STRING: value = std::string(static_cast<const char*>(e.p[0])); break;
+		case CELL: value = static_cast<Cell*>(e.p[0]); break;
+		case VERTEX: value = static_cast<Vertex*>(e.p[0]); break;
+		case EDGE: value = static_cast<Edge*>(e.p[0]); break;
+		case FACE: value = static_cast<Face*>(e.p[0]); break;
+		case TETRA: value = static_cast<Tetra*>(e.p[0]); break;
+		case TRIANGLE:
+			value = boost::make_tuple(static_cast<Vertex*>(e.p[0]),static_cast<Vertex*>(e.p[1]),static_cast<Vertex*>(e.p[2]));
+			break;
+		case POINT: value = Vector3d(e.x[0],e.x[1],e.x[2]); break;
+		case SEGMENT:
+			value = boost::make_tuple(Vector3d(e.x[0],e.x[1],e.x[2]),Vector3d(e.x[3],e.x[4],e.x[5]));
+			break;
+	}
+	return PropertyList::property_type(key.str(),value);
+}
+
+PropertyList TransformTrace::properties() const
+{
+	PropertyList pl;
+	for(unsigned long n=std::max(mBegin,oldest());n<mRecorded;n++)
+	{
+		if (mEvents[n%mEvents.size()].type!=PROPERTY)
+			continue;
+		PropertyList::property_type p = property(n);
+		pl.add(p.first,p.second);
+	}
+	return pl;
+}
+
+std::list<PropertyList> TransformTrace::allProperties() const
+{
+	// (from the oldest event, as a transformation may have begun before the step)
+	std::list<PropertyList> all;
+	PropertyList pl;
+	for(unsigned long n=oldest();n<mRecorded;n++)
+	{
+		switch (mEvents[n%mEvents.size()].type)
+		{
+			case BEGIN: pl.clear(); break;
+			case END: if (n >= mStep) all.push_back(pl); break;
+			case PROPERTY:
+			{
+				PropertyList::property_type p = property(n);
+				pl.add(p.first,p.second);
+				break;
+			}
+		}
+	}
+	return all;
+}
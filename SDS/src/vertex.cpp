@@ -5,13 +5,14 @@
 #include <cmath>
 
 Vertex::Vertex()
-:mMass(0)
+:mX(Vector3d::ZERO)
+,mOldX(Vector3d::ZERO)
+,mF(Vector3d::ZERO)
+,mMass(0)
 ,mSurface(false)
 ,mIsFrozen(false)
 ,mTag(false)
-,mX(Vector3d::ZERO)
-,mOldX(Vector3d::ZERO)
-,mF(Vector3d::ZERO)
+,mSlot(0)
 ,mV(Vector3d::ZERO)
 {}
 
@@ -19,7 +20,7 @@ Vertex::Vertex(const Vector3d& v, double m)
 :mX(v),mOldX(v),mF(Vector3d::ZERO),mMass(m)
 ,mSurface(false)
 ,mIsFrozen(false)
-,mTag(false),mV(Vector3d::ZERO)
+,mTag(false),mSlot(0),mV(Vector3d::ZERO)
 {
 	computeR();
 }
@@ -28,7 +29,7 @@ Vertex::Vertex(double x, double y, double z, double m)
 :mX(x,y,z),mOldX(x,y,z),mF(Vector3d::ZERO),mMass(m)
 ,mSurface(false)
 ,mIsFrozen(false)
-,mTag(false),mV(Vector3d::ZERO)
+,mTag(false),mSlot(0),mV(Vector3d::ZERO)
 {
 	computeR();
 }
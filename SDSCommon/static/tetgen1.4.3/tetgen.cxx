@@ -31119,7 +31119,7 @@ void tetgenmesh::outelements(tetgenio* out)
     }
     if (b->neighout) {
       // Remember the index of this element.
-      * (int *) (tptr + elemmarkerindex) = elementnumber;
+      ((int *) (tptr))[elemmarkerindex] = elementnumber;
     }
     // Count the number of Voronoi faces. Look at the six edges of each
     //   tetrahedron. Count the edge only if the tetrahedron's pointer is
@@ -31153,7 +31153,7 @@ void tetgenmesh::outelements(tetgenio* out)
   }
   if (b->neighout) {
     // Set the outside element marker.
-    * (int *) (dummytet + elemmarkerindex) = -1;
+    ((int *) (dummytet))[elemmarkerindex] = -1;
   }
 
   if (out == (tetgenio *) NULL) {
@@ -31284,9 +31284,9 @@ void tetgenmesh::outfaces(tetgenio* out)
         }
         if (b->neighout > 1) {
           // '-nn' switch. Output adjacent tets indices.
-          neigh1 = * (int *)(tface.tet + elemmarkerindex);
+          neigh1 = ((int *) (tface.tet))[elemmarkerindex];
           if (tsymface.tet != dummytet) {
-            neigh2 = * (int *)(tsymface.tet + elemmarkerindex);
+            neigh2 = ((int *) (tsymface.tet))[elemmarkerindex];
           } else {
             neigh2 = -1;  
           }
@@ -31553,13 +31553,13 @@ void tetgenmesh::outsubfaces(tetgenio* out)
       neigh1 = -1;
       stpivot(faceloop, abuttingtet);
       if (abuttingtet.tet != dummytet) {
-        neigh1 = * (int *)(abuttingtet.tet + elemmarkerindex);
+        neigh1 = ((int *) (abuttingtet.tet))[elemmarkerindex];
       }
       neigh2 = -1;
       sesymself(faceloop);
       stpivot(faceloop, abuttingtet);
       if (abuttingtet.tet != dummytet) {
-        neigh2 = * (int *)(abuttingtet.tet + elemmarkerindex);
+        neigh2 = ((int *) (abuttingtet.tet))[elemmarkerindex];
       }
     }
     if (out == (tetgenio *) NULL) {
@@ -31879,16 +31879,16 @@ void tetgenmesh::outneighbors(tetgenio* out)
   while (tetloop.tet != (tetrahedron *) NULL) {
     tetloop.loc = 2;
     sym(tetloop, tetsym);
-    neighbor1 = * (int *) (tetsym.tet + elemmarkerindex);
+    neighbor1 = ((int *) (tetsym.tet))[elemmarkerindex];
     tetloop.loc = 3;
     sym(tetloop, tetsym);
-    neighbor2 = * (int *) (tetsym.tet + elemmarkerindex);
+    neighbor2 = ((int *) (tetsym.tet))[elemmarkerindex];
     tetloop.loc = 1;
     sym(tetloop, tetsym);
-    neighbor3 = * (int *) (tetsym.tet + elemmarkerindex);
+    neighbor3 = ((int *) (tetsym.tet))[elemmarkerindex];
     tetloop.loc = 0;
     sym(tetloop, tetsym);
-    neighbor4 = * (int *) (tetsym.tet + elemmarkerindex);
+    neighbor4 = ((int *) (tetsym.tet))[elemmarkerindex];
     if (out == (tetgenio *) NULL) {
       // Tetrahedra number, neighboring tetrahedron numbers.
       fprintf(outfile, "%4d    %4d  %4d  %4d  %4d\n", elementnumber,
@@ -32010,12 +32010,12 @@ void tetgenmesh::outvoronoi(tetgenio* out)
       out->vpointlist[index++] = ccent[2];
     }
     // Remember the index of this element.
-    * (int *) (tetloop.tet + elemmarkerindex) = vpointcount;
+    ((int *) (tetloop.tet))[elemmarkerindex] = vpointcount;
     vpointcount++;
     tetloop.tet = tetrahedrontraverse();
   }
   // Set the outside element marker.
-  * (int *) (dummytet + elemmarkerindex) = -1;
+  ((int *) (dummytet))[elemmarkerindex] = -1;
 
   if (out == (tetgenio *) NULL) {
     fprintf(outfile, "# Generated by %s\n", b->commandline);
@@ -32064,7 +32064,7 @@ void tetgenmesh::outvoronoi(tetgenio* out)
     // Count the number of Voronoi edges. Look at the four faces of each
     //   tetrahedron. Count the face if the tetrahedron's pointer is
     //   smaller than its neighbor's or the neighbor is outside.
-    end1 = * (int *) (tetloop.tet + elemmarkerindex);
+    end1 = ((int *) (tetloop.tet))[elemmarkerindex];
     for (i = 0; i < 4; i++) {
       decode(tetloop.tet[i], worktet);
       if ((worktet.tet == dummytet) || (tetloop.tet < worktet.tet)) {
@@ -32074,7 +32074,7 @@ void tetgenmesh::outvoronoi(tetgenio* out)
           vedge = &(out->vedgelist[index++]);
           vedge->v1 = end1 + shift;
         }
-        end2 = * (int *) (worktet.tet + elemmarkerindex);
+        end2 = ((int *) (worktet.tet))[elemmarkerindex];
         // Note that end2 may be -1 (worktet.tet is outside).
         if (end2 == -1) {
           // Calculate the out normal of this hull face.
@@ -32212,7 +32212,7 @@ void tetgenmesh::outvoronoi(tetgenio* out)
         // If hitbdry > 0, then spintet is a hull face.
         if (hitbdry > 0) {
           // The edge list starts with a ray.
-          vpointcount = * (int *) (spintet.tet + elemmarkerindex);
+          vpointcount = ((int *) (spintet.tet))[elemmarkerindex];
           vedgecount = tetfaceindexarray[vpointcount * 4 + spintet.loc];
           if (out == (tetgenio *) NULL) {
             fprintf(outfile, " %d", vedgecount + shift);
@@ -32227,7 +32227,7 @@ void tetgenmesh::outvoronoi(tetgenio* out)
         }
         // Output internal Voronoi edges.
         for (j = 0; j < tcount; j++) {
-          vpointcount = * (int *) (spintet.tet + elemmarkerindex);
+          vpointcount = ((int *) (spintet.tet))[elemmarkerindex];
           vedgecount = tetfaceindexarray[vpointcount * 4 + spintet.loc];
           if (out == (tetgenio *) NULL) {
             fprintf(outfile, " %d", vedgecount + shift);
@@ -32325,7 +32325,7 @@ void tetgenmesh::outvoronoi(tetgenio* out)
         }
         assert(j < tetlist->len());
         // k is the right edge number.        
-        end1 = * (int *) (tetloop.tet + elemmarkerindex);
+        end1 = ((int *) (tetloop.tet))[elemmarkerindex];
         vfacecount = tetedgeindexarray[end1 * 6 + k];
         if (out == (tetgenio *) NULL) {
           fprintf(outfile, " %d", vfacecount + shift);
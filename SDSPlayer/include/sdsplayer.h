@@ -5,11 +5,16 @@
 #include "ui_sdsplayer.h"
 #include "timelinewidget.h"
 #include "recordedsimulation.h"
+#include "framecache.h"
 #include "viewer.h"
 #include "frame.h"
 
+#include <QMutex>
+
 #include <boost/any.hpp>
 
+class FramePrefetcher;
+
 class SDSPlayer : public QMainWindow
 {
     Q_OBJECT
@@ -36,7 +41,14 @@ public slots:
 
 	void generateTetTopograph();
 
+	// ask for the memory the decoded frames may take (see FrameCache)
+	void setCacheBudget();
+
 private:
+	// play back a simulation file (*.cfg) through a FrameCache, which a background thread fills
+	void openFrameCache(std::string header);
+	void closeSimulation();
+
 	// ui
     Ui::SDSPlayerClass ui;
     TimeLineWidget* mTimeLineWidget;
@@ -45,9 +57,14 @@ private:
 	QLabel* mLabelDate;
 	Viewer* mViewer;
 
-	// simulation
+	// simulation (either a deprecated recorded simulation, or a frame cache)
     IRecordedSimulation* mIRecordedSimulation;
-    IFrame* mCurrentFrame;
+    FrameCache* mFrameCache;
+    // locked around each call to the frame cache
+    QMutex mFrameCacheMutex;
+    FramePrefetcher* mFramePrefetcher;
+    unsigned long mCacheBudget;
+    Organism* mCurrentOrganism;
 
     // selection/etc...
     boost::any mSelectedItem;
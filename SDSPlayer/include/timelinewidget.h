@@ -31,6 +31,8 @@ public:
 
 	void test(std::vector<float>& frametimes);
 	void init(IRecordedSimulation *irs = NULL);
+	/// disabled if there are no frames
+	void init(const std::vector<double>& frameTimes);
 
 	int frame();
 
@@ -90,6 +92,8 @@ public:
 	/// (re-)initialise the timeline view with new simulation data
 	/// if irs==NULL then disable the widget
 	void init(IRecordedSimulation* irs=NULL);
+	/// (re-)initialise the timeline view with the times of the frames (e.g., from a FrameCache)
+	void init(const std::vector<double>& frameTimes);
 	void test();
 
 public slots:
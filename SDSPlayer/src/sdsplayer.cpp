@@ -12,11 +12,48 @@
 
 #include <QFileDialog>
 #include <QProgressDialog>
+#include <QInputDialog>
 #include <QThread>
+#include <QWaitCondition>
 #include <QMessageBox>
 
+/*
+ * Decodes the frames ahead of the current one (see FrameCache::prefetch) until there are none
+ * left to decode, then waits to be woken (when another frame is selected).
+ */
+class FramePrefetcher: public QThread
+{
+public:
+	FramePrefetcher(FrameCache* c, QMutex* m):cache(c),mutex(m),stopped(false){}
+	void run()
+	{
+		mutex->lock();
+		while (not stopped)
+		{
+			if (not cache->prefetch())
+				wake.wait(mutex);
+			else
+			{
+				// (a frame at a time, so that the player doesn't wait long for the cache)
+				mutex->unlock();
+				yieldCurrentThread();
+				mutex->lock();
+			}
+		}
+		mutex->unlock();
+	}
+	// the mutex must be locked
+	void stop(){stopped = true; wake.wakeOne();}
+
+	FrameCache* cache;
+	QMutex* mutex;
+	QWaitCondition wake;
+	bool stopped;
+};
+
 SDSPlayer::SDSPlayer(QWidget *parent)
-    : QMainWindow(parent),mIRecordedSimulation(NULL),mSelectedItem(),mCurrentFrame(NULL)
+    : QMainWindow(parent),mIRecordedSimulation(NULL),mFrameCache(NULL),mFramePrefetcher(NULL)
+    ,mCacheBudget(FrameCache::DEFAULT_BUDGET),mCurrentOrganism(NULL),mSelectedItem()
 {
 	ui.setupUi(this);
 
@@ -24,6 +61,10 @@ SDSPlayer::SDSPlayer(QWidget *parent)
 	connect(findChild<QAction*>("action_Open"),SIGNAL(triggered()),this,SLOT(open()));
 	connect(findChild<QAction*>("actionQuit"),SIGNAL(triggered()),this,SLOT(close()));
 
+	QAction* actionCacheBudget = new QAction(tr("Frame &Cache..."),this);
+	ui.menuFile->insertAction(ui.actionQuit,actionCacheBudget);
+	connect(actionCacheBudget,SIGNAL(triggered()),this,SLOT(setCacheBudget()));
+
 	connect(findChild<QPushButton*>("pushButtonTetTopograph"), SIGNAL(clicked()),
 			this, SLOT(generateTetTopograph()));
 
@@ -46,7 +87,7 @@ SDSPlayer::SDSPlayer(QWidget *parent)
 
 SDSPlayer::~SDSPlayer()
 {
-
+	closeSimulation();
 }
 
 void SDSPlayer::stop()
@@ -62,7 +103,11 @@ void SDSPlayer::play()
 void SDSPlayer::reset()
 {
 	// reset the system to use the new irecordedsimulation
-	mTimeLineWidget->init(mIRecordedSimulation);
+	mCurrentOrganism = NULL;
+	if (mFrameCache!=NULL)
+		mTimeLineWidget->init(mFrameCache->frameTimes());
+	else
+		mTimeLineWidget->init(mIRecordedSimulation);
 
 	if (mIRecordedSimulation!=NULL)
 	{
@@ -73,6 +118,16 @@ void SDSPlayer::reset()
 		frameSelected(0);
 		mViewer->reset();
 	}
+	else if (mFrameCache!=NULL)
+	{
+		SimulationIO_Base::SimulationHeader hdr = mFrameCache->simulationHeader();
+		mLabelFilename->setText(QString("Filename: ") + QString::fromStdString(hdr.frameDataFileName));
+		mLabelVersion->setText(QString("Frames: ") + QString::number(mFrameCache->numberOfFrames()));
+		mLabelDate->setText(QString("Date: ") + QString::fromStdString(boost::posix_time::to_simple_string(hdr.time)));
+
+		frameSelected(0);
+		mViewer->reset();
+	}
 	else
 	{
 		mLabelFilename->setText("");
@@ -91,9 +146,23 @@ void SDSPlayer::frameSelected(int f)
 		{
 			IFrame* fr = mIRecordedSimulation->frames()[f];
 			if (fr->isValid())
+			{
 				mViewer->setOrganism(fr->organism());
-			mCurrentFrame = fr;
+				mCurrentOrganism = fr->organism();
+			}
+		}
+	}
+	else if (mFrameCache)
+	{
+		// (decoded now, unless it has been prefetched)
+		QMutexLocker lock(&mFrameCacheMutex);
+		Organism* o = mFrameCache->frame(f);
+		if (o)
+		{
+			mViewer->setOrganism(o);
+			mCurrentOrganism = o;
 		}
+		mFramePrefetcher->wake.wakeOne();
 	}
 }
 
@@ -129,10 +198,10 @@ void SDSPlayer::generateTetTopograph()
 	{
 		// then we're all good
 
-		if (mCurrentFrame->isValid())
+		if (mCurrentOrganism!=NULL)
 		{
 			Vertex* v = boost::any_cast<Vertex*>(mSelectedItem);
-			Organism* o = mCurrentFrame->organism();
+			Organism* o = mCurrentOrganism;
 			Cell* c = o->getAssociatedCell(v);
 
 			std::map<Tetra*, std::list<Tetra*> > adjList = SDSUtil::getTetTopoGraph(c,o);
@@ -195,12 +264,73 @@ public:
 	IRecordedSimulation* irs;
 };
 
+void SDSPlayer::setCacheBudget()
+{
+	bool ok = false;
+	int mb = QInputDialog::getInt(this,tr("Frame Cache"),tr("Memory for decoded frames (MB):"),
+			mCacheBudget/(1024*1024),16,1024*1024,16,&ok);
+	if (ok)
+	{
+		mCacheBudget = (unsigned long)mb*1024*1024;
+		if (mFrameCache)
+		{
+			QMutexLocker lock(&mFrameCacheMutex);
+			mFrameCache->setBudget(mCacheBudget);
+		}
+	}
+}
+
+void SDSPlayer::closeSimulation()
+{
+	if (mFramePrefetcher)
+	{
+		{
+			QMutexLocker lock(&mFrameCacheMutex);
+			mFramePrefetcher->stop();
+		}
+		mFramePrefetcher->wait();
+		delete mFramePrefetcher;
+		mFramePrefetcher = NULL;
+	}
+	mViewer->setOrganism(NULL);
+	mCurrentOrganism = NULL;
+
+	delete mFrameCache;
+	mFrameCache = NULL;
+	delete mIRecordedSimulation;
+	mIRecordedSimulation = NULL;
+}
+
+void SDSPlayer::openFrameCache(std::string header)
+{
+	try
+	{
+		FrameCache* cache = new FrameCache(header,mCacheBudget);
+
+		closeSimulation();
+		mFrameCache = cache;
+		mFramePrefetcher = new FramePrefetcher(mFrameCache,&mFrameCacheMutex);
+		mFramePrefetcher->start(QThread::LowPriority);
+
+		reset();
+	}
+	catch (SimulationLoader::LoadException& e)
+	{
+		std::cout << "sorry, I can't seem to load the file, error msg: " << e.why() << "\n";
+	}
+}
+
 void SDSPlayer::open()
 {
 	stop();
 	QString filename = QFileDialog::getOpenFileName(this,
-		     tr("Open Simulation File"), ".", tr("Simulation Files (*.bin)"));
-	if (filename.length()!=0)
+		     tr("Open Simulation File"), ".", tr("Simulation Files (*.cfg *.bin)"));
+	if (filename.endsWith(".cfg"))
+	{
+		std::cout << "opening file: \"" <<  filename.toStdString() << "\"" << std::endl;
+		openFrameCache(filename.toStdString());
+	}
+	else if (filename.length()!=0)
 	{
 		// first check file
 		// if it is okay then clear all current data
@@ -247,7 +377,7 @@ void SDSPlayer::open()
 
 			// at this point newSim has been successfully loaded
 			// so delete mIRecordedSimulation, and redirect the pointer to newSim
-			delete this->mIRecordedSimulation;
+			closeSimulation();
 			this->mIRecordedSimulation = newSim;
 
 			reset();
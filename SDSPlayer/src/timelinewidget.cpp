@@ -67,6 +67,18 @@ void TimeLineSlider::init(IRecordedSimulation *irs)
 	}
 }
 
+void TimeLineSlider::init(const std::vector<double>& frameTimes)
+{
+	mCurrentFrame = 0;
+	setDisabled(frameTimes.empty());
+	mFrameTimes.assign(frameTimes.begin(),frameTimes.end());
+
+	if (!mFrameTimes.empty())
+	{
+		mDuration = mFrameTimes[mFrameTimes.size()-1] - mFrameTimes[0];
+	}
+}
+
 int TimeLineSlider::frame()
 {
 	return mCurrentFrame;
@@ -260,6 +272,13 @@ void TimeLineWidget::init(IRecordedSimulation* irs)
 	mSlider->init(irs);
 }
 
+void TimeLineWidget::init(const std::vector<double>& frameTimes)
+{
+	setDisabled(frameTimes.empty());
+	mFrameTimes.assign(frameTimes.begin(),frameTimes.end());
+	mSlider->init(frameTimes);
+}
+
 void TimeLineWidget::test()
 {
 	const int NUMTIMES = 100;
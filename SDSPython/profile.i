@@ -0,0 +1,55 @@
+// Copyright 2010  Bart Veldstra
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+// 3. The name of the author may not be used to endorse or promote products 
+//    derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+// IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+// OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+// IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+// NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+// THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+%{
+#include "profile.h"
+#include <sstream>
+%}
+
+// (the substeps are read with step(i), t(i), time(i,phase) and count(i,counter))
+%ignore Profile::Timer;
+%ignore Profile::Record;
+%ignore Profile::record;
+%ignore Profile::addLastTo;
+
+%include "../SDS/include/profile.h"
+
+%extend Profile {
+    public:
+        /// the substeps recorded, as writeCSV writes them (with the header)
+        std::string csv() {
+            std::ostringstream oss;
+            $self->writeCSVHeader(oss);
+            $self->writeCSV(oss);
+            return oss.str();
+        }
+
+        /// the substeps recorded, as writeJSON writes them
+        std::string json() {
+            std::ostringstream oss;
+            $self->writeJSON(oss);
+            return oss.str();
+        }
+};
@@ -57,6 +57,7 @@
 %include mesh.i
 %include geometry.i
 %include physics.i
+%include profile.i
 %include sdssimulation.i
 %include sdsutil.i
 
@@ -34,6 +34,7 @@
 #include "sdssimulation.h"
 
 #include "simulationio.h"
+#include "framewriter.h"
 
 #include "random.h"
 
@@ -161,7 +162,7 @@ protected:
 	// Simulation Mode
 	SDSSimulation* mSimulation;
 	std::list<SegmentWriter*> mSegmentWriters;
-	std::ofstream mOutputFile;
+	FrameWriter* mFrameWriter; // (NULL unless recording)
 	int mNumOutputFrames;
 	bool mRunInDirtyMode;
 
@@ -53,6 +53,7 @@ Simulator::Simulator(QApplication* app, int argc, char** argv)
 	,mMostSteps(0)
 	,mPaused(false)
 	,mRecording(false)
+	,mFrameWriter(NULL)
 	,mNumOutputFrames(0)
 	,mInspector(NULL)
 	,mComments(NULL)
@@ -156,6 +157,7 @@ Simulator::Simulator(QApplication* app, int argc, char** argv)
 Simulator::~Simulator()
 {
 	mSimulation->cleanup();
+	delete mFrameWriter;
 
 	if (mTimer)
 	{
@@ -303,11 +305,8 @@ void Simulator::loadSceneFromSimulationFile(std::string header, int frameNumber)
 			frameNumber = loader.countFrames()-1;
 		}
 
-		// skip forward to the required frame
-		for(int i=0;i<frameNumber;i++)
-		{
-			if (!loader.nextFrame()) throw(std::runtime_error("Simulation file doesn't have that many frames."));
-		}
+		// jump to the required frame
+		if (!loader.setFrame(frameNumber)) throw(std::runtime_error("Simulation file doesn't have that many frames."));
 
 		SimulationIO_Base::FrameHeader frame = loader.currentFrame();
 
@@ -588,7 +587,7 @@ void Simulator::record()
 	header.comments = "Generated by SDSSimulator";
 
 	// build the segment writers
-	MeshSegmentIO* mio = new MeshSegmentIO(mSimulation->world()->organism()->mesh());
+	MeshSegmentIO* mio = new MeshSegmentIO(mSimulation->world()->organism()->mesh(),"topodelta");
 	OrganismSegmentIO* oio = new OrganismSegmentIO(mSimulation->world()->organism());
 	ProcessModelSegmentIO* pio = new ProcessModelSegmentIO(mSimulation->world()->organism());
 
@@ -603,15 +602,15 @@ void Simulator::record()
 	// write the simulation configuration file
 	SimulationWriter::writeSimulationHeader("simulation.cfg",header,mSegmentWriters);
 
-	// open the binary file
-	mOutputFile.open(header.frameDataFileName.c_str(),std::ios::binary);
-	if (!mOutputFile)
+	// open the binary file (and the frame index)
+	// (the frames are written before continuing, a queue doesn't pay yet, see framewriter_test)
+	delete mFrameWriter;
+	mFrameWriter = new FrameWriter(header.frameDataFileName,mSegmentWriters,std::list<SegmentWriter*>(),0);
+	if (not mFrameWriter->good())
 	{
 		std::cerr << "Cannot open " << header.frameDataFileName << " for output!\nContinuing without file output.\n";
-	}
-	else
-	{
-		SimulationWriter::writeFrameDataHeader(mOutputFile);
+		delete mFrameWriter;
+		mFrameWriter = NULL;
 	}
 
 	mRecording = true;
@@ -631,9 +630,10 @@ void Simulator::keepStepping()
 
 		BOOST_FOREACH(PropertyList::property_type p, mSimulation->lastStepProperties.all())
 			mInspector->addProperty(p);
-		BOOST_FOREACH(PropertyList::property_type p, Transform::properties.all())
+		BOOST_FOREACH(PropertyList::property_type p, Transform::properties().all())
 		mInspector->addProperty(p);
-		BOOST_FOREACH(PropertyList& pl, Transform::allProperties)
+		std::list<PropertyList> all = Transform::allProperties();
+		BOOST_FOREACH(PropertyList& pl, all)
 			BOOST_FOREACH(PropertyList::property_type p, pl.all())
 				mInspector->addProperty(p);
 	}
@@ -686,7 +686,8 @@ bool Simulator::step()
 
 		BOOST_FOREACH(PropertyList::property_type p, mSimulation->lastStepProperties.all())
 			mInspector->addProperty(p);
-		BOOST_FOREACH(PropertyList& pl, Transform::allProperties)
+		std::list<PropertyList> all = Transform::allProperties();
+		BOOST_FOREACH(PropertyList& pl, all)
 			BOOST_FOREACH(PropertyList::property_type p, pl.all())
 				mInspector->addProperty(p);
 	}
@@ -699,7 +700,9 @@ void Simulator::stop()
 	if (mTimer) mTimer->stop();
 
 	mRecording = false;
-	if (mOutputFile) mOutputFile.close();
+	// (the frames that are waiting are written first)
+	delete mFrameWriter;
+	mFrameWriter = NULL;
 }
 
 void Simulator::runForNSteps(int n)
@@ -793,25 +796,9 @@ void Simulator::load()
 
 void Simulator::outputCurrentFrame()
 {
-	if (mOutputFile)
-	{
-		// first compute frame size by writing the segment data to a temporary buffer
-		std::ostringstream oss(std::ios::binary);
-		BOOST_FOREACH(SegmentWriter* sw, mSegmentWriters)
-			SimulationWriter::writeSegment(oss, *sw);
-		std::string os = oss.str();
-
-		// then construct the appropriate header
-		SimulationIO_Base::FrameHeader fhdr;
-		fhdr.sizeInBytes = (unsigned int)(os.length());
-		fhdr.number = mNumOutputFrames++;
-		fhdr.time = mSimulation->t();
-		fhdr.step = mSimulation->steps();
-
-		// now write the frame header and frame data to out
-		SimulationWriter::writeFrameHeader(mOutputFile,fhdr);
-		mOutputFile << os;
-	}
+	// (the frame is written to disk while simulating the next ones)
+	if (mFrameWriter)
+		mFrameWriter->write(mNumOutputFrames++, mSimulation->t(), mSimulation->steps());
 }
 
 void Simulator::redraw()